@@ -0,0 +1,662 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "cpu_topology.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#if defined(__linux__) && __has_include(<liburing.h>)
+#include <liburing.h>
+#define HAS_IO_URING 1
+#else
+#define HAS_IO_URING 0
+#endif
+
+// Batched reader for the per-frame capture files. Every pair needs eight small files, and on network volumes the
+// open latency dominates, so all files of the next few pairs are requested at once and complete out of order.
+// On Linux the batch goes through a single io_uring submission when liburing is available, otherwise through a
+// pool of blocking reader threads.
+
+static constexpr size_t DirectIoAlignment = 4096;
+
+enum class FrameFileType : uint32_t {
+    ClipInfo,
+    MotionVector,
+    Depth,
+    ColorInput,
+    Count
+};
+
+static constexpr size_t FrameFileTypeCount = static_cast<size_t>(FrameFileType::Count);
+
+// Bit sets of frame file types, used to leave some inputs unread.
+static constexpr uint32_t AllFrameFileTypes = (1u << FrameFileTypeCount) - 1;
+
+inline constexpr uint32_t FrameFileTypeBit(FrameFileType type)
+{
+    return 1u << static_cast<uint32_t>(type);
+}
+
+// colorExtension selects the container of the colour input (".png", ".qoi" or ".rgba").
+inline std::string GetFrameFilePath(FrameFileType type, uint32_t frameId, const std::string& colorExtension = ".png")
+{
+    switch (type)
+    {
+    case FrameFileType::ClipInfo:
+        return "ClipInfo/clipinfo_" + std::to_string(frameId) + ".bin";
+    case FrameFileType::MotionVector:
+        return "MotionVector/motionvector_" + std::to_string(frameId) + ".bin";
+    case FrameFileType::Depth:
+        return "Depth/depth_" + std::to_string(frameId) + ".bin";
+    case FrameFileType::ColorInput:
+        return "ColorInput/colorinput_" + std::to_string(frameId) + colorExtension;
+    case FrameFileType::Count:
+    default:
+        return {};
+    }
+}
+
+// File content in a buffer aligned (and padded) for unbuffered reads. Copies share the storage.
+struct FileBuffer
+{
+    std::shared_ptr<uint8_t> storage;
+    size_t                   size = 0;
+
+    const uint8_t* data() const
+    {
+        return storage.get();
+    }
+
+    bool empty() const
+    {
+        return size == 0;
+    }
+};
+
+inline size_t AlignUp(size_t value, size_t alignment)
+{
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+// memoryNode >= 0 places the pages on that NUMA node instead of the node of the thread that first touches them.
+inline std::shared_ptr<uint8_t> AllocateAligned(size_t bytes, int32_t memoryNode = -1)
+{
+    if (memoryNode >= 0)
+    {
+        return AllocateOnNode(bytes, static_cast<uint32_t>(memoryNode));
+    }
+#ifdef _WIN32
+    uint8_t* p = static_cast<uint8_t*>(_aligned_malloc(bytes, DirectIoAlignment));
+    return std::shared_ptr<uint8_t>(p, [](uint8_t* q) { _aligned_free(q); });
+#else
+    void* p = nullptr;
+    if (posix_memalign(&p, DirectIoAlignment, bytes) != 0)
+    {
+        p = nullptr;
+    }
+    return std::shared_ptr<uint8_t>(static_cast<uint8_t*>(p), [](uint8_t* q) { free(q); });
+#endif
+}
+
+// Blocking whole-file read. With directIo the page cache is bypassed (O_DIRECT / FILE_FLAG_NO_BUFFERING), which needs
+// the aligned, block-padded buffer; file systems that refuse unbuffered opens silently fall back to buffered reads. The
+// buffer goes on memoryNode, see AllocateAligned.
+inline FileBuffer ReadFileBlocking(const std::string& path, bool directIo, int32_t memoryNode = -1)
+{
+    FileBuffer result;
+
+#ifdef _WIN32
+    DWORD  flags = FILE_FLAG_SEQUENTIAL_SCAN | (directIo ? FILE_FLAG_NO_BUFFERING : 0);
+    HANDLE file  = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, flags, nullptr);
+    if (file == INVALID_HANDLE_VALUE)
+    {
+        return result;
+    }
+
+    LARGE_INTEGER fileSize = {};
+    if (GetFileSizeEx(file, &fileSize))
+    {
+        size_t size     = static_cast<size_t>(fileSize.QuadPart);
+        size_t capacity = AlignUp((std::max)(size, size_t(1)), DirectIoAlignment);
+        auto   storage  = AllocateAligned(capacity, memoryNode);
+        size_t done     = 0;
+        while (storage && done < size)
+        {
+            DWORD chunk = static_cast<DWORD>((std::min)(capacity - done, size_t(1) << 30));
+            DWORD read  = 0;
+            if (!ReadFile(file, storage.get() + done, chunk, &read, nullptr) || read == 0)
+            {
+                break;
+            }
+            done += read;
+        }
+        if (storage && done >= size)
+        {
+            result.storage = storage;
+            result.size    = size;
+        }
+    }
+    CloseHandle(file);
+#else
+    int openFlags = O_RDONLY;
+#ifdef O_DIRECT
+    if (directIo)
+    {
+        openFlags |= O_DIRECT;
+    }
+#endif
+    int fd = open(path.c_str(), openFlags);
+    if (fd < 0 && openFlags != O_RDONLY)
+    {
+        fd = open(path.c_str(), O_RDONLY);
+    }
+    if (fd < 0)
+    {
+        return result;
+    }
+
+    struct stat st = {};
+    if (fstat(fd, &st) == 0)
+    {
+        size_t size     = static_cast<size_t>(st.st_size);
+        size_t capacity = AlignUp((std::max)(size, size_t(1)), DirectIoAlignment);
+        auto   storage  = AllocateAligned(capacity, memoryNode);
+        size_t done     = 0;
+        while (storage && done < size)
+        {
+            ssize_t read = pread(fd, storage.get() + done, capacity - done, static_cast<off_t>(done));
+            if (read <= 0)
+            {
+                break;
+            }
+            done += static_cast<size_t>(read);
+        }
+        if (storage && done >= size)
+        {
+            result.storage = storage;
+            result.size    = size;
+        }
+    }
+    close(fd);
+#endif
+
+    return result;
+}
+
+struct AsyncIoStats
+{
+    uint64_t submitted   = 0;
+    uint64_t completed   = 0;
+    uint64_t failed      = 0;
+    uint64_t bytes       = 0;
+    uint64_t batches     = 0;
+    uint32_t inFlight    = 0; // current queue depth
+    uint32_t maxInFlight = 0;
+    double   busySeconds = 0.0; // wall time during which at least one read was in flight
+
+    double MegabytesPerSecond() const
+    {
+        return busySeconds > 0.0 ? static_cast<double>(bytes) / (1024.0 * 1024.0) / busySeconds : 0.0;
+    }
+
+    double FilesPerSecond() const
+    {
+        return busySeconds > 0.0 ? static_cast<double>(completed) / busySeconds : 0.0;
+    }
+};
+
+class AsyncFileReader
+{
+public:
+    using Callback = std::function<void(FileBuffer)>;
+
+    struct Request
+    {
+        std::string path;
+        Callback    onComplete;
+        int32_t     memoryNode = -1; // NUMA node for the buffer, -1 for wherever the I/O thread touches it
+    };
+
+    AsyncFileReader(bool directIo, uint32_t threadCount)
+        : m_directIo(directIo)
+    {
+#if HAS_IO_URING
+        if (io_uring_queue_init(UringEntries, &m_ring, 0) == 0)
+        {
+            m_useUring = true;
+            m_workers.emplace_back([this]() { UringLoop(); });
+            return;
+        }
+#endif
+        threadCount = (std::max)(threadCount, 1u);
+        for (uint32_t i = 0; i < threadCount; i++)
+        {
+            m_workers.emplace_back([this]() { PoolLoop(); });
+        }
+    }
+
+    ~AsyncFileReader()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stop = true;
+        }
+        m_wake.notify_all();
+        for (auto& worker : m_workers)
+        {
+            worker.join();
+        }
+#if HAS_IO_URING
+        if (m_useUring)
+        {
+            io_uring_queue_exit(&m_ring);
+        }
+#endif
+    }
+
+    AsyncFileReader(const AsyncFileReader&)            = delete;
+    AsyncFileReader& operator=(const AsyncFileReader&) = delete;
+
+    const char* BackendName() const
+    {
+        return m_useUring ? "io_uring" : "thread pool";
+    }
+
+    // Queues all requests as one batch. Callbacks run on an I/O thread, in completion order. The wake-up happens under
+    // the lock: a callback may let its submitter finish and destroy the reader before an unlocked notify would run.
+    void SubmitBatch(std::vector<Request> requests)
+    {
+        if (requests.empty())
+        {
+            return;
+        }
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_stats.inFlight == 0)
+        {
+            m_busySince = std::chrono::steady_clock::now();
+        }
+        m_stats.batches++;
+        m_stats.submitted += requests.size();
+        m_stats.inFlight += static_cast<uint32_t>(requests.size());
+        m_stats.maxInFlight = (std::max)(m_stats.maxInFlight, m_stats.inFlight);
+        for (auto& request : requests)
+        {
+            m_pending.push_back(std::move(request));
+        }
+        m_wake.notify_all();
+    }
+
+    AsyncIoStats GetStats() const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        AsyncIoStats                stats = m_stats;
+        if (stats.inFlight != 0)
+        {
+            stats.busySeconds +=
+                std::chrono::duration<double>(std::chrono::steady_clock::now() - m_busySince).count();
+        }
+        return stats;
+    }
+
+private:
+    void Complete(Request& request, FileBuffer buffer)
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stats.completed++;
+            m_stats.bytes += buffer.size;
+            if (buffer.storage == nullptr)
+            {
+                m_stats.failed++;
+            }
+            m_stats.inFlight--;
+            if (m_stats.inFlight == 0)
+            {
+                m_stats.busySeconds +=
+                    std::chrono::duration<double>(std::chrono::steady_clock::now() - m_busySince).count();
+            }
+        }
+        request.onComplete(std::move(buffer));
+    }
+
+    void PoolLoop()
+    {
+        for (;;)
+        {
+            Request request;
+            {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                m_wake.wait(lock, [this]() { return m_stop || !m_pending.empty(); });
+                if (m_pending.empty())
+                {
+                    return;
+                }
+                request = std::move(m_pending.front());
+                m_pending.pop_front();
+            }
+            Complete(request, ReadFileBlocking(request.path, m_directIo, request.memoryNode));
+        }
+    }
+
+#if HAS_IO_URING
+    static constexpr unsigned UringEntries = 256;
+
+    // Each batch is processed in three submissions: openat + statx for every file, then one read per file (re-issued
+    // on short reads), then the closes. A batch larger than the ring is split into ring-sized slices.
+    void UringLoop()
+    {
+        for (;;)
+        {
+            std::vector<Request> batch;
+            {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                m_wake.wait(lock, [this]() { return m_stop || !m_pending.empty(); });
+                if (m_pending.empty())
+                {
+                    return;
+                }
+                size_t count = (std::min)(m_pending.size(), size_t(UringEntries / 2));
+                for (size_t i = 0; i < count; i++)
+                {
+                    batch.push_back(std::move(m_pending.front()));
+                    m_pending.pop_front();
+                }
+            }
+            UringProcess(batch);
+        }
+    }
+
+    // Submits the queued operations and reaps count completions. The operations write into the batch's slots, so none
+    // may still be in flight on return: a wait interrupted by a signal, or refused while the completion queue is full,
+    // is simply retried, and an error that leaves the ring unusable aborts rather than free memory the kernel writes.
+    void UringWait(size_t count, const std::function<void(uint64_t, int)>& onCqe)
+    {
+        size_t reaped = 0;
+        while (reaped < count)
+        {
+            int result = io_uring_submit_and_wait(&m_ring, 1);
+            if (result < 0 && result != -EINTR && result != -EAGAIN && result != -EBUSY)
+            {
+                abort();
+            }
+
+            io_uring_cqe* cqe = nullptr;
+            while (reaped < count && io_uring_peek_cqe(&m_ring, &cqe) == 0)
+            {
+                onCqe(io_uring_cqe_get_data64(cqe), cqe->res);
+                io_uring_cqe_seen(&m_ring, cqe);
+                reaped++;
+            }
+        }
+    }
+
+    void UringProcess(std::vector<Request>& batch)
+    {
+        struct Slot
+        {
+            int                      fd = -1;
+            struct statx             st = {};
+            bool                     statOk = false;
+            std::shared_ptr<uint8_t> storage;
+            size_t                   size     = 0;
+            size_t                   capacity = 0;
+            size_t                   done     = 0;
+            bool                     failed   = false;
+        };
+        std::vector<Slot> slots(batch.size());
+
+        int openFlags = O_RDONLY | (m_directIo ? O_DIRECT : 0);
+        for (size_t i = 0; i < batch.size(); i++)
+        {
+            io_uring_sqe* sqe = io_uring_get_sqe(&m_ring);
+            io_uring_prep_openat(sqe, AT_FDCWD, batch[i].path.c_str(), openFlags, 0);
+            io_uring_sqe_set_data64(sqe, i * 2);
+
+            sqe = io_uring_get_sqe(&m_ring);
+            io_uring_prep_statx(sqe, AT_FDCWD, batch[i].path.c_str(), 0, STATX_SIZE, &slots[i].st);
+            io_uring_sqe_set_data64(sqe, i * 2 + 1);
+        }
+        UringWait(batch.size() * 2, [&](uint64_t data, int res) {
+            Slot& slot = slots[data / 2];
+            if (data % 2 == 0)
+            {
+                slot.fd = res;
+            }
+            else
+            {
+                slot.statOk = (res == 0);
+            }
+        });
+
+        std::vector<size_t> reading;
+        for (size_t i = 0; i < slots.size(); i++)
+        {
+            Slot& slot = slots[i];
+            if (slot.fd == -EINVAL && m_directIo)
+            {
+                // No O_DIRECT support on this file system.
+                slot.fd = open(batch[i].path.c_str(), O_RDONLY);
+            }
+            if (slot.fd < 0 || !slot.statOk)
+            {
+                slot.failed = true;
+                continue;
+            }
+            slot.size     = static_cast<size_t>(slot.st.stx_size);
+            slot.capacity = AlignUp((std::max)(slot.size, size_t(1)), DirectIoAlignment);
+            slot.storage  = AllocateAligned(slot.capacity, batch[i].memoryNode);
+            slot.failed   = (slot.storage == nullptr);
+            if (!slot.failed && slot.size != 0)
+            {
+                reading.push_back(i);
+            }
+        }
+
+        while (!reading.empty())
+        {
+            for (size_t i : reading)
+            {
+                Slot&         slot = slots[i];
+                io_uring_sqe* sqe  = io_uring_get_sqe(&m_ring);
+                io_uring_prep_read(sqe,
+                                   slot.fd,
+                                   slot.storage.get() + slot.done,
+                                   static_cast<unsigned>(slot.capacity - slot.done),
+                                   slot.done);
+                io_uring_sqe_set_data64(sqe, i);
+            }
+            UringWait(reading.size(), [&](uint64_t data, int res) {
+                Slot& slot = slots[data];
+                if (res <= 0)
+                {
+                    slot.failed = true;
+                }
+                else
+                {
+                    slot.done += static_cast<size_t>(res);
+                }
+            });
+
+            std::vector<size_t> unfinished;
+            for (size_t i : reading)
+            {
+                if (!slots[i].failed && slots[i].done < slots[i].size)
+                {
+                    unfinished.push_back(i);
+                }
+            }
+            reading.swap(unfinished);
+        }
+
+        size_t closes = 0;
+        for (auto& slot : slots)
+        {
+            if (slot.fd >= 0)
+            {
+                io_uring_sqe* sqe = io_uring_get_sqe(&m_ring);
+                io_uring_prep_close(sqe, slot.fd);
+                io_uring_sqe_set_data64(sqe, 0);
+                closes++;
+            }
+        }
+        UringWait(closes, [](uint64_t, int) {});
+
+        for (size_t i = 0; i < batch.size(); i++)
+        {
+            FileBuffer buffer;
+            if (!slots[i].failed)
+            {
+                buffer.storage = slots[i].storage;
+                buffer.size    = slots[i].size;
+            }
+            Complete(batch[i], std::move(buffer));
+        }
+    }
+
+    io_uring m_ring = {};
+#endif
+
+    bool                     m_directIo = false;
+    bool                     m_useUring = false;
+    bool                     m_stop     = false;
+    std::vector<std::thread> m_workers;
+    std::deque<Request>      m_pending;
+    mutable std::mutex       m_mutex;
+    std::condition_variable  m_wake;
+
+    AsyncIoStats                          m_stats;
+    std::chrono::steady_clock::time_point m_busySince;
+};
+
+using FrameFiles = std::array<FileBuffer, FrameFileTypeCount>;
+
+// Keeps the files of a window of frames in flight or resident. Pair (i, i + 1) acquires frames i and i + 1; frames are
+// dropped once no later pair needs them.
+class FramePrefetcher
+{
+public:
+    // Only the file types in typeMask are read; the others always come back empty. The input folders are looked up
+    // in directory, or in the working directory when it is empty. memoryNode >= 0 puts the buffers on that NUMA node.
+    FramePrefetcher(AsyncFileReader& reader,
+                    std::string      colorExtension,
+                    uint32_t         typeMask   = AllFrameFileTypes,
+                    std::string      directory  = {},
+                    int32_t          memoryNode = -1)
+        : m_reader(reader),
+          m_colorExtension(std::move(colorExtension)),
+          m_typeMask(typeMask),
+          m_directory(std::move(directory)),
+          m_memoryNode(memoryNode)
+    {
+    }
+
+    // The reader outlives the prefetcher and still calls back for reads in flight, including those of released frames,
+    // so wait for them.
+    ~FramePrefetcher()
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_ready.wait(lock, [this]() { return m_inFlight == 0; });
+    }
+
+    FramePrefetcher(const FramePrefetcher&)            = delete;
+    FramePrefetcher& operator=(const FramePrefetcher&) = delete;
+
+    // Requests every frame in [first, last] that is not already resident or in flight, as a single batch.
+    void Prefetch(uint32_t first, uint32_t last)
+    {
+        std::vector<AsyncFileReader::Request> requests;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            for (uint32_t frameId = first; frameId <= last; frameId++)
+            {
+                if (m_frames.count(frameId) != 0)
+                {
+                    continue;
+                }
+                auto entry = std::make_shared<Entry>();
+                m_frames.insert({frameId, entry});
+
+                for (uint32_t type = 0; type < FrameFileTypeCount; type++)
+                {
+                    if ((m_typeMask & FrameFileTypeBit(static_cast<FrameFileType>(type))) == 0)
+                    {
+                        continue;
+                    }
+                    entry->pending++;
+                    m_inFlight++;
+                    std::string path = GetFrameFilePath(static_cast<FrameFileType>(type), frameId, m_colorExtension);
+                    if (!m_directory.empty())
+                    {
+                        path = m_directory + "/" + path;
+                    }
+                    auto onComplete = [this, entry, type](FileBuffer buffer) {
+                        std::lock_guard<std::mutex> lock(m_mutex);
+                        entry->files[type] = std::move(buffer);
+                        entry->pending--;
+                        m_inFlight--;
+                        m_ready.notify_all();
+                    };
+                    requests.push_back({path, onComplete, m_memoryNode});
+                }
+            }
+        }
+        m_reader.SubmitBatch(std::move(requests));
+    }
+
+    // Blocks until every file of the frame has completed. Missing files come back empty.
+    FrameFiles Acquire(uint32_t frameId)
+    {
+        Prefetch(frameId, frameId);
+
+        std::unique_lock<std::mutex> lock(m_mutex);
+        auto                         entry = m_frames[frameId];
+        m_ready.wait(lock, [&entry]() { return entry->pending == 0; });
+        return entry->files;
+    }
+
+    // Drops frames below frameId. Reads still in flight keep their entry alive until they complete.
+    void Release(uint32_t frameId)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_frames.erase(m_frames.begin(), m_frames.lower_bound(frameId));
+    }
+
+private:
+    struct Entry
+    {
+        FrameFiles files;
+        uint32_t   pending = 0;
+    };
+
+    AsyncFileReader&                           m_reader;
+    std::string                                m_colorExtension;
+    uint32_t                                   m_typeMask;
+    std::string                                m_directory;
+    int32_t                                    m_memoryNode;
+    std::map<uint32_t, std::shared_ptr<Entry>> m_frames;
+    uint32_t                                   m_inFlight = 0; // reads submitted and not yet called back
+    std::mutex                                 m_mutex;
+    std::condition_variable                    m_ready;
+};
@@ -0,0 +1,396 @@
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+
+#include <algorithm>
+#include <vector>
+
+#include <dxgiformat.h>
+
+#include "image_decode.h"
+#include "thread_pool.h"
+#include "tile_codec.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define CAMERA_MOTION_SSE2 1
+#else
+#define CAMERA_MOTION_SSE2 0
+#endif
+
+#if CAMERA_MOTION_SSE2 && (defined(__F16C__) || defined(__AVX2__))
+#include <immintrin.h>
+#define CAMERA_MOTION_F16C 1
+#else
+#define CAMERA_MOTION_F16C 0
+#endif
+
+// Motion that the camera alone explains. Each pixel's device depth is unprojected and moved through
+// ClipInfo::clipToPrevClip; the motion is the previous frame's UV minus the current UV, the convention of the
+// MotionVector inputs. Matrices multiply row vectors (clip * M), the layout the capture plugin exports.
+// Pixels that land behind the previous camera get zero motion.
+//
+// The SSE2 and scalar paths perform the same IEEE operations in the same order and halves are rounded to nearest
+// even, so every build produces bit-identical motion; stored motion residuals rely on that.
+
+inline bool IsCameraMotionDepthFormat(uint32_t format)
+{
+    switch (static_cast<DXGI_FORMAT>(format))
+    {
+    case DXGI_FORMAT_R24_UNORM_X8_TYPELESS:
+    case DXGI_FORMAT_R24G8_TYPELESS:
+    case DXGI_FORMAT_D24_UNORM_S8_UINT:
+    case DXGI_FORMAT_R32_FLOAT:
+    case DXGI_FORMAT_D32_FLOAT:
+    case DXGI_FORMAT_R32_TYPELESS:
+    case DXGI_FORMAT_R16_UNORM:
+    case DXGI_FORMAT_D16_UNORM:
+    case DXGI_FORMAT_R16_TYPELESS:
+        return true;
+    default:
+        return false;
+    }
+}
+
+inline bool IsCameraMotionFormat(uint32_t format)
+{
+    return format == DXGI_FORMAT_R16G16_FLOAT || format == DXGI_FORMAT_R32G32_FLOAT;
+}
+
+inline uint32_t GetCameraMotionBytesPerPixel(uint32_t format)
+{
+    return format == DXGI_FORMAT_R32G32_FLOAT ? 8 : 4;
+}
+
+inline uint32_t GetDepthBytesPerPixel(uint32_t format)
+{
+    switch (static_cast<DXGI_FORMAT>(format))
+    {
+    case DXGI_FORMAT_R16_UNORM:
+    case DXGI_FORMAT_D16_UNORM:
+    case DXGI_FORMAT_R16_TYPELESS:
+        return 2;
+    default:
+        return 4;
+    }
+}
+
+// Converts one row of depth texels to floats in [0, 1].
+inline void LoadDepthRow(const uint8_t* pRow, uint32_t width, uint32_t format, float* pDepth)
+{
+    switch (static_cast<DXGI_FORMAT>(format))
+    {
+    case DXGI_FORMAT_R32_FLOAT:
+    case DXGI_FORMAT_D32_FLOAT:
+    case DXGI_FORMAT_R32_TYPELESS:
+        memcpy(pDepth, pRow, static_cast<size_t>(width) * sizeof(float));
+        break;
+    case DXGI_FORMAT_R16_UNORM:
+    case DXGI_FORMAT_D16_UNORM:
+    case DXGI_FORMAT_R16_TYPELESS:
+        for (uint32_t x = 0; x < width; x++)
+        {
+            uint16_t value;
+            memcpy(&value, pRow + x * 2, sizeof(value));
+            pDepth[x] = static_cast<float>(value) * (1.0f / 65535.0f);
+        }
+        break;
+    default:
+    {
+        uint32_t x = 0;
+#if CAMERA_MOTION_SSE2
+        const __m128i depthMask = _mm_set1_epi32(0xFFFFFF);
+        const __m128  scale     = _mm_set1_ps(1.0f / 16777215.0f);
+        for (; x + 4 <= width; x += 4)
+        {
+            __m128i texels = _mm_and_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(pRow + x * 4)), depthMask);
+            _mm_storeu_ps(pDepth + x, _mm_mul_ps(_mm_cvtepi32_ps(texels), scale));
+        }
+#endif
+        for (; x < width; x++)
+        {
+            uint32_t value;
+            memcpy(&value, pRow + x * 4, sizeof(value));
+            pDepth[x] = static_cast<float>(static_cast<int32_t>(value & 0xFFFFFF)) * (1.0f / 16777215.0f);
+        }
+        break;
+    }
+    }
+}
+
+// Camera motion of the count pixels of row y that start at x0, as interleaved (x, y) UV offsets. pDepth and pMotion
+// point at the first of them; width and height are those of the frame.
+inline void ComputeCameraMotionRow(const float* pDepth,
+                                   uint32_t     x0,
+                                   uint32_t     y,
+                                   uint32_t     count,
+                                   uint32_t     width,
+                                   uint32_t     height,
+                                   const float  clipToPrevClip[16],
+                                   float*       pMotion)
+{
+    const float* m    = clipToPrevClip;
+    const float  invW = 1.0f / static_cast<float>(width);
+    const float  v    = (static_cast<float>(y) + 0.5f) * (1.0f / static_cast<float>(height));
+    const float  ndcY = 1.0f - v * 2.0f;
+
+    // Terms that are constant along the row.
+    const float rowX = ndcY * m[4] + m[12];
+    const float rowY = ndcY * m[5] + m[13];
+    const float rowW = ndcY * m[7] + m[15];
+
+    uint32_t x = 0;
+#if CAMERA_MOTION_SSE2
+    const __m128 half = _mm_set1_ps(0.5f);
+    const __m128 one  = _mm_set1_ps(1.0f);
+    const __m128 two  = _mm_set1_ps(2.0f);
+    const __m128 zero = _mm_setzero_ps();
+
+    // Centre of pixel x0, so the lanes only convert their offset from it.
+    const __m128 center = _mm_set1_ps(static_cast<float>(x0) + 0.5f);
+    for (; x + 4 <= count; x += 4)
+    {
+        __m128 u    = _mm_mul_ps(_mm_add_ps(_mm_cvtepi32_ps(_mm_setr_epi32(x, x + 1, x + 2, x + 3)), center),
+                              _mm_set1_ps(invW));
+        __m128 ndcX = _mm_sub_ps(_mm_mul_ps(u, two), one);
+        __m128 d    = _mm_loadu_ps(pDepth + x);
+
+        __m128 px = _mm_add_ps(_mm_add_ps(_mm_mul_ps(ndcX, _mm_set1_ps(m[0])), _mm_set1_ps(rowX)),
+                               _mm_mul_ps(d, _mm_set1_ps(m[8])));
+        __m128 py = _mm_add_ps(_mm_add_ps(_mm_mul_ps(ndcX, _mm_set1_ps(m[1])), _mm_set1_ps(rowY)),
+                               _mm_mul_ps(d, _mm_set1_ps(m[9])));
+        __m128 pw = _mm_add_ps(_mm_add_ps(_mm_mul_ps(ndcX, _mm_set1_ps(m[3])), _mm_set1_ps(rowW)),
+                               _mm_mul_ps(d, _mm_set1_ps(m[11])));
+
+        __m128 prevU = _mm_add_ps(_mm_mul_ps(_mm_div_ps(px, pw), half), half);
+        __m128 prevV = _mm_sub_ps(half, _mm_mul_ps(_mm_div_ps(py, pw), half));
+        __m128 mx    = _mm_sub_ps(prevU, u);
+        __m128 my    = _mm_sub_ps(prevV, _mm_set1_ps(v));
+
+        __m128 valid = _mm_and_ps(_mm_cmpgt_ps(pw, zero), _mm_and_ps(_mm_cmpord_ps(mx, mx), _mm_cmpord_ps(my, my)));
+        mx           = _mm_and_ps(mx, valid);
+        my           = _mm_and_ps(my, valid);
+
+        _mm_storeu_ps(pMotion + x * 2, _mm_unpacklo_ps(mx, my));
+        _mm_storeu_ps(pMotion + x * 2 + 4, _mm_unpackhi_ps(mx, my));
+    }
+#endif
+    for (; x < count; x++)
+    {
+        float u    = (static_cast<float>(static_cast<int32_t>(x0 + x)) + 0.5f) * invW;
+        float ndcX = u * 2.0f - 1.0f;
+        float d    = pDepth[x];
+
+        float px = (ndcX * m[0] + rowX) + d * m[8];
+        float py = (ndcX * m[1] + rowY) + d * m[9];
+        float pw = (ndcX * m[3] + rowW) + d * m[11];
+
+        float mx = (px / pw * 0.5f + 0.5f) - u;
+        float my = (0.5f - py / pw * 0.5f) - v;
+
+        bool valid         = pw > 0.0f && mx == mx && my == my;
+        pMotion[x * 2]     = valid ? mx : 0.0f;
+        pMotion[x * 2 + 1] = valid ? my : 0.0f;
+    }
+}
+
+// Float to half with round to nearest even, matching the F16C conversion.
+inline uint16_t FloatToHalf(float value)
+{
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    uint32_t sign = bits & 0x80000000u;
+    bits ^= sign;
+
+    uint32_t result;
+    if (bits >= 0x47800000u)
+    {
+        result = bits > 0x7F800000u ? 0x7E00u : 0x7C00u; // NaN or overflow to infinity
+    }
+    else if (bits < 0x38800000u)
+    {
+        // Denormal or zero: let the FPU round by adding a magic number that aligns the mantissa.
+        const uint32_t magicBits = 126u << 23;
+        float          magic;
+        float          f;
+        memcpy(&magic, &magicBits, sizeof(magic));
+        memcpy(&f, &bits, sizeof(f));
+        f += magic;
+        memcpy(&result, &f, sizeof(result));
+        result -= magicBits;
+    }
+    else
+    {
+        uint32_t mantissaOdd = (bits >> 13) & 1;
+        bits += (static_cast<uint32_t>(15 - 127) << 23) + 0xFFF;
+        bits += mantissaOdd;
+        result = bits >> 13;
+    }
+    return static_cast<uint16_t>(result | (sign >> 16));
+}
+
+// Writes interleaved (x, y) floats as R16G16_FLOAT or R32G32_FLOAT texels.
+inline void StoreMotionRow(const float* pMotion, uint32_t width, uint32_t format, uint8_t* pRow)
+{
+    if (format == DXGI_FORMAT_R32G32_FLOAT)
+    {
+        memcpy(pRow, pMotion, static_cast<size_t>(width) * 2 * sizeof(float));
+        return;
+    }
+
+    size_t i     = 0;
+    size_t count = static_cast<size_t>(width) * 2;
+#if CAMERA_MOTION_F16C
+    for (; i + 8 <= count; i += 8)
+    {
+        __m128i lo = _mm_cvtps_ph(_mm_loadu_ps(pMotion + i), _MM_FROUND_TO_NEAREST_INT);
+        __m128i hi = _mm_cvtps_ph(_mm_loadu_ps(pMotion + i + 4), _MM_FROUND_TO_NEAREST_INT);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(pRow + i * 2), _mm_unpacklo_epi64(lo, hi));
+    }
+#endif
+    for (; i < count; i++)
+    {
+        uint16_t value = FloatToHalf(pMotion[i]);
+        memcpy(pRow + i * 2, &value, sizeof(value));
+    }
+}
+
+// Writes the camera motion of one tile of the frame into surface (rows at its pitch, mevcFormat texels). pDepth holds
+// the whole frame as tightly packed depthFormat texels.
+inline void SynthesizeCameraMotionTile(const uint8_t*        pDepth,
+                                       uint32_t              depthFormat,
+                                       const float           clipToPrevClip[16],
+                                       uint32_t              mevcFormat,
+                                       const PitchedSurface& surface,
+                                       const TileRect&       tile)
+{
+    thread_local std::vector<float> depth;
+    thread_local std::vector<float> motion;
+    depth.resize(tile.width);
+    motion.resize(static_cast<size_t>(tile.width) * 2);
+
+    const uint32_t depthBytes  = GetDepthBytesPerPixel(depthFormat);
+    const size_t   depthStride = static_cast<size_t>(surface.width) * depthBytes;
+    for (uint32_t y = tile.y; y < tile.y + tile.height; y++)
+    {
+        LoadDepthRow(pDepth + y * depthStride + tile.x * depthBytes, tile.width, depthFormat, depth.data());
+        ComputeCameraMotionRow(
+            depth.data(), tile.x, y, tile.width, surface.width, surface.height, clipToPrevClip, motion.data());
+        StoreMotionRow(motion.data(),
+                       tile.width,
+                       mevcFormat,
+                       surface.pData + static_cast<size_t>(y) * surface.rowPitch + tile.x * surface.bytesPerPixel);
+    }
+}
+
+inline bool CanSynthesizeCameraMotion(uint32_t depthFormat, uint32_t mevcFormat, const PitchedSurface& surface)
+{
+    return IsCameraMotionDepthFormat(depthFormat) && IsCameraMotionFormat(mevcFormat) &&
+           surface.bytesPerPixel == GetCameraMotionBytesPerPixel(mevcFormat);
+}
+
+// Writes the camera motion of a whole frame. The frame is split into the pool's tiles, which its threads share out
+// by stealing.
+inline bool SynthesizeCameraMotion(const uint8_t*        pDepth,
+                                   uint32_t              depthFormat,
+                                   const float           clipToPrevClip[16],
+                                   uint32_t              mevcFormat,
+                                   const PitchedSurface& surface,
+                                   ThreadPool*           pPool)
+{
+    if (pDepth == nullptr || !CanSynthesizeCameraMotion(depthFormat, mevcFormat, surface))
+    {
+        return false;
+    }
+
+    auto synthesizeTile = [&](const TileRect& tile) {
+        SynthesizeCameraMotionTile(pDepth, depthFormat, clipToPrevClip, mevcFormat, surface, tile);
+    };
+    if (pPool != nullptr)
+    {
+        pPool->ParallelForTiles(surface.width, surface.height, 0, synthesizeTile);
+    }
+    else
+    {
+        synthesizeTile({0, 0, surface.width, surface.height});
+    }
+    return true;
+}
+
+// Motion residuals are taken between the order-preserving integer forms of the float bits (tile_codec.h), so a
+// stored residual of zero means bit-identical motion and the reconstruction is exact.
+inline void MakeMotionResidual(uint8_t* pMotion, const uint8_t* pCamera, size_t bytes, uint32_t format)
+{
+    if (format == DXGI_FORMAT_R32G32_FLOAT)
+    {
+        for (size_t i = 0; i + 4 <= bytes; i += 4)
+        {
+            uint32_t motion;
+            uint32_t camera;
+            memcpy(&motion, pMotion + i, 4);
+            memcpy(&camera, pCamera + i, 4);
+            uint32_t residual =
+                static_cast<uint32_t>(FloatBitsToOrdered(motion, 32) - FloatBitsToOrdered(camera, 32));
+            memcpy(pMotion + i, &residual, 4);
+        }
+        return;
+    }
+
+    for (size_t i = 0; i + 2 <= bytes; i += 2)
+    {
+        uint16_t motion;
+        uint16_t camera;
+        memcpy(&motion, pMotion + i, 2);
+        memcpy(&camera, pCamera + i, 2);
+        uint16_t residual = static_cast<uint16_t>(FloatBitsToOrdered(motion, 16) - FloatBitsToOrdered(camera, 16));
+        memcpy(pMotion + i, &residual, 2);
+    }
+}
+
+// pMotion holds the camera motion on entry and the full motion on return.
+inline void ApplyMotionResidual(uint8_t* pMotion, const uint8_t* pResidual, size_t bytes, uint32_t format)
+{
+    if (format == DXGI_FORMAT_R32G32_FLOAT)
+    {
+        for (size_t i = 0; i + 4 <= bytes; i += 4)
+        {
+            uint32_t camera;
+            uint32_t residual;
+            memcpy(&camera, pMotion + i, 4);
+            memcpy(&residual, pResidual + i, 4);
+            uint64_t ordered = (FloatBitsToOrdered(camera, 32) + residual) & ChannelMask(32);
+            uint32_t motion  = static_cast<uint32_t>(OrderedToFloatBits(ordered, 32));
+            memcpy(pMotion + i, &motion, 4);
+        }
+        return;
+    }
+
+    size_t i = 0;
+#if CAMERA_MOTION_SSE2
+    // For halves the order-preserving map is a XOR with (sign ? 0xFFFF : 0x8000), and its inverse a XOR with
+    // (top bit ? 0x8000 : 0xFFFF).
+    const __m128i signBit = _mm_set1_epi16(static_cast<short>(0x8000));
+    const __m128i allOnes = _mm_set1_epi16(-1);
+    for (; i + 16 <= bytes; i += 16)
+    {
+        __m128i camera   = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pMotion + i));
+        __m128i residual = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pResidual + i));
+        __m128i ordered  = _mm_xor_si128(camera, _mm_or_si128(_mm_srai_epi16(camera, 15), signBit));
+        ordered          = _mm_add_epi16(ordered, residual);
+        __m128i motion   = _mm_xor_si128(
+            ordered, _mm_or_si128(_mm_xor_si128(_mm_srai_epi16(ordered, 15), allOnes), signBit));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(pMotion + i), motion);
+    }
+#endif
+    for (; i + 2 <= bytes; i += 2)
+    {
+        uint16_t camera;
+        uint16_t residual;
+        memcpy(&camera, pMotion + i, 2);
+        memcpy(&residual, pResidual + i, 2);
+        uint64_t ordered = (FloatBitsToOrdered(camera, 16) + residual) & ChannelMask(16);
+        uint16_t motion  = static_cast<uint16_t>(OrderedToFloatBits(ordered, 16));
+        memcpy(pMotion + i, &motion, 2);
+    }
+}
@@ -0,0 +1,362 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <psapi.h>
+#elif defined(__linux__)
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <filesystem>
+#include <fstream>
+#include <string>
+#endif
+
+// One logical processor as the OS schedules it. SMT siblings share core; the first sibling of every core has
+// firstOfCore set, so picking only those gives one thread per physical core.
+struct LogicalCpu
+{
+    uint32_t id;          // Windows: group * 64 + number; Linux: the kernel's CPU number
+    uint32_t node;        // NUMA node
+    uint32_t core;        // physical core, unique across packages
+    bool     firstOfCore;
+};
+
+// The logical processors this process may run on, queried once. Machines or platforms that do not report a topology
+// look like a single node with one core per hardware thread.
+class CpuTopology
+{
+public:
+    static const CpuTopology& Get()
+    {
+        static const CpuTopology topology;
+        return topology;
+    }
+
+    const std::vector<LogicalCpu>& Cpus() const
+    {
+        return m_cpus;
+    }
+
+    uint32_t NodeCount() const
+    {
+        return m_nodeCount;
+    }
+
+    // The processors of one node, or of all nodes for node < 0, in the order threads should be placed on them: one per
+    // physical core first, node by node, then the second siblings and so on. physicalCoresOnly drops the siblings.
+    std::vector<LogicalCpu> SelectCpus(int32_t node, bool physicalCoresOnly) const
+    {
+        std::vector<LogicalCpu> selected;
+        for (const LogicalCpu& cpu : m_cpus)
+        {
+            if ((node < 0 || cpu.node == static_cast<uint32_t>(node)) && (cpu.firstOfCore || !physicalCoresOnly))
+            {
+                selected.push_back(cpu);
+            }
+        }
+        std::stable_sort(selected.begin(), selected.end(), [](const LogicalCpu& a, const LogicalCpu& b) {
+            return a.firstOfCore != b.firstOfCore ? a.firstOfCore : a.node < b.node;
+        });
+        return selected;
+    }
+
+private:
+    CpuTopology()
+    {
+        Query();
+        if (m_cpus.empty())
+        {
+            uint32_t count = (std::max)(std::thread::hardware_concurrency(), 1u);
+            for (uint32_t i = 0; i < count; i++)
+            {
+                m_cpus.push_back({i, 0, i, true});
+            }
+        }
+        for (const LogicalCpu& cpu : m_cpus)
+        {
+            m_nodeCount = (std::max)(m_nodeCount, cpu.node + 1);
+        }
+    }
+
+#ifdef _WIN32
+    void Query()
+    {
+        DWORD length = 0;
+        GetLogicalProcessorInformationEx(RelationAll, nullptr, &length);
+        std::vector<uint8_t> buffer(length);
+        if (length == 0 ||
+            !GetLogicalProcessorInformationEx(
+                RelationAll, reinterpret_cast<SYSTEM_LOGICAL_PROCESSOR_INFORMATION_EX*>(buffer.data()), &length))
+        {
+            return;
+        }
+
+        std::vector<GROUP_AFFINITY> nodeMasks;
+        std::vector<uint32_t>       nodeNumbers;
+        uint32_t                    core = 0;
+        for (DWORD offset = 0; offset < length;)
+        {
+            const auto& info =
+                *reinterpret_cast<const SYSTEM_LOGICAL_PROCESSOR_INFORMATION_EX*>(buffer.data() + offset);
+            if (info.Relationship == RelationProcessorCore)
+            {
+                bool first = true;
+                for (WORD g = 0; g < info.Processor.GroupCount; g++)
+                {
+                    const GROUP_AFFINITY& mask = info.Processor.GroupMask[g];
+                    for (uint32_t bit = 0; bit < 64; bit++)
+                    {
+                        if ((mask.Mask >> bit) & 1)
+                        {
+                            m_cpus.push_back({mask.Group * 64u + bit, 0, core, first});
+                            first = false;
+                        }
+                    }
+                }
+                core++;
+            }
+            else if (info.Relationship == RelationNumaNode)
+            {
+                nodeMasks.push_back(info.NumaNode.GroupMask);
+                nodeNumbers.push_back(info.NumaNode.NodeNumber);
+            }
+            offset += info.Size;
+        }
+
+        for (LogicalCpu& cpu : m_cpus)
+        {
+            for (size_t n = 0; n < nodeMasks.size(); n++)
+            {
+                if (nodeMasks[n].Group == cpu.id / 64 && ((nodeMasks[n].Mask >> (cpu.id % 64)) & 1))
+                {
+                    cpu.node = nodeNumbers[n];
+                }
+            }
+        }
+    }
+#elif defined(__linux__)
+    // Reads /sys/devices/system/cpu, limited to the CPUs in the process's affinity mask so that a container or taskset
+    // is respected.
+    void Query()
+    {
+        cpu_set_t allowed;
+        CPU_ZERO(&allowed);
+        if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0)
+        {
+            return;
+        }
+
+        std::vector<std::pair<uint64_t, uint32_t>> cores; // (package << 32 | core_id, core index)
+        for (uint32_t id = 0; id < CPU_SETSIZE; id++)
+        {
+            if (!CPU_ISSET(id, &allowed))
+            {
+                continue;
+            }
+            std::string dir     = "/sys/devices/system/cpu/cpu" + std::to_string(id);
+            uint64_t    package = ReadNumber(dir + "/topology/physical_package_id");
+            uint64_t    coreId  = ReadNumber(dir + "/topology/core_id");
+            uint64_t    key     = package << 32 | coreId;
+
+            LogicalCpu cpu  = {id, 0, 0, true};
+            auto       seen = std::find_if(cores.begin(), cores.end(), [key](const auto& c) { return c.first == key; });
+            if (seen != cores.end())
+            {
+                cpu.core        = seen->second;
+                cpu.firstOfCore = false;
+            }
+            else
+            {
+                cpu.core = static_cast<uint32_t>(cores.size());
+                cores.push_back({key, cpu.core});
+            }
+
+            std::error_code error;
+            for (const auto& entry : std::filesystem::directory_iterator(dir, error))
+            {
+                std::string name = entry.path().filename().string();
+                if (name.compare(0, 4, "node") == 0 && name.size() > 4 && isdigit(static_cast<unsigned char>(name[4])))
+                {
+                    cpu.node = static_cast<uint32_t>(atoi(name.c_str() + 4));
+                }
+            }
+            m_cpus.push_back(cpu);
+        }
+    }
+
+    static uint64_t ReadNumber(const std::string& path)
+    {
+        std::ifstream file(path);
+        uint64_t      value = 0;
+        file >> value;
+        return value;
+    }
+#else
+    void Query()
+    {
+    }
+#endif
+
+    std::vector<LogicalCpu> m_cpus;
+    uint32_t                m_nodeCount = 1;
+};
+
+// Restricts the calling thread to the given processors. On Windows a thread lives in one processor group, so only the
+// processors in the group of the first one are used. Returns false if the OS refused.
+inline bool PinCurrentThread(const std::vector<LogicalCpu>& cpus)
+{
+    if (cpus.empty())
+    {
+        return false;
+    }
+#ifdef _WIN32
+    GROUP_AFFINITY affinity = {};
+    affinity.Group          = static_cast<WORD>(cpus[0].id / 64);
+    for (const LogicalCpu& cpu : cpus)
+    {
+        if (cpu.id / 64 == affinity.Group)
+        {
+            affinity.Mask |= KAFFINITY(1) << (cpu.id % 64);
+        }
+    }
+    return SetThreadGroupAffinity(GetCurrentThread(), &affinity, nullptr) != 0;
+#elif defined(__linux__)
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (const LogicalCpu& cpu : cpus)
+    {
+        CPU_SET(cpu.id, &set);
+    }
+    return sched_setaffinity(0, sizeof(set), &set) == 0;
+#else
+    return false;
+#endif
+}
+
+// NUMA node of the processor the calling thread is running on right now.
+inline uint32_t CurrentNumaNode()
+{
+#ifdef _WIN32
+    PROCESSOR_NUMBER processor = {};
+    USHORT           node      = 0;
+    GetCurrentProcessorNumberEx(&processor);
+    return GetNumaProcessorNodeEx(&processor, &node) ? node : 0;
+#elif defined(__linux__)
+    unsigned cpu  = 0;
+    unsigned node = 0;
+    return syscall(SYS_getcpu, &cpu, &node, nullptr) == 0 ? node : 0;
+#else
+    return 0;
+#endif
+}
+
+// Allocates bytes of page-aligned memory whose pages the OS places on node, falling back to other nodes only when node
+// is out of memory. The pages are placed when first touched, wherever the touching thread runs.
+inline std::shared_ptr<uint8_t> AllocateOnNode(size_t bytes, uint32_t node)
+{
+#ifdef _WIN32
+    void* p = VirtualAllocExNuma(GetCurrentProcess(), nullptr, bytes, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE, node);
+    return std::shared_ptr<uint8_t>(static_cast<uint8_t*>(p), [](uint8_t* q) { VirtualFree(q, 0, MEM_RELEASE); });
+#elif defined(__linux__)
+    void* p = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (p == MAP_FAILED)
+    {
+        return nullptr;
+    }
+    // MPOL_PREFERRED, without pulling in libnuma's numaif.h.
+    const int     MpolPreferred = 1;
+    unsigned long mask[16]      = {};
+    if (node < sizeof(mask) * 8)
+    {
+        mask[node / (sizeof(unsigned long) * 8)] = 1ul << (node % (sizeof(unsigned long) * 8));
+        syscall(SYS_mbind, p, bytes, MpolPreferred, mask, sizeof(mask) * 8, 0);
+    }
+    return std::shared_ptr<uint8_t>(static_cast<uint8_t*>(p), [bytes](uint8_t* q) { munmap(q, bytes); });
+#else
+    (void)node;
+    return std::shared_ptr<uint8_t>(new uint8_t[bytes], std::default_delete<uint8_t[]>());
+#endif
+}
+
+// NUMA node holding the page at p, or -1 if the page is not resident or the OS cannot tell.
+inline int32_t PageNumaNode(const void* p)
+{
+#ifdef _WIN32
+    PSAPI_WORKING_SET_EX_INFORMATION info = {};
+    info.VirtualAddress                   = const_cast<void*>(p);
+    if (!QueryWorkingSetEx(GetCurrentProcess(), &info, sizeof(info)) || !info.VirtualAttributes.Valid)
+    {
+        return -1;
+    }
+    return static_cast<int32_t>(info.VirtualAttributes.Node);
+#elif defined(__linux__)
+    void* page   = const_cast<void*>(p);
+    int   status = -1;
+    if (syscall(SYS_move_pages, 0, 1, &page, nullptr, &status, 0) != 0)
+    {
+        return -1;
+    }
+    return status >= 0 ? status : -1;
+#else
+    (void)p;
+    return -1;
+#endif
+}
+
+// Counts sampled buffer pages by whether they sit on the node of the thread that reads them. Comparing the remote
+// share of runs with and without node binding shows how much of the buffer traffic crossed sockets.
+class NumaPlacementCounters
+{
+public:
+    // Looks at the first, middle and last page of the buffer.
+    void Sample(const void* p, size_t bytes)
+    {
+        if (p == nullptr || bytes == 0 || CpuTopology::Get().NodeCount() < 2)
+        {
+            return;
+        }
+
+        const uint8_t* base = static_cast<const uint8_t*>(p);
+        const int32_t  node = static_cast<int32_t>(CurrentNumaNode());
+        for (size_t offset : {size_t(0), bytes / 2, bytes - 1})
+        {
+            int32_t pageNode = PageNumaNode(base + offset);
+            if (pageNode >= 0)
+            {
+                (pageNode == node ? m_local : m_remote)++;
+            }
+        }
+    }
+
+    uint64_t LocalPages() const
+    {
+        return m_local.load();
+    }
+
+    uint64_t RemotePages() const
+    {
+        return m_remote.load();
+    }
+
+    double RemoteShare() const
+    {
+        uint64_t total = LocalPages() + RemotePages();
+        return total != 0 ? static_cast<double>(RemotePages()) / total : 0.0;
+    }
+
+private:
+    std::atomic<uint64_t> m_local{0};
+    std::atomic<uint64_t> m_remote{0};
+};
@@ -0,0 +1,580 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <chrono>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "async_io.h"
+#include "camera_motion.h"
+#include "thread_pool.h"
+#include "tile_codec.h"
+
+#ifndef _WIN32
+#include <sys/mman.h>
+#endif
+
+// Single-file capture archive. A capture is thousands of small files, and on shared storage opening them costs more
+// than reading them, so the converter packs every frame into one file that the runner maps into memory:
+//
+//   FrameArchiveHeader                          at offset 0
+//   file blobs                                  each aligned to FrameArchiveAlignment
+//   FrameArchiveEntry[frameCount]               at header.indexOffset, one per frame id starting at firstFrameId
+//
+// A frame's entry is found by arithmetic on its id, and the files handed out point straight into the mapping.
+// Colour blobs keep their container (PNG, QOI or raw); clip info, depth and motion blobs are the .bin contents.
+// In a compressed archive depth and motion blobs may instead hold a tiled frame (tile_codec.h); those that predict
+// from the previous frame need it decoded first, and every keyFrameInterval-th frame is coded without reference so
+// that a random seek decodes at most that many frames.
+// With the motion residual flag, a frame whose clip info and depth are complete stores its motion minus the camera
+// motion derived from them (camera_motion.h); static geometry then leaves a residual that is almost all zero. Such
+// frames are marked in their index entry.
+
+static constexpr uint8_t  FrameArchiveMagic[8]         = {'F', 'G', 'A', 'R', 'C', 'H', 0, 0};
+static constexpr uint32_t FrameArchiveVersion          = 2;
+static constexpr size_t   FrameArchiveAlignment        = 4096;
+static constexpr uint32_t FrameArchiveKeyFrameInterval = 16;
+
+enum FrameArchiveFlags : uint32_t {
+    FrameArchiveCompressed     = 1,
+    FrameArchiveMotionResidual = 2,
+};
+
+struct FrameArchiveHeader
+{
+    uint8_t  magic[8];
+    uint32_t version;
+    uint32_t frameCount;
+    uint32_t firstFrameId;
+    uint32_t width;
+    uint32_t height;
+    uint32_t depthFormat; // DXGI_FORMAT of the depth blobs
+    uint32_t mevcFormat;  // DXGI_FORMAT of the motion blobs
+    uint32_t flags;
+    uint64_t indexOffset;
+    uint32_t keyFrameInterval;
+    uint8_t  reserved[12];
+};
+
+struct FrameArchiveBlob
+{
+    uint64_t offset;
+    uint64_t size; // 0 when the file was missing at conversion time
+};
+
+enum FrameArchiveEntryFlags : uint64_t {
+    FrameArchiveEntryMotionResidual = 1, // the motion blob holds the residual to the frame's camera motion
+};
+
+struct FrameArchiveEntry
+{
+    FrameArchiveBlob files[FrameFileTypeCount];
+    uint64_t         flags;
+};
+
+static_assert(sizeof(FrameArchiveHeader) == 64, "archive header layout is part of the file format");
+static_assert(sizeof(FrameArchiveEntry) == 16 * FrameFileTypeCount + 8,
+              "archive entry layout is part of the file format");
+
+// Read-only mapping of a whole file. The view stays valid for as long as any copy of Data() is referenced through
+// the shared owner.
+class MappedFile
+{
+public:
+    static std::shared_ptr<MappedFile> Open(const std::string& path)
+    {
+        auto mapped = std::shared_ptr<MappedFile>(new MappedFile());
+#ifdef _WIN32
+        mapped->m_file = CreateFileA(
+            path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_RANDOM_ACCESS, nullptr);
+        if (mapped->m_file == INVALID_HANDLE_VALUE)
+        {
+            return nullptr;
+        }
+        LARGE_INTEGER fileSize = {};
+        if (!GetFileSizeEx(mapped->m_file, &fileSize) || fileSize.QuadPart == 0)
+        {
+            return nullptr;
+        }
+        mapped->m_size    = static_cast<size_t>(fileSize.QuadPart);
+        mapped->m_mapping = CreateFileMappingA(mapped->m_file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (mapped->m_mapping == nullptr)
+        {
+            return nullptr;
+        }
+        mapped->m_pData = static_cast<const uint8_t*>(MapViewOfFile(mapped->m_mapping, FILE_MAP_READ, 0, 0, 0));
+#else
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+        {
+            return nullptr;
+        }
+        struct stat st = {};
+        if (fstat(fd, &st) == 0 && st.st_size > 0)
+        {
+            mapped->m_size = static_cast<size_t>(st.st_size);
+            void* p        = mmap(nullptr, mapped->m_size, PROT_READ, MAP_SHARED, fd, 0);
+            mapped->m_pData = p == MAP_FAILED ? nullptr : static_cast<const uint8_t*>(p);
+        }
+        close(fd);
+#endif
+        return mapped->m_pData != nullptr ? mapped : nullptr;
+    }
+
+    ~MappedFile()
+    {
+#ifdef _WIN32
+        if (m_pData != nullptr)
+        {
+            UnmapViewOfFile(m_pData);
+        }
+        if (m_mapping != nullptr)
+        {
+            CloseHandle(m_mapping);
+        }
+        if (m_file != INVALID_HANDLE_VALUE)
+        {
+            CloseHandle(m_file);
+        }
+#else
+        if (m_pData != nullptr)
+        {
+            munmap(const_cast<uint8_t*>(m_pData), m_size);
+        }
+#endif
+    }
+
+    MappedFile(const MappedFile&)            = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    const uint8_t* Data() const
+    {
+        return m_pData;
+    }
+
+    size_t Size() const
+    {
+        return m_size;
+    }
+
+    // Asks the OS to start paging in [offset, offset + size) so the first touch does not stall on storage.
+    void WillNeed(uint64_t offset, uint64_t size) const
+    {
+        if (size == 0 || offset >= m_size)
+        {
+            return;
+        }
+        size = (std::min)(size, static_cast<uint64_t>(m_size - offset));
+#ifdef _WIN32
+#if _WIN32_WINNT >= 0x0602
+        WIN32_MEMORY_RANGE_ENTRY range = {const_cast<uint8_t*>(m_pData) + offset, static_cast<SIZE_T>(size)};
+        PrefetchVirtualMemory(GetCurrentProcess(), 1, &range, 0);
+#endif
+#else
+        uint64_t pageMask = static_cast<uint64_t>(sysconf(_SC_PAGESIZE)) - 1;
+        uint64_t begin    = offset & ~pageMask;
+        madvise(const_cast<uint8_t*>(m_pData) + begin, static_cast<size_t>(offset + size - begin), MADV_WILLNEED);
+#endif
+    }
+
+private:
+    MappedFile() = default;
+
+#ifdef _WIN32
+    HANDLE m_file    = INVALID_HANDLE_VALUE;
+    HANDLE m_mapping = nullptr;
+#endif
+    const uint8_t* m_pData = nullptr;
+    size_t         m_size  = 0;
+};
+
+// Camera motion of a frame from its own clip info and depth. Returns false, leaving camera empty, when the frame
+// does not have both or the formats are not supported; such frames keep their full motion in the archive.
+inline bool ComputeFrameCameraMotion(const FrameFiles&         files,
+                                     const FrameArchiveHeader& header,
+                                     ThreadPool*               pPool,
+                                     FileBuffer&               camera)
+{
+    static constexpr size_t ClipMatrixBytes = 16 * sizeof(float);
+
+    const FileBuffer& clip   = files[static_cast<size_t>(FrameFileType::ClipInfo)];
+    const FileBuffer& depth  = files[static_cast<size_t>(FrameFileType::Depth)];
+    const FileBuffer& motion = files[static_cast<size_t>(FrameFileType::MotionVector)];
+    const size_t      pixels = static_cast<size_t>(header.width) * header.height;
+    if (!IsCameraMotionDepthFormat(header.depthFormat) || !IsCameraMotionFormat(header.mevcFormat) ||
+        clip.size < 2 * ClipMatrixBytes || depth.size != pixels * GetDepthBytesPerPixel(header.depthFormat) ||
+        motion.size != pixels * GetCameraMotionBytesPerPixel(header.mevcFormat))
+    {
+        return false;
+    }
+
+    float clipToPrevClip[16];
+    memcpy(clipToPrevClip, clip.data() + ClipMatrixBytes, ClipMatrixBytes);
+
+    camera.storage = AllocateAligned(AlignUp(motion.size, DirectIoAlignment));
+    camera.size    = motion.size;
+    PitchedSurface surface = {camera.storage.get(), header.width * GetCameraMotionBytesPerPixel(header.mevcFormat),
+                              header.width, header.height, GetCameraMotionBytesPerPixel(header.mevcFormat)};
+    return camera.storage &&
+           SynthesizeCameraMotion(depth.data(), header.depthFormat, clipToPrevClip, header.mevcFormat, surface, pPool);
+}
+
+class FrameArchive
+{
+public:
+    struct DecodeStats
+    {
+        uint64_t frames  = 0;
+        uint64_t bytes   = 0; // decoded size
+        double   seconds = 0.0;
+    };
+
+    // Returns nullptr if the file is missing, truncated or not an archive of this version. Compressed blobs are
+    // decoded with their tiles spread over pDecodePool.
+    static std::unique_ptr<FrameArchive> Open(const std::string& path, ThreadPool* pDecodePool)
+    {
+        auto mapped = MappedFile::Open(path);
+        if (!mapped || mapped->Size() < sizeof(FrameArchiveHeader))
+        {
+            return nullptr;
+        }
+
+        FrameArchiveHeader header;
+        memcpy(&header, mapped->Data(), sizeof(header));
+        uint64_t indexBytes = static_cast<uint64_t>(header.frameCount) * sizeof(FrameArchiveEntry);
+        if (memcmp(header.magic, FrameArchiveMagic, sizeof(header.magic)) != 0 ||
+            header.version != FrameArchiveVersion || header.indexOffset > mapped->Size() ||
+            indexBytes > mapped->Size() - header.indexOffset)
+        {
+            return nullptr;
+        }
+
+        auto archive      = std::unique_ptr<FrameArchive>(new FrameArchive());
+        archive->m_mapped = std::move(mapped);
+        archive->m_header = header;
+        archive->m_pPool  = pDecodePool;
+        return archive;
+    }
+
+    const FrameArchiveHeader& Header() const
+    {
+        return m_header;
+    }
+
+    bool HasFrame(uint32_t frameId) const
+    {
+        return frameId >= m_header.firstFrameId && frameId - m_header.firstFrameId < m_header.frameCount;
+    }
+
+    // Files of one frame as views into the mapping, or decoded copies for compressed blobs. Frames outside the
+    // archive, blobs that point past the end of the file and frames that fail to decode come back empty, like
+    // missing files from the directory reader.
+    FrameFiles GetFrame(uint32_t frameId)
+    {
+        FrameFiles files;
+        for (size_t type = 0; type < FrameFileTypeCount; type++)
+        {
+            files[type] = GetBlob(type, frameId);
+            if (IsTiledFrame(files[type].data(), files[type].size))
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                files[type] = DecodeBlob(type, frameId);
+            }
+        }
+
+        // The camera motion buffer becomes the frame's motion; the cached residual is left untouched. A residual whose
+        // camera motion cannot be rebuilt, because the depth or clip info did not decode, reads as missing motion.
+        FrameArchiveEntry entry = {};
+        if (ReadEntry(frameId, entry) && (entry.flags & FrameArchiveEntryMotionResidual) != 0)
+        {
+            FileBuffer  motion;
+            FileBuffer& residual = files[static_cast<size_t>(FrameFileType::MotionVector)];
+            if (ComputeFrameCameraMotion(files, m_header, m_pPool, motion))
+            {
+                ApplyMotionResidual(motion.storage.get(), residual.data(), motion.size, m_header.mevcFormat);
+                residual = motion;
+            }
+            else
+            {
+                residual = FileBuffer();
+            }
+        }
+        return files;
+    }
+
+    DecodeStats GetDecodeStats() const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_stats;
+    }
+
+    // Starts paging in every blob of frames [first, last].
+    void Prefetch(uint32_t first, uint32_t last) const
+    {
+        for (uint32_t frameId = first; frameId <= last; frameId++)
+        {
+            FrameArchiveEntry entry;
+            if (!ReadEntry(frameId, entry))
+            {
+                continue;
+            }
+            for (const FrameArchiveBlob& blob : entry.files)
+            {
+                m_mapped->WillNeed(blob.offset, blob.size);
+            }
+        }
+    }
+
+private:
+    FrameArchive() = default;
+
+    // The aliasing constructor keeps the mapping alive for as long as any buffer handed out is referenced.
+    FileBuffer GetBlob(size_t type, uint32_t frameId) const
+    {
+        FileBuffer        file;
+        FrameArchiveEntry entry;
+        if (!ReadEntry(frameId, entry))
+        {
+            return file;
+        }
+        const FrameArchiveBlob& blob = entry.files[type];
+        if (blob.size != 0 && blob.offset <= m_mapped->Size() && blob.size <= m_mapped->Size() - blob.offset)
+        {
+            file.storage = std::shared_ptr<uint8_t>(m_mapped, const_cast<uint8_t*>(m_mapped->Data()) + blob.offset);
+            file.size    = static_cast<size_t>(blob.size);
+        }
+        return file;
+    }
+
+    // Decodes a tiled blob, first decoding the frames it references. Recent results are cached, so the sequential
+    // pair loop decodes every frame once even though each frame belongs to two pairs. Called with m_mutex held.
+    FileBuffer DecodeBlob(size_t type, uint32_t frameId)
+    {
+        uint64_t key    = static_cast<uint64_t>(frameId) * FrameFileTypeCount + type;
+        auto     cached = m_decoded.find(key);
+        if (cached != m_decoded.end())
+        {
+            return cached->second;
+        }
+
+        FileBuffer blob = GetBlob(type, frameId);
+        size_t     size = GetTiledFrameSize(blob.data(), blob.size);
+        if (size == 0)
+        {
+            return {};
+        }
+
+        // A predecessor the converter kept raw is used as stored.
+        FileBuffer previous;
+        if (TiledFrameNeedsPrevious(blob.data(), blob.size))
+        {
+            if (frameId > m_header.firstFrameId)
+            {
+                previous = GetBlob(type, frameId - 1);
+                if (IsTiledFrame(previous.data(), previous.size))
+                {
+                    previous = DecodeBlob(type, frameId - 1);
+                }
+            }
+            if (previous.size != size)
+            {
+                return {};
+            }
+        }
+
+        auto       begin = std::chrono::steady_clock::now();
+        FileBuffer decoded;
+        decoded.storage = AllocateAligned(AlignUp(size, DirectIoAlignment));
+        decoded.size    = size;
+        if (!decoded.storage ||
+            !DecodeTiledFrame(blob.data(), blob.size, previous.data(), decoded.storage.get(), m_pPool))
+        {
+            return {};
+        }
+        m_stats.frames++;
+        m_stats.bytes += size;
+        m_stats.seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+
+        m_decoded[key] = decoded;
+        while (m_decoded.size() > DecodedCacheFrames * FrameFileTypeCount)
+        {
+            m_decoded.erase(m_decoded.begin());
+        }
+        return decoded;
+    }
+
+    bool ReadEntry(uint32_t frameId, FrameArchiveEntry& entry) const
+    {
+        if (!HasFrame(frameId))
+        {
+            return false;
+        }
+        uint64_t offset = m_header.indexOffset + static_cast<uint64_t>(frameId - m_header.firstFrameId) *
+                                                     sizeof(FrameArchiveEntry);
+        memcpy(&entry, m_mapped->Data() + offset, sizeof(entry));
+        return true;
+    }
+
+    static constexpr size_t DecodedCacheFrames = 3;
+
+    std::shared_ptr<MappedFile>    m_mapped;
+    FrameArchiveHeader             m_header = {};
+    ThreadPool*                    m_pPool  = nullptr;
+    std::map<uint64_t, FileBuffer> m_decoded;
+    DecodeStats                    m_stats;
+    mutable std::mutex             m_mutex;
+};
+
+// Packs the per-frame files of [firstFrameId, lastFrameId] from the directory layout into an archive at path.
+// Missing files are recorded as empty blobs. With pCompressPool, depth and motion frames are tile coded on the pool
+// and kept raw where that does not make them smaller. With motionResidual, motion is stored relative to the camera
+// motion. Returns false if the output cannot be written.
+inline bool BuildFrameArchive(const std::string& path,
+                              uint32_t           firstFrameId,
+                              uint32_t           lastFrameId,
+                              const std::string& colorExtension,
+                              uint32_t           width,
+                              uint32_t           height,
+                              uint32_t           depthFormat,
+                              uint32_t           mevcFormat,
+                              bool               directIo,
+                              ThreadPool*        pCompressPool,
+                              bool               motionResidual)
+{
+    FILE* file = fopen(path.c_str(), "wb");
+    if (file == nullptr)
+    {
+        return false;
+    }
+
+    FrameArchiveHeader header = {};
+    memcpy(header.magic, FrameArchiveMagic, sizeof(header.magic));
+    header.version      = FrameArchiveVersion;
+    header.frameCount   = lastFrameId - firstFrameId + 1;
+    header.firstFrameId = firstFrameId;
+    header.width        = width;
+    header.height       = height;
+    header.depthFormat  = depthFormat;
+    header.mevcFormat   = mevcFormat;
+    if (pCompressPool != nullptr)
+    {
+        header.flags |= FrameArchiveCompressed;
+        header.keyFrameInterval = FrameArchiveKeyFrameInterval;
+    }
+    if (motionResidual)
+    {
+        header.flags |= FrameArchiveMotionResidual;
+    }
+
+    static const uint8_t zeros[FrameArchiveAlignment] = {};
+
+    std::vector<FrameArchiveEntry>             index(header.frameCount);
+    std::array<FileBuffer, FrameFileTypeCount> previous;
+    uint64_t                       offset = FrameArchiveAlignment;
+    bool                           ok     = fwrite(&header, sizeof(header), 1, file) == 1 &&
+                fwrite(zeros, FrameArchiveAlignment - sizeof(header), 1, file) == 1;
+
+    for (uint32_t frameId = firstFrameId; ok && frameId <= lastFrameId; frameId++)
+    {
+        FrameArchiveEntry& entry = index[frameId - firstFrameId];
+        FrameFiles         files;
+        for (size_t type = 0; type < FrameFileTypeCount; type++)
+        {
+            files[type] = ReadFileBlocking(
+                GetFrameFilePath(static_cast<FrameFileType>(type), frameId, colorExtension), directIo);
+        }
+
+        FileBuffer camera;
+        if (motionResidual && ComputeFrameCameraMotion(files, header, pCompressPool, camera))
+        {
+            FileBuffer& motion = files[static_cast<size_t>(FrameFileType::MotionVector)];
+            MakeMotionResidual(motion.storage.get(), camera.data(), camera.size, mevcFormat);
+            entry.flags |= FrameArchiveEntryMotionResidual;
+        }
+
+        for (size_t type = 0; type < FrameFileTypeCount && ok; type++)
+        {
+            const FileBuffer& buffer = files[type];
+
+            const uint8_t* pBlob    = buffer.data();
+            size_t         blobSize = buffer.size;
+
+            std::vector<uint8_t> coded;
+            bool                 tiled  = false;
+            uint32_t             format = static_cast<uint32_t>(DXGI_FORMAT_UNKNOWN);
+            if (type == static_cast<size_t>(FrameFileType::Depth))
+            {
+                format = depthFormat;
+            }
+            else if (type == static_cast<size_t>(FrameFileType::MotionVector))
+            {
+                format = mevcFormat;
+            }
+            TileChannelLayout layout;
+            if (pCompressPool != nullptr && GetTileChannelLayout(format, layout) &&
+                buffer.size == static_cast<size_t>(width) * height * layout.bytesPerPixel)
+            {
+                bool keyFrame = (frameId - firstFrameId) % FrameArchiveKeyFrameInterval == 0 ||
+                                previous[type].size != buffer.size;
+                coded = EncodeTiledFrame(
+                    buffer.data(), keyFrame ? nullptr : previous[type].data(), width, height, format, pCompressPool);
+                if (!coded.empty() && coded.size() < buffer.size)
+                {
+                    pBlob    = coded.data();
+                    blobSize = coded.size();
+                    tiled    = true;
+                }
+            }
+            // Only tiled frames are predicted from; the frame after a raw one is a key frame.
+            previous[type] = tiled ? buffer : FileBuffer();
+
+            entry.files[type] = {offset, blobSize};
+            if (blobSize == 0)
+            {
+                continue;
+            }
+
+            size_t padding = AlignUp(blobSize, FrameArchiveAlignment) - blobSize;
+            ok             = fwrite(pBlob, blobSize, 1, file) == 1 && (padding == 0 || fwrite(zeros, padding, 1, file) == 1);
+            offset += blobSize + padding;
+        }
+    }
+
+    header.indexOffset = offset;
+    ok                 = ok && fwrite(index.data(), sizeof(FrameArchiveEntry), index.size(), file) == index.size();
+    ok                 = ok && fseek(file, 0, SEEK_SET) == 0 && fwrite(&header, sizeof(header), 1, file) == 1;
+    ok                 = fclose(file) == 0 && ok;
+    return ok;
+}
+
+// Reads frames [firstFrameId, lastFrameId] back from the archive and compares them with the files in the working
+// directory they were packed from. Returns the number of files that differ; a missing file must come back empty.
+inline uint32_t VerifyFrameArchive(FrameArchive&      archive,
+                                   uint32_t           firstFrameId,
+                                   uint32_t           lastFrameId,
+                                   const std::string& colorExtension,
+                                   bool               directIo)
+{
+    uint32_t mismatches = 0;
+    for (uint32_t frameId = firstFrameId; frameId <= lastFrameId; frameId++)
+    {
+        FrameFiles files = archive.GetFrame(frameId);
+        for (size_t type = 0; type < FrameFileTypeCount; type++)
+        {
+            FileBuffer source = ReadFileBlocking(
+                GetFrameFilePath(static_cast<FrameFileType>(type), frameId, colorExtension), directIo);
+            if (source.size != files[type].size ||
+                (source.size != 0 && memcmp(source.data(), files[type].data(), source.size) != 0))
+            {
+                mismatches++;
+            }
+        }
+    }
+    return mismatches;
+}
@@ -0,0 +1,1794 @@
+#define _CRT_SECURE_NO_WARNINGS
+
+// In sample.exe, main.cpp holds the stb_image implementation. A DLL or extension module built from this file without
+// main.cpp defines FG_STANDALONE (FG_BUILD_DLL implies it) to compile it here.
+#if defined(FG_STANDALONE) || defined(FG_BUILD_DLL)
+#define STB_IMAGE_IMPLEMENTATION
+#endif
+
+#include <d3d11.h>
+
+#include <assert.h>
+#include <string.h>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <deque>
+#include <fstream>
+#include <functional>
+#include <map>
+#include <memory>
+#include <new>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "frame_generation.h"
+#include "util.h"
+#include "camera_motion.h"
+#include "image_formats.h"
+#include "thread_pool.h"
+#include "worker_team.h"
+
+#pragma comment(lib, "d3d11")
+
+#define RELEASE_SAFE(pObj) \
+    if (pObj != nullptr)   \
+    {                      \
+        pObj->Release();   \
+        pObj = nullptr;    \
+    }
+
+struct FrameGenerationInputCb
+{
+    float    prevClipToClip[16];
+    float    clipToPrevClip[16];
+    float    tipTopDistance[2];
+    float    viewportSize[2];
+    float    viewportInv[2];
+    uint32_t dimensions[2]; // x, y
+};
+
+static constexpr size_t ComputeShaderTypeCount = static_cast<size_t>(ComputeShaderType::Count);
+static constexpr size_t StagTypeCount          = static_cast<size_t>(StagResType::Count);
+static constexpr size_t InputTypeCount         = static_cast<size_t>(InputResType::Count);
+static constexpr size_t ConstBufferTypeCount   = static_cast<size_t>(ConstBufferType::Count);
+static constexpr size_t InternalTypeCount      = static_cast<size_t>(InternalResType::Count);
+static constexpr size_t SamplerTypeCount       = static_cast<size_t>(SamplerType::Count);
+
+static constexpr uint32_t DefaultReadbackDepth = 3;
+
+// FG_CONTEXT_LOW_LATENCY: helpers in the context's worker team, and the rows of the bands planes are copied in.
+static constexpr uint32_t LowLatencyTeamThreads = 3;
+static constexpr uint32_t UploadBandRows        = 64;
+
+struct FgWorkerPool_T
+{
+    std::unique_ptr<ThreadPool> pOwned;
+    ThreadPool*                 pPool;
+};
+
+// Copies a plane into the surface row by row. Returns false if the plane holds fewer than height rows; the rows that
+// are present are still copied.
+static bool CopyPlaneToSurface(const PitchedSurface& surface, const FgPlane& plane)
+{
+    const size_t stride = static_cast<size_t>(surface.width) * surface.bytesPerPixel;
+    const size_t pitch  = plane.rowPitch != 0 ? plane.rowPitch : stride;
+    const auto*  pSrc   = static_cast<const uint8_t*>(plane.pData);
+    if (pSrc == nullptr || pitch < stride)
+    {
+        return false;
+    }
+    if (pitch == stride)
+    {
+        return CopyRowsToSurface(surface, pSrc, plane.size);
+    }
+
+    const size_t rows = plane.size >= stride ? (std::min)((plane.size - stride) / pitch + 1, size_t(surface.height)) : 0;
+    for (size_t y = 0; y < rows; y++)
+    {
+        memcpy(surface.pData + y * surface.rowPitch, pSrc + y * pitch, stride);
+    }
+    return rows == surface.height;
+}
+
+// Everything one generator needs on the GPU: the device, the shaders and the textures sized for one resolution, plus
+// the frame that was submitted last.
+struct FgContext_T
+{
+public:
+    ~FgContext_T()
+    {
+        FlushReadbacks();
+        ReleaseContext();
+    }
+
+    FgResult Init(const FgContextDesc& desc)
+    {
+        if (desc.workerPool != nullptr)
+        {
+            m_pPool = desc.workerPool->pPool;
+        }
+        else
+        {
+            m_pOwnedPool = std::make_unique<ThreadPool>(0);
+            m_pPool      = m_pOwnedPool.get();
+        }
+        m_shaderDirectory = desc.shaderDirectory != nullptr ? desc.shaderDirectory : "";
+
+        if (FAILED(InitSampleContext((desc.flags & FG_CONTEXT_DEBUG_LAYER) != 0, (desc.flags & FG_CONTEXT_WARP) != 0)))
+        {
+            return FG_ERROR_DEVICE;
+        }
+
+        std::vector<ShaderInfo> shaderList = {
+            {ComputeShaderType::Clear,        "phsr_fg_clearing.dxbc"    },
+            {ComputeShaderType::Reprojection, "phsr_fg_reprojection.dxbc"},
+            {ComputeShaderType::MergeHalf,    "phsr_fg_merginghalf.dxbc" },
+            {ComputeShaderType::MergeFull,    "phsr_fg_mergingfull.dxbc" },
+            {ComputeShaderType::FirstLeg,     "phsr_fg_firstleg.dxbc"    },
+            {ComputeShaderType::Pull,         "phsr_fg_pulling.dxbc"     },
+            {ComputeShaderType::LastStretch,  "phsr_fg_laststretch.dxbc" },
+            {ComputeShaderType::Push,         "phsr_fg_pushing.dxbc"     },
+            {ComputeShaderType::Resolution,   "phsr_fg_resolution.dxbc"  },
+        };
+
+        for (const ShaderInfo& shader : shaderList)
+        {
+            if (FAILED(CreateComputeShader(&m_computeShaders[static_cast<uint32_t>(shader.shaderType)], shader.dxbcFile)))
+            {
+                return FG_ERROR_SHADER_NOT_FOUND;
+            }
+        }
+
+        if (FAILED(InitSamplerList()))
+        {
+            return FG_ERROR_DEVICE;
+        }
+
+        bool reused = false;
+        return Reset(desc, reused);
+    }
+
+    // A size of 0 x 0 releases the frame-sized textures and leaves the context waiting for the next Reset.
+    FgResult Reset(const FgContextDesc& desc, bool& reused)
+    {
+        const bool sized = desc.width != 0 && desc.height != 0;
+        if (sized && (GetFormatBytesPerPixel(static_cast<DXGI_FORMAT>(desc.depthFormat)) == 0 ||
+                      GetFormatBytesPerPixel(static_cast<DXGI_FORMAT>(desc.motionFormat)) == 0))
+        {
+            return FG_ERROR_UNSUPPORTED_FORMAT;
+        }
+        const bool canSynthesize = IsCameraMotionDepthFormat(desc.depthFormat) && IsCameraMotionFormat(desc.motionFormat);
+        if ((desc.flags & FG_CONTEXT_SYNTHESIZE_MOTION) != 0 && !canSynthesize)
+        {
+            return FG_ERROR_UNSUPPORTED_FORMAT;
+        }
+
+        // Outputs of the previous settings go to the previous callback.
+        FlushReadbacks();
+
+        ResourceKey key = {desc.width,
+                           desc.height,
+                           static_cast<DXGI_FORMAT>(desc.depthFormat),
+                           static_cast<DXGI_FORMAT>(desc.motionFormat),
+                           desc.readbackDepth != 0 ? desc.readbackDepth : DefaultReadbackDepth};
+        reused = sized && key == m_key;
+        if (!reused)
+        {
+            ReleaseResources();
+            m_key = {};
+            if (sized)
+            {
+                m_depthFormat   = key.depthFormat;
+                m_mevcFormat    = key.mevcFormat;
+                m_readbackDepth = key.readbackDepth;
+                if (FAILED(InitResources(key.width, key.height)))
+                {
+                    ReleaseResources();
+                    return FG_ERROR_DEVICE;
+                }
+                m_key = key;
+            }
+        }
+
+        m_interpolatedFrames = desc.interpolatedFrames;
+        m_flags              = desc.flags;
+        m_canSynthesize      = canSynthesize;
+        m_callback           = desc.outputCallback;
+        m_pUserData          = desc.pUserData;
+        m_hasPrev            = false;
+
+        // Kept once created, so its statistics survive a Reset that turns FG_CONTEXT_LOW_LATENCY off and on again.
+        if ((m_flags & FG_CONTEXT_LOW_LATENCY) != 0 && !m_pTeam)
+        {
+            m_pTeam = std::make_unique<WorkerTeam>(LowLatencyTeamThreads);
+        }
+        return FG_SUCCESS;
+    }
+
+    uint32_t GetBarrierStats(FgBarrierStats* pStats, uint32_t capacity) const
+    {
+        std::vector<WorkerTeam::BarrierStats> stats;
+        if (m_pTeam)
+        {
+            stats = m_pTeam->GetBarrierStats();
+        }
+        for (uint32_t i = 0; i < capacity && i < stats.size(); i++)
+        {
+            pStats[i] = {stats[i].crossings, stats[i].waitSeconds, stats[i].maxWaitSeconds};
+        }
+        return static_cast<uint32_t>(stats.size());
+    }
+
+    FgResult Submit(const FgFrameDesc& frame)
+    {
+        if (m_key.width == 0)
+        {
+            return FG_ERROR_INVALID_ARGUMENT;
+        }
+
+        if (m_hasPrev)
+        {
+            // The last frame's textures become the Prev inputs and the new frame is uploaded over the one before it,
+            // so every frame is decoded and uploaded once.
+            SwapInputs(InputResType::PrevColor, InputResType::CurrColor);
+            SwapInputs(InputResType::PrevDepth, InputResType::CurrDepth);
+            SwapInputs(InputResType::PrevMevc, InputResType::CurrMevc);
+        }
+
+        bool complete = UploadFrame(frame);
+
+        if (m_hasPrev)
+        {
+            // The pair is reprojected with the matrices of its first frame.
+            if (m_prevHasClip)
+            {
+                memcpy(m_constBufData.prevClipToClip, m_prevClip.prevClipToClip, sizeof(m_constBufData.prevClipToClip));
+                memcpy(m_constBufData.clipToPrevClip, m_prevClip.clipToPrevClip, sizeof(m_constBufData.clipToPrevClip));
+            }
+            complete &= m_prevHasClip;
+            GeneratePair(m_prevFrameId, frame.frameId, frame.timestampNs);
+        }
+
+        if ((m_flags & FG_CONTEXT_EMIT_INPUTS) != 0)
+        {
+            FgOutputFrame captured = {
+                frame.frameId, frame.frameId, frame.timestampNs, FG_CAPTURED_FRAME, m_key.width, m_key.height, 0, nullptr};
+            QueueReadback(m_inputResources[static_cast<size_t>(InputResType::CurrColor)], captured);
+        }
+
+        m_hasPrev     = true;
+        m_prevFrameId = frame.frameId;
+        m_prevHasClip = frame.pClipInfo != nullptr;
+        if (m_prevHasClip)
+        {
+            memcpy(&m_prevClip, frame.pClipInfo, sizeof(m_prevClip));
+        }
+
+        return TakeReadbackError() ? FG_ERROR_DEVICE : complete ? FG_SUCCESS : FG_INCOMPLETE_INPUT;
+    }
+
+    FgResult SubmitPair(const FgFrameDesc& prev, const FgFrameDesc& curr)
+    {
+        // prev only fills the Curr inputs; it is neither generated against the last frame nor emitted.
+        const uint32_t flags = m_flags;
+        m_hasPrev            = false;
+        m_flags &= ~FG_CONTEXT_EMIT_INPUTS;
+        FgResult first = Submit(prev);
+        m_flags        = flags;
+        if (first < 0)
+        {
+            return first;
+        }
+        FgResult second = Submit(curr);
+        return second != FG_SUCCESS ? second : first;
+    }
+
+    FgResult Flush()
+    {
+        FlushReadbacks();
+        return TakeReadbackError() ? FG_ERROR_DEVICE : FG_SUCCESS;
+    }
+
+    FgResult Receive(FgOutputFrame& frame, void* pPixels, uint32_t rowPitch)
+    {
+        if (m_received.empty() && m_callback == nullptr)
+        {
+            RetireReadback(true);
+        }
+        if (TakeReadbackError())
+        {
+            return FG_ERROR_DEVICE;
+        }
+        if (m_received.empty())
+        {
+            return FG_NOT_READY;
+        }
+
+        ReceivedFrame& received = m_received.front();
+        const size_t   stride   = static_cast<size_t>(received.frame.width) * 4;
+        if (pPixels == nullptr || rowPitch < stride)
+        {
+            return FG_ERROR_INVALID_ARGUMENT;
+        }
+        for (uint32_t y = 0; y < received.frame.height; y++)
+        {
+            memcpy(static_cast<uint8_t*>(pPixels) + static_cast<size_t>(y) * rowPitch,
+                   received.pixels.data() + y * stride,
+                   stride);
+        }
+        frame          = received.frame;
+        frame.rowPitch = rowPitch;
+        frame.pPixels  = static_cast<const uint8_t*>(pPixels);
+        m_received.pop_front();
+        return FG_SUCCESS;
+    }
+
+private:
+    // What the frame-sized resources were created for; Reset keeps them while this stays the same.
+    struct ResourceKey
+    {
+        uint32_t    width;
+        uint32_t    height;
+        DXGI_FORMAT depthFormat;
+        DXGI_FORMAT mevcFormat;
+        uint32_t    readbackDepth;
+
+        bool operator==(const ResourceKey& other) const
+        {
+            return width == other.width && height == other.height && depthFormat == other.depthFormat &&
+                   mevcFormat == other.mevcFormat && readbackDepth == other.readbackDepth;
+        }
+    };
+
+    // Generated frames waiting for their GPU copy to land in a readback texture, oldest first.
+    struct PendingReadback
+    {
+        uint32_t      slot;
+        FgOutputFrame frame;
+    };
+
+    // Outputs copied out of the readback ring for fgReceiveFrame.
+    struct ReceivedFrame
+    {
+        FgOutputFrame        frame;
+        std::vector<uint8_t> pixels;
+    };
+
+    DXGI_FORMAT GetInputResFormat(InputResType type)
+    {
+        switch (type)
+        {
+        case InputResType::CurrColor:
+        case InputResType::PrevColor:
+            return DXGI_FORMAT_R8G8B8A8_UNORM;
+
+        case InputResType::CurrDepth:
+        case InputResType::PrevDepth:
+            return m_depthFormat;
+            break;
+        case InputResType::CurrMevc:
+        case InputResType::PrevMevc:
+            return m_mevcFormat;
+        case InputResType::Count:
+        default:
+            return DXGI_FORMAT_UNKNOWN;
+        }
+    }
+
+    // Releases everything sized by the frame dimensions, formats or ReadbackDepth; the device, shaders and samplers stay.
+    void ReleaseResources()
+    {
+        for (auto& res : m_stagResources)
+        {
+            auto view = m_resourceViews.find(res);
+            if (view != m_resourceViews.end())
+            {
+                RELEASE_SAFE(view->second.srv);
+                RELEASE_SAFE(view->second.uav);
+            }
+            RELEASE_SAFE(res);
+        }
+
+        for (auto& res : m_inputResources)
+        {
+            auto view = m_resourceViews.find(res);
+            if (view != m_resourceViews.end())
+            {
+                RELEASE_SAFE(view->second.srv);
+                RELEASE_SAFE(view->second.uav);
+            }
+            RELEASE_SAFE(res);
+        }
+
+        for (auto& res : m_internalResources)
+        {
+            auto view = m_resourceViews.find(res);
+            if (view != m_resourceViews.end())
+            {
+                RELEASE_SAFE(view->second.srv);
+                RELEASE_SAFE(view->second.uav);
+            }
+            RELEASE_SAFE(res);
+        }
+
+        for (auto& buf : m_constantBuffers)
+        {
+            RELEASE_SAFE(buf);
+        }
+
+        RELEASE_SAFE(m_pColorOutputUav);
+        RELEASE_SAFE(m_pColorOutput);
+
+        for (auto& res : m_readbackRing)
+        {
+            RELEASE_SAFE(res);
+        }
+        m_readbackRing.clear();
+        m_pendingReadbacks.clear();
+        m_nextReadbackSlot = 0;
+
+        m_resourceViews.clear();
+        m_inputViews    = {};
+        m_internalViews = {};
+    }
+
+    void ReleaseContext()
+    {
+        ReleaseResources();
+
+        for (auto& shader : m_computeShaders)
+        {
+            RELEASE_SAFE(shader);
+        }
+
+        for (auto& sampler : m_samplers)
+        {
+            RELEASE_SAFE(sampler);
+        }
+
+        RELEASE_SAFE(m_pContext);
+        RELEASE_SAFE(m_pDevice);
+    }
+
+    HRESULT InitSampleContext(bool debugLayer, bool warp)
+    {
+        ULONG createFlags = 0;
+        if (debugLayer)
+        {
+            createFlags |= D3D11_CREATE_DEVICE_DEBUG;
+        }
+
+        const D3D_FEATURE_LEVEL pFeatureLevels[] = {
+            D3D_FEATURE_LEVEL_11_1,
+        };
+        const UINT nFeatureLevels = 1;
+
+        return D3D11CreateDevice(nullptr,
+                                 warp ? D3D_DRIVER_TYPE_WARP : D3D_DRIVER_TYPE_HARDWARE,
+                                 nullptr,
+                                 createFlags,
+                                 pFeatureLevels,
+                                 1,
+                                 D3D11_SDK_VERSION,
+                                 &m_pDevice,
+                                 nullptr,
+                                 &m_pContext);
+    }
+
+    HRESULT InitStagingResources(int width, int height)
+    {
+        HRESULT hr = E_FAIL;
+
+        D3D11_TEXTURE2D_DESC desc = {};
+        desc.Format               = DXGI_FORMAT_R8G8B8A8_UNORM;
+        desc.Width                = width;
+        desc.Height               = height;
+        desc.MipLevels            = 1;
+        desc.SampleDesc.Count     = 1;
+        desc.SampleDesc.Quality   = 0;
+        desc.ArraySize            = 1;
+        desc.CPUAccessFlags       = D3D11_CPU_ACCESS_WRITE | D3D11_CPU_ACCESS_READ;
+        desc.BindFlags            = 0;
+        desc.Usage                = D3D11_USAGE_STAGING;
+
+        hr = m_pDevice->CreateTexture2D(&desc, nullptr, &m_stagResources[static_cast<size_t>(StagResType::ColorInput)]);
+
+        m_readbackRing.assign(m_readbackDepth, nullptr);
+        desc.CPUAccessFlags = D3D11_CPU_ACCESS_READ;
+        for (size_t i = 0; i < m_readbackRing.size() && SUCCEEDED(hr); i++)
+        {
+            hr = m_pDevice->CreateTexture2D(&desc, nullptr, &m_readbackRing[i]);
+        }
+        desc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE | D3D11_CPU_ACCESS_READ;
+
+        if (SUCCEEDED(hr))
+        {
+            desc.Format = m_mevcFormat;
+            hr = m_pDevice->CreateTexture2D(&desc, nullptr, &m_stagResources[static_cast<size_t>(StagResType::Mevc)]);
+        }
+
+        if (SUCCEEDED(hr))
+        {
+            desc.Format = m_depthFormat;
+            hr = m_pDevice->CreateTexture2D(&desc, nullptr, &m_stagResources[static_cast<size_t>(StagResType::Depth)]);
+        }
+
+        return hr;
+    }
+
+    HRESULT InitAlgoResources(int width, int height)
+    {
+        HRESULT hr = S_OK;
+
+        D3D11_TEXTURE2D_DESC desc = {};
+        desc.Width                = width;
+        desc.Height               = height;
+        desc.MipLevels            = 1;
+        desc.SampleDesc.Count     = 1;
+        desc.SampleDesc.Quality   = 0;
+        desc.ArraySize            = 1;
+        desc.CPUAccessFlags       = 0;
+        desc.Usage                = D3D11_USAGE_DEFAULT;
+
+        auto createViewFunc = [this](ID3D11Texture2D* res, ResourceView& resView) {
+            D3D11_TEXTURE2D_DESC desc = {};
+            res->GetDesc(&desc);
+
+            HRESULT hr = S_OK;
+
+            if (desc.BindFlags & D3D11_BIND_SHADER_RESOURCE)
+            {
+                D3D11_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
+                srvDesc.Format                          = desc.Format;
+                srvDesc.ViewDimension                   = D3D11_SRV_DIMENSION_TEXTURE2D;
+                srvDesc.Texture2D.MipLevels             = 1;
+                srvDesc.Texture2D.MostDetailedMip       = 0;
+
+                hr = m_pDevice->CreateShaderResourceView(res, &srvDesc, &resView.srv);
+            }
+
+            if (desc.BindFlags & D3D11_BIND_UNORDERED_ACCESS)
+            {
+                D3D11_UNORDERED_ACCESS_VIEW_DESC uavDesc = {};
+                uavDesc.Format                           = desc.Format;
+                uavDesc.ViewDimension                    = D3D11_UAV_DIMENSION_TEXTURE2D;
+                uavDesc.Texture2D.MipSlice               = 0;
+
+                if (SUCCEEDED(hr))
+                {
+                    hr = m_pDevice->CreateUnorderedAccessView(res, &uavDesc, &resView.uav);
+                }
+            }
+
+            if (SUCCEEDED(hr))
+            {
+                m_resourceViews.insert({res, resView});
+            }
+            return hr;
+        };
+
+        for (uint32_t i = 0; i < static_cast<uint32_t>(InputResType::Count) && SUCCEEDED(hr); i++)
+        {
+            DXGI_FORMAT  fmt     = DXGI_FORMAT_UNKNOWN;
+            InputResType resType = static_cast<InputResType>(i);
+            fmt                  = GetInputResFormat(resType);
+            assert(fmt != DXGI_FORMAT_UNKNOWN);
+            desc.Format    = fmt;
+            desc.BindFlags = 0;
+
+            UINT formatSupport{};
+            m_pDevice->CheckFormatSupport(fmt, &formatSupport);
+            if ((formatSupport & D3D11_FORMAT_SUPPORT_TYPED_UNORDERED_ACCESS_VIEW) &&
+                (resType != InputResType::CurrDepth) && resType != InputResType::PrevDepth)
+            {
+                desc.BindFlags |= D3D11_BIND_UNORDERED_ACCESS;
+            }
+
+            if (formatSupport & D3D11_FORMAT_SUPPORT_TEXTURE2D)
+            {
+                desc.BindFlags |= D3D11_BIND_SHADER_RESOURCE;
+            }
+
+            hr = m_pDevice->CreateTexture2D(&desc, nullptr, &m_inputResources[i]);
+
+            if (SUCCEEDED(hr))
+            {
+                hr = createViewFunc(m_inputResources[static_cast<size_t>(i)],
+                                    m_inputViews[static_cast<size_t>(i)]);
+            }
+        }
+
+        if (SUCCEEDED(hr))
+        {
+            desc.Format    = DXGI_FORMAT_R8G8B8A8_UNORM;
+            desc.BindFlags = D3D11_BIND_UNORDERED_ACCESS;
+            hr             = m_pDevice->CreateTexture2D(&desc, nullptr, &m_pColorOutput);
+
+            D3D11_UNORDERED_ACCESS_VIEW_DESC UAVDesc = {};
+            UAVDesc.ViewDimension                    = D3D11_UAV_DIMENSION_TEXTURE2D;
+            UAVDesc.Texture2D.MipSlice               = 0;
+            UAVDesc.Format                           = DXGI_FORMAT_R8G8B8A8_UNORM;
+            hr = m_pDevice->CreateUnorderedAccessView(m_pColorOutput, &UAVDesc, &m_pColorOutputUav);
+        }
+
+        for (uint32_t i = 0; i < static_cast<uint32_t>(InternalResType::Count) && SUCCEEDED(hr); i++)
+        {
+            DXGI_FORMAT     fmt     = DXGI_FORMAT_UNKNOWN;
+            InternalResType resType = static_cast<InternalResType>(i);
+            fmt                     = GetInternalResFormat(resType);
+            assert(fmt != DXGI_FORMAT_UNKNOWN);
+
+            auto resolution = GetInternalResResolution(resType, width, height);
+            assert(resolution.first != 0);
+            assert(resolution.second != 0);
+
+            desc.Width     = resolution.first;
+            desc.Height    = resolution.second;
+            desc.Format    = fmt;
+            desc.BindFlags = 0;
+
+            UINT formatSupport{};
+            m_pDevice->CheckFormatSupport(fmt, &formatSupport);
+            if (formatSupport & D3D11_FORMAT_SUPPORT_TYPED_UNORDERED_ACCESS_VIEW)
+            {
+                desc.BindFlags |= D3D11_BIND_UNORDERED_ACCESS;
+            }
+
+            if (formatSupport & D3D11_FORMAT_SUPPORT_TEXTURE2D)
+            {
+                desc.BindFlags |= D3D11_BIND_SHADER_RESOURCE;
+            }
+
+            hr = m_pDevice->CreateTexture2D(&desc, nullptr, &m_internalResources[i]);
+
+            if (SUCCEEDED(hr))
+            {
+                hr = createViewFunc(m_internalResources[static_cast<size_t>(i)],
+                                    m_internalViews[static_cast<size_t>(i)]);
+            }
+        }
+
+        D3D11_BUFFER_DESC bufDesc   = {};
+        bufDesc.Usage               = D3D11_USAGE_DYNAMIC;
+        bufDesc.CPUAccessFlags      = D3D11_CPU_ACCESS_WRITE;
+        bufDesc.BindFlags           = D3D11_BIND_CONSTANT_BUFFER;
+        bufDesc.StructureByteStride = 0;
+
+        if (SUCCEEDED(hr))
+        {
+            bufDesc.ByteWidth = sizeof(ClearingConstParamStruct);
+            hr                = m_pDevice->CreateBuffer(&bufDesc,
+                                         nullptr,
+                                         &m_constantBuffers[static_cast<uint32_t>(ConstBufferType::Clearing)]);
+        }
+
+        if (SUCCEEDED(hr))
+        {
+            bufDesc.ByteWidth = sizeof(MVecParamStruct);
+            hr                = m_pDevice->CreateBuffer(&bufDesc,
+                                         nullptr,
+                                         &m_constantBuffers[static_cast<uint32_t>(ConstBufferType::Mevc)]);
+        }
+
+        if (SUCCEEDED(hr))
+        {
+            bufDesc.ByteWidth = sizeof(MergeParamStruct);
+            hr                = m_pDevice->CreateBuffer(&bufDesc,
+                                         nullptr,
+                                         &m_constantBuffers[static_cast<uint32_t>(ConstBufferType::Merge)]);
+        }
+
+        if (SUCCEEDED(hr))
+        {
+            bufDesc.ByteWidth = sizeof(PushPullParameters);
+            hr                = m_pDevice->CreateBuffer(&bufDesc,
+                                         nullptr,
+                                         &m_constantBuffers[static_cast<uint32_t>(ConstBufferType::PushPull)]);
+        }
+
+        if (SUCCEEDED(hr))
+        {
+            bufDesc.ByteWidth = sizeof(ResolutionConstParamStruct);
+            hr                = m_pDevice->CreateBuffer(&bufDesc,
+                                         nullptr,
+                                         &m_constantBuffers[static_cast<uint32_t>(ConstBufferType::Resolution)]);
+        }
+
+        return hr;
+    }
+
+    HRESULT InitResources(uint32_t width, uint32_t height)
+    {
+        HRESULT hr = InitStagingResources(width, height);
+
+        if (SUCCEEDED(hr))
+        {
+            hr = InitAlgoResources(width, height);
+        }
+
+        if (SUCCEEDED(hr))
+        {
+            m_width  = width;
+            m_height = height;
+
+            m_constBufData.dimensions[0]   = m_width;
+            m_constBufData.dimensions[1]   = m_height;
+            m_constBufData.viewportSize[0] = static_cast<float>(m_width);
+            m_constBufData.viewportSize[1] = static_cast<float>(m_height);
+            m_constBufData.viewportInv[0]  = 1.0 / static_cast<float>(m_width);
+            m_constBufData.viewportInv[1]  = 1.0 / static_cast<float>(m_height);
+        }
+
+        return hr;
+    }
+
+    HRESULT InitSamplerList()
+    {
+        HRESULT hr = S_OK;
+
+        {
+            D3D11_SAMPLER_DESC sampDesc = {
+                D3D11_FILTER_MIN_MAG_MIP_POINT,
+                D3D11_TEXTURE_ADDRESS_CLAMP,
+                D3D11_TEXTURE_ADDRESS_CLAMP,
+                D3D11_TEXTURE_ADDRESS_CLAMP,
+                0.0f,
+                1,
+                D3D11_COMPARISON_NEVER,
+                {0.0f, 0.0f, 0.0f, 0.0f},
+                0.0f,
+                D3D11_FLOAT32_MAX,
+            };
+            hr  = m_pDevice->CreateSamplerState(&sampDesc, &m_samplers[static_cast<uint32_t>(SamplerType::PointClamp)]);
+        }
+
+        {
+            D3D11_SAMPLER_DESC sampDesc = {
+                D3D11_FILTER_MIN_MAG_MIP_POINT,
+                D3D11_TEXTURE_ADDRESS_MIRROR,
+                D3D11_TEXTURE_ADDRESS_MIRROR,
+                D3D11_TEXTURE_ADDRESS_MIRROR,
+                0.0f,
+                1,
+                D3D11_COMPARISON_NEVER,
+                {0.0f, 0.0f, 0.0f, 0.0f},
+                0.0f,
+                D3D11_FLOAT32_MAX,
+            };
+            hr = m_pDevice->CreateSamplerState(&sampDesc, &m_samplers[static_cast<uint32_t>(SamplerType::PointMirror)]);
+        }
+
+        {
+            D3D11_SAMPLER_DESC sampDesc = {
+                D3D11_FILTER_MIN_MAG_MIP_LINEAR,
+                D3D11_TEXTURE_ADDRESS_CLAMP,
+                D3D11_TEXTURE_ADDRESS_CLAMP,
+                D3D11_TEXTURE_ADDRESS_CLAMP,
+                0.0f,
+                1,
+                D3D11_COMPARISON_NEVER,
+                {0.0f, 0.0f, 0.0f, 0.0f},
+                0.0f,
+                D3D11_FLOAT32_MAX,
+            };
+
+            hr = m_pDevice->CreateSamplerState(&sampDesc, &m_samplers[static_cast<uint32_t>(SamplerType::LinearClamp)]);
+        }
+
+        {
+            D3D11_SAMPLER_DESC sampDesc = {
+                D3D11_FILTER_MIN_MAG_MIP_LINEAR,
+                D3D11_TEXTURE_ADDRESS_MIRROR,
+                D3D11_TEXTURE_ADDRESS_MIRROR,
+                D3D11_TEXTURE_ADDRESS_MIRROR,
+                0.0f,
+                1,
+                D3D11_COMPARISON_NEVER,
+                {0.0f, 0.0f, 0.0f, 0.0f},
+                0.0f,
+                D3D11_FLOAT32_MAX,
+            };
+
+            hr = m_pDevice->CreateSamplerState(&sampDesc, &m_samplers[static_cast<uint32_t>(SamplerType::LinearMirror)]);
+        }
+
+        {
+            D3D11_SAMPLER_DESC sampDesc = {
+                D3D11_FILTER_ANISOTROPIC,
+                D3D11_TEXTURE_ADDRESS_CLAMP,
+                D3D11_TEXTURE_ADDRESS_CLAMP,
+                D3D11_TEXTURE_ADDRESS_CLAMP,
+                0.0f,
+                1,
+                D3D11_COMPARISON_NEVER,
+                {0.0f, 0.0f, 0.0f, 0.0f},
+                0.0f,
+                D3D11_FLOAT32_MAX,
+            };
+
+            hr = m_pDevice->CreateSamplerState(&sampDesc, &m_samplers[static_cast<uint32_t>(SamplerType::AnisoClamp)]);
+        }
+
+        return hr;
+    }
+
+    HRESULT CreateComputeShader(ID3D11ComputeShader** ppShader, const std::string& dxbcFile)
+    {
+        HRESULT           hr   = E_FAIL;
+        const std::string path = m_shaderDirectory.empty() ? dxbcFile : m_shaderDirectory + "/" + dxbcFile;
+        std::ifstream     f(path);
+        if (f.is_open())
+        {
+            std::vector<uint8_t> result = AcquireFileContent(path);
+            hr = m_pDevice->CreateComputeShader(static_cast<void*>(result.data()), result.size(), nullptr, ppShader);
+        }
+        return hr;
+    }
+
+    bool MapStaging(StagResType stagType, PitchedSurface& surface)
+    {
+        ID3D11Texture2D*     pStaging = m_stagResources[static_cast<size_t>(stagType)];
+        D3D11_TEXTURE2D_DESC desc     = {};
+        pStaging->GetDesc(&desc);
+
+        D3D11_MAPPED_SUBRESOURCE mapped = {};
+        if (FAILED(m_pContext->Map(pStaging, 0, D3D11_MAP_WRITE, 0, &mapped)))
+        {
+            return false;
+        }
+        surface = {static_cast<uint8_t*>(mapped.pData),
+                   mapped.RowPitch,
+                   desc.Width,
+                   desc.Height,
+                   GetFormatBytesPerPixel(desc.Format)};
+        return true;
+    }
+
+    void UnmapStaging(StagResType stagType, InputResType inputType)
+    {
+        ID3D11Texture2D* pStaging = m_stagResources[static_cast<size_t>(stagType)];
+        m_pContext->Unmap(pStaging, 0);
+        m_pContext->CopyResource(m_inputResources[static_cast<size_t>(inputType)], pStaging);
+    }
+
+    // Maps the staging texture, lets fill() write straight into it at the driver's row pitch and copies it to the input.
+    template <typename FillFunc>
+    bool UploadInput(StagResType stagType, InputResType inputType, FillFunc&& fill)
+    {
+        PitchedSurface surface = {};
+        if (!MapStaging(stagType, surface))
+        {
+            return false;
+        }
+        bool result = fill(surface);
+        UnmapStaging(stagType, inputType);
+        return result;
+    }
+
+    void SwapInputs(InputResType prev, InputResType curr)
+    {
+        std::swap(m_inputResources[static_cast<size_t>(prev)], m_inputResources[static_cast<size_t>(curr)]);
+        std::swap(m_inputViews[static_cast<size_t>(prev)], m_inputViews[static_cast<size_t>(curr)]);
+    }
+
+    enum class MotionSource
+    {
+        Plane,       // the submitted motion plane
+        Synthesized, // reprojected from the frame's own depth and ClipToPrevClip
+        None,        // neither is available; the frame is incomplete
+    };
+
+    // Motion is synthesized when FG_CONTEXT_SYNTHESIZE_MOTION is set or no motion was submitted.
+    MotionSource GetMotionSource(const FgFrameDesc& frame) const
+    {
+        if ((m_flags & FG_CONTEXT_SYNTHESIZE_MOTION) == 0 && frame.motion.pData != nullptr && frame.motion.size != 0)
+        {
+            return MotionSource::Plane;
+        }
+
+        const size_t depthStride = static_cast<size_t>(m_width) * GetDepthBytesPerPixel(m_depthFormat);
+        if (!m_canSynthesize || frame.pClipInfo == nullptr || frame.depth.pData == nullptr ||
+            (frame.depth.rowPitch != 0 && frame.depth.rowPitch != depthStride) || frame.depth.size < depthStride * m_height)
+        {
+            return MotionSource::None;
+        }
+        return MotionSource::Synthesized;
+    }
+
+    static const float* GetClipToPrevClip(const FgFrameDesc& frame)
+    {
+        return frame.pClipInfo + offsetof(ClipInfo, clipToPrevClip) / sizeof(float);
+    }
+
+    // Uploads a submitted frame into the Curr inputs. Returns false if any of them was missing or too short.
+    bool UploadFrame(const FgFrameDesc& frame)
+    {
+        const MotionSource motion = GetMotionSource(frame);
+        if (m_pTeam && (m_flags & FG_CONTEXT_LOW_LATENCY) != 0)
+        {
+            return UploadFrameWithTeam(frame, motion);
+        }
+
+        auto uploadPlane = [this](StagResType stagType, InputResType inputType, const FgPlane& plane) {
+            return UploadInput(stagType, inputType, [&plane](const PitchedSurface& surface) {
+                return CopyPlaneToSurface(surface, plane);
+            });
+        };
+
+        bool complete = UploadInput(StagResType::ColorInput, InputResType::CurrColor, [&frame](const PitchedSurface& surface) {
+            return frame.colorEncoding == FG_COLOR_IMAGE
+                       ? DecodeImageToSurface(surface, static_cast<const uint8_t*>(frame.color.pData), frame.color.size)
+                       : CopyPlaneToSurface(surface, frame.color);
+        });
+        complete &= uploadPlane(StagResType::Depth, InputResType::CurrDepth, frame.depth);
+
+        switch (motion)
+        {
+        case MotionSource::Plane:
+            return uploadPlane(StagResType::Mevc, InputResType::CurrMevc, frame.motion) && complete;
+        case MotionSource::Synthesized:
+            return UploadInput(StagResType::Mevc, InputResType::CurrMevc, [&](const PitchedSurface& surface) {
+                       return SynthesizeCameraMotion(static_cast<const uint8_t*>(frame.depth.pData),
+                                                     m_depthFormat,
+                                                     GetClipToPrevClip(frame),
+                                                     m_mevcFormat,
+                                                     surface,
+                                                     m_pPool);
+                   }) &&
+                   complete;
+        default:
+            return false;
+        }
+    }
+
+    // Adds one item per band of UploadBandRows rows that copies the band of the plane into the surface.
+    static void AddPlaneBands(std::vector<std::function<bool()>>& items,
+                              const PitchedSurface&               surface,
+                              const FgPlane&                      plane)
+    {
+        const size_t stride = static_cast<size_t>(surface.width) * surface.bytesPerPixel;
+        const size_t pitch  = plane.rowPitch != 0 ? plane.rowPitch : stride;
+        const auto*  pSrc   = static_cast<const uint8_t*>(plane.pData);
+        for (uint32_t y = 0; y < surface.height; y += UploadBandRows)
+        {
+            PitchedSurface band = surface;
+            band.pData += static_cast<size_t>(y) * surface.rowPitch;
+            band.height = (std::min)(UploadBandRows, surface.height - y);
+
+            const size_t offset = static_cast<size_t>(y) * pitch;
+            FgPlane      part   = plane;
+            part.pData = pSrc != nullptr ? pSrc + (std::min)(offset, plane.size) : nullptr;
+            part.size  = plane.size > offset ? plane.size - offset : 0;
+            items.push_back([band, part]() { return CopyPlaneToSurface(band, part); });
+        }
+    }
+
+    // FG_CONTEXT_LOW_LATENCY: maps every staging texture first and fills them all in one phase of the worker team, as
+    // bands of the planes, the colour image as a single item and tiles of synthesized motion. Between the maps and the
+    // copies there is only the team's barrier instead of a thread pool round trip per input.
+    bool UploadFrameWithTeam(const FgFrameDesc& frame, MotionSource motion)
+    {
+        struct Target
+        {
+            StagResType    stagType;
+            InputResType   inputType;
+            PitchedSurface surface;
+        };
+        Target targets[] = {
+            {StagResType::ColorInput, InputResType::CurrColor, {}},
+            {StagResType::Depth,      InputResType::CurrDepth, {}},
+            {StagResType::Mevc,       InputResType::CurrMevc,  {}},
+        };
+        const size_t count  = motion == MotionSource::None ? 2 : 3;
+        size_t       mapped = 0;
+        while (mapped < count && MapStaging(targets[mapped].stagType, targets[mapped].surface))
+        {
+            mapped++;
+        }
+
+        bool complete = mapped == count;
+        if (complete)
+        {
+            std::vector<std::function<bool()>> items;
+            const PitchedSurface&              color = targets[0].surface;
+            if (frame.colorEncoding == FG_COLOR_IMAGE)
+            {
+                const auto* pImage = static_cast<const uint8_t*>(frame.color.pData);
+                items.push_back([&frame, &color, pImage]() {
+                    return DecodeImageToSurface(color, pImage, frame.color.size);
+                });
+            }
+            else
+            {
+                AddPlaneBands(items, color, frame.color);
+            }
+            AddPlaneBands(items, targets[1].surface, frame.depth);
+
+            const PitchedSurface& mevc = targets[2].surface;
+            if (motion == MotionSource::Plane)
+            {
+                AddPlaneBands(items, mevc, frame.motion);
+            }
+            else if (motion == MotionSource::Synthesized)
+            {
+                if (!CanSynthesizeCameraMotion(m_depthFormat, m_mevcFormat, mevc))
+                {
+                    complete = false;
+                }
+                else
+                {
+                    const uint32_t tileSize = m_pPool->TileSize();
+                    for (uint32_t y = 0; y < mevc.height; y += tileSize)
+                    {
+                        for (uint32_t x = 0; x < mevc.width; x += tileSize)
+                        {
+                            TileRect tile = {x, y, (std::min)(tileSize, mevc.width - x),
+                                             (std::min)(tileSize, mevc.height - y)};
+                            items.push_back([this, &frame, &mevc, tile]() {
+                                SynthesizeCameraMotionTile(static_cast<const uint8_t*>(frame.depth.pData),
+                                                           m_depthFormat,
+                                                           GetClipToPrevClip(frame),
+                                                           m_mevcFormat,
+                                                           mevc,
+                                                           tile);
+                                return true;
+                            });
+                        }
+                    }
+                }
+            }
+
+            std::atomic<bool> failed{false};
+            m_pTeam->Run({{static_cast<uint32_t>(items.size()), [&items, &failed](uint32_t i) {
+                               if (!items[i]())
+                               {
+                                   failed = true;
+                               }
+                           }}});
+            complete = complete && !failed;
+        }
+
+        for (size_t i = 0; i < mapped; i++)
+        {
+            UnmapStaging(targets[i].stagType, targets[i].inputType);
+        }
+        return complete && motion != MotionSource::None;
+    }
+
+    // Hands a mapped output to the callback, or keeps a copy for fgReceiveFrame.
+    void Deliver(const FgOutputFrame& frame)
+    {
+        if (m_callback != nullptr)
+        {
+            m_callback(m_pUserData, &frame);
+            return;
+        }
+
+        ReceivedFrame received;
+        const size_t  stride = static_cast<size_t>(frame.width) * 4;
+        received.frame       = frame;
+        received.frame.rowPitch = static_cast<uint32_t>(stride);
+        received.frame.pPixels  = nullptr;
+        received.pixels.resize(stride * frame.height);
+        for (uint32_t y = 0; y < frame.height; y++)
+        {
+            memcpy(received.pixels.data() + y * stride, frame.pPixels + static_cast<size_t>(y) * frame.rowPitch, stride);
+        }
+        m_received.push_back(std::move(received));
+    }
+
+    // Maps the oldest pending readback and delivers its pixels. With wait == false it gives up as soon as the GPU has
+    // not finished the copy, so delivery always stays in submission order.
+    bool RetireReadback(bool wait)
+    {
+        if (m_pendingReadbacks.empty())
+        {
+            return false;
+        }
+
+        PendingReadback&         pending  = m_pendingReadbacks.front();
+        ID3D11Texture2D*         pTexture = m_readbackRing[pending.slot];
+        D3D11_MAPPED_SUBRESOURCE mapped   = {};
+        HRESULT hr = m_pContext->Map(pTexture, 0, D3D11_MAP_READ, wait ? 0 : D3D11_MAP_FLAG_DO_NOT_WAIT, &mapped);
+        if (hr == DXGI_ERROR_WAS_STILL_DRAWING)
+        {
+            return false;
+        }
+
+        if (SUCCEEDED(hr))
+        {
+            FgOutputFrame frame = pending.frame;
+            frame.rowPitch      = mapped.RowPitch;
+            frame.pPixels       = static_cast<const uint8_t*>(mapped.pData);
+            Deliver(frame);
+            m_pContext->Unmap(pTexture, 0);
+        }
+        else
+        {
+            m_readbackFailed = true;
+        }
+
+        m_pendingReadbacks.pop_front();
+        return true;
+    }
+
+    // Queues a copy of an RGBA8 texture into the readback ring. The frame is delivered once the copy has completed,
+    // which is picked up here on later calls or by FlushReadbacks; the caller only blocks when every slot of the ring
+    // is still in flight.
+    void QueueReadback(ID3D11Texture2D* pSource, const FgOutputFrame& frame)
+    {
+        if (m_pendingReadbacks.size() == m_readbackRing.size())
+        {
+            RetireReadback(true);
+        }
+
+        uint32_t slot      = m_nextReadbackSlot;
+        m_nextReadbackSlot = (m_nextReadbackSlot + 1) % static_cast<uint32_t>(m_readbackRing.size());
+
+        m_pContext->CopyResource(m_readbackRing[slot], pSource);
+        m_pContext->Flush();
+
+        m_pendingReadbacks.push_back({slot, frame});
+
+        while (m_pendingReadbacks.size() > 1 && RetireReadback(false))
+        {
+        }
+    }
+
+    void FlushReadbacks()
+    {
+        while (RetireReadback(true))
+        {
+        }
+    }
+
+    bool TakeReadbackError()
+    {
+        bool failed      = m_readbackFailed;
+        m_readbackFailed = false;
+        return failed;
+    }
+
+    void ProcessFrameGenerationClearing(ClearingConstParamStruct* pCb, uint32_t grid[])
+    {
+        m_pContext->CSSetShader(m_computeShaders[static_cast<uint32_t>(ComputeShaderType::Clear)], nullptr, 0);
+        ID3D11UnorderedAccessView* ppUavs[] = {
+            m_internalViews[static_cast<uint32_t>(InternalResType::ReprojectedFullX)].uav,
+            m_internalViews[static_cast<uint32_t>(InternalResType::ReprojectedFullY)].uav,
+            m_internalViews[static_cast<uint32_t>(InternalResType::ReprojectedHalfTipX)].uav,
+            m_internalViews[static_cast<uint32_t>(InternalResType::ReprojectedHalfTipY)].uav,
+            m_internalViews[static_cast<uint32_t>(InternalResType::ReprojectedHalfTopX)].uav,
+            m_internalViews[static_cast<uint32_t>(InternalResType::ReprojectedHalfTopY)].uav,
+        };
+
+        m_pContext->CSSetUnorderedAccessViews(0, 6, ppUavs, nullptr);
+
+        ID3D11Buffer*            buf    = m_constantBuffers[static_cast<uint32_t>(ConstBufferType::Clearing)];
+        D3D11_MAPPED_SUBRESOURCE mapped = {};
+        m_pContext->Map(buf, 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped);
+        memcpy(mapped.pData, pCb, mapped.RowPitch);
+        m_pContext->Unmap(buf, 0);
+
+        m_pContext->CSSetConstantBuffers(0, 1, &buf);
+        m_pContext->Dispatch(grid[0], grid[1], grid[2]);
+
+        ID3D11UnorderedAccessView* emptyUavs[6] = {nullptr};
+
+        m_pContext->CSSetUnorderedAccessViews(0, 6, emptyUavs, nullptr);
+    }
+
+    void ProcessFrameGenerationReprojection(MVecParamStruct* pCb, uint32_t grid[])
+    {
+        m_pContext->CSSetShader(m_computeShaders[static_cast<uint32_t>(ComputeShaderType::Reprojection)], nullptr, 0);
+
+        ID3D11ShaderResourceView* ppSrvs[] = {
+            m_internalViews[static_cast<uint32_t>(InternalResType::PrevMevcFiltered)].srv,
+            m_internalViews[static_cast<uint32_t>(InternalResType::CurrMevcFiltered)].srv,
+            m_inputViews[static_cast<uint32_t>(InputResType::PrevDepth)].srv,
+            m_inputViews[static_cast<uint32_t>(InputResType::CurrDepth)].srv};
+        m_pContext->CSSetShaderResources(0, 4, ppSrvs);
+
+        ID3D11UnorderedAccessView* ppUavs[] = {
+            m_internalViews[static_cast<uint32_t>(InternalResType::ReprojectedFullX)].uav,
+            m_internalViews[static_cast<uint32_t>(InternalResType::ReprojectedFullY)].uav,
+            m_internalViews[static_cast<uint32_t>(InternalResType::ReprojectedHalfTipX)].uav,
+            m_internalViews[static_cast<uint32_t>(InternalResType::ReprojectedHalfTipY)].uav,
+            m_internalViews[static_cast<uint32_t>(InternalResType::ReprojectedHalfTopX)].uav,
+            m_internalViews[static_cast<uint32_t>(InternalResType::ReprojectedHalfTopY)].uav,
+        };
+
+        m_pContext->CSSetUnorderedAccessViews(0, 6, ppUavs, nullptr);
+
+        ID3D11Buffer*            buf    = m_constantBuffers[static_cast<uint32_t>(ConstBufferType::Mevc)];
+        D3D11_MAPPED_SUBRESOURCE mapped = {};
+        m_pContext->Map(buf, 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped);
+        memcpy(mapped.pData, pCb, mapped.RowPitch);
+        m_pContext->Unmap(buf, 0);
+
+        m_pContext->CSSetSamplers(0, 1, &m_samplers[static_cast<uint32_t>(SamplerType::LinearClamp)]);
+        m_pContext->CSSetConstantBuffers(0, 1, &buf);
+        m_pContext->Dispatch(grid[0], grid[1], grid[2]);
+
+        ID3D11UnorderedAccessView* emptyUavs[6] = {nullptr};
+        m_pContext->CSSetUnorderedAccessViews(0, 6, emptyUavs, nullptr);
+        ID3D11ShaderResourceView* emptySrvs[4] = {nullptr};
+        m_pContext->CSSetShaderResources(0, 4, emptySrvs);
+    }
+
+    void ProcessFrameGenerationMerging(MergeParamStruct* pCb, uint32_t grid[])
+    {
+        {
+            m_pContext->CSSetShader(m_computeShaders[static_cast<uint32_t>(ComputeShaderType::MergeHalf)], nullptr, 0);
+
+            ID3D11UnorderedAccessView* ppUavs[] = {
+                m_internalViews[static_cast<uint32_t>(InternalResType::ReprojectedHalfTipX)].uav,
+                m_internalViews[static_cast<uint32_t>(InternalResType::ReprojectedHalfTipY)].uav,
+                m_internalViews[static_cast<uint32_t>(InternalResType::ReprojectedHalfTopX)].uav,
+                m_internalViews[static_cast<uint32_t>(InternalResType::ReprojectedHalfTopY)].uav,
+                m_internalViews[static_cast<uint32_t>(InternalResType::ReprojectedHalfTip)].uav,
+                m_internalViews[static_cast<uint32_t>(InternalResType::ReprojectedHalfTop)].uav,
+            };
+            m_pContext->CSSetUnorderedAccessViews(0, 6, ppUavs, nullptr);
+
+            ID3D11ShaderResourceView* ppSrvs[] = {
+                m_internalViews[static_cast<uint32_t>(InternalResType::CurrMevcFiltered)].srv,
+                m_internalViews[static_cast<uint32_t>(InternalResType::PrevMevcFiltered)].srv,
+                m_inputViews[static_cast<uint32_t>(InputResType::CurrDepth)].srv,
+                m_inputViews[static_cast<uint32_t>(InputResType::PrevDepth)].srv};
+            m_pContext->CSSetShaderResources(0, 4, ppSrvs);
+
+            ID3D11Buffer*            buf    = m_constantBuffers[static_cast<uint32_t>(ConstBufferType::Merge)];
+            D3D11_MAPPED_SUBRESOURCE mapped = {};
+            m_pContext->Map(buf, 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped);
+            memcpy(mapped.pData, pCb, mapped.RowPitch);
+            m_pContext->Unmap(buf, 0);
+
+            m_pContext->CSSetConstantBuffers(0, 1, &buf);
+
+            m_pContext->CSSetSamplers(0, 1, &m_samplers[static_cast<uint32_t>(SamplerType::LinearClamp)]);
+
+            m_pContext->Dispatch(grid[0], grid[1], grid[2]);
+
+            ID3D11UnorderedAccessView* emptyUavs[6] = {nullptr};
+            m_pContext->CSSetUnorderedAccessViews(0, 6, emptyUavs, nullptr);
+            ID3D11ShaderResourceView* emptySrvs[4] = {nullptr};
+            m_pContext->CSSetShaderResources(0, 4, emptySrvs);
+        }
+
+        {
+            m_pContext->CSSetShader(m_computeShaders[static_cast<uint32_t>(ComputeShaderType::MergeFull)], nullptr, 0);
+            ID3D11UnorderedAccessView* ppUavs[] = {
+                m_internalViews[static_cast<uint32_t>(InternalResType::ReprojectedFullX)].uav,
+                m_internalViews[static_cast<uint32_t>(InternalResType::ReprojectedFullY)].uav,
+                m_internalViews[static_cast<uint32_t>(InternalResType::ReprojectedFull)].uav,
+            };
+            m_pContext->CSSetUnorderedAccessViews(0, 3, ppUavs, nullptr);
+
+            ID3D11ShaderResourceView* ppSrvs[] = {
+                m_internalViews[static_cast<uint32_t>(InternalResType::CurrMevcFiltered)].srv,
+                m_inputViews[static_cast<uint32_t>(InputResType::PrevDepth)].srv};
+            m_pContext->CSSetShaderResources(0, 2, ppSrvs);
+
+            m_pContext->CSSetSamplers(0, 1, &m_samplers[static_cast<uint32_t>(SamplerType::LinearClamp)]);
+
+            m_pContext->Dispatch(grid[0], grid[1], grid[2]);
+
+            ID3D11UnorderedAccessView* emptyUavs[3] = {nullptr};
+            m_pContext->CSSetUnorderedAccessViews(0, 3, emptyUavs, nullptr);
+            ID3D11ShaderResourceView* emptySrvs[2] = {nullptr};
+            m_pContext->CSSetShaderResources(0, 2, emptySrvs);
+        }
+    }
+
+    void AddPushPullPasses(ID3D11Texture2D* pInput, ID3D11Texture2D* pOutput, const int layers)
+    {
+        if (layers == 0)
+        {
+            m_pContext->CopyResource(pOutput, pInput);
+            return;
+        }
+
+        PushPullParameters ppParameters  = {};
+        ppParameters.FinerDimension[0]   = m_width;
+        ppParameters.FinerDimension[1]   = m_height;
+        ppParameters.CoarserDimension[0] = ppParameters.FinerDimension[0] / 2;
+        ppParameters.CoarserDimension[1] = ppParameters.FinerDimension[1] / 2;
+
+        ID3D11Buffer* buf = m_constantBuffers[static_cast<uint32_t>(ConstBufferType::PushPull)];
+
+        PushPullParameters ppParametersLv01 = ppParameters;
+        // Pulling
+        if (layers >= 1)
+        {
+            m_pContext->CSSetShader(m_computeShaders[static_cast<uint32_t>(ComputeShaderType::FirstLeg)], nullptr, 0);
+            m_pContext->CSSetShaderResources(0, 1, &m_resourceViews[pInput].srv);
+
+            ID3D11UnorderedAccessView* ppUavs[] = {
+                m_internalViews[static_cast<uint32_t>(InternalResType::MotionVectorLv1)].uav,
+                m_internalViews[static_cast<uint32_t>(InternalResType::ReliabilityLv1)].uav};
+            m_pContext->CSSetUnorderedAccessViews(0, 2, ppUavs, nullptr);
+
+            D3D11_MAPPED_SUBRESOURCE mapped = {};
+            m_pContext->Map(buf, 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped);
+            memcpy(mapped.pData, &ppParametersLv01, mapped.RowPitch);
+            m_pContext->Unmap(buf, 0);
+            m_pContext->CSSetConstantBuffers(0, 1, &buf);
+
+            uint32_t grid[] = {(ppParametersLv01.CoarserDimension[0] + 8 - 1) / 8,
+                               (ppParametersLv01.CoarserDimension[1] + 8 - 1) / 8,
+                               1};
+            m_pContext->Dispatch(grid[0], grid[1], grid[2]);
+
+            ID3D11UnorderedAccessView* emptyUavs[2] = {nullptr};
+            m_pContext->CSSetUnorderedAccessViews(0, 2, emptyUavs, nullptr);
+            ID3D11ShaderResourceView* emptySrvs[1] = { nullptr };
+            m_pContext->CSSetShaderResources(0, 1, emptySrvs);
+        }
+
+        PushPullParameters ppParametersLv12;
+        ppParametersLv12.FinerDimension[0]   = ppParametersLv01.FinerDimension[0] / 2;
+        ppParametersLv12.FinerDimension[1]   = ppParametersLv01.FinerDimension[1] / 2;
+        ppParametersLv12.CoarserDimension[0] = ppParametersLv01.CoarserDimension[0] / 2;
+        ppParametersLv12.CoarserDimension[1] = ppParametersLv01.CoarserDimension[1] / 2;
+        if (layers >= 2)
+        {
+            m_pContext->CSSetShader(m_computeShaders[static_cast<uint32_t>(ComputeShaderType::Pull)], nullptr, 0);
+
+            ID3D11ShaderResourceView* ppSrvs[] = {
+                m_internalViews[static_cast<uint32_t>(InternalResType::MotionVectorLv1)].srv,
+                m_internalViews[static_cast<uint32_t>(InternalResType::ReliabilityLv1)].srv};
+
+            m_pContext->CSSetShaderResources(0, 2, ppSrvs);
+
+            ID3D11UnorderedAccessView* ppUavs[] = {
+                m_internalViews[static_cast<uint32_t>(InternalResType::MotionVectorLv2)].uav,
+                m_internalViews[static_cast<uint32_t>(InternalResType::ReliabilityLv2)].uav};
+            m_pContext->CSSetUnorderedAccessViews(0, 2, ppUavs, nullptr);
+
+            D3D11_MAPPED_SUBRESOURCE mapped = {};
+            m_pContext->Map(buf, 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped);
+            memcpy(mapped.pData, &ppParametersLv12, mapped.RowPitch);
+            m_pContext->Unmap(buf, 0);
+            m_pContext->CSSetConstantBuffers(0, 1, &buf);
+
+            uint32_t grid[] = {(ppParametersLv12.CoarserDimension[0] + 8 - 1) / 8,
+                               (ppParametersLv12.CoarserDimension[1] + 8 - 1) / 8,
+                               1};
+            m_pContext->Dispatch(grid[0], grid[1], grid[2]);
+
+            ID3D11UnorderedAccessView* emptyUavs[2] = {nullptr};
+            m_pContext->CSSetUnorderedAccessViews(0, 2, emptyUavs, nullptr);
+            ID3D11ShaderResourceView* emptySrvs[2] = { nullptr };
+            m_pContext->CSSetShaderResources(0, 2, emptySrvs);
+        }
+
+        PushPullParameters ppParametersLv23;
+        ppParametersLv23.FinerDimension[0]   = ppParametersLv12.FinerDimension[0] / 2;
+        ppParametersLv23.FinerDimension[1]   = ppParametersLv12.FinerDimension[1] / 2;
+        ppParametersLv23.CoarserDimension[0] = ppParametersLv12.CoarserDimension[0] / 2;
+        ppParametersLv23.CoarserDimension[1] = ppParametersLv12.CoarserDimension[1] / 2;
+
+        if (layers >= 3)
+        {
+            m_pContext->CSSetShader(m_computeShaders[static_cast<uint32_t>(ComputeShaderType::Pull)], nullptr, 0);
+
+            ID3D11ShaderResourceView* ppSrvs[] = {
+                m_internalViews[static_cast<uint32_t>(InternalResType::MotionVectorLv2)].srv,
+                m_internalViews[static_cast<uint32_t>(InternalResType::ReliabilityLv2)].srv};
+
+            m_pContext->CSSetShaderResources(0, 2, ppSrvs);
+
+            ID3D11UnorderedAccessView* ppUavs[] = {
+                m_internalViews[static_cast<uint32_t>(InternalResType::MotionVectorLv3)].uav,
+                m_internalViews[static_cast<uint32_t>(InternalResType::ReliabilityLv3)].uav};
+            m_pContext->CSSetUnorderedAccessViews(0, 2, ppUavs, nullptr);
+
+            D3D11_MAPPED_SUBRESOURCE mapped = {};
+            m_pContext->Map(buf, 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped);
+            memcpy(mapped.pData, &ppParametersLv23, mapped.RowPitch);
+            m_pContext->Unmap(buf, 0);
+            m_pContext->CSSetConstantBuffers(0, 1, &buf);
+
+            uint32_t grid[] = {(ppParametersLv23.CoarserDimension[0] + 8 - 1) / 8,
+                               (ppParametersLv23.CoarserDimension[1] + 8 - 1) / 8,
+                               1};
+            m_pContext->Dispatch(grid[0], grid[1], grid[2]);
+
+            ID3D11UnorderedAccessView* emptyUavs[2] = {nullptr};
+            m_pContext->CSSetUnorderedAccessViews(0, 2, emptyUavs, nullptr);
+            ID3D11ShaderResourceView* emptySrvs[2] = { nullptr };
+            m_pContext->CSSetShaderResources(0, 2, emptySrvs);
+        }
+
+        if (layers >= 3)
+        {
+            m_pContext->CSSetShader(m_computeShaders[static_cast<uint32_t>(ComputeShaderType::Push)], nullptr, 0);
+
+            ID3D11ShaderResourceView* ppSrvs[] = {
+                m_internalViews[static_cast<uint32_t>(InternalResType::MotionVectorLv2)].srv,
+                m_internalViews[static_cast<uint32_t>(InternalResType::MotionVectorLv3)].srv,
+                m_internalViews[static_cast<uint32_t>(InternalResType::ReliabilityLv2)].srv,
+                m_internalViews[static_cast<uint32_t>(InternalResType::ReliabilityLv3)].srv,
+            };
+            m_pContext->CSSetShaderResources(0, 4, ppSrvs);
+
+            m_pContext->CSSetUnorderedAccessViews(
+                0,
+                1,
+                &m_internalViews[static_cast<uint32_t>(InternalResType::PushedVectorLv2)].uav,
+                nullptr);
+
+            D3D11_MAPPED_SUBRESOURCE mapped = {};
+            m_pContext->Map(buf, 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped);
+            memcpy(mapped.pData, &ppParametersLv23, mapped.RowPitch);
+            m_pContext->Unmap(buf, 0);
+            m_pContext->CSSetConstantBuffers(0, 1, &buf);
+
+            uint32_t grid[] = {(ppParametersLv23.FinerDimension[0] + 8 - 1) / 8,
+                               (ppParametersLv23.FinerDimension[1] + 8 - 1) / 8,
+                               1};
+            m_pContext->Dispatch(grid[0], grid[1], grid[2]);
+
+            ID3D11UnorderedAccessView* emptyUavs[1] = {nullptr};
+            m_pContext->CSSetUnorderedAccessViews(0, 1, emptyUavs, nullptr);
+            ID3D11ShaderResourceView* emptySrvs[4] = { nullptr };
+            m_pContext->CSSetShaderResources(0, 4, emptySrvs);
+        }
+
+        if (layers >= 2)
+        {
+            m_pContext->CSSetShader(m_computeShaders[static_cast<uint32_t>(ComputeShaderType::Push)], nullptr, 0);
+
+            ID3D11ShaderResourceView* ppSrvs[] = {
+                m_internalViews[static_cast<uint32_t>(InternalResType::MotionVectorLv1)].srv,
+                layers >= 3 ? m_internalViews[static_cast<uint32_t>(InternalResType::PushedVectorLv2)].srv
+                            : m_internalViews[static_cast<uint32_t>(InternalResType::MotionVectorLv2)].srv,
+                m_internalViews[static_cast<uint32_t>(InternalResType::ReliabilityLv1)].srv,
+                m_internalViews[static_cast<uint32_t>(InternalResType::ReliabilityLv2)].srv,
+            };
+            m_pContext->CSSetShaderResources(0, 4, ppSrvs);
+
+            m_pContext->CSSetUnorderedAccessViews(
+                0,
+                1,
+                &m_internalViews[static_cast<uint32_t>(InternalResType::PushedVectorLv1)].uav,
+                nullptr);
+
+            D3D11_MAPPED_SUBRESOURCE mapped = {};
+            m_pContext->Map(buf, 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped);
+            memcpy(mapped.pData, &ppParametersLv12, mapped.RowPitch);
+            m_pContext->Unmap(buf, 0);
+            m_pContext->CSSetConstantBuffers(0, 1, &buf);
+
+            uint32_t grid[] = {(ppParametersLv12.FinerDimension[0] + 8 - 1) / 8,
+                               (ppParametersLv12.FinerDimension[1] + 8 - 1) / 8,
+                               1};
+            m_pContext->Dispatch(grid[0], grid[1], grid[2]);
+
+            ID3D11UnorderedAccessView* emptyUavs[1] = {nullptr};
+            m_pContext->CSSetUnorderedAccessViews(0, 1, emptyUavs, nullptr);
+            ID3D11ShaderResourceView* emptySrvs[4] = { nullptr };
+            m_pContext->CSSetShaderResources(0, 4, emptySrvs);
+        }
+
+        if (layers >= 1)
+        {
+            m_pContext->CSSetShader(m_computeShaders[static_cast<uint32_t>(ComputeShaderType::LastStretch)], nullptr, 0);
+
+            ID3D11ShaderResourceView* ppSrvs[] = {
+                m_resourceViews[pInput].srv,
+                layers >= 2 ? m_internalViews[static_cast<uint32_t>(InternalResType::PushedVectorLv1)].srv
+                            : m_internalViews[static_cast<uint32_t>(InternalResType::MotionVectorLv1)].srv,
+                m_internalViews[static_cast<uint32_t>(InternalResType::ReliabilityLv1)].srv};
+            m_pContext->CSSetShaderResources(0, 3, ppSrvs);
+
+            m_pContext->CSSetUnorderedAccessViews(0, 1, &m_resourceViews[pOutput].uav, nullptr);
+
+            D3D11_MAPPED_SUBRESOURCE mapped = {};
+            m_pContext->Map(buf, 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped);
+            memcpy(mapped.pData, &ppParametersLv01, mapped.RowPitch);
+            m_pContext->Unmap(buf, 0);
+            m_pContext->CSSetConstantBuffers(0, 1, &buf);
+
+            uint32_t grid[] = {(ppParametersLv01.FinerDimension[0] + 8 - 1) / 8,
+                               (ppParametersLv01.FinerDimension[1] + 8 - 1) / 8,
+                               1};
+            m_pContext->Dispatch(grid[0], grid[1], grid[2]);
+
+            ID3D11UnorderedAccessView* emptyUavs[1] = {nullptr};
+            m_pContext->CSSetUnorderedAccessViews(0, 1, emptyUavs, nullptr);
+            ID3D11ShaderResourceView* emptySrvs[3] = { nullptr };
+            m_pContext->CSSetShaderResources(0, 3, emptySrvs);
+        }
+    }
+
+    void ProcessFrameGenerationResolution(ResolutionConstParamStruct* pCb, uint32_t grid[])
+    {
+        m_pContext->CSSetShader(m_computeShaders[static_cast<uint32_t>(ComputeShaderType::Resolution)], nullptr, 0);
+
+        ID3D11ShaderResourceView* ppSrvs[] = {
+            m_inputViews[static_cast<uint32_t>(InputResType::PrevColor)].srv,
+            m_inputViews[static_cast<uint32_t>(InputResType::PrevDepth)].srv,
+            m_inputViews[static_cast<uint32_t>(InputResType::CurrColor)].srv,
+            m_inputViews[static_cast<uint32_t>(InputResType::CurrDepth)].srv,
+            m_internalViews[static_cast<uint32_t>(InternalResType::CurrMevcFiltered)].srv,
+            m_internalViews[static_cast<uint32_t>(InternalResType::ReprojectedFull)].srv,
+            m_internalViews[static_cast<uint32_t>(InternalResType::ReprojectedHalfTip)].srv,
+            m_internalViews[static_cast<uint32_t>(InternalResType::ReprojectedHalfTopFiltered)].srv};
+        m_pContext->CSSetShaderResources(0, 8, ppSrvs);
+
+        m_pContext->CSSetUnorderedAccessViews(0, 1, &m_pColorOutputUav, nullptr);
+
+        ID3D11Buffer*            buf    = m_constantBuffers[static_cast<uint32_t>(ConstBufferType::Resolution)];
+        D3D11_MAPPED_SUBRESOURCE mapped = {};
+        m_pContext->Map(buf, 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped);
+        memcpy(mapped.pData, pCb, mapped.RowPitch);
+        m_pContext->Unmap(buf, 0);
+
+        m_pContext->CSSetConstantBuffers(0, 1, &buf);
+        m_pContext->CSSetSamplers(0, 1, &m_samplers[static_cast<uint32_t>(SamplerType::LinearClamp)]);
+        m_pContext->Dispatch(grid[0], grid[1], grid[2]);
+
+        ID3D11UnorderedAccessView* emptyUavs[1] = {nullptr};
+        m_pContext->CSSetUnorderedAccessViews(0, 1, emptyUavs, 0);
+        ID3D11ShaderResourceView* emptySrvs[8] = {nullptr};
+        m_pContext->CSSetShaderResources(0, 8, emptySrvs);
+    }
+
+    // Generates m_interpolatedFrames frames between the Prev and Curr inputs and queues their readbacks.
+    void GeneratePair(uint64_t prevFrameId, uint64_t currFrameId, uint64_t timestampNs)
+    {
+        const uint32_t total = m_interpolatedFrames;
+
+        uint32_t grid[] = {(m_width + 8 - 1) / 8, (m_height + 8 - 1) / 8, 1};
+
+        for (uint32_t seq = 0; seq < total; seq++)
+        {
+            float tipDistance                = static_cast<float>(seq + 1) / static_cast<float>(total + 1);
+            float topDistance                = 1.0f - tipDistance;
+            m_constBufData.tipTopDistance[0] = tipDistance;
+            m_constBufData.tipTopDistance[1] = topDistance;
+
+            {
+                // Clearing
+                ClearingConstParamStruct cb = {};
+                memcpy(cb.dimensions, m_constBufData.dimensions, sizeof(cb.dimensions));
+                memcpy(cb.tipTopDistance, m_constBufData.tipTopDistance, sizeof(m_constBufData.tipTopDistance));
+                memcpy(cb.viewportInv, m_constBufData.viewportInv, sizeof(m_constBufData.viewportInv));
+                memcpy(cb.viewportSize, m_constBufData.viewportSize, sizeof(m_constBufData.viewportSize));
+                ProcessFrameGenerationClearing(&cb, grid);
+            }
+
+            AddPushPullPasses(m_inputResources[static_cast<uint32_t>(InputResType::CurrMevc)],
+                              m_internalResources[static_cast<uint32_t>(InternalResType::CurrMevcFiltered)],
+                              3);
+            AddPushPullPasses(m_inputResources[static_cast<uint32_t>(InputResType::PrevMevc)],
+                              m_internalResources[static_cast<uint32_t>(InternalResType::PrevMevcFiltered)],
+                              3);
+
+            {
+                // Reprojection
+                MVecParamStruct cb = {};
+                memcpy(cb.prevClipToClip, m_constBufData.prevClipToClip, sizeof(cb.prevClipToClip));
+                memcpy(cb.clipToPrevClip, m_constBufData.clipToPrevClip, sizeof(cb.clipToPrevClip));
+                memcpy(cb.dimensions, m_constBufData.dimensions, sizeof(cb.dimensions));
+                memcpy(cb.tipTopDistance, m_constBufData.tipTopDistance, sizeof(m_constBufData.tipTopDistance));
+                memcpy(cb.viewportInv, m_constBufData.viewportInv, sizeof(m_constBufData.viewportInv));
+                memcpy(cb.viewportSize, m_constBufData.viewportSize, sizeof(m_constBufData.viewportSize));
+                ProcessFrameGenerationReprojection(&cb, grid);
+            }
+
+            {
+                // Merging
+                MergeParamStruct cb = {};
+                memcpy(cb.prevClipToClip, m_constBufData.prevClipToClip, sizeof(cb.prevClipToClip));
+                memcpy(cb.clipToPrevClip, m_constBufData.clipToPrevClip, sizeof(cb.clipToPrevClip));
+                memcpy(cb.dimensions, m_constBufData.dimensions, sizeof(cb.dimensions));
+                memcpy(cb.tipTopDistance, m_constBufData.tipTopDistance, sizeof(m_constBufData.tipTopDistance));
+                memcpy(cb.viewportInv, m_constBufData.viewportInv, sizeof(m_constBufData.viewportInv));
+                memcpy(cb.viewportSize, m_constBufData.viewportSize, sizeof(m_constBufData.viewportSize));
+
+                ProcessFrameGenerationMerging(&cb, grid);
+            }
+
+            {
+                // Push Pull Pass
+                AddPushPullPasses(m_internalResources[static_cast<uint32_t>(InternalResType::ReprojectedFull)],
+                                  m_internalResources[static_cast<uint32_t>(InternalResType::ReprojectedFullFiltered)],
+                                  1);
+                AddPushPullPasses(m_internalResources[static_cast<uint32_t>(InternalResType::ReprojectedHalfTip)],
+                                  m_internalResources[static_cast<uint32_t>(InternalResType::ReprojectedHalfTipFiltered)],
+                                  1);
+                AddPushPullPasses(m_internalResources[static_cast<uint32_t>(InternalResType::ReprojectedHalfTop)],
+                                  m_internalResources[static_cast<uint32_t>(InternalResType::ReprojectedHalfTopFiltered)],
+                                  1);
+            }
+
+            {
+                // Resolution
+                ResolutionConstParamStruct cb = {};
+                memcpy(cb.dimensions, m_constBufData.dimensions, sizeof(cb.dimensions));
+                memcpy(cb.tipTopDistance, m_constBufData.tipTopDistance, sizeof(m_constBufData.tipTopDistance));
+                memcpy(cb.viewportInv, m_constBufData.viewportInv, sizeof(m_constBufData.viewportInv));
+                memcpy(cb.viewportSize, m_constBufData.viewportSize, sizeof(m_constBufData.viewportSize));
+                ProcessFrameGenerationResolution(&cb, grid);
+            }
+
+            QueueReadback(m_pColorOutput, {prevFrameId, currFrameId, timestampNs, seq, m_width, m_height, 0, nullptr});
+        }
+    }
+
+    ThreadPool*                 m_pPool = nullptr;
+    std::unique_ptr<ThreadPool> m_pOwnedPool;
+    std::unique_ptr<WorkerTeam> m_pTeam;
+    std::string                 m_shaderDirectory;
+
+    ID3D11Device*        m_pDevice  = nullptr;
+    ID3D11DeviceContext* m_pContext = nullptr;
+
+    std::array<ID3D11ComputeShader*, ComputeShaderTypeCount> m_computeShaders{};
+    std::array<ID3D11Texture2D*, StagTypeCount>              m_stagResources{};
+    std::array<ID3D11Texture2D*, InputTypeCount>             m_inputResources{};
+    std::array<ResourceView, InputTypeCount>                 m_inputViews{};
+    std::array<ID3D11Buffer*, ConstBufferTypeCount>          m_constantBuffers{};
+    std::array<ID3D11Texture2D*, InternalTypeCount>          m_internalResources{};
+    std::array<ResourceView, InternalTypeCount>              m_internalViews{};
+    std::array<ID3D11SamplerState*, SamplerTypeCount>        m_samplers{};
+    std::map<ID3D11Resource*, ResourceView>                  m_resourceViews{};
+
+    ID3D11Texture2D*           m_pColorOutput    = nullptr;
+    ID3D11UnorderedAccessView* m_pColorOutputUav = nullptr;
+
+    std::vector<ID3D11Texture2D*> m_readbackRing;
+    std::deque<PendingReadback>   m_pendingReadbacks;
+    uint32_t                      m_nextReadbackSlot = 0;
+    bool                          m_readbackFailed   = false;
+    std::deque<ReceivedFrame>     m_received;
+
+    ResourceKey            m_key                = {};
+    DXGI_FORMAT            m_depthFormat        = DXGI_FORMAT_UNKNOWN;
+    DXGI_FORMAT            m_mevcFormat         = DXGI_FORMAT_UNKNOWN;
+    uint32_t               m_readbackDepth      = DefaultReadbackDepth;
+    uint32_t               m_width              = 0;
+    uint32_t               m_height             = 0;
+    uint32_t               m_interpolatedFrames = 1;
+    uint32_t               m_flags              = 0;
+    bool                   m_canSynthesize      = false;
+    FgOutputCallback       m_callback           = nullptr;
+    void*                  m_pUserData          = nullptr;
+    FrameGenerationInputCb m_constBufData       = {};
+
+    bool     m_hasPrev     = false;
+    bool     m_prevHasClip = false;
+    uint64_t m_prevFrameId = 0;
+    ClipInfo m_prevClip    = {};
+};
+
+FgResult fgCreateWorkerPool(uint32_t threadCount, FgWorkerPool* pPool)
+{
+    if (pPool == nullptr)
+    {
+        return FG_ERROR_INVALID_ARGUMENT;
+    }
+    FgWorkerPool pool = new (std::nothrow) FgWorkerPool_T;
+    if (pool == nullptr)
+    {
+        return FG_ERROR_OUT_OF_MEMORY;
+    }
+    pool->pOwned = std::make_unique<ThreadPool>(threadCount);
+    pool->pPool  = pool->pOwned.get();
+    *pPool       = pool;
+    return FG_SUCCESS;
+}
+
+FgWorkerPool fgWrapThreadPool(ThreadPool* pPool)
+{
+    FgWorkerPool pool = pPool != nullptr ? new (std::nothrow) FgWorkerPool_T : nullptr;
+    if (pool != nullptr)
+    {
+        pool->pPool = pPool;
+    }
+    return pool;
+}
+
+void fgDestroyWorkerPool(FgWorkerPool pool)
+{
+    delete pool;
+}
+
+FgResult fgCreateContext(const FgContextDesc* pDesc, FgContext* pContext)
+{
+    if (pDesc == nullptr || pContext == nullptr)
+    {
+        return FG_ERROR_INVALID_ARGUMENT;
+    }
+    *pContext         = nullptr;
+    FgContext context = new (std::nothrow) FgContext_T;
+    if (context == nullptr)
+    {
+        return FG_ERROR_OUT_OF_MEMORY;
+    }
+    FgResult result = context->Init(*pDesc);
+    if (result != FG_SUCCESS)
+    {
+        delete context;
+        return result;
+    }
+    *pContext = context;
+    return FG_SUCCESS;
+}
+
+void fgDestroyContext(FgContext context)
+{
+    delete context;
+}
+
+FgResult fgResetContext(FgContext context, const FgContextDesc* pDesc, int* pReused)
+{
+    if (context == nullptr || pDesc == nullptr)
+    {
+        return FG_ERROR_INVALID_ARGUMENT;
+    }
+    bool     reused = false;
+    FgResult result = context->Reset(*pDesc, reused);
+    if (pReused != nullptr)
+    {
+        *pReused = reused ? 1 : 0;
+    }
+    return result;
+}
+
+FgResult fgSubmitFrame(FgContext context, const FgFrameDesc* pFrame)
+{
+    return context != nullptr && pFrame != nullptr ? context->Submit(*pFrame) : FG_ERROR_INVALID_ARGUMENT;
+}
+
+FgResult fgSubmitPair(FgContext context, const FgFrameDesc* pPrev, const FgFrameDesc* pCurr)
+{
+    return context != nullptr && pPrev != nullptr && pCurr != nullptr ? context->SubmitPair(*pPrev, *pCurr)
+                                                                       : FG_ERROR_INVALID_ARGUMENT;
+}
+
+FgResult fgFlush(FgContext context)
+{
+    return context != nullptr ? context->Flush() : FG_ERROR_INVALID_ARGUMENT;
+}
+
+FgResult fgReceiveFrame(FgContext context, FgOutputFrame* pFrame, void* pPixels, uint32_t rowPitch)
+{
+    return context != nullptr && pFrame != nullptr ? context->Receive(*pFrame, pPixels, rowPitch)
+                                                   : FG_ERROR_INVALID_ARGUMENT;
+}
+
+uint32_t fgGetBarrierStats(FgContext context, FgBarrierStats* pStats, uint32_t capacity)
+{
+    return context != nullptr ? context->GetBarrierStats(pStats, pStats != nullptr ? capacity : 0) : 0;
+}
+
+const char* fgResultString(FgResult result)
+{
+    switch (result)
+    {
+    case FG_SUCCESS:
+        return "success";
+    case FG_INCOMPLETE_INPUT:
+        return "missing or truncated input";
+    case FG_NOT_READY:
+        return "no frame ready";
+    case FG_ERROR_INVALID_ARGUMENT:
+        return "invalid argument";
+    case FG_ERROR_OUT_OF_MEMORY:
+        return "out of memory";
+    case FG_ERROR_DEVICE:
+        return "D3D11 device error";
+    case FG_ERROR_SHADER_NOT_FOUND:
+        return "shader file missing";
+    case FG_ERROR_UNSUPPORTED_FORMAT:
+        return "unsupported format";
+    default:
+        return "unknown error";
+    }
+}
@@ -0,0 +1,163 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// C interface to the frame generator, for embedding it in other tools without going through files. A context owns a
+// D3D11 device, the compiled shaders and every texture sized for one resolution. Frames are submitted one at a time
+// from memory; once two frames have been submitted, every further frame produces InterpolatedFrames generated frames
+// between it and the one before. Generated frames are read back asynchronously and handed out in submission order,
+// either to a callback or through fgReceiveFrame.
+//
+// A context must only be used from one thread at a time. Worker pools may be shared by any number of contexts.
+// framegen.vcxproj builds the library as a DLL with FG_BUILD_DLL, and its users, sample.exe among them, define FG_DLL;
+// without either, the functions are plain extern "C" symbols for a static build such as the Python module.
+
+#if defined(_WIN32) && defined(FG_BUILD_DLL)
+#define FG_API __declspec(dllexport)
+#elif defined(_WIN32) && defined(FG_DLL)
+#define FG_API __declspec(dllimport)
+#else
+#define FG_API
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define FG_API_VERSION 1
+
+// Output sequence number of a submitted frame passed through with FG_CONTEXT_EMIT_INPUTS.
+#define FG_CAPTURED_FRAME 0xFFFFFFFFu
+
+typedef struct FgContext_T*    FgContext;
+typedef struct FgWorkerPool_T* FgWorkerPool;
+
+typedef enum FgResult
+{
+    FG_SUCCESS                  = 0,
+    FG_INCOMPLETE_INPUT         = 1,  // the frame was used, but an input was missing or too short
+    FG_NOT_READY                = 2,  // fgReceiveFrame: no frame is waiting
+    FG_ERROR_INVALID_ARGUMENT   = -1,
+    FG_ERROR_OUT_OF_MEMORY      = -2,
+    FG_ERROR_DEVICE             = -3, // device creation, resource creation or readback failed
+    FG_ERROR_SHADER_NOT_FOUND   = -4, // a phsr_fg_*.dxbc file is missing or does not load
+    FG_ERROR_UNSUPPORTED_FORMAT = -5, // a depth or motion format the shaders cannot read
+} FgResult;
+
+typedef enum FgContextFlags
+{
+    FG_CONTEXT_DEBUG_LAYER       = 1 << 0, // create the device with the D3D11 debug layer
+    FG_CONTEXT_SYNTHESIZE_MOTION = 1 << 1, // ignore submitted motion and reproject depth through the clip matrices
+    FG_CONTEXT_EMIT_INPUTS       = 1 << 2, // output submitted frames too, in presentation order
+    FG_CONTEXT_WARP              = 1 << 3, // run on the WARP software device, on the CPU, instead of the GPU
+    FG_CONTEXT_LOW_LATENCY       = 1 << 4, // upload frames with a small team of spinning threads owned by the context
+} FgContextFlags;
+
+typedef enum FgColorEncoding
+{
+    FG_COLOR_RGBA8 = 0, // RGBA8 pixels, rowPitch bytes apart
+    FG_COLOR_IMAGE = 1, // a PNG, QOI or raw RGBA image file held in memory
+} FgColorEncoding;
+
+// One input plane. rowPitch 0 means tightly packed rows; size bounds what is read.
+typedef struct FgPlane
+{
+    const void* pData;
+    size_t      size;
+    uint32_t    rowPitch;
+} FgPlane;
+
+typedef struct FgFrameDesc
+{
+    uint64_t        frameId;     // returned with the frames generated after this one
+    uint64_t        timestampNs; // returned with the frames generated before this one
+    FgColorEncoding colorEncoding;
+    FgPlane         color;
+    FgPlane         depth;       // texels of FgContextDesc::depthFormat
+    FgPlane         motion;      // texels of FgContextDesc::motionFormat; empty to synthesize from depth
+    const float*    pClipInfo;   // 32 floats, PrevClipToClip then ClipToPrevClip, row-major; may be NULL
+} FgFrameDesc;
+
+// A frame coming out of the context. pPixels is only valid during the callback; fgReceiveFrame copies the pixels.
+typedef struct FgOutputFrame
+{
+    uint64_t       prevFrameId; // the submitted frames this one lies between
+    uint64_t       currFrameId;
+    uint64_t       timestampNs; // timestampNs of currFrameId
+    uint32_t       seq;         // 0 .. interpolatedFrames - 1, or FG_CAPTURED_FRAME
+    uint32_t       width;
+    uint32_t       height;
+    uint32_t       rowPitch;
+    const uint8_t* pPixels; // RGBA8
+} FgOutputFrame;
+
+// Waits at one barrier of the FG_CONTEXT_LOW_LATENCY worker team, summed over its threads.
+typedef struct FgBarrierStats
+{
+    uint64_t crossings;
+    double   waitSeconds;
+    double   maxWaitSeconds; // longest single wait
+} FgBarrierStats;
+
+typedef void (*FgOutputCallback)(void* pUserData, const FgOutputFrame* pFrame);
+
+typedef struct FgContextDesc
+{
+    uint32_t         width;
+    uint32_t         height;
+    uint32_t         depthFormat;        // DXGI_FORMAT of the depth planes
+    uint32_t         motionFormat;       // DXGI_FORMAT of the motion planes
+    uint32_t         interpolatedFrames; // frames generated between two submitted frames
+    uint32_t         readbackDepth;      // generated frames that may be in flight on the GPU; 0 uses 3
+    uint32_t         flags;              // FgContextFlags
+    const char*      shaderDirectory;    // where the phsr_fg_*.dxbc files are; NULL for the working directory
+    FgWorkerPool     workerPool;         // NULL gives the context a pool of its own
+    FgOutputCallback outputCallback;     // NULL queues outputs for fgReceiveFrame
+    void*            pUserData;
+} FgContextDesc;
+
+// threadCount 0 uses one thread per hardware thread. The pool must outlive the contexts that use it.
+FG_API FgResult fgCreateWorkerPool(uint32_t threadCount, FgWorkerPool* pPool);
+FG_API void     fgDestroyWorkerPool(FgWorkerPool pool);
+
+FG_API FgResult fgCreateContext(const FgContextDesc* pDesc, FgContext* pContext);
+FG_API void     fgDestroyContext(FgContext context);
+
+// Starts over with new settings: waits for outstanding outputs, forgets the previous frame and keeps the device and
+// shaders. The textures are only recreated when the size, the formats or the readback depth change; *pReused (may be
+// NULL) tells whether they were kept. shaderDirectory, workerPool, FG_CONTEXT_DEBUG_LAYER and FG_CONTEXT_WARP cannot
+// change.
+FG_API FgResult fgResetContext(FgContext context, const FgContextDesc* pDesc, int* pReused);
+
+// Uploads a frame and, if there is a previous one, generates the frames between the two. Outputs whose readback has
+// completed are delivered before returning; the call only blocks while every readback slot is in flight.
+FG_API FgResult fgSubmitFrame(FgContext context, const FgFrameDesc* pFrame);
+
+// Generates the frames between two frames that need not follow the last one submitted: both are uploaded, and the
+// context then continues from pCurr. With FG_CONTEXT_EMIT_INPUTS only pCurr is output. Lets several contexts work on
+// different pairs of one sequence at the same time.
+FG_API FgResult fgSubmitPair(FgContext context, const FgFrameDesc* pPrev, const FgFrameDesc* pCurr);
+
+// Delivers every outstanding output.
+FG_API FgResult fgFlush(FgContext context);
+
+// Without an output callback: copies the oldest output into pPixels (rowPitch bytes per row) and describes it in
+// *pFrame, waiting for its readback if needed. Returns FG_NOT_READY when nothing has been generated.
+FG_API FgResult fgReceiveFrame(FgContext context, FgOutputFrame* pFrame, void* pPixels, uint32_t rowPitch);
+
+// Copies the statistics of up to capacity barriers, in phase order, and returns how many the worker team has; 0 when
+// the context never ran with FG_CONTEXT_LOW_LATENCY. Not while another thread uses the context.
+FG_API uint32_t fgGetBarrierStats(FgContext context, FgBarrierStats* pStats, uint32_t capacity);
+
+FG_API const char* fgResultString(FgResult result);
+
+#ifdef __cplusplus
+}
+
+class ThreadPool;
+
+// Lets C++ hosts that already run a ThreadPool share it with their contexts. fgDestroyWorkerPool releases the handle
+// but leaves the pool alone.
+FG_API FgWorkerPool fgWrapThreadPool(ThreadPool* pPool);
+#endif
@@ -0,0 +1,597 @@
+#pragma once
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#else
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#endif
+
+#include "async_io.h"
+#include "image_formats.h"
+#include "thread_pool.h"
+#include "y4m.h"
+
+// Inputs read as streams instead of numbered files, so the runner can sit in a pipeline. The colour stream is Y4M or
+// a concatenation of raw RGBA images (image_formats.h), which is what OutputFormat "raw" writes. Clip info, depth and
+// motion come from sibling streams of fixed-size records, one per frame, in the layout of their .bin files. Every
+// stream is stdin ("-"), a named pipe (mkfifo, \\.\pipe\name) or a plain file.
+
+// Buffered binary input whose blocking reads another thread can end with Cancel, so a reader waiting on a producer
+// that stalls can still be stopped. On Linux every read first polls the stream together with a wake-up pipe that Cancel
+// writes to. On Windows Cancel only makes later reads fail, and the owner ends a ReadFile in progress with
+// CancelSynchronousIo on the reading thread, repeating both until the thread has seen them.
+class InputStream
+{
+public:
+    // "-" is stdin. Returns null if path cannot be opened.
+    static std::unique_ptr<InputStream> Open(const std::string& path)
+    {
+        std::unique_ptr<InputStream> pStream(new InputStream());
+#ifdef _WIN32
+        pStream->m_owned  = path != "-";
+        pStream->m_handle = pStream->m_owned ? CreateFileA(path.c_str(),
+                                                           GENERIC_READ,
+                                                           FILE_SHARE_READ | FILE_SHARE_WRITE,
+                                                           nullptr,
+                                                           OPEN_EXISTING,
+                                                           FILE_ATTRIBUTE_NORMAL,
+                                                           nullptr)
+                                             : GetStdHandle(STD_INPUT_HANDLE);
+        if (pStream->m_handle == INVALID_HANDLE_VALUE || pStream->m_handle == nullptr)
+        {
+            return nullptr;
+        }
+#else
+        pStream->m_owned = path != "-";
+        pStream->m_fd    = pStream->m_owned ? open(path.c_str(), O_RDONLY | O_CLOEXEC) : STDIN_FILENO;
+        if (pStream->m_fd < 0 || pipe(pStream->m_wake) != 0)
+        {
+            return nullptr;
+        }
+#endif
+        return pStream;
+    }
+
+    ~InputStream()
+    {
+#ifdef _WIN32
+        if (m_owned && m_handle != INVALID_HANDLE_VALUE && m_handle != nullptr)
+        {
+            CloseHandle(m_handle);
+        }
+#else
+        if (m_owned && m_fd >= 0)
+        {
+            close(m_fd);
+        }
+        for (int fd : m_wake)
+        {
+            if (fd >= 0)
+            {
+                close(fd);
+            }
+        }
+#endif
+    }
+
+    InputStream(const InputStream&)            = delete;
+    InputStream& operator=(const InputStream&) = delete;
+
+    // Reads exactly size bytes. Fails at the end of the stream, on errors and once cancelled.
+    bool Read(void* pData, size_t size)
+    {
+        uint8_t* pOut = static_cast<uint8_t*>(pData);
+        while (size != 0)
+        {
+            if (m_begin == m_end && size >= m_buffer.size())
+            {
+                // Large reads go straight to the caller's memory.
+                size_t read = ReadSome(pOut, size);
+                if (read == 0)
+                {
+                    return false;
+                }
+                pOut += read;
+                size -= read;
+                continue;
+            }
+            if (m_begin == m_end && Fill() == 0)
+            {
+                return false;
+            }
+            size_t count = (std::min)(size, m_end - m_begin);
+            memcpy(pOut, m_buffer.data() + m_begin, count);
+            m_begin += count;
+            pOut += count;
+            size -= count;
+        }
+        return true;
+    }
+
+    // The next byte, or EOF under the same conditions as Read failing.
+    int GetChar()
+    {
+        if (m_begin == m_end && Fill() == 0)
+        {
+            return EOF;
+        }
+        return m_buffer[m_begin++];
+    }
+
+    // Makes every later read fail, and on Linux also the one another thread may be blocked in.
+    void Cancel()
+    {
+        m_cancelled = true;
+#ifndef _WIN32
+        char wake = 0;
+        if (write(m_wake[1], &wake, 1) < 0)
+        {
+            // The pipe is full of earlier wake-ups already.
+        }
+#endif
+    }
+
+private:
+    InputStream() : m_buffer(1 << 20)
+    {
+    }
+
+    size_t Fill()
+    {
+        m_begin = 0;
+        m_end   = ReadSome(m_buffer.data(), m_buffer.size());
+        return m_end;
+    }
+
+    // Blocks until some bytes arrive. Returns 0 at the end of the stream, on errors and once cancelled.
+    size_t ReadSome(uint8_t* pData, size_t size)
+    {
+        if (m_cancelled)
+        {
+            return 0;
+        }
+#ifdef _WIN32
+        DWORD read = 0;
+        DWORD want = static_cast<DWORD>((std::min)(size, size_t(1) << 30));
+        return ReadFile(m_handle, pData, want, &read, nullptr) && !m_cancelled ? read : 0;
+#else
+        for (;;)
+        {
+            pollfd fds[2] = {{m_fd, POLLIN, 0}, {m_wake[0], POLLIN, 0}};
+            if (poll(fds, 2, -1) < 0)
+            {
+                if (errno == EINTR)
+                {
+                    continue;
+                }
+                return 0;
+            }
+            if (fds[1].revents != 0 || m_cancelled)
+            {
+                return 0;
+            }
+            ssize_t bytes = read(m_fd, pData, size);
+            if (bytes < 0 && (errno == EINTR || errno == EAGAIN))
+            {
+                continue;
+            }
+            return bytes > 0 ? static_cast<size_t>(bytes) : 0;
+        }
+#endif
+    }
+
+#ifdef _WIN32
+    HANDLE m_handle = INVALID_HANDLE_VALUE;
+#else
+    int m_fd      = -1;
+    int m_wake[2] = {-1, -1};
+#endif
+    bool                 m_owned = false;
+    std::atomic<bool>    m_cancelled{false};
+    std::vector<uint8_t> m_buffer;
+    size_t               m_begin = 0;
+    size_t               m_end   = 0;
+};
+
+// Opens path for binary writing; "-" is stdout.
+inline FILE* OpenOutputStream(const std::string& path)
+{
+    if (path == "-")
+    {
+#ifdef _WIN32
+        _setmode(_fileno(stdout), _O_BINARY);
+#endif
+        return stdout;
+    }
+    return fopen(path.c_str(), "wb");
+}
+
+// Reads frames on a background thread, at most capacity frames ahead of the oldest one not yet released. Colour
+// frames come out as raw RGBA images, so they upload through the same path as .rgba files.
+class FrameStreamReader
+{
+public:
+    struct Stats
+    {
+        uint64_t frames      = 0;
+        uint64_t bytes       = 0;
+        double   waitSeconds = 0.0; // time Acquire spent blocked on the streams
+    };
+
+    // Sizes of the side stream records. Depth and motion records are whole frames at the colour stream's size.
+    struct RecordLayout
+    {
+        size_t   clipInfoBytes;
+        uint32_t depthBytesPerPixel;
+        uint32_t motionBytesPerPixel;
+    };
+
+    // paths[type] names the stream of each frame file type; an empty path leaves that type out and its files come
+    // back empty. Returns null if a stream cannot be opened or the colour stream does not start with a Y4M or raw
+    // image header.
+    static std::unique_ptr<FrameStreamReader> Open(const std::array<std::string, FrameFileTypeCount>& paths,
+                                                   const RecordLayout&                                layout,
+                                                   uint32_t                                           firstFrameId,
+                                                   uint32_t                                           capacity,
+                                                   ThreadPool*                                        pPool)
+    {
+        std::unique_ptr<FrameStreamReader> pReader(new FrameStreamReader(firstFrameId, capacity, pPool));
+        for (size_t type = 0; type < FrameFileTypeCount; type++)
+        {
+            if (paths[type].empty())
+            {
+                continue;
+            }
+            pReader->m_streams[type] = InputStream::Open(paths[type]);
+            if (pReader->m_streams[type] == nullptr)
+            {
+                return nullptr;
+            }
+        }
+        if (!pReader->ReadColorHeader())
+        {
+            return nullptr;
+        }
+
+        const size_t pixels = static_cast<size_t>(pReader->m_width) * pReader->m_height;
+        pReader->m_recordSizes[static_cast<size_t>(FrameFileType::ClipInfo)]     = layout.clipInfoBytes;
+        pReader->m_recordSizes[static_cast<size_t>(FrameFileType::Depth)]        = pixels * layout.depthBytesPerPixel;
+        pReader->m_recordSizes[static_cast<size_t>(FrameFileType::MotionVector)] = pixels * layout.motionBytesPerPixel;
+
+        pReader->m_thread = std::thread([reader = pReader.get()]() { reader->ReaderLoop(); });
+        return pReader;
+    }
+
+    // Stops the reader thread, cancelling the read it may be blocked in, so a stalled producer cannot hold up the end
+    // of a session.
+    ~FrameStreamReader()
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_stop = true;
+        m_space.notify_all();
+        while (m_thread.joinable() && !m_finished)
+        {
+            for (const auto& pStream : m_streams)
+            {
+                if (pStream)
+                {
+                    pStream->Cancel();
+                }
+            }
+#ifdef _WIN32
+            CancelSynchronousIo(m_thread.native_handle());
+#endif
+            m_ready.wait_for(lock, std::chrono::milliseconds(10), [this]() { return m_finished; });
+        }
+        lock.unlock();
+        if (m_thread.joinable())
+        {
+            m_thread.join();
+        }
+    }
+
+    FrameStreamReader(const FrameStreamReader&)            = delete;
+    FrameStreamReader& operator=(const FrameStreamReader&) = delete;
+
+    uint32_t Width() const
+    {
+        return m_width;
+    }
+
+    uint32_t Height() const
+    {
+        return m_height;
+    }
+
+    const char* FormatName() const
+    {
+        return m_y4m ? "y4m" : "raw rgba";
+    }
+
+    // Only Y4M streams carry a frame rate.
+    bool GetFrameRate(uint32_t& rateNum, uint32_t& rateDen) const
+    {
+        rateNum = m_y4mHeader.rateNum;
+        rateDen = m_y4mHeader.rateDen;
+        return m_y4m;
+    }
+
+    // Blocks until frameId has been read. Returns false once the colour stream ended before it.
+    bool WaitForFrame(uint32_t frameId)
+    {
+        auto                         begin = std::chrono::steady_clock::now();
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_ready.wait(lock, [this, frameId]() { return m_ended || frameId < m_nextFrameId; });
+        m_stats.waitSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+        return m_frames.count(frameId) != 0;
+    }
+
+    // Files of a frame that WaitForFrame has reported; anything else comes back empty.
+    FrameFiles Acquire(uint32_t frameId)
+    {
+        WaitForFrame(frameId);
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto                        it = m_frames.find(frameId);
+        return it != m_frames.end() ? it->second : FrameFiles{};
+    }
+
+    // Drops frames below frameId and lets the reader run ahead again.
+    void Release(uint32_t frameId)
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_frames.erase(m_frames.begin(), m_frames.lower_bound(frameId));
+        }
+        m_space.notify_all();
+    }
+
+    Stats GetStats() const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_stats;
+    }
+
+private:
+    FrameStreamReader(uint32_t firstFrameId, uint32_t capacity, ThreadPool* pPool)
+        : m_capacity((std::max)(capacity, 2u)),
+          m_nextFrameId(firstFrameId),
+          m_pPool(pPool)
+    {
+    }
+
+    InputStream* ColorStream() const
+    {
+        return m_streams[static_cast<size_t>(FrameFileType::ColorInput)].get();
+    }
+
+    bool ReadExact(InputStream* pStream, void* pData, size_t size)
+    {
+        return pStream->Read(pData, size);
+    }
+
+    // Reads up to and excluding the next newline.
+    bool ReadLine(InputStream* pStream, std::string& line)
+    {
+        line.clear();
+        for (int c = pStream->GetChar(); c != '\n'; c = pStream->GetChar())
+        {
+            if (c == EOF || line.size() == Y4mMaxLine)
+            {
+                return false;
+            }
+            line.push_back(static_cast<char>(c));
+        }
+        return true;
+    }
+
+    // Both containers are recognised from their first four bytes. A raw stream's first image header is kept for the
+    // first frame.
+    bool ReadColorHeader()
+    {
+        InputStream* pStream = ColorStream();
+        if (pStream == nullptr)
+        {
+            return false;
+        }
+
+        uint8_t magic[4] = {};
+        if (!ReadExact(pStream, magic, sizeof(magic)))
+        {
+            return false;
+        }
+
+        if (memcmp(magic, Y4mMagic, sizeof(magic)) == 0)
+        {
+            std::string rest;
+            if (!ReadLine(pStream, rest) || !ParseY4mHeader(std::string(Y4mMagic, sizeof(magic)) + rest, m_y4mHeader))
+            {
+                return false;
+            }
+            m_y4m    = true;
+            m_width  = m_y4mHeader.width;
+            m_height = m_y4mHeader.height;
+            m_planes.resize(GetY4mFrameSize(m_y4mHeader));
+            return true;
+        }
+
+        if (memcmp(magic, RawImageMagic, sizeof(magic)) == 0)
+        {
+            memcpy(&m_firstRawHeader, magic, sizeof(magic));
+            if (!ReadExact(pStream, reinterpret_cast<uint8_t*>(&m_firstRawHeader) + sizeof(magic),
+                           sizeof(m_firstRawHeader) - sizeof(magic)))
+            {
+                return false;
+            }
+            m_haveRawHeader = true;
+            m_width         = m_firstRawHeader.width;
+            m_height        = m_firstRawHeader.height;
+            return m_width != 0 && m_height != 0;
+        }
+        return false;
+    }
+
+    // The colour frame becomes a raw RGBA image: header followed by tightly packed rows.
+    bool ReadColorFrame(FileBuffer& buffer)
+    {
+        InputStream* pStream = ColorStream();
+        const size_t pixels  = static_cast<size_t>(m_width) * m_height * 4;
+
+        RawImageHeader header = MakeRawImageHeader(m_width, m_height);
+        if (m_y4m)
+        {
+            std::string line;
+            if (!ReadLine(pStream, line) || line.compare(0, strlen(Y4mFrameTag), Y4mFrameTag) != 0 ||
+                !ReadExact(pStream, m_planes.data(), m_planes.size()))
+            {
+                return false;
+            }
+        }
+        else
+        {
+            if (m_haveRawHeader)
+            {
+                header          = m_firstRawHeader;
+                m_haveRawHeader = false;
+            }
+            else if (!ReadExact(pStream, &header, sizeof(header)))
+            {
+                return false;
+            }
+            if (memcmp(header.magic, RawImageMagic, sizeof(header.magic)) != 0 || header.width != m_width ||
+                header.height != m_height)
+            {
+                return false;
+            }
+        }
+
+        buffer.storage = AllocateAligned(AlignUp(sizeof(header) + pixels, DirectIoAlignment));
+        buffer.size    = sizeof(header) + pixels;
+        if (!buffer.storage)
+        {
+            return false;
+        }
+        memcpy(buffer.storage.get(), &header, sizeof(header));
+
+        uint8_t* pPixels = buffer.storage.get() + sizeof(header);
+        if (m_y4m)
+        {
+            ConvertY4mFrameToRgba(m_planes.data(), m_y4mHeader, pPixels, static_cast<size_t>(m_width) * 4, m_pPool);
+            return true;
+        }
+        return ReadExact(pStream, pPixels, pixels);
+    }
+
+    // A side stream that ends or breaks leaves the rest of its files empty; the colour stream decides when the run
+    // ends. The stream stays open until the reader goes away, so the destructor can always cancel it.
+    FileBuffer ReadRecord(size_t type)
+    {
+        FileBuffer   buffer;
+        InputStream* pStream = m_streams[type].get();
+        if (pStream == nullptr || m_recordSizes[type] == 0)
+        {
+            return buffer;
+        }
+
+        buffer.storage = AllocateAligned(AlignUp(m_recordSizes[type], DirectIoAlignment));
+        buffer.size    = m_recordSizes[type];
+        if (!buffer.storage || !ReadExact(pStream, buffer.storage.get(), buffer.size))
+        {
+            m_recordSizes[type] = 0;
+            return {};
+        }
+        return buffer;
+    }
+
+    void ReaderLoop()
+    {
+        for (;;)
+        {
+            {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                m_space.wait(lock, [this]() { return m_stop || m_frames.size() < m_capacity; });
+                if (m_stop)
+                {
+                    m_finished = true;
+                    m_ready.notify_all();
+                    return;
+                }
+            }
+
+            FrameFiles files;
+            bool       ok = ReadColorFrame(files[static_cast<size_t>(FrameFileType::ColorInput)]);
+            for (size_t type = 0; type < FrameFileTypeCount && ok; type++)
+            {
+                if (type != static_cast<size_t>(FrameFileType::ColorInput))
+                {
+                    files[type] = ReadRecord(type);
+                }
+            }
+
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                if (!ok)
+                {
+                    m_ended    = true;
+                    m_finished = true;
+                }
+                else
+                {
+                    for (const FileBuffer& file : files)
+                    {
+                        m_stats.bytes += file.size;
+                    }
+                    m_stats.frames++;
+                    m_frames.insert({m_nextFrameId++, std::move(files)});
+                }
+            }
+            m_ready.notify_all();
+            if (!ok)
+            {
+                return;
+            }
+        }
+    }
+
+    std::array<std::unique_ptr<InputStream>, FrameFileTypeCount> m_streams;
+    std::array<size_t, FrameFileTypeCount>                       m_recordSizes = {};
+    uint32_t                               m_capacity;
+    uint32_t                               m_nextFrameId;
+    ThreadPool*                            m_pPool;
+
+    bool                 m_y4m            = false;
+    Y4mHeader            m_y4mHeader      = {};
+    std::vector<uint8_t> m_planes;
+    RawImageHeader       m_firstRawHeader = {};
+    bool                 m_haveRawHeader  = false;
+    uint32_t             m_width          = 0;
+    uint32_t             m_height         = 0;
+
+    std::thread                    m_thread;
+    std::map<uint32_t, FrameFiles> m_frames;
+    mutable std::mutex             m_mutex;
+    std::condition_variable        m_ready;
+    std::condition_variable        m_space;
+    bool                           m_ended    = false;
+    bool                           m_finished = false; // the reader thread is about to return
+    bool                           m_stop     = false;
+    Stats                          m_stats;
+};
@@ -0,0 +1,518 @@
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <coroutine>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "async_io.h"
+#include "frame_generation.h"
+#include "frame_writer.h"
+#include "image_decode.h"
+#include "image_formats.h"
+#include "thread_pool.h"
+
+// C++20 coroutine layer over the frame stages, for hosts that drive many streams at once. A stream's flow is one
+// coroutine that reads top to bottom, load, generate, write, and every stage is a FrameTask it co_awaits. While a
+// stage waits for file reads the coroutine holds no thread; CPU and GPU work run on the threads of a shared
+// FrameTaskExecutor, so hundreds of flows can be in flight on a pool of a few threads. The stages are the ones the
+// threaded paths use: AsyncFileReader and the colour decoder for loading, fgSubmitFrame for generating and
+// EncodeImageFile for writing.
+//
+// Tasks are lazy: a FrameTask starts when it is awaited, or when FrameTaskExecutor::Spawn is given it, and resumes its
+// awaiter when it finishes. Exceptions are not used; an exception leaving a task terminates the process.
+
+template <typename T>
+class FrameTask;
+
+namespace frame_tasks_detail
+{
+struct PromiseBase
+{
+    std::coroutine_handle<> continuation;
+
+    // Hands the thread straight to the awaiter instead of returning through the scheduler.
+    struct FinalAwaiter
+    {
+        bool await_ready() noexcept
+        {
+            return false;
+        }
+
+        template <typename Promise>
+        std::coroutine_handle<> await_suspend(std::coroutine_handle<Promise> handle) noexcept
+        {
+            std::coroutine_handle<> continuation = handle.promise().continuation;
+            return continuation ? continuation : std::noop_coroutine();
+        }
+
+        void await_resume() noexcept
+        {
+        }
+    };
+
+    std::suspend_always initial_suspend() noexcept
+    {
+        return {};
+    }
+
+    FinalAwaiter final_suspend() noexcept
+    {
+        return {};
+    }
+
+    void unhandled_exception() noexcept
+    {
+        std::terminate();
+    }
+};
+
+template <typename T>
+struct Promise : PromiseBase
+{
+    std::optional<T> value;
+
+    void return_value(T result)
+    {
+        value = std::move(result);
+    }
+
+    T Take()
+    {
+        return std::move(*value);
+    }
+};
+
+template <>
+struct Promise<void> : PromiseBase
+{
+    void return_void()
+    {
+    }
+
+    void Take()
+    {
+    }
+};
+} // namespace frame_tasks_detail
+
+// A coroutine producing a T. Owns its frame; awaiting it once starts it and yields its result.
+template <typename T = void>
+class FrameTask
+{
+public:
+    struct promise_type : frame_tasks_detail::Promise<T>
+    {
+        FrameTask get_return_object()
+        {
+            return FrameTask(std::coroutine_handle<promise_type>::from_promise(*this));
+        }
+    };
+
+    FrameTask(FrameTask&& other) noexcept : m_handle(std::exchange(other.m_handle, nullptr))
+    {
+    }
+
+    FrameTask& operator=(FrameTask&& other) noexcept
+    {
+        if (this != &other)
+        {
+            Release();
+            m_handle = std::exchange(other.m_handle, nullptr);
+        }
+        return *this;
+    }
+
+    ~FrameTask()
+    {
+        Release();
+    }
+
+    FrameTask(const FrameTask&)            = delete;
+    FrameTask& operator=(const FrameTask&) = delete;
+
+    bool await_ready() const noexcept
+    {
+        return false;
+    }
+
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiter) noexcept
+    {
+        m_handle.promise().continuation = awaiter;
+        return m_handle;
+    }
+
+    T await_resume()
+    {
+        return m_handle.promise().Take();
+    }
+
+private:
+    explicit FrameTask(std::coroutine_handle<promise_type> handle) : m_handle(handle)
+    {
+    }
+
+    void Release()
+    {
+        if (m_handle)
+        {
+            m_handle.destroy();
+        }
+    }
+
+    std::coroutine_handle<promise_type> m_handle;
+};
+
+// Runs coroutines on a ThreadPool. co_await Schedule() moves the calling coroutine onto a pool thread; Spawn starts a
+// task there without anyone awaiting it, and WaitIdle blocks until every spawned task has finished. The pool may be
+// the one the contexts and encoders use: their ParallelFor calls from inside a task take part in the work.
+class FrameTaskExecutor
+{
+public:
+    explicit FrameTaskExecutor(ThreadPool& pool) : m_pool(pool)
+    {
+    }
+
+    FrameTaskExecutor(const FrameTaskExecutor&)            = delete;
+    FrameTaskExecutor& operator=(const FrameTaskExecutor&) = delete;
+
+    ThreadPool& Pool() const
+    {
+        return m_pool;
+    }
+
+    struct ScheduleAwaiter
+    {
+        ThreadPool& pool;
+
+        bool await_ready() const noexcept
+        {
+            return false;
+        }
+
+        void await_suspend(std::coroutine_handle<> handle)
+        {
+            pool.Submit([handle]() { handle.resume(); });
+        }
+
+        void await_resume() const noexcept
+        {
+        }
+    };
+
+    ScheduleAwaiter Schedule()
+    {
+        return {m_pool};
+    }
+
+    // The task runs to completion on the pool; its frame is freed when it ends.
+    void Spawn(FrameTask<void> task)
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_running++;
+        }
+        RunDetached(this, std::move(task));
+    }
+
+    void WaitIdle()
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_idle.wait(lock, [this]() { return m_running == 0; });
+    }
+
+private:
+    // A coroutine nobody awaits: it starts at once and frees itself at the end.
+    struct Detached
+    {
+        struct promise_type
+        {
+            Detached get_return_object()
+            {
+                return {};
+            }
+
+            std::suspend_never initial_suspend() noexcept
+            {
+                return {};
+            }
+
+            std::suspend_never final_suspend() noexcept
+            {
+                return {};
+            }
+
+            void return_void()
+            {
+            }
+
+            void unhandled_exception() noexcept
+            {
+                std::terminate();
+            }
+        };
+    };
+
+    static Detached RunDetached(FrameTaskExecutor* pExecutor, FrameTask<void> task)
+    {
+        co_await pExecutor->Schedule();
+        co_await task;
+        pExecutor->Finished();
+    }
+
+    // Notifies under the lock: once WaitIdle can see the count drop, the executor may be gone.
+    void Finished()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_running--;
+        m_idle.notify_all();
+    }
+
+    ThreadPool&             m_pool;
+    std::mutex              m_mutex;
+    std::condition_variable m_idle;
+    uint64_t                m_running = 0;
+};
+
+// Reads the given files through the shared reader as one batch and resumes the awaiting coroutine on the executor once
+// all of them have completed. Empty paths are skipped and come back empty.
+class ReadFrameFilesAwaiter
+{
+public:
+    ReadFrameFilesAwaiter(FrameTaskExecutor&                          executor,
+                          AsyncFileReader&                            reader,
+                          std::array<std::string, FrameFileTypeCount> paths,
+                          int32_t                                     memoryNode)
+        : m_executor(executor), m_reader(reader), m_paths(std::move(paths)), m_memoryNode(memoryNode)
+    {
+    }
+
+    bool await_ready() const noexcept
+    {
+        for (const std::string& path : m_paths)
+        {
+            if (!path.empty())
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // The last completion may resume the coroutine, and free this awaiter, before SubmitBatch returns, so nothing here
+    // is touched after it.
+    void await_suspend(std::coroutine_handle<> handle)
+    {
+        struct Pending
+        {
+            std::atomic<uint32_t> count{0};
+        };
+        auto pPending = std::make_shared<Pending>();
+        for (const std::string& path : m_paths)
+        {
+            pPending->count += path.empty() ? 0 : 1;
+        }
+
+        ThreadPool&                           pool = m_executor.Pool();
+        std::vector<AsyncFileReader::Request> requests;
+        for (size_t type = 0; type < m_paths.size(); type++)
+        {
+            if (m_paths[type].empty())
+            {
+                continue;
+            }
+            FileBuffer* pTarget    = &m_files[type];
+            auto        onComplete = [pPending, pTarget, &pool, handle](FileBuffer buffer) {
+                *pTarget = std::move(buffer);
+                if (pPending->count.fetch_sub(1) == 1)
+                {
+                    pool.Submit([handle]() { handle.resume(); });
+                }
+            };
+            requests.push_back({m_paths[type], onComplete, m_memoryNode});
+        }
+        m_reader.SubmitBatch(std::move(requests));
+    }
+
+    FrameFiles await_resume()
+    {
+        return std::move(m_files);
+    }
+
+private:
+    FrameTaskExecutor&                          m_executor;
+    AsyncFileReader&                            m_reader;
+    std::array<std::string, FrameFileTypeCount> m_paths;
+    int32_t                                     m_memoryNode;
+    FrameFiles                                  m_files;
+};
+
+// A frame after the load stage: its files and its colour decoded to tightly packed RGBA8 rows, empty when the image
+// did not decode.
+struct FrameInput
+{
+    FrameFiles           files;
+    std::vector<uint8_t> rgba;
+    uint32_t             width  = 0;
+    uint32_t             height = 0;
+};
+
+// Load stage: reads the frame's files, paths indexed by FrameFileType, onto memoryNode (see AllocateAligned), then
+// decodes the colour image on the executor.
+inline FrameTask<FrameInput> LoadFrameAsync(FrameTaskExecutor&                          executor,
+                                            AsyncFileReader&                            reader,
+                                            std::array<std::string, FrameFileTypeCount> paths,
+                                            int32_t                                     memoryNode = -1)
+{
+    FrameInput input;
+    input.files = co_await ReadFrameFilesAwaiter(executor, reader, std::move(paths), memoryNode);
+
+    const FileBuffer& color = input.files[static_cast<size_t>(FrameFileType::ColorInput)];
+    if (GetImageInfo(color.data(), color.size, input.width, input.height))
+    {
+        input.rgba.resize(static_cast<size_t>(input.width) * input.height * 4);
+        PitchedSurface surface = {input.rgba.data(), input.width * 4, input.width, input.height, 4};
+        if (!DecodeImageToSurface(surface, color.data(), color.size))
+        {
+            input.rgba.clear();
+        }
+    }
+    co_return input;
+}
+
+// A frame that came out of a generator, with its pixels copied to tightly packed RGBA8 rows.
+struct GeneratedFrame
+{
+    uint64_t             prevFrameId = 0;
+    uint64_t             currFrameId = 0;
+    uint32_t             seq         = 0;
+    uint32_t             width       = 0;
+    uint32_t             height      = 0;
+    std::vector<uint8_t> pixels;
+};
+
+// One context driven by a coroutine flow. Generate uploads a frame on the executor and returns everything it
+// generated, the InterpolatedFrames frames between it and the frame before, so outputs never have to be matched to
+// their inputs later. A flow awaits one Generate at a time; several streams each use a FrameGenerator of their own.
+class FrameGenerator
+{
+public:
+    struct Result
+    {
+        FgResult                    result = FG_SUCCESS;
+        std::vector<GeneratedFrame> frames;
+    };
+
+    // desc's outputCallback and pUserData are replaced. Returns nullptr if the context cannot be created; *pResult
+    // (may be NULL) tells why.
+    static std::unique_ptr<FrameGenerator> Create(FrameTaskExecutor& executor, FgContextDesc desc, FgResult* pResult)
+    {
+        std::unique_ptr<FrameGenerator> pGenerator(new FrameGenerator(executor));
+        desc.outputCallback = OnOutput;
+        desc.pUserData      = pGenerator.get();
+        FgResult result     = fgCreateContext(&desc, &pGenerator->m_context);
+        if (pResult != nullptr)
+        {
+            *pResult = result;
+        }
+        if (result != FG_SUCCESS)
+        {
+            pGenerator.reset();
+        }
+        return pGenerator;
+    }
+
+    ~FrameGenerator()
+    {
+        fgDestroyContext(m_context);
+    }
+
+    FrameGenerator(const FrameGenerator&)            = delete;
+    FrameGenerator& operator=(const FrameGenerator&) = delete;
+
+    // Generate stage. frame points into buffers the caller keeps alive until the task has finished. The result holds
+    // the outputs whose readback has completed, so they trail the frame by up to ReadbackDepth frames; Flush delivers
+    // the rest.
+    FrameTask<Result> Generate(FgFrameDesc frame)
+    {
+        co_await m_executor.Schedule();
+
+        Result generated;
+        generated.result = fgSubmitFrame(m_context, &frame);
+        generated.frames.swap(m_outputs);
+        co_return generated;
+    }
+
+    // Waits for every output still being read back. For the end of a stream, or a consumer that needs the frames of
+    // the last submission before it submits another.
+    FrameTask<Result> Flush()
+    {
+        co_await m_executor.Schedule();
+
+        Result flushed;
+        flushed.result = fgFlush(m_context);
+        flushed.frames.swap(m_outputs);
+        co_return flushed;
+    }
+
+private:
+    explicit FrameGenerator(FrameTaskExecutor& executor) : m_executor(executor)
+    {
+    }
+
+    static void OnOutput(void* pUserData, const FgOutputFrame* pFrame)
+    {
+        FrameGenerator& generator = *static_cast<FrameGenerator*>(pUserData);
+        GeneratedFrame  output;
+        output.prevFrameId = pFrame->prevFrameId;
+        output.currFrameId = pFrame->currFrameId;
+        output.seq         = pFrame->seq;
+        output.width       = pFrame->width;
+        output.height      = pFrame->height;
+        output.pixels.resize(static_cast<size_t>(pFrame->width) * pFrame->height * 4);
+        for (uint32_t y = 0; y < pFrame->height; y++)
+        {
+            memcpy(output.pixels.data() + static_cast<size_t>(y) * pFrame->width * 4,
+                   pFrame->pPixels + static_cast<size_t>(y) * pFrame->rowPitch,
+                   pFrame->width * 4);
+        }
+        generator.m_outputs.push_back(std::move(output));
+    }
+
+    FrameTaskExecutor&          m_executor;
+    FgContext                   m_context = nullptr;
+    std::vector<GeneratedFrame> m_outputs;
+};
+
+// Write stage: encodes the frame as format and writes it to path on the executor, with PNG bands spread over its pool.
+// Returns false if the file could not be written.
+inline FrameTask<bool> WriteFrameAsync(FrameTaskExecutor& executor,
+                                       std::string        path,
+                                       ImageFormat        format,
+                                       int                compressionLevel,
+                                       GeneratedFrame     frame)
+{
+    co_await executor.Schedule();
+
+    size_t bytes   = 0;
+    double seconds = 0.0;
+    co_return EncodeImageFile(path,
+                              format,
+                              compressionLevel,
+                              frame.pixels.data(),
+                              frame.width,
+                              frame.height,
+                              &executor.Pool(),
+                              &bytes,
+                              &seconds);
+}
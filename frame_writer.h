@@ -0,0 +1,275 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "image_formats.h"
+#include "pipeline.h"
+#include "png_encode.h"
+#include "thread_pool.h"
+#include "y4m.h"
+
+// Encodes tightly packed RGBA8 rows as format and writes them to path; PNG bands are spread over pPool when it is set.
+// *pBytes receives the bytes written and *pEncodeSeconds the time spent encoding. Returns false if the file could not
+// be written.
+inline bool EncodeImageFile(const std::string& path,
+                            ImageFormat        format,
+                            int                compressionLevel,
+                            const uint8_t*     pPixels,
+                            uint32_t           width,
+                            uint32_t           height,
+                            ThreadPool*        pPool,
+                            size_t*            pBytes,
+                            double*            pEncodeSeconds)
+{
+    const size_t         stride = static_cast<size_t>(width) * 4;
+    auto                 begin  = std::chrono::steady_clock::now();
+    std::vector<uint8_t> encoded;
+    if (format == ImageFormat::Png)
+    {
+        encoded = EncodePngRgba(pPixels, width, height, stride, compressionLevel, pPool);
+    }
+    else if (format == ImageFormat::Qoi)
+    {
+        encoded = EncodeQoiRgba(pPixels, width, height, stride);
+    }
+    else
+    {
+        RawImageHeader header = MakeRawImageHeader(width, height);
+        encoded.assign(reinterpret_cast<const uint8_t*>(&header),
+                       reinterpret_cast<const uint8_t*>(&header) + sizeof(header));
+    }
+    *pEncodeSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+
+    std::ofstream file(path, std::ios::binary);
+    file.write(reinterpret_cast<const char*>(encoded.data()), static_cast<std::streamsize>(encoded.size()));
+    size_t bytes = encoded.size();
+    if (format == ImageFormat::Raw)
+    {
+        // The pixels are already in their final layout; only the header was built above.
+        file.write(reinterpret_cast<const char*>(pPixels), static_cast<std::streamsize>(stride * height));
+        bytes += stride * height;
+    }
+    bool ok = file.good();
+    file.close();
+    *pBytes = bytes;
+    return ok;
+}
+
+// Encodes and writes generated frames off the render thread: the encode stage of the frame pipeline. Frames wait in
+// a bounded queue, so a generator that outruns the encoders blocks instead of piling up frames, and are taken by
+// `threads` writer threads; each frame's PNG bands are also spread over the shared pool. QOI frames are encoded on the
+// writer thread and raw frames are written as they are. In stream mode a single writer converts every frame to 4:2:0
+// on the pool and appends it to one Y4M stream, in submission order.
+class FrameWriter
+{
+public:
+    static constexpr uint32_t DefaultQueueDepth = 8;
+
+    struct Stats
+    {
+        uint64_t frames        = 0;
+        uint64_t bytes         = 0;
+        uint64_t failed        = 0;
+        double   encodeSeconds = 0.0;
+    };
+
+    FrameWriter(ThreadPool& pool,
+                ImageFormat format,
+                int         compressionLevel,
+                uint32_t    threads    = 1,
+                uint32_t    queueDepth = DefaultQueueDepth)
+        : m_pool(pool),
+          m_format(format),
+          m_compressionLevel(compressionLevel),
+          m_queue((std::max)(queueDepth, 1u))
+    {
+        for (uint32_t i = 0; i < (std::max)(threads, 1u); i++)
+        {
+            m_threads.emplace_back([this]() { WriterLoop(); });
+        }
+    }
+
+    // Writes a Y4M stream to pStream, which stays owned by the caller. Paths given to Enqueue are ignored.
+    FrameWriter(ThreadPool& pool,
+                FILE*       pStream,
+                uint32_t    rateNum,
+                uint32_t    rateDen,
+                uint32_t    queueDepth = DefaultQueueDepth)
+        : m_pool(pool),
+          m_format(ImageFormat::Raw),
+          m_compressionLevel(0),
+          m_pStream(pStream),
+          m_queue((std::max)(queueDepth, 1u))
+    {
+        m_streamHeader.rateNum = rateNum;
+        m_streamHeader.rateDen = rateDen;
+        m_threads.emplace_back([this]() { WriterLoop(); });
+    }
+
+    ~FrameWriter()
+    {
+        m_queue.Close();
+        for (auto& thread : m_threads)
+        {
+            thread.join();
+        }
+        if (m_pStream != nullptr)
+        {
+            fflush(m_pStream);
+        }
+    }
+
+    FrameWriter(const FrameWriter&)            = delete;
+    FrameWriter& operator=(const FrameWriter&) = delete;
+
+    // pixels holds tightly packed RGBA8 rows. Blocks while the queue is full.
+    void Enqueue(std::string path, uint32_t width, uint32_t height, std::vector<uint8_t> pixels)
+    {
+        Job      job    = {std::move(path), width, height, std::move(pixels)};
+        uint64_t waitNs = 0;
+        m_enqueued++;
+        m_queue.Push(job, &waitNs);
+        m_enqueueWaitNs += waitNs;
+    }
+
+    // Blocks until every queued frame is on disk.
+    void Flush()
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_idle.wait(lock, [this]() { return m_completed == m_enqueued.load(); });
+    }
+
+    Stats GetStats() const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_stats;
+    }
+
+    // The writer threads as a pipeline stage: busy encoding and writing, or waiting for frames.
+    PipelineStageStats GetStageStats() const
+    {
+        return m_counters.Get(static_cast<uint32_t>(m_threads.size()));
+    }
+
+    // Seconds the callers of Enqueue spent blocked on a full queue.
+    double GetEnqueueWaitSeconds() const
+    {
+        return m_enqueueWaitNs.load() * 1e-9;
+    }
+
+private:
+    struct Job
+    {
+        std::string          path;
+        uint32_t             width  = 0;
+        uint32_t             height = 0;
+        std::vector<uint8_t> pixels;
+    };
+
+    void WriterLoop()
+    {
+        Job      job;
+        uint64_t waitNs = 0;
+        while (m_queue.Pop(job, &waitNs))
+        {
+            m_counters.inputWaitNs += waitNs;
+            waitNs = 0;
+
+            auto begin = std::chrono::steady_clock::now();
+            if (m_pStream != nullptr)
+            {
+                WriteStreamFrame(job);
+            }
+            else
+            {
+                WriteImageFile(job);
+            }
+            m_counters.AddBusy(begin);
+        }
+    }
+
+    void WriteImageFile(const Job& job)
+    {
+        size_t bytes   = 0;
+        double seconds = 0.0;
+        bool   ok      = EncodeImageFile(job.path,
+                                         m_format,
+                                         m_compressionLevel,
+                                         job.pixels.data(),
+                                         job.width,
+                                         job.height,
+                                         &m_pool,
+                                         &bytes,
+                                         &seconds);
+        Complete(ok, bytes, seconds);
+    }
+
+    // The stream header is taken from the first frame; later frames of another size are dropped as failed.
+    void WriteStreamFrame(const Job& job)
+    {
+        auto begin = std::chrono::steady_clock::now();
+        bool ok    = true;
+        if (m_streamHeader.width == 0)
+        {
+            m_streamHeader.width  = job.width;
+            m_streamHeader.height = job.height;
+            std::string header    = FormatY4mHeader(m_streamHeader);
+            m_planes.resize(GetY4mFrameSize(m_streamHeader));
+            ok = fwrite(header.data(), header.size(), 1, m_pStream) == 1;
+        }
+        ok = ok && job.width == m_streamHeader.width && job.height == m_streamHeader.height;
+
+        size_t bytes = 0;
+        if (ok)
+        {
+            ConvertRgbaToY4mFrame(job.pixels.data(), static_cast<size_t>(job.width) * 4, job.width, job.height,
+                                  m_planes.data(), &m_pool);
+            static const char FrameLine[] = "FRAME\n";
+            ok    = fwrite(FrameLine, sizeof(FrameLine) - 1, 1, m_pStream) == 1 &&
+                    fwrite(m_planes.data(), m_planes.size(), 1, m_pStream) == 1;
+            bytes = sizeof(FrameLine) - 1 + m_planes.size();
+        }
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+        Complete(ok, ok ? bytes : 0, seconds);
+    }
+
+    void Complete(bool ok, size_t bytes, double seconds)
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stats.frames++;
+            m_stats.bytes += bytes;
+            m_stats.failed += ok ? 0 : 1;
+            m_stats.encodeSeconds += seconds;
+            m_completed++;
+        }
+        m_idle.notify_all();
+    }
+
+    ThreadPool&              m_pool;
+    ImageFormat              m_format;
+    int                      m_compressionLevel;
+    FILE*                    m_pStream = nullptr;
+    Y4mHeader                m_streamHeader;
+    std::vector<uint8_t>     m_planes;
+    BoundedQueue<Job>        m_queue;
+    std::vector<std::thread> m_threads;
+    std::atomic<uint64_t>    m_enqueued{0};
+    std::atomic<uint64_t>    m_enqueueWaitNs{0};
+    PipelineStageCounters    m_counters;
+    mutable std::mutex       m_mutex;
+    std::condition_variable  m_idle;
+    uint64_t                 m_completed = 0;
+    Stats                    m_stats;
+};
@@ -0,0 +1,359 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <vector>
+
+#ifndef STBI_INCLUDE_STB_IMAGE_H
+#include "stb_image.h"
+#endif
+#include "inflate.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define IMAGE_DECODE_SSE2 1
+#else
+#define IMAGE_DECODE_SSE2 0
+#endif
+
+// Destination for decoded pixels: a mapped staging texture or any CPU buffer. Rows are rowPitch bytes apart, which
+// may be larger than width * bytesPerPixel. Staging textures are mapped for writing only, so decoders never read the
+// surface back.
+struct PitchedSurface
+{
+    uint8_t* pData;
+    uint32_t rowPitch;
+    uint32_t width;
+    uint32_t height;
+    uint32_t bytesPerPixel;
+};
+
+// Copies tightly packed rows into the surface. Returns false if the source holds fewer than height rows; the rows
+// that are present are still copied.
+inline bool CopyRowsToSurface(const PitchedSurface& surface, const uint8_t* pSrc, size_t srcSize)
+{
+    const size_t stride = static_cast<size_t>(surface.width) * surface.bytesPerPixel;
+    if (pSrc == nullptr || stride == 0)
+    {
+        return false;
+    }
+
+    const size_t rows = (std::min)(static_cast<size_t>(surface.height), srcSize / stride);
+    if (stride == surface.rowPitch)
+    {
+        memcpy(surface.pData, pSrc, rows * stride);
+    }
+    else
+    {
+        for (size_t y = 0; y < rows; y++)
+        {
+            memcpy(surface.pData + y * surface.rowPitch, pSrc + y * stride, stride);
+        }
+    }
+    return rows == surface.height;
+}
+
+inline uint32_t ReadBigEndian32(const uint8_t* p)
+{
+    return (uint32_t(p[0]) << 24) | (uint32_t(p[1]) << 16) | (uint32_t(p[2]) << 8) | uint32_t(p[3]);
+}
+
+inline uint8_t PaethPredictor(int a, int b, int c)
+{
+    int p  = a + b - c;
+    int pa = abs(p - a);
+    int pb = abs(p - b);
+    int pc = abs(p - c);
+    if (pa <= pb && pa <= pc)
+    {
+        return static_cast<uint8_t>(a);
+    }
+    return static_cast<uint8_t>(pb <= pc ? b : c);
+}
+
+// Reverses one PNG scanline filter. pOut may alias pPrior's row of the previous call, but not pIn.
+inline void UnfilterRow(uint8_t filter, const uint8_t* pIn, uint8_t* pOut, const uint8_t* pPrior, size_t bytes, size_t bpp)
+{
+    switch (filter)
+    {
+    case 0: // None
+        memcpy(pOut, pIn, bytes);
+        break;
+    case 1: // Sub
+        memcpy(pOut, pIn, bpp);
+        for (size_t i = bpp; i < bytes; i++)
+        {
+            pOut[i] = static_cast<uint8_t>(pIn[i] + pOut[i - bpp]);
+        }
+        break;
+    case 2: // Up
+        for (size_t i = 0; i < bytes; i++)
+        {
+            pOut[i] = static_cast<uint8_t>(pIn[i] + pPrior[i]);
+        }
+        break;
+    case 3: // Average
+        for (size_t i = 0; i < bpp; i++)
+        {
+            pOut[i] = static_cast<uint8_t>(pIn[i] + (pPrior[i] >> 1));
+        }
+        for (size_t i = bpp; i < bytes; i++)
+        {
+            pOut[i] = static_cast<uint8_t>(pIn[i] + ((pOut[i - bpp] + pPrior[i]) >> 1));
+        }
+        break;
+    case 4: // Paeth
+        for (size_t i = 0; i < bpp; i++)
+        {
+            pOut[i] = static_cast<uint8_t>(pIn[i] + pPrior[i]);
+        }
+        for (size_t i = bpp; i < bytes; i++)
+        {
+            pOut[i] = static_cast<uint8_t>(pIn[i] + PaethPredictor(pOut[i - bpp], pPrior[i], pPrior[i - bpp]));
+        }
+        break;
+    default:
+        break;
+    }
+}
+
+#if IMAGE_DECODE_SSE2
+inline __m128i LoadPixel(const uint8_t* p, size_t bpp)
+{
+    uint32_t value = 0;
+    memcpy(&value, p, bpp);
+    return _mm_cvtsi32_si128(static_cast<int>(value));
+}
+
+inline void StorePixel(uint8_t* p, __m128i pixel, size_t bpp)
+{
+    uint32_t value = static_cast<uint32_t>(_mm_cvtsi128_si32(pixel));
+    memcpy(p, &value, bpp);
+}
+
+// SSE2 version of UnfilterRow for 3 and 4 byte pixels. Up works on 16 bytes at a time; Sub, Average and Paeth depend
+// on the pixel to the left, so they run one pixel per step with all channels in one register.
+inline bool UnfilterRowSse2(
+    uint8_t filter, const uint8_t* pIn, uint8_t* pOut, const uint8_t* pPrior, size_t bytes, size_t bpp)
+{
+    if (bpp != 3 && bpp != 4)
+    {
+        return false;
+    }
+
+    const __m128i zero = _mm_setzero_si128();
+
+    switch (filter)
+    {
+    case 0:
+        memcpy(pOut, pIn, bytes);
+        return true;
+
+    case 1:
+    {
+        __m128i a = zero;
+        for (size_t i = 0; i < bytes; i += bpp)
+        {
+            a = _mm_add_epi8(a, LoadPixel(pIn + i, bpp));
+            StorePixel(pOut + i, a, bpp);
+        }
+        return true;
+    }
+
+    case 2:
+    {
+        size_t i = 0;
+        for (; i + 16 <= bytes; i += 16)
+        {
+            __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pIn + i));
+            __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pPrior + i));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(pOut + i), _mm_add_epi8(x, b));
+        }
+        for (; i < bytes; i++)
+        {
+            pOut[i] = static_cast<uint8_t>(pIn[i] + pPrior[i]);
+        }
+        return true;
+    }
+
+    case 3:
+    {
+        // _mm_avg_epu8 rounds up, the PNG average rounds down.
+        const __m128i one = _mm_set1_epi8(1);
+        __m128i       a   = zero;
+        for (size_t i = 0; i < bytes; i += bpp)
+        {
+            __m128i b   = LoadPixel(pPrior + i, bpp);
+            __m128i avg = _mm_sub_epi8(_mm_avg_epu8(a, b), _mm_and_si128(_mm_xor_si128(a, b), one));
+            a           = _mm_add_epi8(avg, LoadPixel(pIn + i, bpp));
+            StorePixel(pOut + i, a, bpp);
+        }
+        return true;
+    }
+
+    case 4:
+    {
+        // 16-bit lanes: p - a = b - c, p - b = a - c, p - c = (b - c) + (a - c).
+        const __m128i lowBytes = _mm_set1_epi16(0x00FF);
+        __m128i       a        = zero;
+        __m128i       c        = zero;
+        for (size_t i = 0; i < bytes; i += bpp)
+        {
+            __m128i b  = _mm_unpacklo_epi8(LoadPixel(pPrior + i, bpp), zero);
+            __m128i pa = _mm_sub_epi16(b, c);
+            __m128i pb = _mm_sub_epi16(a, c);
+            __m128i pc = _mm_add_epi16(pa, pb);
+            pa         = _mm_max_epi16(pa, _mm_sub_epi16(zero, pa));
+            pb         = _mm_max_epi16(pb, _mm_sub_epi16(zero, pb));
+            pc         = _mm_max_epi16(pc, _mm_sub_epi16(zero, pc));
+
+            __m128i notA = _mm_or_si128(_mm_cmpgt_epi16(pa, pb), _mm_cmpgt_epi16(pa, pc));
+            __m128i useC = _mm_cmpgt_epi16(pb, pc);
+            __m128i bOrC = _mm_or_si128(_mm_and_si128(useC, c), _mm_andnot_si128(useC, b));
+            __m128i pred = _mm_or_si128(_mm_and_si128(notA, bOrC), _mm_andnot_si128(notA, a));
+
+            __m128i x = _mm_unpacklo_epi8(LoadPixel(pIn + i, bpp), zero);
+            a         = _mm_and_si128(_mm_add_epi16(x, pred), lowBytes);
+            StorePixel(pOut + i, _mm_packus_epi16(a, a), bpp);
+            c = b;
+        }
+        return true;
+    }
+
+    default:
+        return false;
+    }
+}
+#endif
+
+inline void UnfilterRowFast(uint8_t filter, const uint8_t* pIn, uint8_t* pOut, const uint8_t* pPrior, size_t bytes, size_t bpp)
+{
+#if IMAGE_DECODE_SSE2
+    if (UnfilterRowSse2(filter, pIn, pOut, pPrior, bytes, bpp))
+    {
+        return;
+    }
+#endif
+    UnfilterRow(filter, pIn, pOut, pPrior, bytes, bpp);
+}
+
+// Decodes an 8-bit, non-interlaced RGB or RGBA PNG straight into an RGBA8 surface: the stream is inflated with the
+// table-driven Inflater, and scanlines are unfiltered (SSE2 where available) into a two-row ring that keeps the prior
+// row, then written to the destination row. The compressed and inflated streams and the ring live in per-thread scratch
+// buffers that are reused across frames. Every other PNG flavour goes through stb and is then copied at the destination pitch.
+inline bool DecodePngToSurface(const PitchedSurface& surface, const uint8_t* pData, size_t size)
+{
+    static const uint8_t PngSignature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+
+    thread_local std::vector<uint8_t> compressed;
+    thread_local std::vector<uint8_t> inflated;
+    thread_local std::vector<uint8_t> rows;
+
+    if (surface.bytesPerPixel != 4 || pData == nullptr)
+    {
+        return false;
+    }
+
+    bool     fastPath  = size > 8 && memcmp(pData, PngSignature, 8) == 0;
+    uint32_t width     = 0;
+    uint32_t height    = 0;
+    uint32_t colorType = 0;
+
+    compressed.clear();
+    for (size_t offset = 8; fastPath && offset + 12 <= size;)
+    {
+        uint32_t       length = ReadBigEndian32(pData + offset);
+        const uint8_t* pType  = pData + offset + 4;
+        const uint8_t* pChunk = pData + offset + 8;
+        if (length > size - offset - 12)
+        {
+            fastPath = false;
+            break;
+        }
+
+        if (memcmp(pType, "IHDR", 4) == 0 && length >= 13)
+        {
+            width     = ReadBigEndian32(pChunk);
+            height    = ReadBigEndian32(pChunk + 4);
+            colorType = pChunk[9];
+            // 8 bits per channel, RGB or RGBA, no interlacing.
+            fastPath = pChunk[8] == 8 && (colorType == 2 || colorType == 6) && pChunk[12] == 0;
+        }
+        else if (memcmp(pType, "IDAT", 4) == 0)
+        {
+            compressed.insert(compressed.end(), pChunk, pChunk + length);
+        }
+        else if (memcmp(pType, "IEND", 4) == 0)
+        {
+            break;
+        }
+        offset += 12 + static_cast<size_t>(length);
+    }
+
+    fastPath = fastPath && width == surface.width && height == surface.height && !compressed.empty();
+
+    if (fastPath)
+    {
+        const size_t srcBpp   = colorType == 6 ? 4 : 3;
+        const size_t rowBytes = width * srcBpp;
+        const size_t inflatedSize = height * (rowBytes + 1);
+        inflated.resize(inflatedSize + InflateOutputSlack);
+
+        Inflater inflater;
+        fastPath = inflater.InflateZlib(compressed.data(), compressed.size(), inflated.data(), inflatedSize);
+
+        // Filter types above Paeth mark a corrupt stream; leave it to stb to reject.
+        for (uint32_t y = 0; fastPath && y < height; y++)
+        {
+            fastPath = inflated[y * (rowBytes + 1)] <= 4;
+        }
+
+        if (fastPath)
+        {
+            // The prior row comes from the ring, never from the destination, which may be write-combined memory. The
+            // ring starts zeroed, the prior of the first row.
+            rows.assign(rowBytes * 2, 0);
+            for (uint32_t y = 0; y < height; y++)
+            {
+                const uint8_t* pIn    = inflated.data() + y * (rowBytes + 1);
+                uint8_t*       pRow   = rows.data() + (y & 1) * rowBytes;
+                const uint8_t* pPrior = rows.data() + ((y + 1) & 1) * rowBytes;
+                UnfilterRowFast(pIn[0], pIn + 1, pRow, pPrior, rowBytes, srcBpp);
+
+                uint8_t* pOut = surface.pData + y * surface.rowPitch;
+                if (srcBpp == 4)
+                {
+                    memcpy(pOut, pRow, rowBytes);
+                    continue;
+                }
+                for (uint32_t x = 0; x < width; x++)
+                {
+                    pOut[x * 4 + 0] = pRow[x * 3 + 0];
+                    pOut[x * 4 + 1] = pRow[x * 3 + 1];
+                    pOut[x * 4 + 2] = pRow[x * 3 + 2];
+                    pOut[x * 4 + 3] = 0xFF;
+                }
+            }
+        }
+
+        if (fastPath)
+        {
+            return true;
+        }
+    }
+
+    int            w       = 0;
+    int            h       = 0;
+    int            ch      = 0;
+    unsigned char* pPixels = stbi_load_from_memory(pData, static_cast<int>(size), &w, &h, &ch, 4);
+    bool           result  = false;
+    if (pPixels != nullptr && static_cast<uint32_t>(w) == surface.width && static_cast<uint32_t>(h) == surface.height)
+    {
+        result = CopyRowsToSurface(surface, pPixels, static_cast<size_t>(w) * h * 4);
+    }
+    stbi_image_free(pPixels);
+    return result;
+}
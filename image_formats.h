@@ -0,0 +1,364 @@
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+
+#include <string>
+#include <vector>
+
+#include "image_decode.h"
+#include "png_encode.h"
+
+// Image containers used for colour inputs and generated frames. PNG is the interchange format; QOI and raw RGBA trade
+// file size for encode/decode speed and are meant for intermediate results that are fed back into later runs.
+enum class ImageFormat : uint32_t {
+    Png,
+    Qoi,
+    Raw,
+    Count
+};
+
+inline const char* ImageFormatExtension(ImageFormat format)
+{
+    switch (format)
+    {
+    case ImageFormat::Qoi:
+        return ".qoi";
+    case ImageFormat::Raw:
+        return ".rgba";
+    case ImageFormat::Png:
+    case ImageFormat::Count:
+    default:
+        return ".png";
+    }
+}
+
+// The config.json name ParseImageFormat accepts for format.
+inline const char* ImageFormatName(ImageFormat format)
+{
+    switch (format)
+    {
+    case ImageFormat::Qoi:
+        return "qoi";
+    case ImageFormat::Raw:
+        return "raw";
+    case ImageFormat::Png:
+    case ImageFormat::Count:
+    default:
+        return "png";
+    }
+}
+
+// Accepts "png", "qoi" and "raw" as written in config.json.
+inline bool ParseImageFormat(const std::string& name, ImageFormat& format)
+{
+    if (name == "png")
+    {
+        format = ImageFormat::Png;
+    }
+    else if (name == "qoi")
+    {
+        format = ImageFormat::Qoi;
+    }
+    else if (name == "raw")
+    {
+        format = ImageFormat::Raw;
+    }
+    else
+    {
+        return false;
+    }
+    return true;
+}
+
+// Raw files are a 16-byte little-endian header followed by tightly packed RGBA8 rows, so the pixels of a file read
+// into an aligned buffer stay 16-byte aligned.
+struct RawImageHeader
+{
+    uint8_t  magic[4];
+    uint32_t width;
+    uint32_t height;
+    uint32_t reserved;
+};
+
+static_assert(sizeof(RawImageHeader) == 16, "raw image header must stay 16 bytes");
+
+static const uint8_t RawImageMagic[4] = {'R', 'G', 'B', 'A'};
+static const uint8_t QoiMagic[4]      = {'q', 'o', 'i', 'f'};
+
+static constexpr size_t QoiHeaderSize = 14;
+static constexpr size_t QoiEndSize    = 8;
+
+inline RawImageHeader MakeRawImageHeader(uint32_t width, uint32_t height)
+{
+    RawImageHeader header = {};
+    memcpy(header.magic, RawImageMagic, sizeof(header.magic));
+    header.width  = width;
+    header.height = height;
+    return header;
+}
+
+inline ImageFormat DetectImageFormat(const uint8_t* pData, size_t size)
+{
+    if (pData != nullptr && size >= QoiHeaderSize && memcmp(pData, QoiMagic, 4) == 0)
+    {
+        return ImageFormat::Qoi;
+    }
+    if (pData != nullptr && size >= sizeof(RawImageHeader) && memcmp(pData, RawImageMagic, 4) == 0)
+    {
+        return ImageFormat::Raw;
+    }
+    return ImageFormat::Png;
+}
+
+inline uint32_t QoiHash(const uint8_t* pPixel)
+{
+    return (pPixel[0] * 3u + pPixel[1] * 5u + pPixel[2] * 7u + pPixel[3] * 11u) & 63u;
+}
+
+// Encodes RGBA8 rows (stride bytes apart) as a 4-channel sRGB QOI image.
+inline std::vector<uint8_t> EncodeQoiRgba(const uint8_t* pPixels, uint32_t width, uint32_t height, size_t stride)
+{
+    std::vector<uint8_t> out;
+    out.reserve(QoiHeaderSize + static_cast<size_t>(width) * height * 5 / 4 + QoiEndSize);
+
+    out.insert(out.end(), QoiMagic, QoiMagic + 4);
+    for (uint32_t value : {width, height})
+    {
+        out.push_back(static_cast<uint8_t>(value >> 24));
+        out.push_back(static_cast<uint8_t>(value >> 16));
+        out.push_back(static_cast<uint8_t>(value >> 8));
+        out.push_back(static_cast<uint8_t>(value));
+    }
+    out.push_back(4);
+    out.push_back(0);
+
+    uint8_t  index[64][4] = {};
+    uint8_t  prev[4]      = {0, 0, 0, 255};
+    uint32_t run          = 0;
+
+    for (uint32_t y = 0; y < height; y++)
+    {
+        const uint8_t* pRow = pPixels + y * stride;
+        for (uint32_t x = 0; x < width; x++)
+        {
+            const uint8_t* px = pRow + static_cast<size_t>(x) * 4;
+            if (memcmp(px, prev, 4) == 0)
+            {
+                if (++run == 62)
+                {
+                    out.push_back(static_cast<uint8_t>(0xC0 | (run - 1)));
+                    run = 0;
+                }
+                continue;
+            }
+
+            if (run != 0)
+            {
+                out.push_back(static_cast<uint8_t>(0xC0 | (run - 1)));
+                run = 0;
+            }
+
+            uint32_t hash = QoiHash(px);
+            if (memcmp(index[hash], px, 4) == 0)
+            {
+                out.push_back(static_cast<uint8_t>(hash));
+            }
+            else
+            {
+                memcpy(index[hash], px, 4);
+                if (px[3] == prev[3])
+                {
+                    int dr  = static_cast<int8_t>(px[0] - prev[0]);
+                    int dg  = static_cast<int8_t>(px[1] - prev[1]);
+                    int db  = static_cast<int8_t>(px[2] - prev[2]);
+                    int dgr = dr - dg;
+                    int dgb = db - dg;
+
+                    if (dr >= -2 && dr <= 1 && dg >= -2 && dg <= 1 && db >= -2 && db <= 1)
+                    {
+                        out.push_back(static_cast<uint8_t>(0x40 | (dr + 2) << 4 | (dg + 2) << 2 | (db + 2)));
+                    }
+                    else if (dg >= -32 && dg <= 31 && dgr >= -8 && dgr <= 7 && dgb >= -8 && dgb <= 7)
+                    {
+                        out.push_back(static_cast<uint8_t>(0x80 | (dg + 32)));
+                        out.push_back(static_cast<uint8_t>((dgr + 8) << 4 | (dgb + 8)));
+                    }
+                    else
+                    {
+                        out.push_back(0xFE);
+                        out.insert(out.end(), px, px + 3);
+                    }
+                }
+                else
+                {
+                    out.push_back(0xFF);
+                    out.insert(out.end(), px, px + 4);
+                }
+            }
+            memcpy(prev, px, 4);
+        }
+    }
+
+    if (run != 0)
+    {
+        out.push_back(static_cast<uint8_t>(0xC0 | (run - 1)));
+    }
+
+    static const uint8_t QoiEnd[QoiEndSize] = {0, 0, 0, 0, 0, 0, 0, 1};
+    out.insert(out.end(), QoiEnd, QoiEnd + QoiEndSize);
+    return out;
+}
+
+// Decodes a QOI image straight into an RGBA8 surface of the same size. Three-channel files decode with opaque alpha.
+inline bool DecodeQoiToSurface(const PitchedSurface& surface, const uint8_t* pData, size_t size)
+{
+    if (surface.bytesPerPixel != 4 || pData == nullptr || size < QoiHeaderSize + QoiEndSize ||
+        memcmp(pData, QoiMagic, 4) != 0)
+    {
+        return false;
+    }
+
+    uint32_t width    = ReadBigEndian32(pData + 4);
+    uint32_t height   = ReadBigEndian32(pData + 8);
+    uint8_t  channels = pData[12];
+    if (width != surface.width || height != surface.height || (channels != 3 && channels != 4))
+    {
+        return false;
+    }
+
+    const uint8_t* p    = pData + QoiHeaderSize;
+    const uint8_t* pEnd = pData + size - QoiEndSize;
+
+    uint8_t  index[64][4] = {};
+    uint8_t  px[4]        = {0, 0, 0, 255};
+    uint32_t run          = 0;
+
+    for (uint32_t y = 0; y < height; y++)
+    {
+        uint8_t* pRow = surface.pData + static_cast<size_t>(y) * surface.rowPitch;
+        for (uint32_t x = 0; x < width; x++)
+        {
+            if (run != 0)
+            {
+                run--;
+            }
+            else
+            {
+                if (p >= pEnd)
+                {
+                    return false;
+                }
+
+                uint8_t op = *p++;
+                if (op == 0xFE)
+                {
+                    if (pEnd - p < 3)
+                    {
+                        return false;
+                    }
+                    memcpy(px, p, 3);
+                    p += 3;
+                }
+                else if (op == 0xFF)
+                {
+                    if (pEnd - p < 4)
+                    {
+                        return false;
+                    }
+                    memcpy(px, p, 4);
+                    p += 4;
+                }
+                else if ((op & 0xC0) == 0x00)
+                {
+                    memcpy(px, index[op], 4);
+                }
+                else if ((op & 0xC0) == 0x40)
+                {
+                    px[0] = static_cast<uint8_t>(px[0] + ((op >> 4) & 3) - 2);
+                    px[1] = static_cast<uint8_t>(px[1] + ((op >> 2) & 3) - 2);
+                    px[2] = static_cast<uint8_t>(px[2] + (op & 3) - 2);
+                }
+                else if ((op & 0xC0) == 0x80)
+                {
+                    if (p >= pEnd)
+                    {
+                        return false;
+                    }
+                    int dg = (op & 0x3F) - 32;
+                    int rb = *p++;
+                    px[0]  = static_cast<uint8_t>(px[0] + dg - 8 + (rb >> 4));
+                    px[1]  = static_cast<uint8_t>(px[1] + dg);
+                    px[2]  = static_cast<uint8_t>(px[2] + dg - 8 + (rb & 15));
+                }
+                else
+                {
+                    run = op & 0x3F;
+                }
+                memcpy(index[QoiHash(px)], px, 4);
+            }
+            memcpy(pRow + static_cast<size_t>(x) * 4, px, 4);
+        }
+    }
+    return true;
+}
+
+// Reads the dimensions of a PNG, QOI or raw image from its first bytes; other formats go through stb.
+inline bool GetImageInfo(const uint8_t* pData, size_t size, uint32_t& width, uint32_t& height)
+{
+    switch (DetectImageFormat(pData, size))
+    {
+    case ImageFormat::Qoi:
+        width  = ReadBigEndian32(pData + 4);
+        height = ReadBigEndian32(pData + 8);
+        return true;
+    case ImageFormat::Raw:
+    {
+        RawImageHeader header;
+        memcpy(&header, pData, sizeof(header));
+        width  = header.width;
+        height = header.height;
+        return true;
+    }
+    case ImageFormat::Png:
+    case ImageFormat::Count:
+    default:
+    {
+        int w  = 0;
+        int h  = 0;
+        int ch = 0;
+        if (pData == nullptr || !stbi_info_from_memory(pData, static_cast<int>(size), &w, &h, &ch))
+        {
+            return false;
+        }
+        width  = static_cast<uint32_t>(w);
+        height = static_cast<uint32_t>(h);
+        return true;
+    }
+    }
+}
+
+// Decodes a colour input of any supported format into an RGBA8 surface. The container is recognised from its
+// signature, so the file extension does not have to match.
+inline bool DecodeImageToSurface(const PitchedSurface& surface, const uint8_t* pData, size_t size)
+{
+    switch (DetectImageFormat(pData, size))
+    {
+    case ImageFormat::Qoi:
+        return DecodeQoiToSurface(surface, pData, size);
+    case ImageFormat::Raw:
+    {
+        RawImageHeader header;
+        memcpy(&header, pData, sizeof(header));
+        if (surface.bytesPerPixel != 4 || header.width != surface.width || header.height != surface.height)
+        {
+            return false;
+        }
+        return CopyRowsToSurface(surface, pData + sizeof(header), size - sizeof(header));
+    }
+    case ImageFormat::Png:
+    case ImageFormat::Count:
+    default:
+        return DecodePngToSurface(surface, pData, size);
+    }
+}
@@ -0,0 +1,418 @@
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+
+// Table-driven zlib/deflate decoder for the colour input fast path. Literal/length and distance codes of up to
+// FastBits bits resolve with one table lookup, the bit buffer is refilled eight bytes at a time and matches are copied
+// in 8-byte steps. The caller provides an output buffer of exactly the expected size plus InflateOutputSlack bytes.
+
+static constexpr size_t InflateOutputSlack = 8;
+
+class HuffmanTable
+{
+public:
+    static constexpr uint32_t FastBits = 10;
+    static constexpr uint32_t MaxBits  = 15;
+
+    bool Build(const uint8_t* pLengths, uint32_t count)
+    {
+        uint32_t lengthCount[MaxBits + 1] = {};
+        for (uint32_t i = 0; i < count; i++)
+        {
+            lengthCount[pLengths[i]]++;
+        }
+        lengthCount[0] = 0;
+
+        int left = 1;
+        for (uint32_t len = 1; len <= MaxBits; len++)
+        {
+            left = (left << 1) - static_cast<int>(lengthCount[len]);
+            if (left < 0)
+            {
+                return false;
+            }
+        }
+
+        uint32_t nextCode[MaxBits + 1] = {};
+        uint32_t code                  = 0;
+        uint32_t symbolIndex           = 0;
+        for (uint32_t len = 1; len <= MaxBits; len++)
+        {
+            nextCode[len]    = code;
+            m_firstCode[len] = static_cast<uint16_t>(code);
+            m_firstIdx[len]  = static_cast<uint16_t>(symbolIndex);
+            m_maxCode[len]   = (code + lengthCount[len]) << (16 - len);
+            code             = (code + lengthCount[len]) << 1;
+            symbolIndex += lengthCount[len];
+        }
+        m_symbolCount = symbolIndex;
+
+        memset(m_fast, 0, sizeof(m_fast));
+        for (uint32_t symbol = 0; symbol < count; symbol++)
+        {
+            uint32_t len = pLengths[symbol];
+            if (len == 0)
+            {
+                continue;
+            }
+            uint32_t c = nextCode[len]++;
+            m_symbols[m_firstIdx[len] + (c - m_firstCode[len])] = static_cast<uint16_t>(symbol);
+            if (len <= FastBits)
+            {
+                for (uint32_t j = Reverse(c, len); j < (1u << FastBits); j += 1u << len)
+                {
+                    m_fast[j] = static_cast<uint16_t>((len << 9) | symbol);
+                }
+            }
+        }
+        return true;
+    }
+
+    // Decodes one symbol from the low bits of the buffer. Returns the symbol and the code length, or -1.
+    int Decode(uint64_t bits, uint32_t& length) const
+    {
+        uint32_t entry = m_fast[bits & ((1u << FastBits) - 1)];
+        if (entry != 0)
+        {
+            length = entry >> 9;
+            return static_cast<int>(entry & 0x1FF);
+        }
+
+        uint32_t k = Reverse(static_cast<uint32_t>(bits & 0xFFFF), 16);
+        uint32_t len;
+        for (len = FastBits + 1; len <= MaxBits; len++)
+        {
+            if (k < m_maxCode[len])
+            {
+                break;
+            }
+        }
+        if (len > MaxBits)
+        {
+            return -1;
+        }
+        uint32_t index = (k >> (16 - len)) - m_firstCode[len] + m_firstIdx[len];
+        if (index >= m_symbolCount)
+        {
+            return -1;
+        }
+        length = len;
+        return m_symbols[index];
+    }
+
+private:
+    static uint32_t Reverse(uint32_t code, uint32_t bits)
+    {
+        code = ((code & 0xAAAA) >> 1) | ((code & 0x5555) << 1);
+        code = ((code & 0xCCCC) >> 2) | ((code & 0x3333) << 2);
+        code = ((code & 0xF0F0) >> 4) | ((code & 0x0F0F) << 4);
+        code = ((code & 0xFF00) >> 8) | ((code & 0x00FF) << 8);
+        return code >> (16 - bits);
+    }
+
+    uint16_t m_fast[1u << FastBits] = {};
+    uint16_t m_firstCode[MaxBits + 1] = {};
+    uint16_t m_firstIdx[MaxBits + 1]  = {};
+    uint32_t m_maxCode[MaxBits + 1]   = {};
+    uint16_t m_symbols[288]           = {};
+    uint32_t m_symbolCount            = 0;
+};
+
+class Inflater
+{
+public:
+    // Decodes a zlib stream into pOut. Succeeds only if exactly outSize bytes are produced. The Adler-32 trailer is
+    // not verified; the PNG CRCs are not either, matching stb.
+    bool InflateZlib(const uint8_t* pIn, size_t inSize, uint8_t* pOut, size_t outSize)
+    {
+        if (inSize < 2 || (pIn[0] & 0x0F) != 8 || ((pIn[0] << 8) | pIn[1]) % 31 != 0 || (pIn[1] & 0x20) != 0)
+        {
+            return false;
+        }
+
+        m_pIn      = pIn + 2;
+        m_pInEnd   = pIn + inSize;
+        m_bits     = 0;
+        m_bitCount = 0;
+        m_overrun  = 0;
+        m_pOutBase = pOut;
+        m_pOut     = pOut;
+        m_pOutEnd  = pOut + outSize;
+
+        bool last = false;
+        while (!last)
+        {
+            Refill();
+            last          = GetBits(1) != 0;
+            uint32_t type = GetBits(2);
+
+            bool ok = false;
+            if (type == 0)
+            {
+                ok = Stored();
+            }
+            else if (type == 1)
+            {
+                ok = BuildFixedTables() && Compressed();
+            }
+            else if (type == 2)
+            {
+                ok = BuildDynamicTables() && Compressed();
+            }
+            if (!ok || m_overrun > 8)
+            {
+                return false;
+            }
+        }
+        return m_pOut == m_pOutEnd;
+    }
+
+private:
+    void Refill()
+    {
+        if (m_pInEnd - m_pIn >= 8)
+        {
+            uint64_t word;
+            memcpy(&word, m_pIn, 8);
+            m_bits |= word << m_bitCount;
+            m_pIn += (63 - m_bitCount) >> 3;
+            m_bitCount |= 56;
+            return;
+        }
+        while (m_bitCount <= 56)
+        {
+            if (m_pIn < m_pInEnd)
+            {
+                m_bits |= static_cast<uint64_t>(*m_pIn++) << m_bitCount;
+            }
+            else
+            {
+                m_overrun++;
+            }
+            m_bitCount += 8;
+        }
+    }
+
+    uint32_t GetBits(uint32_t count)
+    {
+        uint32_t value = static_cast<uint32_t>(m_bits & ((uint64_t(1) << count) - 1));
+        m_bits >>= count;
+        m_bitCount -= count;
+        return value;
+    }
+
+    int DecodeSymbol(const HuffmanTable& table)
+    {
+        uint32_t length = 0;
+        int      symbol = table.Decode(m_bits, length);
+        if (symbol >= 0)
+        {
+            m_bits >>= length;
+            m_bitCount -= length;
+        }
+        return symbol;
+    }
+
+    bool Stored()
+    {
+        GetBits(m_bitCount & 7);
+        Refill();
+        uint32_t len  = GetBits(16);
+        uint32_t nlen = GetBits(16);
+        if ((len ^ 0xFFFF) != nlen || len > static_cast<size_t>(m_pOutEnd - m_pOut))
+        {
+            return false;
+        }
+        while (len > 0 && m_bitCount >= 8)
+        {
+            *m_pOut++ = static_cast<uint8_t>(GetBits(8));
+            len--;
+        }
+        // Hand whole buffered bytes back to the input before copying directly. Zero bytes padded in past the end of
+        // the input were never taken from it.
+        uint32_t pending = m_bitCount >> 3;
+        uint32_t padding = pending < m_overrun ? pending : m_overrun;
+        m_pIn -= pending - padding;
+        m_overrun -= padding;
+        m_bits     = 0;
+        m_bitCount = 0;
+        if (len > static_cast<size_t>(m_pInEnd - m_pIn))
+        {
+            return false;
+        }
+        memcpy(m_pOut, m_pIn, len);
+        m_pOut += len;
+        m_pIn += len;
+        return true;
+    }
+
+    bool BuildFixedTables()
+    {
+        uint8_t lengths[288 + 32];
+        memset(lengths, 8, 144);
+        memset(lengths + 144, 9, 112);
+        memset(lengths + 256, 7, 24);
+        memset(lengths + 280, 8, 8);
+        memset(lengths + 288, 5, 32);
+        return m_litLen.Build(lengths, 288) && m_dist.Build(lengths + 288, 32);
+    }
+
+    bool BuildDynamicTables()
+    {
+        static const uint8_t CodeLengthOrder[19] = {16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15};
+
+        Refill();
+        uint32_t litCount  = GetBits(5) + 257;
+        uint32_t distCount = GetBits(5) + 1;
+        uint32_t lenCount  = GetBits(4) + 4;
+
+        uint8_t codeLengths[19] = {};
+        for (uint32_t i = 0; i < lenCount; i++)
+        {
+            Refill();
+            codeLengths[CodeLengthOrder[i]] = static_cast<uint8_t>(GetBits(3));
+        }
+
+        HuffmanTable lengthTable;
+        if (!lengthTable.Build(codeLengths, 19))
+        {
+            return false;
+        }
+
+        uint8_t  lengths[288 + 32] = {};
+        uint32_t total             = litCount + distCount;
+        for (uint32_t n = 0; n < total;)
+        {
+            Refill();
+            int symbol = DecodeSymbol(lengthTable);
+            if (symbol < 0)
+            {
+                return false;
+            }
+            if (symbol < 16)
+            {
+                lengths[n++] = static_cast<uint8_t>(symbol);
+                continue;
+            }
+
+            uint8_t  fill   = 0;
+            uint32_t repeat = 0;
+            if (symbol == 16)
+            {
+                if (n == 0)
+                {
+                    return false;
+                }
+                fill   = lengths[n - 1];
+                repeat = GetBits(2) + 3;
+            }
+            else if (symbol == 17)
+            {
+                repeat = GetBits(3) + 3;
+            }
+            else
+            {
+                repeat = GetBits(7) + 11;
+            }
+            if (n + repeat > total)
+            {
+                return false;
+            }
+            memset(lengths + n, fill, repeat);
+            n += repeat;
+        }
+
+        return m_litLen.Build(lengths, litCount) && m_dist.Build(lengths + litCount, distCount);
+    }
+
+    bool Compressed()
+    {
+        static const uint16_t LengthBase[29]  = {3,  4,  5,  6,  7,  8,  9,  10, 11,  13,  15,  17,  19,  23, 27,
+                                                 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258};
+        static const uint8_t  LengthExtra[29] = {0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2,
+                                                 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0};
+        static const uint16_t DistBase[30]    = {1,    2,    3,    4,    5,    7,     9,     13,    17,  25,
+                                                 33,   49,   65,   97,   129,  193,   257,   385,   513, 769,
+                                                 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577};
+        static const uint8_t  DistExtra[30]   = {0, 0, 0, 0, 1, 1, 2, 2,  3,  3,  4,  4,  5,  5,  6,
+                                                 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
+
+        for (;;)
+        {
+            Refill();
+            int symbol = DecodeSymbol(m_litLen);
+            if (symbol < 0)
+            {
+                return false;
+            }
+            if (symbol < 256)
+            {
+                if (m_pOut == m_pOutEnd)
+                {
+                    return false;
+                }
+                *m_pOut++ = static_cast<uint8_t>(symbol);
+                continue;
+            }
+            if (symbol == 256)
+            {
+                return true;
+            }
+
+            symbol -= 257;
+            if (symbol >= 29)
+            {
+                return false;
+            }
+            uint32_t length = LengthBase[symbol] + GetBits(LengthExtra[symbol]);
+
+            int distSymbol = DecodeSymbol(m_dist);
+            if (distSymbol < 0 || distSymbol >= 30)
+            {
+                return false;
+            }
+            uint32_t distance = DistBase[distSymbol] + GetBits(DistExtra[distSymbol]);
+
+            if (distance > static_cast<size_t>(m_pOut - m_pOutBase) || length > static_cast<size_t>(m_pOutEnd - m_pOut))
+            {
+                return false;
+            }
+
+            uint8_t*       pDst = m_pOut;
+            const uint8_t* pSrc = m_pOut - distance;
+            m_pOut += length;
+            if (distance >= 8)
+            {
+                // May write up to 7 bytes past the match, into the next match or the caller's slack.
+                for (; pDst < m_pOut; pDst += 8, pSrc += 8)
+                {
+                    memcpy(pDst, pSrc, 8);
+                }
+            }
+            else if (distance == 1)
+            {
+                memset(pDst, *pSrc, length);
+            }
+            else
+            {
+                for (; pDst < m_pOut; pDst++, pSrc++)
+                {
+                    *pDst = *pSrc;
+                }
+            }
+        }
+    }
+
+    const uint8_t* m_pIn      = nullptr;
+    const uint8_t* m_pInEnd   = nullptr;
+    uint64_t       m_bits     = 0;
+    uint32_t       m_bitCount = 0;
+    uint32_t       m_overrun  = 0;
+    uint8_t*       m_pOutBase = nullptr;
+    uint8_t*       m_pOut     = nullptr;
+    uint8_t*       m_pOutEnd  = nullptr;
+
+    HuffmanTable m_litLen;
+    HuffmanTable m_dist;
+};
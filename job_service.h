@@ -0,0 +1,234 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <filesystem>
+#include <memory>
+#include <string>
+
+#ifdef _WIN32
+// winsock2.h has to be seen before windows.h, which otherwise pulls in the old winsock.h; main.cpp includes it first.
+#include <winsock2.h>
+#include <afunix.h>
+#pragma comment(lib, "ws2_32")
+#else
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+// Local job service transport: newline-delimited messages over a Unix domain stream socket, so CI can submit many
+// small jobs to one long-lived generator instead of paying device creation and shader loading per run.
+// Windows 10 1803 and later provide AF_UNIX sockets through afunix.h; the socket is a path on both platforms.
+// A connection carries one request line at a time and any number of reply lines; either side may close it.
+
+static constexpr size_t JobServiceMaxLine = 64 * 1024;
+
+#ifdef _WIN32
+using SocketHandle                          = SOCKET;
+static constexpr SocketHandle InvalidSocket = INVALID_SOCKET;
+#else
+using SocketHandle                          = int;
+static constexpr SocketHandle InvalidSocket = -1;
+#endif
+
+#if defined(MSG_NOSIGNAL)
+static constexpr int JobServiceSendFlags = MSG_NOSIGNAL; // a client that went away must not kill the service
+#else
+static constexpr int JobServiceSendFlags = 0;
+#endif
+
+inline void CloseSocket(SocketHandle socket)
+{
+#ifdef _WIN32
+    closesocket(socket);
+#else
+    close(socket);
+#endif
+}
+
+inline bool StartSockets()
+{
+#ifdef _WIN32
+    static const bool started = [] {
+        WSADATA data = {};
+        return WSAStartup(MAKEWORD(2, 2), &data) == 0;
+    }();
+    return started;
+#else
+    return true;
+#endif
+}
+
+inline bool MakeUnixAddress(const std::string& path, sockaddr_un& address)
+{
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (path.empty() || path.size() >= sizeof(address.sun_path))
+    {
+        return false;
+    }
+    memcpy(address.sun_path, path.c_str(), path.size());
+    return true;
+}
+
+// One connected stream, read and written a line at a time.
+class LineSocket
+{
+public:
+    explicit LineSocket(SocketHandle socket) : m_socket(socket)
+    {
+    }
+
+    ~LineSocket()
+    {
+        CloseSocket(m_socket);
+    }
+
+    LineSocket(const LineSocket&)            = delete;
+    LineSocket& operator=(const LineSocket&) = delete;
+
+    // Returns the next line without its terminator. Fails at the end of the stream, on errors and on lines longer
+    // than JobServiceMaxLine.
+    bool ReadLine(std::string& line)
+    {
+        for (;;)
+        {
+            size_t end = m_buffer.find('\n', m_scanned);
+            if (end != std::string::npos)
+            {
+                line.assign(m_buffer, 0, end);
+                if (!line.empty() && line.back() == '\r')
+                {
+                    line.pop_back();
+                }
+                m_buffer.erase(0, end + 1);
+                m_scanned = 0;
+                return true;
+            }
+            m_scanned = m_buffer.size();
+            if (m_buffer.size() > JobServiceMaxLine)
+            {
+                return false;
+            }
+
+            char chunk[4096];
+            int  received = static_cast<int>(recv(m_socket, chunk, sizeof(chunk), 0));
+            if (received <= 0)
+            {
+                return false;
+            }
+            m_buffer.append(chunk, static_cast<size_t>(received));
+        }
+    }
+
+    bool WriteLine(const std::string& line)
+    {
+        std::string message = line + "\n";
+        size_t      sent    = 0;
+        while (sent < message.size())
+        {
+            int result = static_cast<int>(
+                send(m_socket, message.data() + sent, static_cast<int>(message.size() - sent), JobServiceSendFlags));
+            if (result <= 0)
+            {
+                return false;
+            }
+            sent += static_cast<size_t>(result);
+        }
+        return true;
+    }
+
+    // Ends the connection in both directions, so that a ReadLine blocked on another thread returns false.
+    void Shutdown()
+    {
+#ifdef _WIN32
+        shutdown(m_socket, SD_BOTH);
+#else
+        shutdown(m_socket, SHUT_RDWR);
+#endif
+    }
+
+private:
+    SocketHandle m_socket;
+    std::string  m_buffer;
+    size_t       m_scanned = 0;
+};
+
+// Listening end of the service. A stale socket file from a previous run is replaced, and the file is removed again
+// when the listener goes away.
+class JobListener
+{
+public:
+    static std::unique_ptr<JobListener> Listen(const std::string& path)
+    {
+        sockaddr_un address = {};
+        if (!StartSockets() || !MakeUnixAddress(path, address))
+        {
+            return nullptr;
+        }
+
+        SocketHandle socket = ::socket(AF_UNIX, SOCK_STREAM, 0);
+        if (socket == InvalidSocket)
+        {
+            return nullptr;
+        }
+
+        std::error_code error;
+        std::filesystem::remove(path, error);
+        if (bind(socket, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0 || listen(socket, 16) != 0)
+        {
+            CloseSocket(socket);
+            return nullptr;
+        }
+        return std::unique_ptr<JobListener>(new JobListener(socket, path));
+    }
+
+    ~JobListener()
+    {
+        CloseSocket(m_socket);
+        std::error_code error;
+        std::filesystem::remove(m_path, error);
+    }
+
+    JobListener(const JobListener&)            = delete;
+    JobListener& operator=(const JobListener&) = delete;
+
+    // Blocks until a client connects.
+    std::unique_ptr<LineSocket> Accept()
+    {
+        SocketHandle client = accept(m_socket, nullptr, nullptr);
+        return client != InvalidSocket ? std::make_unique<LineSocket>(client) : nullptr;
+    }
+
+private:
+    JobListener(SocketHandle socket, const std::string& path) : m_socket(socket), m_path(path)
+    {
+    }
+
+    SocketHandle m_socket;
+    std::string  m_path;
+};
+
+inline std::unique_ptr<LineSocket> ConnectJobService(const std::string& path)
+{
+    sockaddr_un address = {};
+    if (!StartSockets() || !MakeUnixAddress(path, address))
+    {
+        return nullptr;
+    }
+
+    SocketHandle socket = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    if (socket == InvalidSocket)
+    {
+        return nullptr;
+    }
+    if (connect(socket, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0)
+    {
+        CloseSocket(socket);
+        return nullptr;
+    }
+    return std::make_unique<LineSocket>(socket);
+}
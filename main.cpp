@@ -1,12 +1,21 @@
 #define _CRT_SECURE_NO_WARNINGS
 
-#include <d3d11.h>
+#ifdef _WIN32
+#include <winsock2.h>
+#endif
 
 #include <array>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
 #include <filesystem>
 #include <fstream>
+#include <functional>
 #include <map>
+#include <mutex>
+#include <sstream>
 #include <string>
+#include <thread>
 #include <vector>
 #include <iostream>
 
@@ -15,22 +24,27 @@
 #include "stb_image.h"
 #include "stb_image_write.h"
 #include "util.h"
+#include "frame_generation.h"
+#include "async_io.h"
+#include "camera_motion.h"
+#include "frame_archive.h"
+#include "frame_stream.h"
+#include "shm_ring.h"
+#include "job_service.h"
+#include "image_decode.h"
+#include "image_formats.h"
+#include "frame_writer.h"
+#include "frame_tasks.h"
+#include "pipeline.h"
+#include "cpu_topology.h"
+#include "session_scheduler.h"
+#include "shard_coordinator.h"
 
 #define JSON_NOEXCEPTION 1
 #include "json.h"
 
 using json = nlohmann::json;
 
-struct FrameGenerationInputCb
-{
-    float    prevClipToClip[16];
-    float    clipToPrevClip[16];
-    float    tipTopDistance[2];
-    float    viewportSize[2];
-    float    viewportInv[2];
-    uint32_t dimensions[2]; // x, y
-};
-
 struct ConfigInfo
 {
     DXGI_FORMAT depthFormat;
@@ -38,1195 +52,2605 @@ struct ConfigInfo
     uint32_t    beginFrameId;
     uint32_t    endFrameId;
     uint32_t    interpolatedFrames;
+    uint32_t    prefetchPairs;
+    uint32_t    ioThreads;
+    bool        directIo;
+    int         pngCompressionLevel;
+    uint32_t    workerThreads;
+    uint32_t    readbackDepth;
+    ImageFormat outputFormat;
+    ImageFormat colorInputFormat;
+    std::string archive;
+    bool        synthesizeMotion;
+    std::string colorStream;
+    std::string clipInfoStream;
+    std::string depthStream;
+    std::string motionStream;
+    std::string outputStream;
+    uint32_t    inputRateNum;
+    uint32_t    inputRateDen;
+    std::string sharedMemoryRing;
+    uint32_t    concurrentSessions;
+    json        sessions;
+    uint32_t    parallelPairs;
+    bool        warp;
+    uint32_t    tileSize;
+    bool        lowLatency;
+    uint32_t    pipelineLoadThreads;
+    uint32_t    pipelineEncodeThreads;
+    uint32_t    pipelineQueueDepth;
+    bool        pinThreads;
+    bool        physicalCoresOnly;
+    bool        bindNumaNodes;
+    bool        coroutineSessions;
+    uint32_t    batchWorkers;
+    uint32_t    shardPairs;
 };
 
-uint32_t g_ColorWidth;
-uint32_t g_ColorHeight;
+ConfigInfo g_configInfo = {DXGI_FORMAT_R24_UNORM_X8_TYPELESS, DXGI_FORMAT_R16G16_FLOAT, 0, 1, 1, 2, 8, false, 6, 0, 3, ImageFormat::Png, ImageFormat::Png, "", false, "", "", "", "", "", 30, 1, "", 2, json::array(), 1, false, 64, false, 0, 1, 8, false, false, false, false, 4, 64};
 
-ID3D11Device*        g_pDevice;
-ID3D11DeviceContext* g_pContext;
+// The CPU workers of one NUMA node, or of the whole machine when BindNumaNodes is off: a pool and its handle for the
+// generator.
+struct WorkerGroup
+{
+    int32_t                     node = -1; // -1 when the group is not bound to a node
+    std::vector<LogicalCpu>     cpus;      // where the group's threads run, in placement order
+    std::unique_ptr<ThreadPool> pPool;
+    FgWorkerPool                fgPool = nullptr;
+};
+
+// Shared by every session: the file reader, the worker groups, and where the input buffers were found relative to the
+// threads that used them.
+std::unique_ptr<AsyncFileReader> g_pFileReader;
+std::vector<WorkerGroup>         g_workerGroups;
+NumaPlacementCounters            g_inputPlacement;
 
-static constexpr size_t ComputeShaderTypeCount = static_cast<size_t>(ComputeShaderType::Count);
-static constexpr size_t StagTypeCount          = static_cast<size_t>(StagResType::Count);
-static constexpr size_t InputTypeCount         = static_cast<size_t>(InputResType::Count);
-static constexpr size_t ConstBufferTypeCount   = static_cast<size_t>(ConstBufferType::Count);
-static constexpr size_t InternalTypeCount      = static_cast<size_t>(InternalResType::Count);
-static constexpr size_t SamplerTypeCount      = static_cast<size_t>(SamplerType::Count);
+std::mutex g_logMutex;
 
-std::array<ID3D11ComputeShader*, ComputeShaderTypeCount> ComputeShaders{};
+// One generation stream: its config, input source, generator and writer. A plain run and each service job use one
+// session; "Sessions" in config.json runs several at once, each on its own thread.
+struct Session
+{
+    std::string                        name;      // prefixes the session's messages; empty for a single run
+    std::string                        directory; // holds the input folders and ColorOutput/; empty for the working one
+    ConfigInfo                         config;
+    std::unique_ptr<FramePrefetcher>   pPrefetcher;
+    std::unique_ptr<FrameArchive>      pArchive;
+    std::unique_ptr<FrameStreamReader> pStreamReader;
+    std::unique_ptr<ShmFrameSource>    pShmSource;
+    std::unique_ptr<FrameWriter>       pFrameWriter;
+    FILE*                              pOutputStream = nullptr;
+    FgContext                          context       = nullptr;
+    uint32_t                           width         = 0;
+    uint32_t                           height        = 0;
+    SessionScheduler*                  pScheduler    = nullptr;
+    uint32_t                           schedulerId   = 0;
+    WorkerGroup*                       pWorkers      = nullptr; // runs the session's CPU work, holds its buffers
+};
 
-std::array<ID3D11Texture2D*, StagTypeCount> StagResourceList{};
+// Collects one message and prints it as a whole line, prefixed with the session name, so that concurrent sessions do
+// not interleave their output.
+class SessionLog
+{
+public:
+    explicit SessionLog(const Session& session) : m_session(session)
+    {
+    }
 
-std::array<ID3D11Texture2D*, InputTypeCount> InputResourceList{};
-std::array<ResourceView, InputTypeCount>     InputResourceViewList{};
+    ~SessionLog()
+    {
+        std::lock_guard<std::mutex> lock(g_logMutex);
+        std::cout << (m_session.name.empty() ? "" : "[" + m_session.name + "] ") << m_stream.str() << std::endl;
+    }
 
-std::array<ID3D11Buffer*, ConstBufferTypeCount> ConstantBufferList{};
+    template <typename T>
+    SessionLog& operator<<(const T& value)
+    {
+        m_stream << value;
+        return *this;
+    }
 
-std::array<ID3D11Texture2D*, InternalTypeCount> InternalResourceList{};
-std::array<ResourceView, InternalTypeCount>     InternalResourceViewList{};
+private:
+    const Session&     m_session;
+    std::ostringstream m_stream;
+};
 
-std::array<ID3D11SamplerState*, SamplerTypeCount> SamplerList{};
+// Resolves a path from the config against the session's directory.
+std::string SessionPath(const Session& session, const std::string& path)
+{
+    return session.directory.empty() ? path : (std::filesystem::path(session.directory) / path).string();
+}
 
-std::map<ID3D11Resource*, ResourceView> ResourceViewMap{};
+// The JSON library is built without exceptions, so get<T>() on a value of another type would abort the process. Config
+// values are type checked first; a value of the wrong type is reported and its key left alone.
+bool IsConfigType(const json& value, uint32_t*)
+{
+    return value.is_number_unsigned();
+}
 
-FrameGenerationInputCb g_constBufData;
-ConfigInfo             g_configInfo = {DXGI_FORMAT_R24_UNORM_X8_TYPELESS, DXGI_FORMAT_R16G16_FLOAT, 0, 1, 1};
+bool IsConfigType(const json& value, int*)
+{
+    return value.is_number_integer();
+}
 
-// Outputs
-ID3D11Texture2D*           g_pColorOutput;
-ID3D11UnorderedAccessView* g_pColorOutputUav;
+bool IsConfigType(const json& value, bool*)
+{
+    return value.is_boolean();
+}
 
-#pragma comment(lib, "d3d11")
+bool IsConfigType(const json& value, std::string*)
+{
+    return value.is_string();
+}
 
-#define RELEASE_SAFE(pObj) \
-    if (pObj != nullptr)   \
-    {                      \
-        pObj->Release();   \
-        pObj = nullptr;    \
+// Reads config[key] into value if it is present and of value's type. A wrong type is added to error.
+template <typename T>
+bool GetConfigValue(const json& config, const char* key, T& value, std::string& error)
+{
+    auto found = config.find(key);
+    if (found == config.end())
+    {
+        return false;
     }
+    if (!IsConfigType(*found, static_cast<T*>(nullptr)))
+    {
+        error += (error.empty() ? "" : ", ") + std::string(key) + " has the wrong type";
+        return false;
+    }
+    value = found->get<T>();
+    return true;
+}
 
-void ParseConfig(ConfigInfo& info)
+// Applies the keys present in a config.json object; the job service uses it for request overrides as well. Returns
+// the keys that were skipped because their values have the wrong type, or an empty string.
+std::string ApplyConfig(const json& config, ConfigInfo& info)
 {
-    json config = {};
-    std::ifstream file("config.json");
+    std::string error;
+    if (!config.is_object())
+    {
+        return "the config is not a JSON object";
+    }
+
+    uint32_t    number = 0;
+    std::string text;
+    if (GetConfigValue(config, "DepthFormat", number, error))
+    {
+        info.depthFormat = static_cast<DXGI_FORMAT>(number);
+    }
+    if (GetConfigValue(config, "MevcFormat", number, error))
+    {
+        info.mevcFormat = static_cast<DXGI_FORMAT>(number);
+    }
+    GetConfigValue(config, "BeginFrameId", info.beginFrameId, error);
+    GetConfigValue(config, "EndFrameId", info.endFrameId, error);
+    GetConfigValue(config, "InterpolatedFrames", info.interpolatedFrames, error);
+    GetConfigValue(config, "PrefetchPairs", info.prefetchPairs, error);
+    GetConfigValue(config, "IoThreads", info.ioThreads, error);
+    GetConfigValue(config, "DirectIo", info.directIo, error);
+    GetConfigValue(config, "PngCompressionLevel", info.pngCompressionLevel, error);
+    GetConfigValue(config, "WorkerThreads", info.workerThreads, error);
+    if (GetConfigValue(config, "ReadbackDepth", number, error))
+    {
+        info.readbackDepth = (std::max)(number, 1u);
+    }
+    if (GetConfigValue(config, "OutputFormat", text, error) && !ParseImageFormat(text, info.outputFormat))
+    {
+        std::cout << "Unknown OutputFormat, using png" << std::endl;
+    }
+    if (GetConfigValue(config, "ColorInputFormat", text, error) && !ParseImageFormat(text, info.colorInputFormat))
+    {
+        std::cout << "Unknown ColorInputFormat, using png" << std::endl;
+    }
+    GetConfigValue(config, "Archive", info.archive, error);
+    GetConfigValue(config, "SynthesizeMotion", info.synthesizeMotion, error);
+    GetConfigValue(config, "ColorStream", info.colorStream, error);
+    GetConfigValue(config, "ClipInfoStream", info.clipInfoStream, error);
+    GetConfigValue(config, "DepthStream", info.depthStream, error);
+    GetConfigValue(config, "MotionStream", info.motionStream, error);
+    GetConfigValue(config, "OutputStream", info.outputStream, error);
+    if (GetConfigValue(config, "InputFrameRate", text, error) &&
+        !ParseY4mFrameRate(text, info.inputRateNum, info.inputRateDen))
+    {
+        std::cout << "Invalid InputFrameRate, using 30" << std::endl;
+        info.inputRateNum = 30;
+        info.inputRateDen = 1;
+    }
+    GetConfigValue(config, "SharedMemoryRing", info.sharedMemoryRing, error);
+    GetConfigValue(config, "ConcurrentSessions", info.concurrentSessions, error);
+    if (config.contains("Sessions") && config["Sessions"].is_array())
+    {
+        info.sessions = config["Sessions"];
+    }
+    if (GetConfigValue(config, "ParallelPairs", number, error))
+    {
+        info.parallelPairs = (std::max)(number, 1u);
+    }
+    GetConfigValue(config, "Warp", info.warp, error);
+    if (GetConfigValue(config, "TileSize", number, error))
+    {
+        info.tileSize = (std::max)(number, 1u);
+    }
+    GetConfigValue(config, "LowLatency", info.lowLatency, error);
+    GetConfigValue(config, "PipelineLoadThreads", info.pipelineLoadThreads, error);
+    if (GetConfigValue(config, "PipelineEncodeThreads", number, error))
+    {
+        info.pipelineEncodeThreads = (std::max)(number, 1u);
+    }
+    if (GetConfigValue(config, "PipelineQueueDepth", number, error))
+    {
+        info.pipelineQueueDepth = (std::max)(number, 1u);
+    }
+    GetConfigValue(config, "PinThreads", info.pinThreads, error);
+    GetConfigValue(config, "PhysicalCoresOnly", info.physicalCoresOnly, error);
+    GetConfigValue(config, "BindNumaNodes", info.bindNumaNodes, error);
+    GetConfigValue(config, "CoroutineSessions", info.coroutineSessions, error);
+    if (GetConfigValue(config, "BatchWorkers", number, error))
+    {
+        info.batchWorkers = (std::max)(number, 1u);
+    }
+    if (GetConfigValue(config, "ShardPairs", number, error))
+    {
+        info.shardPairs = (std::max)(number, 1u);
+    }
+    return error;
+}
+
+// Applies the config file at path, config.json in the working directory by default. Returns false if there is none.
+// A file that is not valid JSON, or values of the wrong type, are reported on stderr and otherwise ignored; stdout may
+// be about to carry the Y4M output stream, which this runs before.
+bool ParseConfig(ConfigInfo& info, const std::string& path = "config.json")
+{
+    std::ifstream file(path);
     if (file.is_open())
     {
-        file >> config;
+        json        config = json::parse(file, nullptr, false);
+        std::string error  = config.is_discarded() ? "not valid JSON" : ApplyConfig(config, info);
+        if (!error.empty())
+        {
+            std::cerr << path << ": " << error << ", ignored" << std::endl;
+        }
+    }
+    return file.is_open();
+}
+
+// Frame size of the session's input source, taken from its header or from the first colour image.
+void GetInputDimensions(const Session& session, uint32_t& width, uint32_t& height)
+{
+    width  = 0;
+    height = 0;
+    if (session.pShmSource)
+    {
+        width  = session.pShmSource->Header().width;
+        height = session.pShmSource->Header().height;
+    }
+    else if (session.pStreamReader)
+    {
+        width  = session.pStreamReader->Width();
+        height = session.pStreamReader->Height();
+    }
+    else if (session.pArchive)
+    {
+        width  = session.pArchive->Header().width;
+        height = session.pArchive->Header().height;
+    }
+    else
+    {
+        std::vector<uint8_t> color = AcquireFileContent(SessionPath(
+            session,
+            GetFrameFilePath(FrameFileType::ColorInput,
+                             session.config.beginFrameId,
+                             ImageFormatExtension(session.config.colorInputFormat))));
+        GetImageInfo(color.data(), color.size(), width, height);
+    }
+}
 
-        if (config.contains("DepthFormat"))
+// The buffers are sampled for g_inputPlacement from the thread that is about to read them.
+FrameFiles AcquireFrame(Session& session, uint32_t frameId)
+{
+    FrameFiles files = session.pShmSource      ? session.pShmSource->Acquire(frameId)
+                       : session.pStreamReader ? session.pStreamReader->Acquire(frameId)
+                       : session.pArchive      ? session.pArchive->GetFrame(frameId)
+                                               : session.pPrefetcher->Acquire(frameId);
+    for (const FileBuffer& file : files)
+    {
+        g_inputPlacement.Sample(file.data(), file.size);
+    }
+    return files;
+}
+
+// Decodes every PNG in dir with stb and with DecodePngToSurface, checks that both agree and reports the timings.
+int RunPngBenchmark(const std::string& dir, uint32_t iterations)
+{
+    using Clock = std::chrono::steady_clock;
+
+    double   totalStb  = 0.0;
+    double   totalFast = 0.0;
+    uint32_t files     = 0;
+    uint32_t mismatch  = 0;
+
+    for (const auto& entry : std::filesystem::directory_iterator(dir))
+    {
+        if (entry.path().extension() != ".png")
         {
-            info.depthFormat = static_cast<DXGI_FORMAT>(config["DepthFormat"].get<uint32_t>());
+            continue;
         }
-        if (config.contains("MevcFormat"))
+
+        std::vector<uint8_t> png = AcquireFileContent(entry.path().string());
+        int                  w   = 0;
+        int                  h   = 0;
+        int                  ch  = 0;
+        if (png.empty() || !stbi_info_from_memory(png.data(), static_cast<int>(png.size()), &w, &h, &ch))
         {
-            info.mevcFormat = static_cast<DXGI_FORMAT>(config["MevcFormat"].get<uint32_t>());
+            continue;
         }
-        if (config.contains("BeginFrameId"))
+
+        std::vector<uint8_t> pixels(static_cast<size_t>(w) * h * 4);
+        PitchedSurface       surface = {pixels.data(), static_cast<uint32_t>(w) * 4, static_cast<uint32_t>(w),
+                                        static_cast<uint32_t>(h), 4};
+
+        auto           begin     = Clock::now();
+        unsigned char* pReference = nullptr;
+        for (uint32_t i = 0; i < iterations; i++)
         {
-            info.beginFrameId = config["BeginFrameId"].get<uint32_t>();
+            stbi_image_free(pReference);
+            pReference = stbi_load_from_memory(png.data(), static_cast<int>(png.size()), &w, &h, &ch, 4);
         }
-        if (config.contains("EndFrameId"))
+        double stbSeconds = std::chrono::duration<double>(Clock::now() - begin).count() / iterations;
+
+        begin = Clock::now();
+        bool decoded = true;
+        for (uint32_t i = 0; i < iterations; i++)
         {
-            info.endFrameId = config["EndFrameId"].get<uint32_t>();
+            decoded &= DecodePngToSurface(surface, png.data(), png.size());
         }
-        if (config.contains("InterpolatedFrames"))
+        double fastSeconds = std::chrono::duration<double>(Clock::now() - begin).count() / iterations;
+
+        bool match = decoded && pReference != nullptr && memcmp(pReference, pixels.data(), pixels.size()) == 0;
+        stbi_image_free(pReference);
+
+        std::cout << entry.path().filename().string() << " " << w << "x" << h << ": stb " << stbSeconds * 1000.0
+                  << " ms, fast " << fastSeconds * 1000.0 << " ms, x" << stbSeconds / fastSeconds
+                  << (match ? "" : " MISMATCH") << std::endl;
+
+        totalStb += stbSeconds;
+        totalFast += fastSeconds;
+        files++;
+        mismatch += match ? 0 : 1;
+    }
+
+    if (files != 0)
+    {
+        std::cout << files << " files: stb " << totalStb * 1000.0 / files << " ms, fast " << totalFast * 1000.0 / files
+                  << " ms per image, x" << totalStb / totalFast << ", " << mismatch << " mismatches" << std::endl;
+    }
+    return mismatch == 0 ? 0 : 1;
+}
+
+// Packs frames [first, last] of the directory layout into one archive file, using the formats from config.json.
+// With compress, depth and motion are tile coded on a pool of WorkerThreads threads.
+int PackArchive(const std::string& path, uint32_t first, uint32_t last, bool compress, bool motionResidual)
+{
+    uint32_t             width  = 0;
+    uint32_t             height = 0;
+    std::string          ext    = ImageFormatExtension(g_configInfo.colorInputFormat);
+    std::vector<uint8_t> color  = AcquireFileContent(GetFrameFilePath(FrameFileType::ColorInput, first, ext));
+    if (last < first || !GetImageInfo(color.data(), color.size(), width, height))
+    {
+        std::cout << "No colour input for frame " << first << std::endl;
+        return 1;
+    }
+
+    std::unique_ptr<ThreadPool> pPool;
+    if (compress)
+    {
+        pPool = std::make_unique<ThreadPool>(g_configInfo.workerThreads);
+    }
+
+    auto begin = std::chrono::steady_clock::now();
+    bool ok    = BuildFrameArchive(path,
+                                first,
+                                last,
+                                ext,
+                                width,
+                                height,
+                                g_configInfo.depthFormat,
+                                g_configInfo.mevcFormat,
+                                g_configInfo.directIo,
+                                pPool.get(),
+                                motionResidual);
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+
+    std::cout << (ok ? "Packed frames " : "Failed to pack frames ") << first << "-" << last << " into " << path
+              << " in " << seconds << " s";
+    if (ok)
+    {
+        uint64_t rawBytes = 0;
+        for (uint32_t frameId = first; frameId <= last; frameId++)
         {
-            info.interpolatedFrames = config["InterpolatedFrames"].get<uint32_t>();
+            for (uint32_t type = 0; type < FrameFileTypeCount; type++)
+            {
+                std::error_code error;
+                std::string     file = GetFrameFilePath(static_cast<FrameFileType>(type), frameId, ext);
+                uintmax_t       size = std::filesystem::file_size(file, error);
+                rawBytes += error ? 0 : size;
+            }
         }
+        std::error_code error;
+        uintmax_t       archiveBytes = std::filesystem::file_size(path, error);
+        std::cout << ", " << rawBytes / (1024.0 * 1024.0) << " MB of files -> " << archiveBytes / (1024.0 * 1024.0)
+                  << " MB";
+    }
+    std::cout << std::endl;
+
+    // Every frame is read back through the archive reader before the archive is trusted.
+    if (ok)
+    {
+        std::unique_ptr<FrameArchive> pArchive   = FrameArchive::Open(path, pPool.get());
+        uint32_t                      mismatches = pArchive ? VerifyFrameArchive(*pArchive, first, last, ext, false)
+                                                            : (last - first + 1) * FrameFileTypeCount;
+        std::cout << "Verified the archive: " << mismatches << " files differ from the capture" << std::endl;
+        ok = mismatches == 0;
     }
+    return ok ? 0 : 1;
 }
 
-DXGI_FORMAT GetInputResFormat(InputResType type)
+// Packs a small synthetic capture in dir, tile coded without and with motion residuals, and checks that every frame
+// reads back unchanged. From frame 1 on the depth is the same noise every frame: frame 1 cannot be shrunk and is
+// stored raw, and the frames after it repeat it and are coded from it. Returns 0 if both archives read back exactly.
+int RunArchiveTest(const std::string& dir)
 {
-    switch (type)
+    const uint32_t  Width  = 64;
+    const uint32_t  Height = 32;
+    const uint32_t  Frames = 6;
+    std::error_code error;
+    std::filesystem::create_directories(dir, error);
+    std::filesystem::current_path(dir, error);
+    if (error)
+    {
+        std::cout << "Cannot enter " << dir << std::endl;
+        return 1;
+    }
+    for (const char* folder : {"ColorInput", "ClipInfo", "Depth", "MotionVector"})
+    {
+        std::filesystem::create_directory(folder, error);
+    }
+
+    auto writeFile = [](const std::string& path, const void* pData, size_t bytes) {
+        std::ofstream file(path, std::ios::binary);
+        file.write(static_cast<const char*>(pData), static_cast<std::streamsize>(bytes));
+    };
+
+    // Identity CurrentClipToWorld and ClipToPrevClip: the camera does not move.
+    float clip[32] = {};
+    for (uint32_t i = 0; i < 4; i++)
+    {
+        clip[i * 5]      = 1.0f;
+        clip[16 + i * 5] = 1.0f;
+    }
+    std::vector<uint8_t>  color(Width * Height * 4);
+    std::vector<uint32_t> depth(Width * Height); // R32_FLOAT bits
+    std::vector<uint16_t> motion(Width * Height * 2, 0x3800); // 0.5 in half precision
+    for (size_t i = 0; i < color.size(); i++)
+    {
+        color[i] = static_cast<uint8_t>(i * 7);
+    }
+    for (uint32_t frameId = 0; frameId < Frames; frameId++)
     {
-    case InputResType::CurrColor:
-    case InputResType::PrevColor:
-        return DXGI_FORMAT_R8G8B8A8_UNORM;
+        uint32_t noise = 1;
+        for (size_t i = 0; i < depth.size(); i++)
+        {
+            noise ^= noise << 13;
+            noise ^= noise >> 17;
+            noise ^= noise << 5;
+            depth[i] = frameId != 0 ? noise : 0x3F000000u + static_cast<uint32_t>(i); // just above 0.5
+        }
+        stbi_write_png(GetFrameFilePath(FrameFileType::ColorInput, frameId).c_str(),
+                       Width,
+                       Height,
+                       4,
+                       color.data(),
+                       Width * 4);
+        writeFile(GetFrameFilePath(FrameFileType::ClipInfo, frameId), clip, sizeof(clip));
+        writeFile(GetFrameFilePath(FrameFileType::Depth, frameId), depth.data(), depth.size() * 4);
+        writeFile(GetFrameFilePath(FrameFileType::MotionVector, frameId), motion.data(), motion.size() * 2);
+    }
 
-    case InputResType::CurrDepth:
-    case InputResType::PrevDepth:
-        return g_configInfo.depthFormat;
-        break;
-    case InputResType::CurrMevc:
-    case InputResType::PrevMevc:
-        return g_configInfo.mevcFormat;
-    case InputResType::Count:
-    default:
-        return DXGI_FORMAT_UNKNOWN;
+    ThreadPool pool(2);
+    bool       ok = true;
+    for (bool motionResidual : {false, true})
+    {
+        bool packed = BuildFrameArchive("test.fga",
+                                        0,
+                                        Frames - 1,
+                                        ".png",
+                                        Width,
+                                        Height,
+                                        DXGI_FORMAT_R32_FLOAT,
+                                        DXGI_FORMAT_R16G16_FLOAT,
+                                        false,
+                                        &pool,
+                                        motionResidual);
+        std::unique_ptr<FrameArchive> pArchive   = packed ? FrameArchive::Open("test.fga", &pool) : nullptr;
+        uint32_t                      mismatches = pArchive ? VerifyFrameArchive(*pArchive, 0, Frames - 1, ".png", false)
+                                                            : Frames * FrameFileTypeCount;
+        std::cout << (motionResidual ? "Compressed with motion residuals: " : "Compressed: ") << mismatches
+                  << " files differ" << std::endl;
+        ok = ok && mismatches == 0;
     }
+    std::cout << (ok ? "Archive test passed" : "Archive test FAILED") << std::endl;
+    return ok ? 0 : 1;
 }
 
-void ReleaseContext()
+// Runs frames through both rings of a shared-memory region named name, with this process as the host on one thread and
+// the generator side of ShmFrameSource on another, which sends every input's colour straight back as its output. The
+// rings are smaller than the run, so both sides wait on each other. Returns 0 if every frame comes back unchanged and in
+// order.
+int RunShmRingTest(const std::string& name)
 {
-    for (auto res : StagResourceList)
+    const uint32_t  Width  = 64;
+    const uint32_t  Height = 32;
+    const uint32_t  Frames = 16;
+    ShmRing::Layout layout = {Width, Height, DXGI_FORMAT_R32_FLOAT, DXGI_FORMAT_R16G16_FLOAT, 4, 4, 128, 3, 2};
+    std::unique_ptr<ShmRing> pHost = ShmRing::Create(name, layout);
+    std::unique_ptr<ShmRing> pRing = pHost ? ShmRing::Open(name) : nullptr;
+    if (!pRing)
+    {
+        std::cout << "Cannot create shared memory ring " << name << std::endl;
+        return 1;
+    }
+
+    auto pattern = [](uint32_t frameId, size_t i) { return static_cast<uint8_t>(i * 3 + frameId * 11); };
+
+    std::atomic<uint32_t> badInputs{0};
+    std::thread           generator([&]() {
+        ShmFrameSource source(std::move(pRing), 0);
+        for (uint32_t frameId = 0;; frameId++)
+        {
+            FrameFiles        files = source.Acquire(frameId);
+            const FileBuffer& color = files[static_cast<size_t>(FrameFileType::ColorInput)];
+            uint32_t          width  = 0;
+            uint32_t          height = 0;
+            if (color.size == 0)
+            {
+                break;
+            }
+            if (!GetImageInfo(color.data(), color.size, width, height) || width != Width || height != Height ||
+                files[static_cast<size_t>(FrameFileType::Depth)].size != Width * Height * 4)
+            {
+                badInputs++;
+            }
+            source.WriteOutput(source.HostFrameId(frameId),
+                               0,
+                               source.PublishNs(frameId),
+                               color.data() + sizeof(RawImageHeader),
+                               Width * 4);
+            source.Release(frameId + 1);
+        }
+    });
+
+    std::thread host([&]() {
+        for (uint32_t frameId = 0; frameId < Frames; frameId++)
+        {
+            ShmRing::InputView view = {};
+            if (!pHost->BeginInput(view, 5000))
+            {
+                break;
+            }
+            uint8_t* pColor = view.fields[static_cast<size_t>(FrameFileType::ColorInput)];
+            for (size_t i = 0; i < Width * Height * 4; i++)
+            {
+                pColor[i] = pattern(frameId, i);
+            }
+            memset(view.fields[static_cast<size_t>(FrameFileType::Depth)], 0, Width * Height * 4);
+            uint32_t sizes[FrameFileTypeCount] = {};
+            sizes[static_cast<size_t>(FrameFileType::ColorInput)] = Width * Height * 4;
+            sizes[static_cast<size_t>(FrameFileType::Depth)]      = Width * Height * 4;
+            pHost->PublishInput(100 + frameId, sizes);
+        }
+        pHost->CloseInput();
+    });
+
+    uint32_t            outputs    = 0;
+    uint32_t            mismatches = 0;
+    ShmRing::OutputView view       = {};
+    while (pHost->AcquireOutput(view, 5000))
     {
-        auto view = ResourceViewMap.find(res);
-        if (view != ResourceViewMap.end())
+        bool same = view.pSlot->frameId == 100 + outputs && view.pSlot->width == Width && view.pSlot->height == Height;
+        for (size_t i = 0; i < Width * Height * 4 && same; i++)
         {
-            RELEASE_SAFE(view->second.srv);
-            RELEASE_SAFE(view->second.uav);
+            same = view.pPixels[i] == pattern(outputs, i);
         }
-        RELEASE_SAFE(res);
+        mismatches += same ? 0 : 1;
+        outputs++;
+        pHost->ReleaseOutput();
     }
+    host.join();
+    generator.join();
+
+    bool ok = outputs == Frames && mismatches == 0 && badInputs == 0;
+    std::cout << outputs << " of " << Frames << " frames came back, " << mismatches << " differ, " << badInputs
+              << " inputs were malformed" << std::endl;
+    std::cout << (ok ? "Shared memory ring test passed" : "Shared memory ring test FAILED") << std::endl;
+    return ok ? 0 : 1;
+}
 
-    for (auto shader : ComputeShaders)
+// Opens the archive, shared-memory ring or input streams named by the session's config. Fails when a ring or stream
+// that was asked for cannot be opened; an unreadable archive falls back to the directories.
+bool OpenInputSources(Session& session)
+{
+    ConfigInfo& config = session.config;
+    if (!config.archive.empty())
     {
-        RELEASE_SAFE(shader);
+        session.pArchive = FrameArchive::Open(SessionPath(session, config.archive), session.pWorkers->pPool.get());
+        if (session.pArchive)
+        {
+            // Depth and motion blobs are stored in the formats they were captured with.
+            config.depthFormat = static_cast<DXGI_FORMAT>(session.pArchive->Header().depthFormat);
+            config.mevcFormat  = static_cast<DXGI_FORMAT>(session.pArchive->Header().mevcFormat);
+        }
+        else
+        {
+            SessionLog(session) << "Cannot open archive " << config.archive << ", reading the directories";
+        }
     }
 
-    for (auto res : InputResourceList)
+    if (!config.sharedMemoryRing.empty())
     {
-        auto view = ResourceViewMap.find(res);
-        if (view != ResourceViewMap.end())
+        std::unique_ptr<ShmRing> pRing = ShmRing::Open(config.sharedMemoryRing);
+        if (!pRing)
         {
-            RELEASE_SAFE(view->second.srv);
-            RELEASE_SAFE(view->second.uav);
+            SessionLog(session) << "Cannot open shared memory ring " << config.sharedMemoryRing;
+            return false;
         }
-        RELEASE_SAFE(res);
+        // The host fixes the frame size and the depth and motion formats.
+        config.depthFormat   = static_cast<DXGI_FORMAT>(pRing->Header().depthFormat);
+        config.mevcFormat    = static_cast<DXGI_FORMAT>(pRing->Header().mevcFormat);
+        session.pShmSource = std::make_unique<ShmFrameSource>(std::move(pRing), config.beginFrameId);
+    }
+
+    if (config.synthesizeMotion &&
+        (!IsCameraMotionDepthFormat(config.depthFormat) || !IsCameraMotionFormat(config.mevcFormat)))
+    {
+        SessionLog(session) << "SynthesizeMotion does not support DepthFormat " << config.depthFormat
+                            << " with MevcFormat " << config.mevcFormat << ", reading MotionVector";
+        config.synthesizeMotion = false;
     }
 
-    for (auto res : InternalResourceList)
+    if (!config.colorStream.empty())
     {
-        auto view = ResourceViewMap.find(res);
-        if (view != ResourceViewMap.end())
+        // Side streams carry records in the layout of the per-frame .bin files. "-" is standard input, not a path.
+        auto streamPath = [&session](const std::string& path) {
+            return path.empty() || path == "-" ? path : SessionPath(session, path);
+        };
+        std::array<std::string, FrameFileTypeCount> paths;
+        paths[static_cast<size_t>(FrameFileType::ColorInput)]   = streamPath(config.colorStream);
+        paths[static_cast<size_t>(FrameFileType::ClipInfo)]     = streamPath(config.clipInfoStream);
+        paths[static_cast<size_t>(FrameFileType::Depth)]        = streamPath(config.depthStream);
+        paths[static_cast<size_t>(FrameFileType::MotionVector)] = config.synthesizeMotion ? "" : streamPath(config.motionStream);
+
+        FrameStreamReader::RecordLayout layout = {sizeof(ClipInfo),
+                                                  GetFormatBytesPerPixel(config.depthFormat),
+                                                  GetFormatBytesPerPixel(config.mevcFormat)};
+        session.pStreamReader = FrameStreamReader::Open(
+            paths, layout, config.beginFrameId, config.prefetchPairs + 2, session.pWorkers->pPool.get());
+        if (!session.pStreamReader)
         {
-            RELEASE_SAFE(view->second.srv);
-            RELEASE_SAFE(view->second.uav);
+            SessionLog(session) << "Cannot read a Y4M or raw RGBA stream from " << config.colorStream;
+            return false;
         }
-        RELEASE_SAFE(res);
     }
 
-    for (auto buf : ConstantBufferList)
+    return true;
+}
+
+// Creates the session's writer: a Y4M stream when OutputStream is set, image files in ColorOutput/ otherwise.
+bool OpenFrameWriter(Session& session)
+{
+    const ConfigInfo& config = session.config;
+    if (config.outputStream.empty())
     {
-        RELEASE_SAFE(buf);
+        std::error_code error;
+        std::filesystem::create_directory(SessionPath(session, "ColorOutput"), error);
+        session.pFrameWriter = std::make_unique<FrameWriter>(*session.pWorkers->pPool,
+                                                             config.outputFormat,
+                                                             config.pngCompressionLevel,
+                                                             config.pipelineEncodeThreads,
+                                                             config.pipelineQueueDepth);
+        return true;
     }
 
-    for (auto sampler : SamplerList)
+    session.pOutputStream =
+        OpenOutputStream(config.outputStream == "-" ? config.outputStream : SessionPath(session, config.outputStream));
+    if (session.pOutputStream == nullptr)
     {
-        RELEASE_SAFE(sampler);
+        SessionLog(session) << "Cannot open output stream " << config.outputStream;
+        return false;
     }
 
-    RELEASE_SAFE(g_pColorOutputUav);
-    RELEASE_SAFE(g_pColorOutput);
+    // A Y4M input supplies its own rate; every pair adds InterpolatedFrames frames.
+    uint32_t rateNum = config.inputRateNum;
+    uint32_t rateDen = config.inputRateDen;
+    if (session.pStreamReader)
+    {
+        uint32_t streamNum = 0;
+        uint32_t streamDen = 0;
+        if (session.pStreamReader->GetFrameRate(streamNum, streamDen))
+        {
+            rateNum = streamNum;
+            rateDen = streamDen;
+        }
+    }
+    session.pFrameWriter = std::make_unique<FrameWriter>(*session.pWorkers->pPool,
+                                                         session.pOutputStream,
+                                                         rateNum * (config.interpolatedFrames + 1),
+                                                         rateDen,
+                                                         config.pipelineQueueDepth);
+    return true;
+}
 
-    RELEASE_SAFE(g_pContext);
-    RELEASE_SAFE(g_pDevice);
+// Releases the session's sources and writer; the writer finishes the frames it still holds first.
+void CloseSession(Session& session)
+{
+    session.pPrefetcher.reset();
+    session.pStreamReader.reset();
+    session.pShmSource.reset();
+    session.pArchive.reset();
+    session.pFrameWriter.reset();
+    if (session.pOutputStream != nullptr && session.pOutputStream != stdout)
+    {
+        fclose(session.pOutputStream);
+    }
+    session.pOutputStream = nullptr;
+}
+
+// A frame read back from a generator, ready for the writer.
+struct OutputFrame
+{
+    std::string          path;
+    uint32_t             width;
+    uint32_t             height;
+    std::vector<uint8_t> pixels;
+};
+
+// Where the generated frame seq after prevFrameId goes in the session's ColorOutput/.
+std::string GetOutputFramePath(const Session& session, uint64_t prevFrameId, uint32_t seq)
+{
+    return SessionPath(session,
+                       "ColorOutput/coloroutput_" + std::to_string(prevFrameId) + "_" + std::to_string(seq) +
+                           ImageFormatExtension(session.config.outputFormat));
 }
 
-HRESULT InitSampleContext(bool debugLayer)
+OutputFrame CopyOutputFrame(const Session& session, const FgOutputFrame& frame)
 {
-    ULONG createFlags = 0;
-    if (debugLayer)
+    OutputFrame output = {};
+    output.width       = frame.width;
+    output.height      = frame.height;
+    output.pixels.resize(static_cast<size_t>(frame.width) * frame.height * 4);
+    for (uint32_t y = 0; y < frame.height; y++)
     {
-        createFlags |= D3D11_CREATE_DEVICE_DEBUG;
+        memcpy(output.pixels.data() + static_cast<size_t>(y) * frame.width * 4,
+               frame.pPixels + static_cast<size_t>(y) * frame.rowPitch,
+               frame.width * 4);
     }
 
-    const D3D_FEATURE_LEVEL pFeatureLevels[] = {
-        D3D_FEATURE_LEVEL_11_1,
-    };
-    const UINT nFeatureLevels = 1;
-
-    return D3D11CreateDevice(nullptr,
-                             D3D_DRIVER_TYPE_HARDWARE,
-                             nullptr,
-                             createFlags,
-                             pFeatureLevels,
-                             1,
-                             D3D11_SDK_VERSION,
-                             &g_pDevice,
-                             nullptr,
-                             &g_pContext);
+    output.path = frame.seq == FG_CAPTURED_FRAME ? "frame " + std::to_string(frame.currFrameId)
+                                                 : GetOutputFramePath(session, frame.prevFrameId, frame.seq);
+    return output;
 }
 
-HRESULT InitStagingResources(int width, int height)
+// Receives every frame the generator reads back, in submission order. Generated frames go to the shared-memory output
+// ring or to the writer; in stream mode the submitted frames reach the writer between them.
+void OnOutputFrame(void* pUserData, const FgOutputFrame* pFrame)
 {
-    HRESULT hr = E_FAIL;
+    Session& session = *static_cast<Session*>(pUserData);
+    if (session.pShmSource)
+    {
+        // The mapped rows go straight into the output slot.
+        if (pFrame->seq != FG_CAPTURED_FRAME)
+        {
+            session.pShmSource->WriteOutput(static_cast<uint32_t>(pFrame->prevFrameId),
+                                            pFrame->seq,
+                                            pFrame->timestampNs,
+                                            pFrame->pPixels,
+                                            pFrame->rowPitch);
+        }
+        return;
+    }
 
-    D3D11_TEXTURE2D_DESC desc = {};
-    desc.Format               = DXGI_FORMAT_R8G8B8A8_UNORM;
-    desc.Width                = width;
-    desc.Height               = height;
-    desc.MipLevels            = 1;
-    desc.SampleDesc.Count     = 1;
-    desc.SampleDesc.Quality   = 0;
-    desc.ArraySize            = 1;
-    desc.CPUAccessFlags       = D3D11_CPU_ACCESS_WRITE | D3D11_CPU_ACCESS_READ;
-    desc.BindFlags            = 0;
-    desc.Usage                = D3D11_USAGE_STAGING;
+    // Encoding happens on the writer thread and the worker pool.
+    OutputFrame output = CopyOutputFrame(session, *pFrame);
+    session.pFrameWriter->Enqueue(std::move(output.path), output.width, output.height, std::move(output.pixels));
+}
+
+// Describes the generator the session's config asks for, at the given frame size.
+FgContextDesc MakeContextDesc(Session& session, uint32_t width, uint32_t height)
+{
+    const ConfigInfo& config = session.config;
+    FgContextDesc     desc   = {};
+    desc.width               = width;
+    desc.height              = height;
+    desc.depthFormat         = config.depthFormat;
+    desc.motionFormat        = config.mevcFormat;
+    desc.interpolatedFrames  = config.interpolatedFrames;
+    desc.readbackDepth       = config.readbackDepth;
+    desc.flags               = FG_CONTEXT_DEBUG_LAYER | (config.warp ? FG_CONTEXT_WARP : 0);
+    desc.workerPool          = session.pWorkers->fgPool;
+    desc.outputCallback      = OnOutputFrame;
+    desc.pUserData           = &session;
+    if (config.synthesizeMotion)
+    {
+        desc.flags |= FG_CONTEXT_SYNTHESIZE_MOTION;
+    }
+    if (!config.outputStream.empty())
+    {
+        desc.flags |= FG_CONTEXT_EMIT_INPUTS;
+    }
+    if (config.lowLatency)
+    {
+        desc.flags |= FG_CONTEXT_LOW_LATENCY;
+    }
+    return desc;
+}
 
-    hr = g_pDevice->CreateTexture2D(&desc, nullptr, &StagResourceList[static_cast<size_t>(StagResType::ColorInput)]);
-    hr = g_pDevice->CreateTexture2D(&desc, nullptr, &StagResourceList[static_cast<size_t>(StagResType::ColorOutput)]);
+// Creates the session's device and shaders and, for a non-zero size, its frame-sized textures. The generator runs its
+// CPU work on the session's worker group.
+bool CreateGenerator(Session& session, uint32_t width, uint32_t height)
+{
+    FgContextDesc desc   = MakeContextDesc(session, width, height);
+    FgResult      result = fgCreateContext(&desc, &session.context);
+    SessionLog(session) << "Create frame generation context: " << fgResultString(result);
+    session.width  = width;
+    session.height = height;
+    return result == FG_SUCCESS;
+}
 
-    if (SUCCEEDED(hr))
+void DestroyGenerator(Session& session)
+{
+    fgDestroyContext(session.context);
+    session.context = nullptr;
+}
+
+// Describes one frame of the session's source; the descriptor points into files.
+FgFrameDesc MakeFrameDesc(const Session& session, uint32_t frameId, const FrameFiles& files)
+{
+    const FileBuffer& clipInfo = files[static_cast<size_t>(FrameFileType::ClipInfo)];
+    const FileBuffer& motion   = files[static_cast<size_t>(FrameFileType::MotionVector)];
+    const FileBuffer& depth    = files[static_cast<size_t>(FrameFileType::Depth)];
+    const FileBuffer& color    = files[static_cast<size_t>(FrameFileType::ColorInput)];
+
+    // Ring frames are named by the host's frame id, which comes back with the outputs.
+    FgFrameDesc desc   = {};
+    desc.frameId       = session.pShmSource ? session.pShmSource->HostFrameId(frameId) : frameId;
+    desc.timestampNs   = session.pShmSource ? session.pShmSource->PublishNs(frameId) : 0;
+    desc.colorEncoding = FG_COLOR_IMAGE;
+    desc.color         = {color.data(), color.size, 0};
+    desc.depth         = {depth.data(), depth.size, 0};
+    desc.motion        = {motion.data(), motion.size, 0};
+    desc.pClipInfo     = clipInfo.size >= sizeof(ClipInfo) ? reinterpret_cast<const float*>(clipInfo.data()) : nullptr;
+    return desc;
+}
+
+// Runs submit under a GPU turn when the session has a scheduler. A turn is charged with the pixels it generates, so
+// sessions of different sizes share the GPU by time.
+FgResult SubmitWithTurn(Session& session, const std::function<FgResult()>& submit)
+{
+    if (session.pScheduler)
+    {
+        uint64_t pixels = static_cast<uint64_t>(session.width) * session.height;
+        session.pScheduler->Acquire(session.schedulerId, pixels * (std::max)(session.config.interpolatedFrames, 1u));
+    }
+    FgResult result = submit();
+    if (session.pScheduler)
     {
-        desc.Format = g_configInfo.mevcFormat;
-        hr = g_pDevice->CreateTexture2D(&desc, nullptr, &StagResourceList[static_cast<size_t>(StagResType::Mevc)]);
+        session.pScheduler->Release(session.schedulerId);
     }
+    return result;
+}
 
-    if (SUCCEEDED(hr))
+// Reports a submission's result; false stops the run.
+bool CheckSubmitResult(const Session& session, uint32_t frameId, FgResult result)
+{
+    if (result == FG_INCOMPLETE_INPUT)
+    {
+        SessionLog(session) << "Missing or truncated inputs for frame " << frameId;
+    }
+    else if (result != FG_SUCCESS)
     {
-        desc.Format = g_configInfo.depthFormat;
-        hr = g_pDevice->CreateTexture2D(&desc, nullptr, &StagResourceList[static_cast<size_t>(StagResType::Depth)]);
+        SessionLog(session) << "Frame " << frameId << " failed: " << fgResultString(result);
+        return false;
     }
+    return true;
+}
 
-    return hr;
+// Hands one frame of the session's source to its generator; from the second frame on this generates a pair. With a
+// scheduler, the submission waits for a GPU turn; reading the inputs does not.
+bool SubmitFrame(Session& session, uint32_t frameId)
+{
+    FrameFiles  files = AcquireFrame(session, frameId);
+    FgFrameDesc desc  = MakeFrameDesc(session, frameId, files);
+    FgResult    result =
+        SubmitWithTurn(session, [&session, &desc]() { return fgSubmitFrame(session.context, &desc); });
+    return CheckSubmitResult(session, frameId, result);
 }
 
-HRESULT InitAlgoResources(int width, int height)
+void PrintFileReaderStats()
 {
-    HRESULT hr = S_OK;
+    AsyncIoStats stats = g_pFileReader->GetStats();
+    std::cout << "Input files: " << stats.completed << " (" << stats.failed << " failed), batches: " << stats.batches
+              << ", max queue depth: " << stats.maxInFlight << ", " << stats.MegabytesPerSecond() << " MB/s, "
+              << stats.FilesPerSecond() << " files/s" << std::endl;
+}
 
-    D3D11_TEXTURE2D_DESC desc = {};
-    desc.Width                = width;
-    desc.Height               = height;
-    desc.MipLevels            = 1;
-    desc.SampleDesc.Count     = 1;
-    desc.SampleDesc.Quality   = 0;
-    desc.ArraySize            = 1;
-    desc.CPUAccessFlags       = 0;
-    desc.Usage                = D3D11_USAGE_DEFAULT;
+// Creates one worker group per NUMA node with BindNumaNodes, otherwise a single group. WorkerThreads is split evenly
+// over the groups; 0 gives every group a thread per processor it may use, or per physical core with PhysicalCoresOnly.
+// PinThreads keeps each pool thread on one processor, filling the physical cores before their SMT siblings; without
+// it, the threads of a bound group still stay on their node.
+void CreateWorkerGroups()
+{
+    const ConfigInfo&  config   = g_configInfo;
+    const CpuTopology& topology = CpuTopology::Get();
 
-    auto createViewFunc = [](ID3D11Texture2D* res, ResourceView& resView) {
-        D3D11_TEXTURE2D_DESC desc = {};
-        res->GetDesc(&desc);
+    std::vector<WorkerGroup> groups;
+    for (uint32_t node = 0; node < (config.bindNumaNodes ? topology.NodeCount() : 1); node++)
+    {
+        WorkerGroup group;
+        group.node = config.bindNumaNodes ? static_cast<int32_t>(node) : -1;
+        group.cpus = topology.SelectCpus(group.node, config.physicalCoresOnly);
+        // Nodes that only hold memory get no group.
+        if (!group.cpus.empty())
+        {
+            groups.push_back(std::move(group));
+        }
+    }
 
-        HRESULT hr = S_OK;
+    const uint32_t total = config.workerThreads;
+    for (uint32_t g = 0; g < groups.size(); g++)
+    {
+        WorkerGroup& group   = groups[g];
+        uint32_t     threads = total == 0 ? static_cast<uint32_t>(group.cpus.size())
+                                          : (std::max)(total * (g + 1) / static_cast<uint32_t>(groups.size()) -
+                                                           total * g / static_cast<uint32_t>(groups.size()),
+                                                       1u);
+
+        std::function<void(uint32_t)> onThreadStart;
+        if (config.pinThreads || group.node >= 0)
+        {
+            onThreadStart = [cpus = group.cpus, pin = config.pinThreads](uint32_t index) {
+                PinCurrentThread(pin ? std::vector<LogicalCpu>{cpus[index % cpus.size()]} : cpus);
+            };
+        }
+        group.pPool  = std::make_unique<ThreadPool>(threads, std::move(onThreadStart));
+        group.fgPool = fgWrapThreadPool(group.pPool.get());
+        group.pPool->SetTileSize(config.tileSize);
+
+        std::cout << "Worker group " << g << ": " << threads << " threads"
+                  << (group.node >= 0 ? " on NUMA node " + std::to_string(group.node) : std::string())
+                  << (config.pinThreads ? ", pinned" : "") << ", " << group.cpus.size()
+                  << (config.physicalCoresOnly ? " physical cores" : " processors") << std::endl;
+    }
+    g_workerGroups = std::move(groups);
+}
 
-        if (desc.BindFlags & D3D11_BIND_SHADER_RESOURCE)
+void DestroyWorkerGroups()
+{
+    for (WorkerGroup& group : g_workerGroups)
+    {
+        fgDestroyWorkerPool(group.fgPool);
+    }
+    g_workerGroups.clear();
+}
+
+// Sessions and the pair generators of a parallel run are spread over the worker groups in turn.
+WorkerGroup& GetWorkerGroup(size_t index)
+{
+    return g_workerGroups[index % g_workerGroups.size()];
+}
+
+// Keeps a session, pair or loader thread on the node of the group whose workers process its frames, so that the
+// buffers it first touches land there too.
+void EnterWorkerGroup(const WorkerGroup& group)
+{
+    if (group.node >= 0)
+    {
+        PinCurrentThread(group.cpus);
+    }
+}
+
+// One line per worker thread that ran tiles or bands, then how evenly the busy time was spread.
+void PrintWorkerStats()
+{
+    double maxBusy   = 0.0;
+    double totalBusy = 0.0;
+    size_t workers   = 0;
+    for (size_t g = 0; g < g_workerGroups.size(); g++)
+    {
+        std::vector<ThreadPool::WorkerStats> stats = g_workerGroups[g].pPool->GetWorkerStats();
+        for (size_t i = 0; i < stats.size(); i++)
+        {
+            if (stats[i].items == 0)
+            {
+                continue;
+            }
+            std::cout << (i + 1 == stats.size() ? std::string("Caller threads") : "Worker " + std::to_string(i))
+                      << (g_workerGroups.size() > 1 ? " of group " + std::to_string(g) : std::string()) << ": "
+                      << stats[i].items << " items, " << stats[i].steals << " steals (" << stats[i].failedSteals
+                      << " failed), busy " << stats[i].busySeconds << " s, idle " << stats[i].idleSeconds << " s"
+                      << std::endl;
+            maxBusy = (std::max)(maxBusy, stats[i].busySeconds);
+            totalBusy += stats[i].busySeconds;
+            workers++;
+        }
+    }
+    if (workers > 0 && totalBusy > 0.0)
+    {
+        std::cout << "Worker imbalance: busiest thread " << maxBusy / (totalBusy / workers) << "x the average"
+                  << std::endl;
+    }
+
+    // Only sampled on machines with several NUMA nodes; compare runs with and without BindNumaNodes.
+    uint64_t sampled = g_inputPlacement.LocalPages() + g_inputPlacement.RemotePages();
+    if (sampled != 0)
+    {
+        std::cout << "Input pages on another NUMA node than their reader: " << g_inputPlacement.RemoteShare() * 100.0
+                  << "% of " << sampled << " sampled" << std::endl;
+    }
+}
+
+// Generates the pairs one after another on the session's generator. Returns false if a frame failed.
+bool RunPairsInOrder(Session& session, const std::function<void(uint32_t)>& onPair)
+{
+    const ConfigInfo& config = session.config;
+
+    // A stream or ring runs until its producer ends; EndFrameId only bounds the other sources.
+    const bool open = session.pStreamReader || session.pShmSource;
+    bool       ok   = true;
+    for (uint32_t i = config.beginFrameId; ok && (open || i < config.endFrameId); i++)
+    {
+        uint32_t last = (std::min)(i + config.prefetchPairs, config.endFrameId);
+        if (session.pShmSource)
+        {
+            if (!session.pShmSource->WaitForFrame(i + 1))
+            {
+                break;
+            }
+        }
+        else if (session.pStreamReader)
+        {
+            if (!session.pStreamReader->WaitForFrame(i + 1))
+            {
+                break;
+            }
+        }
+        else if (session.pArchive)
         {
-            D3D11_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
-            srvDesc.Format                          = desc.Format;
-            srvDesc.ViewDimension                   = D3D11_SRV_DIMENSION_TEXTURE2D;
-            srvDesc.Texture2D.MipLevels             = 1;
-            srvDesc.Texture2D.MostDetailedMip       = 0;
+            session.pArchive->Prefetch(i, last);
+        }
+        else
+        {
+            session.pPrefetcher->Prefetch(i, last);
+        }
 
-            hr = g_pDevice->CreateShaderResourceView(res, &srvDesc, &resView.srv);
+        SessionLog(session) << "Run algo frame: " << i;
+        if (i == config.beginFrameId)
+        {
+            ok = SubmitFrame(session, i);
+        }
+        ok = ok && SubmitFrame(session, i + 1);
+
+        if (session.pShmSource)
+        {
+            session.pShmSource->Release(i + 1);
         }
+        if (session.pStreamReader)
+        {
+            session.pStreamReader->Release(i + 1);
+        }
+        session.pPrefetcher->Release(i + 1);
 
-        if (desc.BindFlags & D3D11_BIND_UNORDERED_ACCESS)
+        if (onPair)
         {
-            D3D11_UNORDERED_ACCESS_VIEW_DESC uavDesc = {};
-            uavDesc.Format                           = desc.Format;
-            uavDesc.ViewDimension                    = D3D11_UAV_DIMENSION_TEXTURE2D;
-            uavDesc.Texture2D.MipSlice               = 0;
+            onPair(i);
+        }
+    }
+    return ok;
+}
+
+// A frame read and decoded by the load stage: its files, and its colour as RGBA8 rows, empty if the image did not
+// decode.
+struct LoadedFrame
+{
+    uint32_t             frameId = 0;
+    FrameFiles           files;
+    std::vector<uint8_t> rgba;
+};
 
-            if (SUCCEEDED(hr))
+LoadedFrame LoadFrame(Session& session, uint32_t frameId)
+{
+    const ConfigInfo& config = session.config;
+    uint32_t          last   = (std::min)(frameId + config.prefetchPairs, config.endFrameId);
+    if (session.pArchive)
+    {
+        session.pArchive->Prefetch(frameId, last);
+    }
+    else
+    {
+        session.pPrefetcher->Prefetch(frameId, last);
+    }
+
+    LoadedFrame frame;
+    frame.frameId = frameId;
+    frame.files   = AcquireFrame(session, frameId);
+    frame.rgba.resize(static_cast<size_t>(session.width) * session.height * 4);
+
+    const FileBuffer& color   = frame.files[static_cast<size_t>(FrameFileType::ColorInput)];
+    PitchedSurface    surface = {frame.rgba.data(), session.width * 4, session.width, session.height, 4};
+    if (!DecodeImageToSurface(surface, color.data(), color.size))
+    {
+        frame.rgba.clear();
+    }
+    return frame;
+}
+
+// Load, generate and encode run at the same time: PipelineLoadThreads threads read frames and decode their colour,
+// the session thread uploads them and generates, and the writer threads encode. Loader t takes frames t, t + n,
+// t + 2n, ... of the range and hands them over through a bounded queue of its own, so the session thread gets them in
+// order by visiting the queues in turn. Returns false if a frame failed.
+bool RunPairsPipelined(Session&                            session,
+                       const std::function<void(uint32_t)>& onPair,
+                       PipelineStageCounters&               load,
+                       PipelineStageCounters&               generate)
+{
+    const ConfigInfo& config    = session.config;
+    const uint32_t    loaders   = config.pipelineLoadThreads;
+    const uint32_t    laneDepth = (std::max)(config.pipelineQueueDepth / loaders, 1u);
+
+    std::vector<std::unique_ptr<BoundedQueue<LoadedFrame>>> lanes;
+    std::vector<std::thread>                                threads;
+    for (uint32_t t = 0; t < loaders; t++)
+    {
+        lanes.push_back(std::make_unique<BoundedQueue<LoadedFrame>>(laneDepth));
+    }
+    for (uint32_t t = 0; t < loaders; t++)
+    {
+        threads.emplace_back([&session, &config, &lanes, &load, loaders, t]() {
+            EnterWorkerGroup(*session.pWorkers);
+            uint64_t waitNs = 0;
+            for (uint32_t frameId = config.beginFrameId + t; frameId <= config.endFrameId; frameId += loaders)
             {
-                hr = g_pDevice->CreateUnorderedAccessView(res, &uavDesc, &resView.uav);
+                auto        begin = std::chrono::steady_clock::now();
+                LoadedFrame frame = LoadFrame(session, frameId);
+                load.AddBusy(begin);
+                if (!lanes[t]->Push(frame, &waitNs))
+                {
+                    break;
+                }
             }
+            load.outputWaitNs += waitNs;
+            lanes[t]->Close();
+        });
+    }
+
+    // Time the writer spends blocking the callbacks inside fgSubmitFrame is the generate stage waiting for output.
+    auto submit = [&](uint32_t frameId) {
+        LoadedFrame frame;
+        uint64_t    waitNs = 0;
+        bool        loaded = lanes[(frameId - config.beginFrameId) % loaders]->Pop(frame, &waitNs);
+        generate.inputWaitNs += waitNs;
+        if (!loaded)
+        {
+            return false;
         }
 
-        if (SUCCEEDED(hr))
+        auto        begin      = std::chrono::steady_clock::now();
+        double      blockedFor = session.pFrameWriter->GetEnqueueWaitSeconds();
+        FgFrameDesc desc       = MakeFrameDesc(session, frameId, frame.files);
+        desc.colorEncoding     = FG_COLOR_RGBA8;
+        desc.color             = {frame.rgba.data(), frame.rgba.size(), 0};
+        FgResult result =
+            SubmitWithTurn(session, [&session, &desc]() { return fgSubmitFrame(session.context, &desc); });
+
+        uint64_t outputWaitNs =
+            static_cast<uint64_t>((session.pFrameWriter->GetEnqueueWaitSeconds() - blockedFor) * 1e9);
+        generate.outputWaitNs += outputWaitNs;
+        generate.AddBusy(begin, outputWaitNs);
+        return CheckSubmitResult(session, frameId, result);
+    };
+
+    bool ok = true;
+    for (uint32_t i = config.beginFrameId; ok && i < config.endFrameId; i++)
+    {
+        SessionLog(session) << "Run algo frame: " << i;
+        if (i == config.beginFrameId)
         {
-            ResourceViewMap.insert({res, resView});
+            ok = submit(i);
+        }
+        ok = ok && submit(i + 1);
+        session.pPrefetcher->Release(i + 1);
+
+        if (onPair)
+        {
+            onPair(i);
+        }
+    }
+
+    // After a failure the loaders may be blocked on full queues; closing them lets the loaders stop.
+    for (auto& lane : lanes)
+    {
+        lane->Close();
+    }
+    for (auto& thread : threads)
+    {
+        thread.join();
+    }
+    return ok;
+}
+
+// Shows how the stages of a pipelined run spent their time. The stage whose threads were busiest bounds throughput;
+// the others wait on it.
+void PrintPipelineReport(const Session& session, const PipelineStageStats (&stages)[3], double wallSeconds)
+{
+    static const char* const Names[] = {"load", "generate", "encode"};
+
+    size_t limiting = 0;
+    for (size_t i = 0; i < 3; i++)
+    {
+        const PipelineStageStats& stage      = stages[i];
+        const double              threadTime = stage.threads * wallSeconds;
+        SessionLog(session) << "Pipeline " << Names[i] << ": " << stage.threads << " threads, " << stage.items
+                            << " items, busy " << stage.Utilization(wallSeconds) * 100.0 << "%, waiting for input "
+                            << (threadTime > 0.0 ? stage.inputWaitSeconds / threadTime * 100.0 : 0.0)
+                            << "%, blocked on output "
+                            << (threadTime > 0.0 ? stage.outputWaitSeconds / threadTime * 100.0 : 0.0) << "%";
+        if (stage.Utilization(wallSeconds) > stages[limiting].Utilization(wallSeconds))
+        {
+            limiting = i;
+        }
+    }
+    SessionLog(session) << "Pipeline limited by the " << Names[limiting] << " stage";
+}
+
+// One generator of a parallel run and the outputs of the pair it is working on.
+struct PairWorker
+{
+    Session*                 pSession = nullptr;
+    WorkerGroup*             pWorkers = nullptr;
+    FgContext                context  = nullptr;
+    std::vector<OutputFrame> outputs;
+};
+
+void OnPairOutput(void* pUserData, const FgOutputFrame* pFrame)
+{
+    PairWorker& worker = *static_cast<PairWorker*>(pUserData);
+    worker.outputs.push_back(CopyOutputFrame(*worker.pSession, *pFrame));
+}
+
+// Generates ParallelPairs pairs at once, each on a generator with its own device and textures, and writes the outputs
+// in pair order. A pair only starts while fewer than ParallelPairs pairs wait to be written, which bounds the memory
+// held by generated frames. Each frame is read once but uploaded twice, once for each pair it belongs to.
+bool RunPairsInParallel(Session& session, const std::function<void(uint32_t)>& onPair)
+{
+    const ConfigInfo& config = session.config;
+
+    // The session's generator is the first worker; the others get a device each. A run goes ahead with the workers
+    // that could be created. The workers take the worker groups in turn, starting with the session's, so one session
+    // can fill several NUMA nodes; each keeps its outputs on its own node.
+    const size_t                             firstGroup = session.pWorkers - g_workerGroups.data();
+    std::vector<std::unique_ptr<PairWorker>> workers;
+    for (uint32_t i = 0; i < config.parallelPairs; i++)
+    {
+        auto pWorker        = std::make_unique<PairWorker>();
+        pWorker->pSession   = &session;
+        pWorker->pWorkers   = &GetWorkerGroup(firstGroup + i);
+        FgContextDesc desc  = MakeContextDesc(session, session.width, session.height);
+        desc.workerPool     = pWorker->pWorkers->fgPool;
+        desc.outputCallback = OnPairOutput;
+        desc.pUserData      = pWorker.get();
+
+        FgResult result = FG_SUCCESS;
+        if (i == 0)
+        {
+            pWorker->context = session.context;
+            result           = fgResetContext(session.context, &desc, nullptr);
+        }
+        else
+        {
+            result = fgCreateContext(&desc, &pWorker->context);
+        }
+        if (result != FG_SUCCESS)
+        {
+            SessionLog(session) << "Cannot create pair generator " << i << ": " << fgResultString(result);
+            break;
+        }
+        workers.push_back(std::move(pWorker));
+    }
+    SessionLog(session) << "Pair generators: " << workers.size();
+
+    std::mutex              mutex;
+    std::condition_variable progress;
+    uint32_t                nextStart = config.beginFrameId;
+    uint32_t                nextWrite = config.beginFrameId;
+    bool                    ok        = !workers.empty();
+
+    auto work = [&](PairWorker& worker) {
+        for (;;)
+        {
+            uint32_t i = 0;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                progress.wait(lock, [&]() {
+                    return !ok || nextStart >= config.endFrameId || nextStart < nextWrite + config.parallelPairs;
+                });
+                if (!ok || nextStart >= config.endFrameId)
+                {
+                    return;
+                }
+                i = nextStart++;
+            }
+
+            uint32_t last = (std::min)(i + config.prefetchPairs, config.endFrameId);
+            if (session.pArchive)
+            {
+                session.pArchive->Prefetch(i, last);
+            }
+            else
+            {
+                session.pPrefetcher->Prefetch(i, last);
+            }
+
+            SessionLog(session) << "Run algo frame: " << i;
+            FrameFiles  prevFiles = AcquireFrame(session, i);
+            FrameFiles  currFiles = AcquireFrame(session, i + 1);
+            FgFrameDesc prev      = MakeFrameDesc(session, i, prevFiles);
+            FgFrameDesc curr      = MakeFrameDesc(session, i + 1, currFiles);
+            FgResult    result    = SubmitWithTurn(session, [&worker, &prev, &curr]() {
+                return fgSubmitPair(worker.context, &prev, &curr);
+            });
+            bool pairOk = CheckSubmitResult(session, i, result);
+
+            // The pair's outputs land in worker.outputs.
+            if (fgFlush(worker.context) != FG_SUCCESS)
+            {
+                SessionLog(session) << "Reading back pair " << i << " failed";
+                pairOk = false;
+            }
+
+            // Every started pair is written, in order, even after another one failed.
+            std::unique_lock<std::mutex> lock(mutex);
+            progress.wait(lock, [&]() { return nextWrite == i; });
+            for (OutputFrame& output : worker.outputs)
+            {
+                session.pFrameWriter->Enqueue(
+                    std::move(output.path), output.width, output.height, std::move(output.pixels));
+            }
+            worker.outputs.clear();
+            session.pPrefetcher->Release(i + 1);
+            if (onPair)
+            {
+                onPair(i);
+            }
+            ok = ok && pairOk;
+            nextWrite++;
+            progress.notify_all();
         }
-        return hr;
     };
 
-    for (uint32_t i = 0; i < static_cast<uint32_t>(InputResType::Count) && SUCCEEDED(hr); i++)
+    std::vector<std::thread> threads;
+    for (size_t i = 1; i < workers.size(); i++)
+    {
+        threads.emplace_back([&work, &workers, i]() {
+            EnterWorkerGroup(*workers[i]->pWorkers);
+            work(*workers[i]);
+        });
+    }
+    if (!workers.empty())
+    {
+        work(*workers[0]);
+    }
+    for (auto& thread : threads)
+    {
+        thread.join();
+    }
+
+    for (size_t i = 1; i < workers.size(); i++)
+    {
+        fgDestroyContext(workers[i]->context);
+    }
+    FgContextDesc desc = MakeContextDesc(session, session.width, session.height);
+    fgResetContext(session.context, &desc, nullptr);
+    return ok;
+}
+
+// Creates the session's reader for its input folders, on the shared file reader.
+void OpenPrefetcher(Session& session)
+{
+    const ConfigInfo& config = session.config;
+    session.pPrefetcher      = std::make_unique<FramePrefetcher>(
+        *g_pFileReader,
+        ImageFormatExtension(config.colorInputFormat),
+        config.synthesizeMotion ? AllFrameFileTypes & ~FrameFileTypeBit(FrameFileType::MotionVector) : AllFrameFileTypes,
+        session.directory,
+        session.pWorkers->node);
+}
+
+// Generates every pair of the session's range, or until its stream or ring ends, and waits for the outputs to be
+// written. onPair, when set, is called after each pair has been submitted. Returns false if a pair failed to generate
+// or read back, or an output failed to write.
+bool RunFrames(Session& session, const std::function<void(uint32_t)>& onPair)
+{
+    const ConfigInfo& config = session.config;
+    OpenPrefetcher(session);
+    SessionLog(session) << "Input reader: "
+                        << (session.pShmSource      ? "shared memory ring " + config.sharedMemoryRing
+                            : session.pStreamReader ? std::string(session.pStreamReader->FormatName()) + " stream " +
+                                                          config.colorStream
+                            : session.pArchive      ? "mapped archive " + config.archive
+                                                    : g_pFileReader->BackendName());
+
+    // Pairs only run in parallel when the whole range can be read at will and nothing depends on the submission order.
+    const bool parallelizable = !session.pStreamReader && !session.pShmSource && config.outputStream.empty();
+    if (config.parallelPairs > 1 && !parallelizable)
+    {
+        SessionLog(session) << "ParallelPairs needs directory or archive input and file output, running pairs in order";
+    }
+
+    // The load stage reads ahead at will, which streams and the ring do not allow.
+    const bool pipelined = config.pipelineLoadThreads > 0 && !session.pStreamReader && !session.pShmSource &&
+                           !(config.parallelPairs > 1 && parallelizable);
+    if (config.pipelineLoadThreads > 0 && !pipelined)
+    {
+        SessionLog(session) << "PipelineLoadThreads needs directory or archive input and no ParallelPairs, loading on "
+                               "the session thread";
+    }
+
+    PipelineStageCounters load;
+    PipelineStageCounters generate;
+    auto                  begin = std::chrono::steady_clock::now();
+    bool                  ok    = true;
+    if (config.parallelPairs > 1 && parallelizable)
+    {
+        ok = RunPairsInParallel(session, onPair);
+    }
+    else if (pipelined)
+    {
+        ok = RunPairsPipelined(session, onPair, load, generate);
+    }
+    else
+    {
+        ok = RunPairsInOrder(session, onPair);
+    }
+
+    if (session.pStreamReader)
+    {
+        FrameStreamReader::Stats stats = session.pStreamReader->GetStats();
+        SessionLog(session) << "Stream frames: " << stats.frames << ", " << stats.bytes / (1024.0 * 1024.0)
+                            << " MB, waited " << stats.waitSeconds << " s for input";
+    }
+
+    // LowLatency uploads run as one phase of the context's worker team, so there is a single barrier to report.
+    FgBarrierStats barrier = {};
+    if (fgGetBarrierStats(session.context, &barrier, 1) != 0 && barrier.crossings != 0)
+    {
+        SessionLog(session) << "Upload team: " << barrier.crossings << " frames, threads waited "
+                            << barrier.waitSeconds * 1e6 / barrier.crossings << " us per frame at the barrier, longest "
+                            << barrier.maxWaitSeconds * 1e6 << " us";
+    }
+
+    // Concurrent sessions share the reader; RunSessions reports it once at the end.
+    if (!session.pScheduler)
+    {
+        PrintFileReaderStats();
+    }
+
+    if (fgFlush(session.context) != FG_SUCCESS)
+    {
+        SessionLog(session) << "Reading back generated frames failed";
+        ok = false;
+    }
+    if (session.pShmSource)
+    {
+        const ShmFrameSource::Stats& stats = session.pShmSource->GetStats();
+        SessionLog(session) << "Ring frames: " << stats.frames << ", outputs: " << stats.outputs << ", latency avg "
+                            << (stats.outputs != 0 ? stats.totalLatencyNs / 1e6 / stats.outputs : 0.0) << " ms, max "
+                            << stats.maxLatencyNs / 1e6 << " ms, waited " << stats.inputWaitSeconds
+                            << " s for inputs and " << stats.outputWaitSeconds << " s for output slots";
+    }
+    if (session.pArchive)
+    {
+        FrameArchive::DecodeStats stats = session.pArchive->GetDecodeStats();
+        SessionLog(session) << "Archive frames decoded: " << stats.frames << ", "
+                            << (stats.seconds > 0.0 ? stats.bytes / (1024.0 * 1024.0) / stats.seconds : 0.0)
+                            << " MB/s";
+    }
+
+    session.pFrameWriter->Flush();
+    {
+        FrameWriter::Stats stats = session.pFrameWriter->GetStats();
+        SessionLog(session) << "Output frames: " << stats.frames << " (" << stats.failed << " failed), "
+                            << stats.bytes / (1024.0 * 1024.0) << " MB, encode "
+                            << (stats.frames != 0 ? stats.encodeSeconds * 1000.0 / stats.frames : 0.0)
+                            << " ms per frame on " << session.pWorkers->pPool->ThreadCount() << " threads";
+        ok = ok && stats.failed == 0;
+    }
+    if (pipelined)
+    {
+        PipelineStageStats stages[3] = {
+            load.Get(config.pipelineLoadThreads), generate.Get(1), session.pFrameWriter->GetStageStats()};
+        PrintPipelineReport(
+            session, stages, std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count());
+    }
+    return ok;
+}
+
+// Runs one session from opening its inputs to closing its writer. Used on a thread of its own by RunSessions. Returns
+// false if the session could not start or any pair or output failed.
+bool RunSession(Session& session)
+{
+    bool ok = OpenInputSources(session);
+    if (ok)
+    {
+        uint32_t width  = 0;
+        uint32_t height = 0;
+        GetInputDimensions(session, width, height);
+        ok = width != 0 && height != 0 && CreateGenerator(session, width, height);
+        SessionLog(session) << (ok ? "Init Resource Success, " : "Init Resource Fail, ") << width << "x" << height;
+    }
+    ok = ok && OpenFrameWriter(session) && RunFrames(session, nullptr);
+    DestroyGenerator(session);
+    CloseSession(session);
+    return ok;
+}
+
+// Paths of the files of one frame in the session's input folders, indexed by FrameFileType. The motion vectors are left
+// out when they are synthesized.
+std::array<std::string, FrameFileTypeCount> GetFramePaths(const Session& session, uint32_t frameId)
+{
+    std::array<std::string, FrameFileTypeCount> paths;
+    for (uint32_t type = 0; type < FrameFileTypeCount; type++)
+    {
+        if (type != static_cast<uint32_t>(FrameFileType::MotionVector) || !session.config.synthesizeMotion)
+        {
+            paths[type] = SessionPath(session,
+                                      GetFrameFilePath(static_cast<FrameFileType>(type),
+                                                       frameId,
+                                                       ImageFormatExtension(session.config.colorInputFormat)));
+        }
+    }
+    return paths;
+}
+
+// Writes generated frames to the session's ColorOutput/ one after another, counting them into written and failed.
+FrameTask<void> WriteGeneratedFrames(FrameTaskExecutor&          executor,
+                                     Session&                    session,
+                                     std::vector<GeneratedFrame> frames,
+                                     uint64_t&                   written,
+                                     uint64_t&                   failed)
+{
+    for (GeneratedFrame& frame : frames)
+    {
+        std::string path = GetOutputFramePath(session, frame.prevFrameId, frame.seq);
+        bool        done = co_await WriteFrameAsync(executor,
+                                             std::move(path),
+                                             session.config.outputFormat,
+                                             session.config.pngCompressionLevel,
+                                             std::move(frame));
+        (done ? written : failed)++;
+    }
+}
+
+// The whole of a session as one coroutine: every frame is loaded, generated and its outputs written in turn, and the
+// flow holds no thread while it waits for its files. Needs directory input and file output.
+FrameTask<bool> RunSessionFlow(FrameTaskExecutor& executor, Session& session)
+{
+    co_await executor.Schedule();
+
+    const ConfigInfo& config = session.config;
+    if (!config.archive.empty() || !config.colorStream.empty() || !config.sharedMemoryRing.empty() ||
+        !config.outputStream.empty())
+    {
+        SessionLog(session) << "CoroutineSessions needs directory input and file output";
+        co_return false;
+    }
+
+    GetInputDimensions(session, session.width, session.height);
+    FgResult                        result = FG_ERROR_INVALID_ARGUMENT;
+    std::unique_ptr<FrameGenerator> pGenerator;
+    if (session.width != 0 && session.height != 0)
+    {
+        pGenerator = FrameGenerator::Create(executor, MakeContextDesc(session, session.width, session.height), &result);
+    }
+    SessionLog(session) << "Create frame generation context: " << fgResultString(result) << ", " << session.width
+                        << "x" << session.height;
+    if (!pGenerator)
+    {
+        co_return false;
+    }
+
+    std::error_code error;
+    std::filesystem::create_directory(SessionPath(session, "ColorOutput"), error);
+
+    bool     ok      = true;
+    uint64_t written = 0;
+    uint64_t failed  = 0;
+    for (uint32_t frameId = config.beginFrameId; ok && frameId <= config.endFrameId; frameId++)
+    {
+        FrameInput input =
+            co_await LoadFrameAsync(executor, *g_pFileReader, GetFramePaths(session, frameId), session.pWorkers->node);
+        for (const FileBuffer& file : input.files)
+        {
+            g_inputPlacement.Sample(file.data(), file.size);
+        }
+
+        FgFrameDesc desc = MakeFrameDesc(session, frameId, input.files);
+        if (!input.rgba.empty())
+        {
+            desc.colorEncoding = FG_COLOR_RGBA8;
+            desc.color         = {input.rgba.data(), input.rgba.size(), 0};
+        }
+        if (frameId > config.beginFrameId)
+        {
+            SessionLog(session) << "Run algo frame: " << frameId - 1;
+        }
+        FrameGenerator::Result generated = co_await pGenerator->Generate(desc);
+        ok                               = CheckSubmitResult(session, frameId, generated.result);
+        co_await WriteGeneratedFrames(executor, session, std::move(generated.frames), written, failed);
+    }
+
+    // The outputs of the last frames are still in the readback ring.
+    FrameGenerator::Result flushed = co_await pGenerator->Flush();
+    if (flushed.result != FG_SUCCESS)
+    {
+        SessionLog(session) << "Reading back generated frames failed";
+        ok = false;
+    }
+    co_await WriteGeneratedFrames(executor, session, std::move(flushed.frames), written, failed);
+    SessionLog(session) << "Output frames: " << written + failed << " (" << failed << " failed)";
+    co_return ok && failed == 0;
+}
+
+FrameTask<void> RunSessionTask(FrameTaskExecutor& executor, Session& session, uint8_t& result)
+{
+    result = co_await RunSessionFlow(executor, session) ? 1 : 0;
+}
+
+// Runs every session as a coroutine on an executor over its worker group's pool instead of on a thread of its own, so
+// the thread count does not grow with the number of sessions. GPU turns are not scheduled; the pool threads bound how
+// many sessions submit at once.
+void RunSessionFlows(std::vector<std::unique_ptr<Session>>& sessions, std::vector<uint8_t>& results)
+{
+    std::vector<std::unique_ptr<FrameTaskExecutor>> executors;
+    for (WorkerGroup& group : g_workerGroups)
+    {
+        executors.push_back(std::make_unique<FrameTaskExecutor>(*group.pPool));
+    }
+    for (size_t i = 0; i < sessions.size(); i++)
     {
-        DXGI_FORMAT  fmt     = DXGI_FORMAT_UNKNOWN;
-        InputResType resType = static_cast<InputResType>(i);
-        fmt                  = GetInputResFormat(resType);
-        assert(fmt != DXGI_FORMAT_UNKNOWN);
-        desc.Format    = fmt;
-        desc.BindFlags = 0;
+        Session&           session  = *sessions[i];
+        FrameTaskExecutor& executor = *executors[session.pWorkers - g_workerGroups.data()];
+        executor.Spawn(RunSessionTask(executor, session, results[i]));
+    }
+    for (auto& pExecutor : executors)
+    {
+        pExecutor->WaitIdle();
+    }
+}
 
-        UINT formatSupport{};
-        g_pDevice->CheckFormatSupport(fmt, &formatSupport);
-        if ((formatSupport & D3D11_FORMAT_SUPPORT_TYPED_UNORDERED_ACCESS_VIEW) &&
-            (resType != InputResType::CurrDepth) && resType != InputResType::PrevDepth)
+// Runs every entry of "Sessions" at once, one thread and one generator per session, sharing the file reader. Sessions
+// take the worker groups in turn. Each entry overrides config.json for its session; "Directory" holds its input
+// folders and receives its ColorOutput/, and "Name" labels its messages. GPU turns go through a SessionScheduler with
+// ConcurrentSessions slots. With CoroutineSessions the sessions run as coroutines on the worker pools instead.
+int RunSessions()
+{
+    SessionScheduler                      scheduler(g_configInfo.concurrentSessions);
+    std::vector<std::unique_ptr<Session>> sessions;
+    for (const json& entry : g_configInfo.sessions)
+    {
+        if (!entry.is_object())
         {
-            desc.BindFlags |= D3D11_BIND_UNORDERED_ACCESS;
+            std::cout << "Sessions entries must be JSON objects. Exit" << std::endl;
+            return 1;
         }
-
-        if (formatSupport & D3D11_FORMAT_SUPPORT_TEXTURE2D)
+        auto        pSession = std::make_unique<Session>();
+        std::string error;
+        pSession->config = g_configInfo;
+        pSession->name   = std::to_string(sessions.size());
+        error            = ApplyConfig(entry, pSession->config);
+        GetConfigValue(entry, "Name", pSession->name, error);
+        GetConfigValue(entry, "Directory", pSession->directory, error);
+        if (!error.empty())
         {
-            desc.BindFlags |= D3D11_BIND_SHADER_RESOURCE;
+            std::cout << "Session " << pSession->name << ": " << error << ". Exit" << std::endl;
+            return 1;
         }
-
-        hr = g_pDevice->CreateTexture2D(&desc, nullptr, &InputResourceList[i]);
-
-        if (SUCCEEDED(hr))
+        pSession->config.sessions      = json::array();
+        pSession->config.workerThreads = g_configInfo.workerThreads;
+        pSession->config.ioThreads     = g_configInfo.ioThreads;
+        pSession->config.directIo      = g_configInfo.directIo;
+        if (pSession->config.outputStream == "-" || pSession->config.colorStream == "-")
         {
-            hr = createViewFunc(InputResourceList[static_cast<size_t>(i)],
-                                InputResourceViewList[static_cast<size_t>(i)]);
+            std::cout << "Session " << pSession->name << " cannot use standard input or output. Exit" << std::endl;
+            return 1;
         }
+        pSession->pScheduler = &scheduler;
+        pSession->pWorkers   = &GetWorkerGroup(sessions.size());
+        sessions.push_back(std::move(pSession));
     }
 
-    if (SUCCEEDED(hr))
+    auto                 begin = std::chrono::steady_clock::now();
+    std::vector<uint8_t> results(sessions.size(), 0);
+    if (g_configInfo.coroutineSessions)
     {
-        desc.Format    = DXGI_FORMAT_R8G8B8A8_UNORM;
-        desc.BindFlags = D3D11_BIND_UNORDERED_ACCESS;
-        hr             = g_pDevice->CreateTexture2D(&desc, nullptr, &g_pColorOutput);
-
-        D3D11_UNORDERED_ACCESS_VIEW_DESC UAVDesc = {};
-        UAVDesc.ViewDimension                    = D3D11_UAV_DIMENSION_TEXTURE2D;
-        UAVDesc.Texture2D.MipSlice               = 0;
-        UAVDesc.Format                           = DXGI_FORMAT_R8G8B8A8_UNORM;
-        hr = g_pDevice->CreateUnorderedAccessView(g_pColorOutput, &UAVDesc, &g_pColorOutputUav);
+        RunSessionFlows(sessions, results);
     }
-
-    for (uint32_t i = 0; i < static_cast<uint32_t>(InternalResType::Count) && SUCCEEDED(hr); i++)
+    else
     {
-        DXGI_FORMAT     fmt     = DXGI_FORMAT_UNKNOWN;
-        InternalResType resType = static_cast<InternalResType>(i);
-        fmt                     = GetInternalResFormat(resType);
-        assert(fmt != DXGI_FORMAT_UNKNOWN);
-
-        auto resolution = GetInternalResResolution(resType, width, height);
-        assert(resolution.first != 0);
-        assert(resolution.second != 0);
-
-        desc.Width     = resolution.first;
-        desc.Height    = resolution.second;
-        desc.Format    = fmt;
-        desc.BindFlags = 0;
-
-        UINT formatSupport{};
-        g_pDevice->CheckFormatSupport(fmt, &formatSupport);
-        if (formatSupport & D3D11_FORMAT_SUPPORT_TYPED_UNORDERED_ACCESS_VIEW)
+        std::vector<std::thread> threads;
+        for (size_t i = 0; i < sessions.size(); i++)
         {
-            desc.BindFlags |= D3D11_BIND_UNORDERED_ACCESS;
+            threads.emplace_back([&sessions, &results, &scheduler, i]() {
+                Session& session = *sessions[i];
+                EnterWorkerGroup(*session.pWorkers);
+                session.schedulerId = scheduler.Join();
+                results[i]          = RunSession(session) ? 1 : 0;
+                double waitSeconds  = scheduler.Leave(session.schedulerId);
+                SessionLog(session) << "Waited " << waitSeconds << " s for GPU turns";
+            });
         }
-
-        if (formatSupport & D3D11_FORMAT_SUPPORT_TEXTURE2D)
+        for (auto& thread : threads)
         {
-            desc.BindFlags |= D3D11_BIND_SHADER_RESOURCE;
+            thread.join();
         }
+    }
 
-        hr = g_pDevice->CreateTexture2D(&desc, nullptr, &InternalResourceList[i]);
+    PrintFileReaderStats();
+    size_t failed = std::count(results.begin(), results.end(), uint8_t(0));
+    std::cout << "Sessions: " << sessions.size() << " (" << failed << " failed) in "
+              << std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count() << " s" << std::endl;
+    return failed == 0 ? 0 : 1;
+}
 
-        if (SUCCEEDED(hr))
-        {
-            hr = createViewFunc(InternalResourceList[static_cast<size_t>(i)],
-                                InternalResourceViewList[static_cast<size_t>(i)]);
-        }
-    }
+// One capture of a batch run: a session over one capture root and how far its pairs have got. The first worker to
+// reach one of its pairs opens the capture and the one that finishes its last pair closes it, so only the captures
+// being worked on hold readers, writers and frames.
+struct BatchCapture
+{
+    Session                               session;
+    std::mutex                            mutex;
+    bool                                  opened      = false;
+    bool                                  usable      = false;
+    uint32_t                              pairsLeft   = 0;
+    uint32_t                              failedPairs = 0;
+    uint32_t                              released    = 0; // pairs below it have all finished
+    std::vector<uint8_t>                  finished;        // per pair of the range
+    FrameWriter::Stats                    output;
+    std::chrono::steady_clock::time_point begin;
+    double                                seconds = 0.0;
+};
 
-    D3D11_BUFFER_DESC bufDesc   = {};
-    bufDesc.Usage               = D3D11_USAGE_DYNAMIC;
-    bufDesc.CPUAccessFlags      = D3D11_CPU_ACCESS_WRITE;
-    bufDesc.BindFlags           = D3D11_BIND_CONSTANT_BUFFER;
-    bufDesc.StructureByteStride = 0;
+// One pair of the global batch queue.
+struct BatchJob
+{
+    uint32_t capture;
+    uint32_t frameId;
+};
 
-    if (SUCCEEDED(hr))
+// Reads a batch list: one capture root per line; blank lines and lines starting with # are skipped.
+std::vector<std::string> ReadBatchList(const std::string& path)
+{
+    std::vector<std::string> roots;
+    std::ifstream            file(path);
+    std::string              line;
+    while (std::getline(file, line))
     {
-        bufDesc.ByteWidth = sizeof(ClearingConstParamStruct);
-        hr                = g_pDevice->CreateBuffer(&bufDesc,
-                                     nullptr,
-                                     &ConstantBufferList[static_cast<uint32_t>(ConstBufferType::Clearing)]);
+        line.erase(line.find_last_not_of(" \t\r") + 1);
+        line.erase(0, (std::min)(line.find_first_not_of(" \t"), line.size()));
+        if (!line.empty() && line[0] != '#')
+        {
+            roots.push_back(line);
+        }
     }
+    return roots;
+}
 
-    if (SUCCEEDED(hr))
+// Opens the capture's inputs and writer on first use. Returns whether its pairs can run.
+bool OpenBatchCapture(BatchCapture& capture)
+{
+    std::lock_guard<std::mutex> lock(capture.mutex);
+    if (capture.opened)
     {
-        bufDesc.ByteWidth = sizeof(MVecParamStruct);
-        hr                = g_pDevice->CreateBuffer(&bufDesc,
-                                     nullptr,
-                                     &ConstantBufferList[static_cast<uint32_t>(ConstBufferType::Mevc)]);
+        return capture.usable;
     }
+    capture.opened = true;
+    capture.begin  = std::chrono::steady_clock::now();
 
-    if (SUCCEEDED(hr))
+    Session&          session = capture.session;
+    const ConfigInfo& config  = session.config;
+    if (!config.colorStream.empty() || !config.sharedMemoryRing.empty() || !config.outputStream.empty())
     {
-        bufDesc.ByteWidth = sizeof(MergeParamStruct);
-        hr                = g_pDevice->CreateBuffer(&bufDesc,
-                                     nullptr,
-                                     &ConstantBufferList[static_cast<uint32_t>(ConstBufferType::Merge)]);
+        SessionLog(session) << "Batch captures need directory or archive input and file output, skipping";
+        return false;
     }
-
-    if (SUCCEEDED(hr))
+    if (!OpenInputSources(session))
     {
-        bufDesc.ByteWidth = sizeof(PushPullParameters);
-        hr                = g_pDevice->CreateBuffer(&bufDesc,
-                                     nullptr,
-                                     &ConstantBufferList[static_cast<uint32_t>(ConstBufferType::PushPull)]);
+        return false;
     }
-
-    if (SUCCEEDED(hr))
+    GetInputDimensions(session, session.width, session.height);
+    if (session.width == 0 || session.height == 0)
     {
-        bufDesc.ByteWidth = sizeof(ResolutionConstParamStruct);
-        hr                = g_pDevice->CreateBuffer(&bufDesc,
-                                     nullptr,
-                                     &ConstantBufferList[static_cast<uint32_t>(ConstBufferType::Resolution)]);
+        SessionLog(session) << "Cannot read the size of frame " << config.beginFrameId << ", skipping";
+        return false;
     }
-
-    return hr;
+    OpenPrefetcher(session);
+    capture.usable = OpenFrameWriter(session);
+    return capture.usable;
 }
 
-HRESULT InitResources()
+// Records a finished pair. Frames below the first unfinished pair are dropped; after the last pair the writer is
+// drained and the capture closed.
+void FinishBatchPair(BatchCapture& capture, uint32_t frameId, bool pairOk)
 {
-    HRESULT hr = E_FAIL;
-
-    int  width   = 0;
-    int  height  = 0;
-    int  channel = 0;
-    auto pPixels = stbi_load("ColorInput/colorinput_0.png", &width, &height, &channel, 4);
-
-    hr = InitStagingResources(width, height);
-
-    if (SUCCEEDED(hr))
+    std::lock_guard<std::mutex> lock(capture.mutex);
+    Session&                    session = capture.session;
+    capture.finished[frameId - session.config.beginFrameId] = 1;
+    capture.failedPairs += pairOk ? 0 : 1;
+    while (capture.released < capture.finished.size() && capture.finished[capture.released] != 0)
     {
-        hr = InitAlgoResources(width, height);
+        capture.released++;
     }
-
-    if (SUCCEEDED(hr))
+    if (session.pPrefetcher)
     {
-        g_ColorWidth  = width;
-        g_ColorHeight = height;
-
-        g_constBufData.dimensions[0]   = g_ColorWidth;
-        g_constBufData.dimensions[1]   = g_ColorHeight;
-        g_constBufData.viewportSize[0] = static_cast<float>(g_ColorWidth);
-        g_constBufData.viewportSize[1] = static_cast<float>(g_ColorHeight);
-        g_constBufData.viewportInv[0]  = 1.0 / static_cast<float>(g_ColorWidth);
-        g_constBufData.viewportInv[1]  = 1.0 / static_cast<float>(g_ColorHeight);
+        session.pPrefetcher->Release(session.config.beginFrameId + capture.released);
     }
 
-    return hr;
+    if (--capture.pairsLeft == 0)
+    {
+        if (session.pFrameWriter)
+        {
+            session.pFrameWriter->Flush();
+            capture.output = session.pFrameWriter->GetStats();
+        }
+        CloseSession(session);
+        capture.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - capture.begin).count();
+    }
 }
 
-HRESULT InitSamplerList()
+// Generates the job's pair on the worker's generator. The generator is created for the first capture the worker meets and
+// reset when it moves to another, which keeps its textures while the sizes and formats agree.
+bool RunBatchPair(BatchCapture& capture, const BatchJob& job, PairWorker& worker)
 {
-    HRESULT hr = S_OK;
-
+    Session&          session = capture.session;
+    const ConfigInfo& config  = session.config;
+    const uint32_t    i       = job.frameId;
+    if (worker.pSession != &session || worker.context == nullptr)
     {
-        D3D11_SAMPLER_DESC sampDesc = {
-            D3D11_FILTER_MIN_MAG_MIP_POINT,
-            D3D11_TEXTURE_ADDRESS_CLAMP,
-            D3D11_TEXTURE_ADDRESS_CLAMP,
-            D3D11_TEXTURE_ADDRESS_CLAMP,
-            0.0f,
-            1,
-            D3D11_COMPARISON_NEVER,
-            {0.0f, 0.0f, 0.0f, 0.0f},
-            0.0f,
-            D3D11_FLOAT32_MAX,
-        };
-        hr  = g_pDevice->CreateSamplerState(&sampDesc, &SamplerList[static_cast<uint32_t>(SamplerType::PointClamp)]);
+        FgContextDesc desc  = MakeContextDesc(session, session.width, session.height);
+        desc.workerPool     = worker.pWorkers->fgPool;
+        desc.outputCallback = OnPairOutput;
+        desc.pUserData      = &worker;
+        FgResult result     = worker.context == nullptr ? fgCreateContext(&desc, &worker.context)
+                                                        : fgResetContext(worker.context, &desc, nullptr);
+        if (result != FG_SUCCESS)
+        {
+            SessionLog(session) << "Cannot set up a generator for pair " << i << ": " << fgResultString(result);
+            return false;
+        }
+        worker.pSession = &session;
     }
 
+    uint32_t last = (std::min)(i + config.prefetchPairs, config.endFrameId);
+    if (session.pArchive)
     {
-        D3D11_SAMPLER_DESC sampDesc = {
-            D3D11_FILTER_MIN_MAG_MIP_POINT,
-            D3D11_TEXTURE_ADDRESS_MIRROR,
-            D3D11_TEXTURE_ADDRESS_MIRROR,
-            D3D11_TEXTURE_ADDRESS_MIRROR,
-            0.0f,
-            1,
-            D3D11_COMPARISON_NEVER,
-            {0.0f, 0.0f, 0.0f, 0.0f},
-            0.0f,
-            D3D11_FLOAT32_MAX,
-        };
-        hr = g_pDevice->CreateSamplerState(&sampDesc, &SamplerList[static_cast<uint32_t>(SamplerType::PointMirror)]);
+        session.pArchive->Prefetch(i, last);
     }
-
+    else
     {
-        D3D11_SAMPLER_DESC sampDesc = {
-            D3D11_FILTER_MIN_MAG_MIP_LINEAR,
-            D3D11_TEXTURE_ADDRESS_CLAMP,
-            D3D11_TEXTURE_ADDRESS_CLAMP,
-            D3D11_TEXTURE_ADDRESS_CLAMP,
-            0.0f,
-            1,
-            D3D11_COMPARISON_NEVER,
-            {0.0f, 0.0f, 0.0f, 0.0f},
-            0.0f,
-            D3D11_FLOAT32_MAX,
-        };
-
-        hr = g_pDevice->CreateSamplerState(&sampDesc, &SamplerList[static_cast<uint32_t>(SamplerType::LinearClamp)]);
+        session.pPrefetcher->Prefetch(i, last);
     }
 
+    FrameFiles  prevFiles = AcquireFrame(session, i);
+    FrameFiles  currFiles = AcquireFrame(session, i + 1);
+    FgFrameDesc prev      = MakeFrameDesc(session, i, prevFiles);
+    FgFrameDesc curr      = MakeFrameDesc(session, i + 1, currFiles);
+    bool        pairOk    = CheckSubmitResult(session, i, fgSubmitPair(worker.context, &prev, &curr));
+    if (fgFlush(worker.context) != FG_SUCCESS)
     {
-        D3D11_SAMPLER_DESC sampDesc = {
-            D3D11_FILTER_MIN_MAG_MIP_LINEAR,
-            D3D11_TEXTURE_ADDRESS_MIRROR,
-            D3D11_TEXTURE_ADDRESS_MIRROR,
-            D3D11_TEXTURE_ADDRESS_MIRROR,
-            0.0f,
-            1,
-            D3D11_COMPARISON_NEVER,
-            {0.0f, 0.0f, 0.0f, 0.0f},
-            0.0f,
-            D3D11_FLOAT32_MAX,
-        };
-
-        hr = g_pDevice->CreateSamplerState(&sampDesc, &SamplerList[static_cast<uint32_t>(SamplerType::LinearMirror)]);
+        SessionLog(session) << "Reading back pair " << i << " failed";
+        pairOk = false;
     }
 
+    // Outputs are image files named by frame, so they are handed to the writer as they come.
+    for (OutputFrame& output : worker.outputs)
     {
-        D3D11_SAMPLER_DESC sampDesc = {
-            D3D11_FILTER_ANISOTROPIC,
-            D3D11_TEXTURE_ADDRESS_CLAMP,
-            D3D11_TEXTURE_ADDRESS_CLAMP,
-            D3D11_TEXTURE_ADDRESS_CLAMP,
-            0.0f,
-            1,
-            D3D11_COMPARISON_NEVER,
-            {0.0f, 0.0f, 0.0f, 0.0f},
-            0.0f,
-            D3D11_FLOAT32_MAX,
-        };
-
-        hr = g_pDevice->CreateSamplerState(&sampDesc, &SamplerList[static_cast<uint32_t>(SamplerType::AnisoClamp)]);
+        session.pFrameWriter->Enqueue(std::move(output.path), output.width, output.height, std::move(output.pixels));
     }
-
-    return hr;
+    worker.outputs.clear();
+    return pairOk;
 }
 
-HRESULT CreateComputeShader(ID3D11ComputeShader** ppShader, const std::string& dxbcFile)
+// Runs every capture root listed in listPath as one batch. Each root is a capture directory with its own config.json
+// on top of the working directory's; Sessions, the thread counts and DirectIo come from the working directory's only.
+// The pairs of all captures go into one queue in capture order, and BatchWorkers generators take them one at a time,
+// so the workers spread over the few captures at the head of the queue while the worker groups encode and decode for
+// all of them. Prints a line per capture at the end and returns 0 if every capture was generated completely.
+int RunBatch(const std::string& listPath)
 {
-    HRESULT       hr = E_FAIL;
-    std::ifstream f(dxbcFile);
-    if (f.is_open())
+    std::vector<std::string> roots = ReadBatchList(listPath);
+    if (roots.empty())
     {
-        std::vector<uint8_t> result = AcquireFileContent(dxbcFile);
-        hr = g_pDevice->CreateComputeShader(static_cast<void*>(result.data()), result.size(), nullptr, ppShader);
+        std::cout << "No capture roots in " << listPath << ". Exit" << std::endl;
+        return 1;
     }
-    return hr;
-}
-
-void PrepareInput(uint32_t frameIndex)
-{
-    D3D11_MAPPED_SUBRESOURCE mapped = {};
 
-    auto stagMevc       = StagResourceList[static_cast<size_t>(StagResType::Mevc)];
-    auto stagColorInput = StagResourceList[static_cast<size_t>(StagResType::ColorInput)];
-    auto stagDepth      = StagResourceList[static_cast<size_t>(StagResType::Depth)];
+    CreateWorkerGroups();
+    g_pFileReader = std::make_unique<AsyncFileReader>(g_configInfo.directIo, g_configInfo.ioThreads);
 
+    std::vector<std::unique_ptr<BatchCapture>> captures;
+    std::vector<BatchJob>                      jobs;
+    for (const std::string& root : roots)
+    {
+        auto     pCapture = std::make_unique<BatchCapture>();
+        Session& session  = pCapture->session;
+        session.config    = g_configInfo;
+        if (!ParseConfig(session.config, root + "/config.json"))
+        {
+            std::cout << "No config.json in " << root << ", using the working directory's" << std::endl;
+        }
+        session.config.sessions      = json::array();
+        session.config.workerThreads = g_configInfo.workerThreads;
+        session.config.ioThreads     = g_configInfo.ioThreads;
+        session.config.directIo      = g_configInfo.directIo;
+        session.name                 = root;
+        session.directory            = root;
+        session.pWorkers             = &GetWorkerGroup(captures.size());
+
+        const ConfigInfo& config = session.config;
+        for (uint32_t i = config.beginFrameId; i < config.endFrameId; i++)
+        {
+            jobs.push_back({static_cast<uint32_t>(captures.size()), i});
+        }
+        pCapture->pairsLeft = config.endFrameId > config.beginFrameId ? config.endFrameId - config.beginFrameId : 0;
+        pCapture->finished.resize(pCapture->pairsLeft, 0);
+        captures.push_back(std::move(pCapture));
+    }
+    std::cout << "Batch: " << captures.size() << " captures, " << jobs.size() << " pairs, "
+              << g_configInfo.batchWorkers << " workers" << std::endl;
+
+    auto                                     begin = std::chrono::steady_clock::now();
+    std::atomic<size_t>                      nextJob{0};
+    std::vector<std::unique_ptr<PairWorker>> workers;
+    std::vector<std::thread>                 threads;
+    for (uint32_t w = 0; w < g_configInfo.batchWorkers; w++)
+    {
+        workers.push_back(std::make_unique<PairWorker>());
+        workers.back()->pWorkers = &GetWorkerGroup(w);
+        threads.emplace_back([&captures, &jobs, &nextJob, &worker = *workers.back()]() {
+            EnterWorkerGroup(*worker.pWorkers);
+            for (size_t j = nextJob++; j < jobs.size(); j = nextJob++)
+            {
+                BatchCapture& capture = *captures[jobs[j].capture];
+                bool          pairOk  = OpenBatchCapture(capture) && RunBatchPair(capture, jobs[j], worker);
+                FinishBatchPair(capture, jobs[j].frameId, pairOk);
+            }
+            fgDestroyContext(worker.context);
+        });
+    }
+    for (auto& thread : threads)
     {
-        std::string clipFile     = "ClipInfo/clipinfo_" + std::to_string(frameIndex) + ".bin";
-        auto        pervClipInfo = AcquireFileContent(clipFile);
+        thread.join();
+    }
 
-        uint32_t offset = 0;
+    PrintFileReaderStats();
+    PrintWorkerStats();
+    g_pFileReader.reset();
+    DestroyWorkerGroups();
 
-        memcpy(g_constBufData.prevClipToClip, pervClipInfo.data() + offset, sizeof(g_constBufData.prevClipToClip));
+    size_t failed = 0;
+    for (const auto& pCapture : captures)
+    {
+        const BatchCapture& capture = *pCapture;
+        const uint32_t      pairs   = static_cast<uint32_t>(capture.finished.size());
+        const bool          ok      = capture.usable && capture.failedPairs == 0 && capture.output.failed == 0;
+        failed += ok ? 0 : 1;
+        std::cout << (ok ? "[ok]     " : "[failed] ") << capture.session.name << ": " << pairs - capture.failedPairs
+                  << "/" << pairs << " pairs, " << capture.output.frames << " frames (" << capture.output.failed
+                  << " failed), " << capture.output.bytes / (1024.0 * 1024.0) << " MB in " << capture.seconds << " s"
+                  << std::endl;
+    }
+    std::cout << "Batch: " << captures.size() << " captures (" << failed << " failed) in "
+              << std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count() << " s" << std::endl;
+    return failed == 0 ? 0 : 1;
+}
 
-        offset += sizeof(g_constBufData.prevClipToClip);
+// Runs one service request as a session on the service's generator and streams progress to the client. The request is
+// a config.json object plus "Directory"; keys that would replace the service's streams, ring or thread counts are
+// ignored.
+void RunServiceJob(LineSocket& client, const json& request, const ConfigInfo& baseConfig, FgContext context)
+{
+    auto reply = [&client](const json& message) {
+        client.WriteLine(message.dump());
+    };
+    auto begin = std::chrono::steady_clock::now();
 
-        memcpy(g_constBufData.clipToPrevClip, pervClipInfo.data() + offset, sizeof(g_constBufData.clipToPrevClip));
-    }
+    Session session;
+    session.context  = context;
+    session.config   = baseConfig;
+    session.pWorkers = &GetWorkerGroup(0);
 
+    // A request with values of the wrong type is refused as a whole.
+    std::string failure = ApplyConfig(request, session.config);
+    GetConfigValue(request, "Directory", session.directory, failure);
+    if (!failure.empty())
     {
-        std::string pervMevcFile = "MotionVector/motionvector_" + std::to_string(frameIndex) + ".bin";
-        auto        pervMevc     = AcquireFileContent(pervMevcFile);
-
-        g_pContext->Map(stagMevc, 0, D3D11_MAP_WRITE, 0, &mapped);
-        memcpy(mapped.pData, pervMevc.data(), pervMevc.size());
-        g_pContext->Unmap(stagMevc, 0);
-        g_pContext->CopyResource(InputResourceList[static_cast<size_t>(InputResType::PrevMevc)], stagMevc);
+        failure = "Invalid request: " + failure;
     }
-
+    session.config.colorStream.clear();
+    session.config.clipInfoStream.clear();
+    session.config.depthStream.clear();
+    session.config.motionStream.clear();
+    session.config.outputStream.clear();
+    session.config.sharedMemoryRing.clear();
+    session.config.sessions      = json::array();
+    session.config.workerThreads = baseConfig.workerThreads;
+    session.config.ioThreads     = baseConfig.ioThreads;
+    session.config.directIo      = baseConfig.directIo;
+
+    std::error_code error;
+    if (failure.empty() && !session.directory.empty() && !std::filesystem::is_directory(session.directory, error))
     {
-        std::string currMevcFile = "MotionVector/motionvector_" + std::to_string(frameIndex + 1) + ".bin";
-        auto        currMevc     = AcquireFileContent(currMevcFile);
-
-        g_pContext->Map(stagMevc, 0, D3D11_MAP_WRITE, 0, &mapped);
-        memcpy(mapped.pData, currMevc.data(), currMevc.size());
-        g_pContext->Unmap(stagMevc, 0);
-        g_pContext->CopyResource(InputResourceList[static_cast<size_t>(InputResType::CurrMevc)], stagMevc);
+        failure = "Cannot enter directory " + session.directory;
     }
 
+    if (failure.empty() && !OpenInputSources(session))
     {
-        std::string pervDepthFile = "Depth/depth_" + std::to_string(frameIndex) + ".bin";
-        auto        pervDepth     = AcquireFileContent(pervDepthFile);
-
-        g_pContext->Map(stagDepth, 0, D3D11_MAP_WRITE, 0, &mapped);
-        memcpy(mapped.pData, pervDepth.data(), pervDepth.size());
-        g_pContext->Unmap(stagDepth, 0);
-        g_pContext->CopyResource(InputResourceList[static_cast<size_t>(InputResType::PrevDepth)], stagDepth);
+        failure = "Cannot open the inputs";
     }
 
+    if (failure.empty())
     {
-        std::string currDepthFile = "Depth/depth_" + std::to_string(frameIndex + 1) + ".bin";
-        auto        currDepth     = AcquireFileContent(currDepthFile);
-
-        g_pContext->Map(stagDepth, 0, D3D11_MAP_WRITE, 0, &mapped);
-        memcpy(mapped.pData, currDepth.data(), currDepth.size());
-        g_pContext->Unmap(stagDepth, 0);
-        g_pContext->CopyResource(InputResourceList[static_cast<size_t>(InputResType::CurrDepth)], stagDepth);
+        GetInputDimensions(session, session.width, session.height);
+        if (session.width == 0 || session.height == 0)
+        {
+            failure = "No colour input for frame " + std::to_string(session.config.beginFrameId);
+        }
     }
 
+    // The context keeps its textures while the size, formats and readback depth stay the same.
+    int reused = 0;
+    if (failure.empty())
     {
-        std::string    pervColorFile = "ColorInput/colorinput_" + std::to_string(frameIndex) + ".png";
-        int            w             = 0;
-        int            h             = 0;
-        int            ch            = 0;
-        unsigned char* pPixels       = stbi_load(pervColorFile.c_str(), &w, &h, &ch, 4);
-
-        g_pContext->Map(stagColorInput, 0, D3D11_MAP_WRITE, 0, &mapped);
-        memcpy(mapped.pData, pPixels, h * mapped.RowPitch);
-        g_pContext->Unmap(stagColorInput, 0);
-        g_pContext->CopyResource(InputResourceList[static_cast<size_t>(InputResType::PrevColor)], stagColorInput);
-
-        stbi_image_free(pPixels);
+        FgContextDesc desc   = MakeContextDesc(session, session.width, session.height);
+        FgResult      result = fgResetContext(context, &desc, &reused);
+        if (result != FG_SUCCESS)
+        {
+            failure = std::string("Init Resource Fail: ") + fgResultString(result);
+        }
     }
 
+    if (failure.empty())
     {
-        std::string    currColorFile = "ColorInput/colorinput_" + std::to_string(frameIndex + 1) + ".png";
-        int            w             = 0;
-        int            h             = 0;
-        int            ch            = 0;
-        unsigned char* pPixels       = stbi_load(currColorFile.c_str(), &w, &h, &ch, 4);
-
-        g_pContext->Map(stagColorInput, 0, D3D11_MAP_WRITE, 0, &mapped);
-        memcpy(mapped.pData, pPixels, h * mapped.RowPitch);
-        g_pContext->Unmap(stagColorInput, 0);
-        g_pContext->CopyResource(InputResourceList[static_cast<size_t>(InputResType::CurrColor)], stagColorInput);
-
-        stbi_image_free(pPixels);
+        reply({{"event", "accepted"},
+               {"width", session.width},
+               {"height", session.height},
+               {"warm", reused != 0},
+               {"beginFrameId", session.config.beginFrameId},
+               {"endFrameId", session.config.endFrameId}});
+
+        OpenFrameWriter(session);
+        bool ok = RunFrames(session, [&reply](uint32_t frameId) {
+            reply({{"event", "pair"}, {"frameId", frameId}});
+        });
+
+        FrameWriter::Stats stats = session.pFrameWriter->GetStats();
+        reply({{"event", "done"},
+               {"ok", ok},
+               {"outputFrames", stats.frames},
+               {"failed", stats.failed},
+               {"seconds", std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count()}});
+    }
+    else
+    {
+        std::cout << failure << std::endl;
+        reply({{"event", "error"}, {"message", failure}});
     }
-}
-
-void DumpOutput(uint32_t frameIndex)
-{
-    std::string genFrameFile = "ColorOutput/coloroutput_" + std::to_string(frameIndex) + ".png";
-
-    ID3D11Texture2D* pTempOut = StagResourceList[static_cast<uint32_t>(StagResType::ColorOutput)];
-    g_pContext->CopyResource(pTempOut, g_pColorOutput);
 
-    D3D11_MAPPED_SUBRESOURCE mapped = {};
-    g_pContext->Map(pTempOut, 0, D3D11_MAP_READ, 0, &mapped);
-    stbi_write_png(genFrameFile.c_str(), g_ColorWidth, g_ColorHeight, 4, mapped.pData, mapped.RowPitch);
-    g_pContext->Unmap(pTempOut, 0);
+    CloseSession(session);
 }
 
-void ProcessFrameGenerationClearing(ClearingConstParamStruct* pCb, uint32_t grid[])
+// Long-lived job service: the generator's device and shaders, the worker pool and the file reader are created once,
+// and the frame-sized textures stay allocated while consecutive jobs agree on size, formats and readback depth.
+// Clients send one JSON request per line and read progress lines back; {"Command": "Shutdown"} stops the service.
+int RunService(const std::string& socketPath)
 {
-    g_pContext->CSSetShader(ComputeShaders[static_cast<uint32_t>(ComputeShaderType::Clear)], nullptr, 0);
-    ID3D11UnorderedAccessView* ppUavs[] = {
-        InternalResourceViewList[static_cast<uint32_t>(InternalResType::ReprojectedFullX)].uav,
-        InternalResourceViewList[static_cast<uint32_t>(InternalResType::ReprojectedFullY)].uav,
-        InternalResourceViewList[static_cast<uint32_t>(InternalResType::ReprojectedHalfTipX)].uav,
-        InternalResourceViewList[static_cast<uint32_t>(InternalResType::ReprojectedHalfTipY)].uav,
-        InternalResourceViewList[static_cast<uint32_t>(InternalResType::ReprojectedHalfTopX)].uav,
-        InternalResourceViewList[static_cast<uint32_t>(InternalResType::ReprojectedHalfTopY)].uav,
-    };
-
-    g_pContext->CSSetUnorderedAccessViews(0, 6, ppUavs, nullptr);
+    std::unique_ptr<JobListener> pListener = JobListener::Listen(socketPath);
+    if (!pListener)
+    {
+        std::cout << "Cannot listen on " << socketPath << ". Exit" << std::endl;
+        return 1;
+    }
 
-    ID3D11Buffer*            buf    = ConstantBufferList[static_cast<uint32_t>(ConstBufferType::Clearing)];
-    D3D11_MAPPED_SUBRESOURCE mapped = {};
-    g_pContext->Map(buf, 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped);
-    memcpy(mapped.pData, pCb, mapped.RowPitch);
-    g_pContext->Unmap(buf, 0);
+    CreateWorkerGroups();
+    g_pFileReader = std::make_unique<AsyncFileReader>(g_configInfo.directIo, g_configInfo.ioThreads);
 
-    g_pContext->CSSetConstantBuffers(0, 1, &buf);
-    g_pContext->Dispatch(grid[0], grid[1], grid[2]);
+    // Created without a size; each job sizes the textures for its inputs and points the outputs at its session. Jobs
+    // run on this thread with the first worker group.
+    Session service;
+    service.pWorkers = &GetWorkerGroup(0);
+    EnterWorkerGroup(*service.pWorkers);
+    const bool created = CreateGenerator(service, 0, 0);
+    if (created)
+    {
+        std::cout << "Serving jobs on " << socketPath << std::endl;
+    }
 
-    ID3D11UnorderedAccessView* emptyUavs[6] = {nullptr};
+    const ConfigInfo baseConfig = g_configInfo;
+    bool             shutdown   = !created;
+    while (!shutdown)
+    {
+        std::unique_ptr<LineSocket> pClient = pListener->Accept();
+        std::string                 line;
+        while (pClient && !shutdown && pClient->ReadLine(line))
+        {
+            json request = json::parse(line, nullptr, false);
+            if (request.is_discarded() || !request.is_object())
+            {
+                pClient->WriteLine(json({{"event", "error"}, {"message", "Request is not a JSON object"}}).dump());
+            }
+            else if (request.contains("Command") && request["Command"] == "Shutdown")
+            {
+                pClient->WriteLine(json({{"event", "shutdown"}}).dump());
+                shutdown = true;
+            }
+            else
+            {
+                RunServiceJob(*pClient, request, baseConfig, service.context);
+            }
+        }
+    }
 
-    g_pContext->CSSetUnorderedAccessViews(0, 6, emptyUavs, nullptr);
+    pListener.reset();
+    DestroyGenerator(service);
+    PrintWorkerStats();
+    g_pFileReader.reset();
+    DestroyWorkerGroups();
+    return created ? 0 : 1;
 }
 
-void ProcessFrameGenerationReprojection(MVecParamStruct* pCb, uint32_t grid[])
+// Sends one request to a running service and prints its replies until the job ends. Returns 0 once the job is done
+// without failed pairs or outputs.
+int SubmitJob(const std::string& socketPath, const std::string& requestText)
 {
-    g_pContext->CSSetShader(ComputeShaders[static_cast<uint32_t>(ComputeShaderType::Reprojection)], nullptr, 0);
-
-    ID3D11ShaderResourceView* ppSrvs[] = {
-        InternalResourceViewList[static_cast<uint32_t>(InternalResType::PrevMevcFiltered)].srv,
-        InternalResourceViewList[static_cast<uint32_t>(InternalResType::CurrMevcFiltered)].srv,
-        InputResourceViewList[static_cast<uint32_t>(InputResType::PrevDepth)].srv,
-        InputResourceViewList[static_cast<uint32_t>(InputResType::CurrDepth)].srv};
-    g_pContext->CSSetShaderResources(0, 4, ppSrvs);
-
-    ID3D11UnorderedAccessView* ppUavs[] = {
-        InternalResourceViewList[static_cast<uint32_t>(InternalResType::ReprojectedFullX)].uav,
-        InternalResourceViewList[static_cast<uint32_t>(InternalResType::ReprojectedFullY)].uav,
-        InternalResourceViewList[static_cast<uint32_t>(InternalResType::ReprojectedHalfTipX)].uav,
-        InternalResourceViewList[static_cast<uint32_t>(InternalResType::ReprojectedHalfTipY)].uav,
-        InternalResourceViewList[static_cast<uint32_t>(InternalResType::ReprojectedHalfTopX)].uav,
-        InternalResourceViewList[static_cast<uint32_t>(InternalResType::ReprojectedHalfTopY)].uav,
-    };
+    json request = json::parse(requestText, nullptr, false);
+    if (request.is_discarded() || !request.is_object())
+    {
+        std::cout << "The request must be a JSON object" << std::endl;
+        return 1;
+    }
 
-    g_pContext->CSSetUnorderedAccessViews(0, 6, ppUavs, nullptr);
+    std::unique_ptr<LineSocket> pService = ConnectJobService(socketPath);
+    if (!pService || !pService->WriteLine(request.dump()))
+    {
+        std::cout << "Cannot reach the job service on " << socketPath << std::endl;
+        return 1;
+    }
 
-    ID3D11Buffer*            buf    = ConstantBufferList[static_cast<uint32_t>(ConstBufferType::Mevc)];
-    D3D11_MAPPED_SUBRESOURCE mapped = {};
-    g_pContext->Map(buf, 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped);
-    memcpy(mapped.pData, pCb, mapped.RowPitch);
-    g_pContext->Unmap(buf, 0);
+    std::string line;
+    while (pService->ReadLine(line))
+    {
+        std::cout << line << std::endl;
+        json reply = json::parse(line, nullptr, false);
+        if (reply.is_object() && reply.contains("event"))
+        {
+            if (reply["event"] == "done")
+            {
+                return reply.contains("ok") && reply["ok"] == false ? 1 : 0;
+            }
+            if (reply["event"] == "shutdown")
+            {
+                return 0;
+            }
+            if (reply["event"] == "error")
+            {
+                return 1;
+            }
+        }
+    }
+    std::cout << "The job service closed the connection" << std::endl;
+    return 1;
+}
 
-    g_pContext->CSSetSamplers(0, 1, &SamplerList[static_cast<uint32_t>(SamplerType::LinearClamp)]);
-    g_pContext->CSSetConstantBuffers(0, 1, &buf);
-    g_pContext->Dispatch(grid[0], grid[1], grid[2]);
+// Claims of one shard, counting the first, before the coordinator gives it up.
+static constexpr uint32_t MaxShardAttempts = 3;
 
-    ID3D11UnorderedAccessView* emptyUavs[6] = {nullptr};
-    g_pContext->CSSetUnorderedAccessViews(0, 6, emptyUavs, nullptr);
-    ID3D11ShaderResourceView* emptySrvs[4] = {nullptr};
-    g_pContext->CSSetShaderResources(0, 4, emptySrvs);
+// Outputs of the shard's pairs that are missing from ColorOutput/ or empty: InterpolatedFrames files per pair.
+uint32_t CountMissingOutputs(const Session& session, const Shard& shard)
+{
+    uint32_t missing = 0;
+    for (uint32_t i = shard.beginFrameId; i < shard.endFrameId; i++)
+    {
+        for (uint32_t seq = 0; seq < session.config.interpolatedFrames; seq++)
+        {
+            std::error_code error;
+            uintmax_t       size = std::filesystem::file_size(GetOutputFramePath(session, i, seq), error);
+            missing += error || size == 0 ? 1 : 0;
+        }
+    }
+    return missing;
 }
 
-void ProcessFrameGenerationMerging(MergeParamStruct* pCb, uint32_t grid[])
+// Serves one worker connection: answers claims with shards and records the worker's reports. A worker that goes away
+// while holding a shard loses it to the next claim.
+void ServeShardWorker(LineSocket&        worker,
+                      uint64_t           owner,
+                      ShardTable&        table,
+                      const json&        shardConfig,
+                      const std::string& directory,
+                      const Session&     coordinator)
 {
+    std::string line;
+    while (worker.ReadLine(line))
     {
-        g_pContext->CSSetShader(ComputeShaders[static_cast<uint32_t>(ComputeShaderType::MergeHalf)], nullptr, 0);
-
-        ID3D11UnorderedAccessView* ppUavs[] = {
-            InternalResourceViewList[static_cast<uint32_t>(InternalResType::ReprojectedHalfTipX)].uav,
-            InternalResourceViewList[static_cast<uint32_t>(InternalResType::ReprojectedHalfTipY)].uav,
-            InternalResourceViewList[static_cast<uint32_t>(InternalResType::ReprojectedHalfTopX)].uav,
-            InternalResourceViewList[static_cast<uint32_t>(InternalResType::ReprojectedHalfTopY)].uav,
-            InternalResourceViewList[static_cast<uint32_t>(InternalResType::ReprojectedHalfTip)].uav,
-            InternalResourceViewList[static_cast<uint32_t>(InternalResType::ReprojectedHalfTop)].uav,
-        };
-        g_pContext->CSSetUnorderedAccessViews(0, 6, ppUavs, nullptr);
-
-        ID3D11ShaderResourceView* ppSrvs[] = {
-            InternalResourceViewList[static_cast<uint32_t>(InternalResType::CurrMevcFiltered)].srv,
-            InternalResourceViewList[static_cast<uint32_t>(InternalResType::PrevMevcFiltered)].srv,
-            InputResourceViewList[static_cast<uint32_t>(InputResType::CurrDepth)].srv,
-            InputResourceViewList[static_cast<uint32_t>(InputResType::PrevDepth)].srv};
-        g_pContext->CSSetShaderResources(0, 4, ppSrvs);
-
-        ID3D11Buffer*            buf    = ConstantBufferList[static_cast<uint32_t>(ConstBufferType::Merge)];
-        D3D11_MAPPED_SUBRESOURCE mapped = {};
-        g_pContext->Map(buf, 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped);
-        memcpy(mapped.pData, pCb, mapped.RowPitch);
-        g_pContext->Unmap(buf, 0);
-
-        g_pContext->CSSetConstantBuffers(0, 1, &buf);
-
-        g_pContext->CSSetSamplers(0, 1, &SamplerList[static_cast<uint32_t>(SamplerType::LinearClamp)]);
-
-        g_pContext->Dispatch(grid[0], grid[1], grid[2]);
-
-        ID3D11UnorderedAccessView* emptyUavs[6] = {nullptr};
-        g_pContext->CSSetUnorderedAccessViews(0, 6, emptyUavs, nullptr);
-        ID3D11ShaderResourceView* emptySrvs[4] = {nullptr};
-        g_pContext->CSSetShaderResources(0, 4, emptySrvs);
+        json        request = json::parse(line, nullptr, false);
+        std::string command;
+        std::string error;
+        if (request.is_object())
+        {
+            GetConfigValue(request, "Command", command, error);
+        }
+        if (command == "Claim")
+        {
+            int32_t index = table.Claim(owner);
+            if (index < 0)
+            {
+                worker.WriteLine(json({{"event", index == ShardFinished ? "finished" : "wait"}}).dump());
+                continue;
+            }
+            Shard shard            = table.Get(index);
+            json  config           = shardConfig;
+            config["BeginFrameId"] = shard.beginFrameId;
+            config["EndFrameId"]   = shard.endFrameId;
+            SessionLog(coordinator) << "Shard " << index << " [" << shard.beginFrameId << ", " << shard.endFrameId
+                                    << ") to worker " << owner << ", attempt " << shard.attempts;
+            worker.WriteLine(
+                json({{"event", "shard"}, {"Shard", index}, {"Directory", directory}, {"Config", config}}).dump());
+        }
+        else if (command == "Done")
+        {
+            int  index = -1;
+            bool ok    = false;
+            GetConfigValue(request, "Shard", index, error);
+            GetConfigValue(request, "Ok", ok, error);
+            SessionLog(coordinator) << "Shard " << index << (ok ? " done" : " failed") << " by worker " << owner;
+            table.Complete(index, owner, ok);
+        }
+        else
+        {
+            worker.WriteLine(json({{"event", "error"}, {"message", "Expected a Claim or Done command"}}).dump());
+        }
     }
 
+    if (table.ReleaseOwner(owner) != 0)
     {
-        g_pContext->CSSetShader(ComputeShaders[static_cast<uint32_t>(ComputeShaderType::MergeFull)], nullptr, 0);
-        ID3D11UnorderedAccessView* ppUavs[] = {
-            InternalResourceViewList[static_cast<uint32_t>(InternalResType::ReprojectedFullX)].uav,
-            InternalResourceViewList[static_cast<uint32_t>(InternalResType::ReprojectedFullY)].uav,
-            InternalResourceViewList[static_cast<uint32_t>(InternalResType::ReprojectedFull)].uav,
-        };
-        g_pContext->CSSetUnorderedAccessViews(0, 3, ppUavs, nullptr);
-
-        ID3D11ShaderResourceView* ppSrvs[] = {
-            InternalResourceViewList[static_cast<uint32_t>(InternalResType::CurrMevcFiltered)].srv,
-            InputResourceViewList[static_cast<uint32_t>(InputResType::PrevDepth)].srv};
-        g_pContext->CSSetShaderResources(0, 2, ppSrvs);
-
-        g_pContext->CSSetSamplers(0, 1, &SamplerList[static_cast<uint32_t>(SamplerType::LinearClamp)]);
-
-        g_pContext->Dispatch(grid[0], grid[1], grid[2]);
-
-        ID3D11UnorderedAccessView* emptyUavs[3] = {nullptr};
-        g_pContext->CSSetUnorderedAccessViews(0, 3, emptyUavs, nullptr);
-        ID3D11ShaderResourceView* emptySrvs[2] = {nullptr};
-        g_pContext->CSSetShaderResources(0, 2, emptySrvs);
+        SessionLog(coordinator) << "Lost worker " << owner << " while it held a shard";
     }
 }
 
-void AddPushPullPasses(ID3D11Texture2D* pInput, ID3D11Texture2D* pOutput, const int layers)
+// Splits [BeginFrameId, EndFrameId) into shards of ShardPairs pairs and hands them to the workers that connect to
+// socketPath (--shard-worker). Once every shard is reported, the outputs are checked and shards with missing ones are
+// issued again; shards of lost or failed workers are issued again straight away. Each shard is claimed at most
+// MaxShardAttempts times. Returns 0 once every output is present.
+int RunCoordinator(const std::string& socketPath)
 {
-    if (layers == 0)
+    const ConfigInfo& config = g_configInfo;
+    if (!config.colorStream.empty() || !config.sharedMemoryRing.empty() || !config.outputStream.empty() ||
+        !config.sessions.empty())
     {
-        g_pContext->CopyResource(pOutput, pInput);
-        return;
+        std::cout << "Sharding needs directory or archive input, file output and no Sessions. Exit" << std::endl;
+        return 1;
     }
-
-    PushPullParameters ppParameters  = {};
-    ppParameters.FinerDimension[0]   = g_ColorWidth;
-    ppParameters.FinerDimension[1]   = g_ColorHeight;
-    ppParameters.CoarserDimension[0] = ppParameters.FinerDimension[0] / 2;
-    ppParameters.CoarserDimension[1] = ppParameters.FinerDimension[1] / 2;
-
-    ID3D11Buffer* buf = ConstantBufferList[static_cast<uint32_t>(ConstBufferType::PushPull)];
-
-    PushPullParameters ppParametersLv01 = ppParameters;
-    // Pulling
-    if (layers >= 1)
+    if (config.endFrameId <= config.beginFrameId)
     {
-        g_pContext->CSSetShader(ComputeShaders[static_cast<uint32_t>(ComputeShaderType::FirstLeg)], nullptr, 0);
-        g_pContext->CSSetShaderResources(0, 1, &ResourceViewMap[pInput].srv);
-
-        ID3D11UnorderedAccessView* ppUavs[] = {
-            InternalResourceViewList[static_cast<uint32_t>(InternalResType::MotionVectorLv1)].uav,
-            InternalResourceViewList[static_cast<uint32_t>(InternalResType::ReliabilityLv1)].uav};
-        g_pContext->CSSetUnorderedAccessViews(0, 2, ppUavs, nullptr);
-
-        D3D11_MAPPED_SUBRESOURCE mapped = {};
-        g_pContext->Map(buf, 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped);
-        memcpy(mapped.pData, &ppParametersLv01, mapped.RowPitch);
-        g_pContext->Unmap(buf, 0);
-        g_pContext->CSSetConstantBuffers(0, 1, &buf);
-
-        uint32_t grid[] = {(ppParametersLv01.CoarserDimension[0] + 8 - 1) / 8,
-                           (ppParametersLv01.CoarserDimension[1] + 8 - 1) / 8,
-                           1};
-        g_pContext->Dispatch(grid[0], grid[1], grid[2]);
-
-        ID3D11UnorderedAccessView* emptyUavs[2] = {nullptr};
-        g_pContext->CSSetUnorderedAccessViews(0, 2, emptyUavs, nullptr);
-        ID3D11ShaderResourceView* emptySrvs[1] = { nullptr };
-        g_pContext->CSSetShaderResources(0, 1, emptySrvs);
+        std::cout << "No pairs between BeginFrameId and EndFrameId. Exit" << std::endl;
+        return 1;
     }
 
-    PushPullParameters ppParametersLv12;
-    ppParametersLv12.FinerDimension[0]   = ppParametersLv01.FinerDimension[0] / 2;
-    ppParametersLv12.FinerDimension[1]   = ppParametersLv01.FinerDimension[1] / 2;
-    ppParametersLv12.CoarserDimension[0] = ppParametersLv01.CoarserDimension[0] / 2;
-    ppParametersLv12.CoarserDimension[1] = ppParametersLv01.CoarserDimension[1] / 2;
-    if (layers >= 2)
+    std::unique_ptr<JobListener> pListener = JobListener::Listen(socketPath);
+    if (!pListener)
     {
-        g_pContext->CSSetShader(ComputeShaders[static_cast<uint32_t>(ComputeShaderType::Pull)], nullptr, 0);
-
-        ID3D11ShaderResourceView* ppSrvs[] = {
-            InternalResourceViewList[static_cast<uint32_t>(InternalResType::MotionVectorLv1)].srv,
-            InternalResourceViewList[static_cast<uint32_t>(InternalResType::ReliabilityLv1)].srv};
-
-        g_pContext->CSSetShaderResources(0, 2, ppSrvs);
-
-        ID3D11UnorderedAccessView* ppUavs[] = {
-            InternalResourceViewList[static_cast<uint32_t>(InternalResType::MotionVectorLv2)].uav,
-            InternalResourceViewList[static_cast<uint32_t>(InternalResType::ReliabilityLv2)].uav};
-        g_pContext->CSSetUnorderedAccessViews(0, 2, ppUavs, nullptr);
-
-        D3D11_MAPPED_SUBRESOURCE mapped = {};
-        g_pContext->Map(buf, 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped);
-        memcpy(mapped.pData, &ppParametersLv12, mapped.RowPitch);
-        g_pContext->Unmap(buf, 0);
-        g_pContext->CSSetConstantBuffers(0, 1, &buf);
-
-        uint32_t grid[] = {(ppParametersLv12.CoarserDimension[0] + 8 - 1) / 8,
-                           (ppParametersLv12.CoarserDimension[1] + 8 - 1) / 8,
-                           1};
-        g_pContext->Dispatch(grid[0], grid[1], grid[2]);
-
-        ID3D11UnorderedAccessView* emptyUavs[2] = {nullptr};
-        g_pContext->CSSetUnorderedAccessViews(0, 2, emptyUavs, nullptr);
-        ID3D11ShaderResourceView* emptySrvs[2] = { nullptr };
-        g_pContext->CSSetShaderResources(0, 2, emptySrvs);
+        std::cout << "Cannot listen on " << socketPath << ". Exit" << std::endl;
+        return 1;
     }
 
-    PushPullParameters ppParametersLv23;
-    ppParametersLv23.FinerDimension[0]   = ppParametersLv12.FinerDimension[0] / 2;
-    ppParametersLv23.FinerDimension[1]   = ppParametersLv12.FinerDimension[1] / 2;
-    ppParametersLv23.CoarserDimension[0] = ppParametersLv12.CoarserDimension[0] / 2;
-    ppParametersLv23.CoarserDimension[1] = ppParametersLv12.CoarserDimension[1] / 2;
+    Session coordinator;
+    coordinator.name   = "coordinator";
+    coordinator.config = config;
 
-    if (layers >= 3)
+    // Workers start from their own config.json; the coordinator's goes over it, with the keys CountMissingOutputs names
+    // the outputs by pinned to the coordinator's values. The directory goes with each shard, so workers elsewhere on a
+    // shared file system find the inputs and write the outputs by absolute path.
+    json          shardConfig = json::object();
+    std::ifstream file("config.json");
+    if (file.is_open())
     {
-        g_pContext->CSSetShader(ComputeShaders[static_cast<uint32_t>(ComputeShaderType::Pull)], nullptr, 0);
-
-        ID3D11ShaderResourceView* ppSrvs[] = {
-            InternalResourceViewList[static_cast<uint32_t>(InternalResType::MotionVectorLv2)].srv,
-            InternalResourceViewList[static_cast<uint32_t>(InternalResType::ReliabilityLv2)].srv};
-
-        g_pContext->CSSetShaderResources(0, 2, ppSrvs);
-
-        ID3D11UnorderedAccessView* ppUavs[] = {
-            InternalResourceViewList[static_cast<uint32_t>(InternalResType::MotionVectorLv3)].uav,
-            InternalResourceViewList[static_cast<uint32_t>(InternalResType::ReliabilityLv3)].uav};
-        g_pContext->CSSetUnorderedAccessViews(0, 2, ppUavs, nullptr);
-
-        D3D11_MAPPED_SUBRESOURCE mapped = {};
-        g_pContext->Map(buf, 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped);
-        memcpy(mapped.pData, &ppParametersLv23, mapped.RowPitch);
-        g_pContext->Unmap(buf, 0);
-        g_pContext->CSSetConstantBuffers(0, 1, &buf);
-
-        uint32_t grid[] = {(ppParametersLv23.CoarserDimension[0] + 8 - 1) / 8,
-                           (ppParametersLv23.CoarserDimension[1] + 8 - 1) / 8,
-                           1};
-        g_pContext->Dispatch(grid[0], grid[1], grid[2]);
-
-        ID3D11UnorderedAccessView* emptyUavs[2] = {nullptr};
-        g_pContext->CSSetUnorderedAccessViews(0, 2, emptyUavs, nullptr);
-        ID3D11ShaderResourceView* emptySrvs[2] = { nullptr };
-        g_pContext->CSSetShaderResources(0, 2, emptySrvs);
+        shardConfig = json::parse(file, nullptr, false);
     }
-
-    if (layers >= 3)
+    if (shardConfig.is_discarded() || !shardConfig.is_object())
     {
-        g_pContext->CSSetShader(ComputeShaders[static_cast<uint32_t>(ComputeShaderType::Push)], nullptr, 0);
-
-        ID3D11ShaderResourceView* ppSrvs[] = {
-            InternalResourceViewList[static_cast<uint32_t>(InternalResType::MotionVectorLv2)].srv,
-            InternalResourceViewList[static_cast<uint32_t>(InternalResType::MotionVectorLv3)].srv,
-            InternalResourceViewList[static_cast<uint32_t>(InternalResType::ReliabilityLv2)].srv,
-            InternalResourceViewList[static_cast<uint32_t>(InternalResType::ReliabilityLv3)].srv,
-        };
-        g_pContext->CSSetShaderResources(0, 4, ppSrvs);
-
-        g_pContext->CSSetUnorderedAccessViews(
-            0,
-            1,
-            &InternalResourceViewList[static_cast<uint32_t>(InternalResType::PushedVectorLv2)].uav,
-            nullptr);
-
-        D3D11_MAPPED_SUBRESOURCE mapped = {};
-        g_pContext->Map(buf, 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped);
-        memcpy(mapped.pData, &ppParametersLv23, mapped.RowPitch);
-        g_pContext->Unmap(buf, 0);
-        g_pContext->CSSetConstantBuffers(0, 1, &buf);
-
-        uint32_t grid[] = {(ppParametersLv23.FinerDimension[0] + 8 - 1) / 8,
-                           (ppParametersLv23.FinerDimension[1] + 8 - 1) / 8,
-                           1};
-        g_pContext->Dispatch(grid[0], grid[1], grid[2]);
-
-        ID3D11UnorderedAccessView* emptyUavs[1] = {nullptr};
-        g_pContext->CSSetUnorderedAccessViews(0, 1, emptyUavs, nullptr);
-        ID3D11ShaderResourceView* emptySrvs[4] = { nullptr };
-        g_pContext->CSSetShaderResources(0, 4, emptySrvs);
+        shardConfig = json::object();
     }
+    shardConfig["InterpolatedFrames"] = config.interpolatedFrames;
+    shardConfig["OutputFormat"]       = ImageFormatName(config.outputFormat);
+    std::error_code   error;
+    const std::string directory = std::filesystem::absolute(".", error).lexically_normal().string();
+
+    ShardTable table(config.beginFrameId, config.endFrameId, config.shardPairs, MaxShardAttempts);
+    SessionLog(coordinator) << table.Count() << " shards of up to " << config.shardPairs << " pairs over ["
+                            << config.beginFrameId << ", " << config.endFrameId << "), waiting for workers on "
+                            << socketPath;
+
+    // Each worker connection has a thread; the threads register their sockets so that they can be shut down at the end.
+    auto                     begin = std::chrono::steady_clock::now();
+    std::mutex               mutex;
+    std::vector<LineSocket*> connections;
+    std::vector<std::thread> threads;
+    std::atomic<bool>        stopping{false};
+    std::thread              acceptor([&]() {
+        for (uint64_t owner = 1;; owner++)
+        {
+            std::unique_ptr<LineSocket> pWorker = pListener->Accept();
+            if (stopping)
+            {
+                return;
+            }
+            if (!pWorker)
+            {
+                continue;
+            }
+            std::lock_guard<std::mutex> lock(mutex);
+            connections.push_back(pWorker.get());
+            threads.emplace_back([&, owner, pWorker = std::move(pWorker)]() mutable {
+                ServeShardWorker(*pWorker, owner, table, shardConfig, directory, coordinator);
+                std::lock_guard<std::mutex> lock(mutex);
+                connections.erase(std::find(connections.begin(), connections.end(), pWorker.get()));
+                pWorker.reset();
+            });
+        }
+    });
 
-    if (layers >= 2)
+    size_t   failed  = 0;
+    uint32_t missing = 0;
+    for (bool reissued = true; reissued;)
     {
-        g_pContext->CSSetShader(ComputeShaders[static_cast<uint32_t>(ComputeShaderType::Push)], nullptr, 0);
-
-        ID3D11ShaderResourceView* ppSrvs[] = {
-            InternalResourceViewList[static_cast<uint32_t>(InternalResType::MotionVectorLv1)].srv,
-            layers >= 3 ? InternalResourceViewList[static_cast<uint32_t>(InternalResType::PushedVectorLv2)].srv
-                        : InternalResourceViewList[static_cast<uint32_t>(InternalResType::MotionVectorLv2)].srv,
-            InternalResourceViewList[static_cast<uint32_t>(InternalResType::ReliabilityLv1)].srv,
-            InternalResourceViewList[static_cast<uint32_t>(InternalResType::ReliabilityLv2)].srv,
-        };
-        g_pContext->CSSetShaderResources(0, 4, ppSrvs);
-
-        g_pContext->CSSetUnorderedAccessViews(
-            0,
-            1,
-            &InternalResourceViewList[static_cast<uint32_t>(InternalResType::PushedVectorLv1)].uav,
-            nullptr);
-
-        D3D11_MAPPED_SUBRESOURCE mapped = {};
-        g_pContext->Map(buf, 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped);
-        memcpy(mapped.pData, &ppParametersLv12, mapped.RowPitch);
-        g_pContext->Unmap(buf, 0);
-        g_pContext->CSSetConstantBuffers(0, 1, &buf);
-
-        uint32_t grid[] = {(ppParametersLv12.FinerDimension[0] + 8 - 1) / 8,
-                           (ppParametersLv12.FinerDimension[1] + 8 - 1) / 8,
-                           1};
-        g_pContext->Dispatch(grid[0], grid[1], grid[2]);
-
-        ID3D11UnorderedAccessView* emptyUavs[1] = {nullptr};
-        g_pContext->CSSetUnorderedAccessViews(0, 1, emptyUavs, nullptr);
-        ID3D11ShaderResourceView* emptySrvs[4] = { nullptr };
-        g_pContext->CSSetShaderResources(0, 4, emptySrvs);
+        std::vector<Shard> shards = table.WaitSettled();
+        reissued                  = false;
+        failed                    = 0;
+        missing                   = 0;
+        for (size_t i = 0; i < shards.size(); i++)
+        {
+            const bool done         = shards[i].state == ShardState::Done;
+            uint32_t   shardMissing = done ? CountMissingOutputs(coordinator, shards[i]) : 0;
+            if (shardMissing != 0)
+            {
+                SessionLog(coordinator) << "Shard " << i << " is missing " << shardMissing << " outputs";
+                table.Reissue(static_cast<int32_t>(i));
+                reissued = reissued || shards[i].attempts < MaxShardAttempts;
+            }
+            if (shards[i].state == ShardState::Failed ||
+                (shardMissing != 0 && shards[i].attempts >= MaxShardAttempts))
+            {
+                failed++;
+                missing += shardMissing;
+            }
+        }
     }
 
-    if (layers >= 1)
+    // Workers asking for more are told to stop. Accept is woken by a connection of our own.
+    table.Finish();
+    stopping = true;
+    ConnectJobService(socketPath);
+    acceptor.join();
     {
-        g_pContext->CSSetShader(ComputeShaders[static_cast<uint32_t>(ComputeShaderType::LastStretch)], nullptr, 0);
-
-        ID3D11ShaderResourceView* ppSrvs[] = {
-            ResourceViewMap[pInput].srv,
-            layers >= 2 ? InternalResourceViewList[static_cast<uint32_t>(InternalResType::PushedVectorLv1)].srv
-                        : InternalResourceViewList[static_cast<uint32_t>(InternalResType::MotionVectorLv1)].srv,
-            InternalResourceViewList[static_cast<uint32_t>(InternalResType::ReliabilityLv1)].srv};
-        g_pContext->CSSetShaderResources(0, 3, ppSrvs);
-
-        g_pContext->CSSetUnorderedAccessViews(0, 1, &ResourceViewMap[pOutput].uav, nullptr);
-
-        D3D11_MAPPED_SUBRESOURCE mapped = {};
-        g_pContext->Map(buf, 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped);
-        memcpy(mapped.pData, &ppParametersLv01, mapped.RowPitch);
-        g_pContext->Unmap(buf, 0);
-        g_pContext->CSSetConstantBuffers(0, 1, &buf);
-
-        uint32_t grid[] = {(ppParametersLv01.FinerDimension[0] + 8 - 1) / 8,
-                           (ppParametersLv01.FinerDimension[1] + 8 - 1) / 8,
-                           1};
-        g_pContext->Dispatch(grid[0], grid[1], grid[2]);
-
-        ID3D11UnorderedAccessView* emptyUavs[1] = {nullptr};
-        g_pContext->CSSetUnorderedAccessViews(0, 1, emptyUavs, nullptr);
-        ID3D11ShaderResourceView* emptySrvs[3] = { nullptr };
-        g_pContext->CSSetShaderResources(0, 3, emptySrvs);
+        std::lock_guard<std::mutex> lock(mutex);
+        for (LineSocket* pConnection : connections)
+        {
+            pConnection->Shutdown();
+        }
+    }
+    for (auto& thread : threads)
+    {
+        thread.join();
     }
-}
 
-void ProcessFrameGenerationResolution(ResolutionConstParamStruct* pCb, uint32_t grid[])
-{
-    g_pContext->CSSetShader(ComputeShaders[static_cast<uint32_t>(ComputeShaderType::Resolution)], nullptr, 0);
-
-    ID3D11ShaderResourceView* ppSrvs[] = {
-        InputResourceViewList[static_cast<uint32_t>(InputResType::PrevColor)].srv,
-        InputResourceViewList[static_cast<uint32_t>(InputResType::PrevDepth)].srv,
-        InputResourceViewList[static_cast<uint32_t>(InputResType::CurrColor)].srv,
-        InputResourceViewList[static_cast<uint32_t>(InputResType::CurrDepth)].srv,
-        InternalResourceViewList[static_cast<uint32_t>(InternalResType::CurrMevcFiltered)].srv,
-        InternalResourceViewList[static_cast<uint32_t>(InternalResType::ReprojectedFull)].srv,
-        InternalResourceViewList[static_cast<uint32_t>(InternalResType::ReprojectedHalfTip)].srv,
-        InternalResourceViewList[static_cast<uint32_t>(InternalResType::ReprojectedHalfTopFiltered)].srv};
-    g_pContext->CSSetShaderResources(0, 8, ppSrvs);
-
-    g_pContext->CSSetUnorderedAccessViews(0, 1, &g_pColorOutputUav, nullptr);
-
-    ID3D11Buffer*            buf    = ConstantBufferList[static_cast<uint32_t>(ConstBufferType::Resolution)];
-    D3D11_MAPPED_SUBRESOURCE mapped = {};
-    g_pContext->Map(buf, 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped);
-    memcpy(mapped.pData, pCb, mapped.RowPitch);
-    g_pContext->Unmap(buf, 0);
-
-    g_pContext->CSSetConstantBuffers(0, 1, &buf);
-    g_pContext->CSSetSamplers(0, 1, &SamplerList[static_cast<uint32_t>(SamplerType::LinearClamp)]);
-    g_pContext->Dispatch(grid[0], grid[1], grid[2]);
-
-    ID3D11UnorderedAccessView* emptyUavs[1] = {nullptr};
-    g_pContext->CSSetUnorderedAccessViews(0, 1, emptyUavs, 0);
-    ID3D11ShaderResourceView* emptySrvs[8] = {nullptr};
-    g_pContext->CSSetShaderResources(0, 8, emptySrvs);
+    SessionLog(coordinator) << "Shards: " << table.Count() << " (" << failed << " failed, " << table.Reissues()
+                            << " issued again), missing outputs: " << missing << ", in "
+                            << std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count() << " s";
+    return failed == 0 ? 0 : 1;
 }
 
-void RunAlgo(uint32_t frameIndex, uint32_t total)
+// Claims shards from the coordinator on socketPath and generates each as a session until the coordinator is done. A
+// shard runs with the coordinator's config.json over this process's own, in the coordinator's directory; the thread
+// counts, streams and ring stay this process's. Returns 0 once the coordinator has said it is done.
+int RunShardWorker(const std::string& socketPath)
 {
-    PrepareInput(frameIndex);
+    std::unique_ptr<LineSocket> pCoordinator = ConnectJobService(socketPath);
+    if (!pCoordinator)
+    {
+        std::cout << "Cannot reach the coordinator on " << socketPath << std::endl;
+        return 1;
+    }
 
-    uint32_t grid[] = {(g_ColorWidth + 8 - 1) / 8, (g_ColorHeight + 8 - 1) / 8, 1};
+    CreateWorkerGroups();
+    g_pFileReader = std::make_unique<AsyncFileReader>(g_configInfo.directIo, g_configInfo.ioThreads);
+    EnterWorkerGroup(GetWorkerGroup(0));
 
-    for (uint32_t seq = 0; seq < total; seq++)
+    bool        finished = false;
+    uint32_t    shards   = 0;
+    std::string line;
+    while (pCoordinator->WriteLine(json({{"Command", "Claim"}}).dump()) && pCoordinator->ReadLine(line))
     {
-        float tipDistance                = static_cast<float>(seq + 1) / static_cast<float>(total + 1);
-        float topDistance                = 1.0f - tipDistance;
-        g_constBufData.tipTopDistance[0] = tipDistance;
-        g_constBufData.tipTopDistance[1] = topDistance;
-
+        json        reply = json::parse(line, nullptr, false);
+        std::string event;
+        std::string error;
+        if (reply.is_object())
         {
-            // Clearing
-            ClearingConstParamStruct cb = {};
-            memcpy(cb.dimensions, g_constBufData.dimensions, sizeof(cb.dimensions));
-            memcpy(cb.tipTopDistance, g_constBufData.tipTopDistance, sizeof(g_constBufData.tipTopDistance));
-            memcpy(cb.viewportInv, g_constBufData.viewportInv, sizeof(g_constBufData.viewportInv));
-            memcpy(cb.viewportSize, g_constBufData.viewportSize, sizeof(g_constBufData.viewportSize));
-            ProcessFrameGenerationClearing(&cb, grid);
+            GetConfigValue(reply, "event", event, error);
         }
-
-        AddPushPullPasses(InputResourceList[static_cast<uint32_t>(InputResType::CurrMevc)],
-                          InternalResourceList[static_cast<uint32_t>(InternalResType::CurrMevcFiltered)],
-                          3);
-        AddPushPullPasses(InputResourceList[static_cast<uint32_t>(InputResType::PrevMevc)],
-                          InternalResourceList[static_cast<uint32_t>(InternalResType::PrevMevcFiltered)],
-                          3);
-
+        if (event == "wait")
         {
-            // Reprojection
-            MVecParamStruct cb = {};
-            memcpy(cb.prevClipToClip, g_constBufData.prevClipToClip, sizeof(cb.prevClipToClip));
-            memcpy(cb.clipToPrevClip, g_constBufData.clipToPrevClip, sizeof(cb.clipToPrevClip));
-            memcpy(cb.dimensions, g_constBufData.dimensions, sizeof(cb.dimensions));
-            memcpy(cb.tipTopDistance, g_constBufData.tipTopDistance, sizeof(g_constBufData.tipTopDistance));
-            memcpy(cb.viewportInv, g_constBufData.viewportInv, sizeof(g_constBufData.viewportInv));
-            memcpy(cb.viewportSize, g_constBufData.viewportSize, sizeof(g_constBufData.viewportSize));
-            ProcessFrameGenerationReprojection(&cb, grid);
+            // A shard may still come back from a worker that is lost or leaves outputs missing.
+            std::this_thread::sleep_for(std::chrono::seconds(1));
+            continue;
         }
-
+        if (event != "shard")
         {
-            // Merging
-            MergeParamStruct cb = {};
-            memcpy(cb.prevClipToClip, g_constBufData.prevClipToClip, sizeof(cb.prevClipToClip));
-            memcpy(cb.clipToPrevClip, g_constBufData.clipToPrevClip, sizeof(cb.clipToPrevClip));
-            memcpy(cb.dimensions, g_constBufData.dimensions, sizeof(cb.dimensions));
-            memcpy(cb.tipTopDistance, g_constBufData.tipTopDistance, sizeof(g_constBufData.tipTopDistance));
-            memcpy(cb.viewportInv, g_constBufData.viewportInv, sizeof(g_constBufData.viewportInv));
-            memcpy(cb.viewportSize, g_constBufData.viewportSize, sizeof(g_constBufData.viewportSize));
-
-            ProcessFrameGenerationMerging(&cb, grid);
+            finished = event == "finished";
+            if (!finished)
+            {
+                std::cout << "Unexpected reply from the coordinator: " << line << std::endl;
+            }
+            break;
         }
 
+        int         index = -1;
+        std::string directory;
+        if (!GetConfigValue(reply, "Shard", index, error) || !GetConfigValue(reply, "Directory", directory, error))
         {
-            // Push Pull Pass
-            AddPushPullPasses(InternalResourceList[static_cast<uint32_t>(InternalResType::ReprojectedFull)],
-                              InternalResourceList[static_cast<uint32_t>(InternalResType::ReprojectedFullFiltered)],
-                              1);
-            AddPushPullPasses(InternalResourceList[static_cast<uint32_t>(InternalResType::ReprojectedHalfTip)],
-                              InternalResourceList[static_cast<uint32_t>(InternalResType::ReprojectedHalfTipFiltered)],
-                              1);
-            AddPushPullPasses(InternalResourceList[static_cast<uint32_t>(InternalResType::ReprojectedHalfTop)],
-                              InternalResourceList[static_cast<uint32_t>(InternalResType::ReprojectedHalfTopFiltered)],
-                              1);
+            std::cout << "Unexpected reply from the coordinator: " << line << std::endl;
+            break;
         }
 
+        Session session;
+        session.name   = "shard " + std::to_string(index);
+        session.config = g_configInfo;
+        if (reply.contains("Config") && reply["Config"].is_object())
         {
-            // Resolution
-            ResolutionConstParamStruct cb = {};
-            memcpy(cb.dimensions, g_constBufData.dimensions, sizeof(cb.dimensions));
-            memcpy(cb.tipTopDistance, g_constBufData.tipTopDistance, sizeof(g_constBufData.tipTopDistance));
-            memcpy(cb.viewportInv, g_constBufData.viewportInv, sizeof(g_constBufData.viewportInv));
-            memcpy(cb.viewportSize, g_constBufData.viewportSize, sizeof(g_constBufData.viewportSize));
-            ProcessFrameGenerationResolution(&cb, grid);
+            ApplyConfig(reply["Config"], session.config);
+        }
+        session.config.colorStream.clear();
+        session.config.clipInfoStream.clear();
+        session.config.depthStream.clear();
+        session.config.motionStream.clear();
+        session.config.outputStream.clear();
+        session.config.sharedMemoryRing.clear();
+        session.config.sessions      = json::array();
+        session.config.workerThreads = g_configInfo.workerThreads;
+        session.config.ioThreads     = g_configInfo.ioThreads;
+        session.config.directIo      = g_configInfo.directIo;
+        session.directory            = directory;
+        session.pWorkers             = &GetWorkerGroup(0);
+
+        bool ok = RunSession(session);
+        shards++;
+        if (!pCoordinator->WriteLine(json({{"Command", "Done"}, {"Shard", index}, {"Ok", ok}}).dump()))
+        {
+            break;
         }
     }
 
-    DumpOutput(frameIndex);
+    PrintWorkerStats();
+    g_pFileReader.reset();
+    DestroyWorkerGroups();
+    std::cout << "Shards generated: " << shards << std::endl;
+    if (!finished)
+    {
+        std::cout << "Lost the coordinator on " << socketPath << std::endl;
+    }
+    return finished ? 0 : 1;
 }
 
-int main()
+int main(int argc, char* argv[])
 {
-    ParseConfig(g_configInfo);
-
-    std::cout << "BeginFrameId: " << g_configInfo.beginFrameId << std::endl;
-    std::cout << "EndFrameId: " << g_configInfo.endFrameId << std::endl;
-    std::cout << "InterpolatedFrames: " << g_configInfo.interpolatedFrames << ", note current only support 1"
-              << std::endl;
-
-    std::filesystem::create_directory("ColorOutput");
-
-    HRESULT hr = InitSampleContext(true);
-
-    if (SUCCEEDED(hr))
+    if (argc >= 2 && std::string(argv[1]) == "--bench-png")
     {
-        std::cout << "Create D3D11 Context Success" << std::endl;
+        std::string dir        = argc >= 3 ? argv[2] : "ColorInput";
+        uint32_t    iterations = argc >= 4 ? static_cast<uint32_t>((std::max)(1, atoi(argv[3]))) : 5;
+        return RunPngBenchmark(dir, iterations);
     }
-    else
+
+    if (argc >= 3 && std::string(argv[1]) == "--test-archive")
     {
-        std::cout << "Create D3D11 Context Fail" << std::endl;
+        return RunArchiveTest(argv[2]);
     }
 
-    std::vector<ShaderInfo> shaderList = {
-        {ComputeShaderType::Clear,        "phsr_fg_clearing.dxbc"    },
-        {ComputeShaderType::Reprojection, "phsr_fg_reprojection.dxbc"},
-        {ComputeShaderType::MergeHalf,    "phsr_fg_merginghalf.dxbc" },
-        {ComputeShaderType::MergeFull,    "phsr_fg_mergingfull.dxbc" },
-        {ComputeShaderType::FirstLeg,     "phsr_fg_firstleg.dxbc"    },
-        {ComputeShaderType::Pull,         "phsr_fg_pulling.dxbc"     },
-        {ComputeShaderType::LastStretch,  "phsr_fg_laststretch.dxbc" },
-        {ComputeShaderType::Push,         "phsr_fg_pushing.dxbc"     },
-        {ComputeShaderType::Resolution,   "phsr_fg_resolution.dxbc"  },
-    };
-
-    for (size_t i = 0; i < shaderList.size() && SUCCEEDED(hr); i++)
+    if (argc >= 2 && std::string(argv[1]) == "--test-shm-ring")
     {
-        hr = CreateComputeShader(&ComputeShaders[static_cast<uint32_t>(shaderList[i].shaderType)],
-                                 shaderList[i].dxbcFile);
+        return RunShmRingTest(argc >= 3 ? argv[2] : "fg_ring_test");
     }
 
-    if (SUCCEEDED(hr))
+    if (argc >= 4 && std::string(argv[1]) == "--submit")
     {
-        std::cout << "Create Compute Shaders Success" << std::endl;
+        return SubmitJob(argv[2], argv[3]);
     }
-    else
+
+    ParseConfig(g_configInfo);
+
+    if (argc >= 3 && std::string(argv[1]) == "--serve")
     {
-        std::cout << "Create Compute Shaders Fail. Exit" << std::endl;
+        return RunService(argv[2]);
     }
 
-    if (SUCCEEDED(hr))
+    if (argc >= 3 && std::string(argv[1]) == "--coordinate")
     {
-        hr = InitSamplerList();
+        return RunCoordinator(argv[2]);
     }
 
-    if (SUCCEEDED(hr))
+    if (argc >= 3 && std::string(argv[1]) == "--shard-worker")
     {
-        std::cout << "Init Samplers Success" << std::endl;
+        return RunShardWorker(argv[2]);
     }
-    else
+
+    // Batch runs are unattended, so they return without waiting for a key.
+    if (argc >= 3 && std::string(argv[1]) == "--batch")
     {
-        std::cout << "Init Samplers Fail. Exit" << std::endl;
+        return RunBatch(argv[2]);
     }
 
-    if (SUCCEEDED(hr))
+    // The Y4M stream owns stdout, so progress messages move to stderr.
+    if (g_configInfo.outputStream == "-")
     {
-        hr = InitResources();
+        std::cout.rdbuf(std::cerr.rdbuf());
     }
 
-    if (SUCCEEDED(hr))
+    if (argc >= 3 && std::string(argv[1]) == "--pack-archive")
     {
-        std::cout << "Init Resource Success" << std::endl;
+        // Flags may follow the frame range in any order.
+        bool compress       = false;
+        bool motionResidual = false;
+        int  args           = argc;
+        while (args > 3 && std::string(argv[args - 1]).compare(0, 2, "--") == 0)
+        {
+            compress       = compress || std::string(argv[args - 1]) == "--compress";
+            motionResidual = motionResidual || std::string(argv[args - 1]) == "--motion-residual";
+            args--;
+        }
+        uint32_t first = args >= 4 ? static_cast<uint32_t>(atoi(argv[3])) : g_configInfo.beginFrameId;
+        uint32_t last  = args >= 5 ? static_cast<uint32_t>(atoi(argv[4])) : g_configInfo.endFrameId;
+        return PackArchive(argv[2], first, last, compress, motionResidual);
     }
-    else
+
+    CreateWorkerGroups();
+    g_pFileReader = std::make_unique<AsyncFileReader>(g_configInfo.directIo, g_configInfo.ioThreads);
+
+    int result = 0;
+    if (!g_configInfo.sessions.empty())
     {
-        std::cout << "Init Resource Fail. Exit" << std::endl;
+        result = RunSessions();
     }
-
-    for (uint32_t i = g_configInfo.beginFrameId; i < g_configInfo.endFrameId && SUCCEEDED(hr); i++)
+    else
     {
-        std::cout << "Run algo frame: " << i << std::endl;
-        RunAlgo(i, g_configInfo.interpolatedFrames);
+        std::cout << "BeginFrameId: " << g_configInfo.beginFrameId << std::endl;
+        std::cout << "EndFrameId: " << g_configInfo.endFrameId << std::endl;
+        std::cout << "InterpolatedFrames: " << g_configInfo.interpolatedFrames << std::endl;
+
+        Session session;
+        session.config   = g_configInfo;
+        session.pWorkers = &GetWorkerGroup(0);
+        EnterWorkerGroup(*session.pWorkers);
+        result = RunSession(session) ? 0 : 1;
     }
+    PrintWorkerStats();
 
-    ReleaseContext();
-
+    g_pFileReader.reset();
+    DestroyWorkerGroups();
 
     system("pause");
-    return hr;
-}
\ No newline at end of file
+    return result;
+}
@@ -0,0 +1,277 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define PIPELINE_PAUSE() _mm_pause()
+#else
+#define PIPELINE_PAUSE() std::this_thread::yield()
+#endif
+
+// Fixed-capacity multi-producer multi-consumer queue between two pipeline stages. Each cell carries a sequence number
+// that tells producers and consumers whose turn it is, so TryPush and TryPop never take a lock while no one waits. Push
+// and Pop wait for room or for an item by spinning briefly, then yielding, then parking until the other side moves an
+// item or the queue is closed, so an idle stage costs no CPU.
+template <typename T>
+class BoundedQueue
+{
+public:
+    // capacity is rounded up to a power of two.
+    explicit BoundedQueue(uint32_t capacity)
+    {
+        size_t size = 1;
+        while (size < capacity)
+        {
+            size *= 2;
+        }
+        m_mask = size - 1;
+        m_cells.reset(new Cell[size]);
+        for (size_t i = 0; i < size; i++)
+        {
+            m_cells[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    BoundedQueue(const BoundedQueue&)            = delete;
+    BoundedQueue& operator=(const BoundedQueue&) = delete;
+
+    size_t Capacity() const
+    {
+        return m_mask + 1;
+    }
+
+    // Moves value into the queue unless it is full.
+    bool TryPush(T& value)
+    {
+        bool pushed = Enqueue(value);
+        if (pushed)
+        {
+            Wake();
+        }
+        return pushed;
+    }
+
+    bool TryPop(T& value)
+    {
+        bool popped = Dequeue(value);
+        if (popped)
+        {
+            Wake();
+        }
+        return popped;
+    }
+
+    // Waits for room. Returns false, leaving value alone, once the queue is closed. The time spent waiting is added to
+    // *pWaitNs.
+    bool Push(T& value, uint64_t* pWaitNs = nullptr)
+    {
+        bool pushed = false;
+        Wait([this, &value, &pushed]() { return m_closed.load() || (pushed = Enqueue(value)); }, pWaitNs);
+        if (pushed)
+        {
+            Wake();
+        }
+        return pushed;
+    }
+
+    // Waits for an item. Returns false once the queue is closed and drained.
+    bool Pop(T& value, uint64_t* pWaitNs = nullptr)
+    {
+        bool popped = false;
+        Wait([this, &value, &popped]() { return (popped = Dequeue(value)) || m_closed.load(); }, pWaitNs);
+        popped = popped || Dequeue(value);
+        if (popped)
+        {
+            Wake();
+        }
+        return popped;
+    }
+
+    // Lets waiting and later Pops return false once the queue is empty, and makes Push fail. Producers close the queue
+    // after their last Push has returned; a consumer may close it to make blocked producers give up.
+    void Close()
+    {
+        m_closed = true;
+        Wake();
+    }
+
+private:
+    struct Cell
+    {
+        std::atomic<size_t> sequence;
+        T                   value;
+    };
+
+    bool Enqueue(T& value)
+    {
+        size_t pos = m_enqueuePos.load(std::memory_order_relaxed);
+        for (;;)
+        {
+            Cell&    cell = m_cells[pos & m_mask];
+            size_t   seq  = cell.sequence.load(std::memory_order_acquire);
+            intptr_t diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos);
+            if (diff == 0)
+            {
+                if (m_enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                {
+                    cell.value = std::move(value);
+                    cell.sequence.store(pos + 1, std::memory_order_release);
+                    return true;
+                }
+            }
+            else if (diff < 0)
+            {
+                return false;
+            }
+            else
+            {
+                pos = m_enqueuePos.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    bool Dequeue(T& value)
+    {
+        size_t pos = m_dequeuePos.load(std::memory_order_relaxed);
+        for (;;)
+        {
+            Cell&    cell = m_cells[pos & m_mask];
+            size_t   seq  = cell.sequence.load(std::memory_order_acquire);
+            intptr_t diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos + 1);
+            if (diff == 0)
+            {
+                if (m_dequeuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                {
+                    value = std::move(cell.value);
+                    cell.sequence.store(pos + m_mask + 1, std::memory_order_release);
+                    return true;
+                }
+            }
+            else if (diff < 0)
+            {
+                return false;
+            }
+            else
+            {
+                pos = m_dequeuePos.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    // Spins, then yields, then parks until ready() holds. A parked waiter counts itself and re-checks under the mutex,
+    // and ready() runs under it from then on, so Wake needs the mutex only while someone is parked.
+    template <typename Ready>
+    void Wait(const Ready& ready, uint64_t* pWaitNs)
+    {
+        if (ready())
+        {
+            return;
+        }
+
+        auto begin = std::chrono::steady_clock::now();
+        for (uint32_t spins = 0; !ready(); spins++)
+        {
+            if (spins < 64)
+            {
+                PIPELINE_PAUSE();
+            }
+            else if (spins < 256)
+            {
+                std::this_thread::yield();
+            }
+            else
+            {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                m_parked++;
+                std::atomic_thread_fence(std::memory_order_seq_cst);
+                m_wake.wait(lock, ready);
+                m_parked--;
+                break;
+            }
+        }
+        if (pWaitNs != nullptr)
+        {
+            *pWaitNs +=
+                std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - begin).count();
+        }
+    }
+
+    // The fence pairs with the one in Wait: either the waiter sees the moved item or the closed flag, or the waker sees
+    // the waiter counted.
+    void Wake()
+    {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (m_parked.load(std::memory_order_relaxed) != 0)
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_wake.notify_all();
+        }
+    }
+
+    std::unique_ptr<Cell[]> m_cells;
+    size_t                  m_mask = 0;
+
+    // Producers and consumers each hammer their own position; keep them on separate cache lines.
+    alignas(64) std::atomic<size_t> m_enqueuePos{0};
+    alignas(64) std::atomic<size_t> m_dequeuePos{0};
+    alignas(64) std::atomic<bool> m_closed{false};
+    std::atomic<uint32_t>   m_parked{0};
+    std::mutex              m_mutex;
+    std::condition_variable m_wake;
+};
+
+// Where the threads of one pipeline stage spent their time: running items, waiting for the stage before to hand them
+// one, and waiting for room in the queue to the stage after.
+struct PipelineStageStats
+{
+    uint32_t threads           = 0;
+    uint64_t items             = 0;
+    double   busySeconds       = 0.0;
+    double   inputWaitSeconds  = 0.0;
+    double   outputWaitSeconds = 0.0;
+
+    // Busy share of the stage's thread time over a run of wallSeconds.
+    double Utilization(double wallSeconds) const
+    {
+        return threads != 0 && wallSeconds > 0.0 ? busySeconds / (threads * wallSeconds) : 0.0;
+    }
+};
+
+// Thread-safe accumulator behind PipelineStageStats.
+struct PipelineStageCounters
+{
+    std::atomic<uint64_t> items{0};
+    std::atomic<uint64_t> busyNs{0};
+    std::atomic<uint64_t> inputWaitNs{0};
+    std::atomic<uint64_t> outputWaitNs{0};
+
+    void AddBusy(std::chrono::steady_clock::time_point begin, uint64_t excludedNs = 0)
+    {
+        uint64_t ns =
+            std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - begin).count();
+        busyNs += ns - (std::min)(ns, excludedNs);
+        items++;
+    }
+
+    PipelineStageStats Get(uint32_t threads) const
+    {
+        PipelineStageStats stats;
+        stats.threads           = threads;
+        stats.items             = items.load();
+        stats.busySeconds       = busyNs.load() * 1e-9;
+        stats.inputWaitSeconds  = inputWaitNs.load() * 1e-9;
+        stats.outputWaitSeconds = outputWaitNs.load() * 1e-9;
+        return stats;
+    }
+};
@@ -0,0 +1,490 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "thread_pool.h"
+
+// PNG writer that splits one image into horizontal bands and filters and deflates every band independently on the
+// pool, pigz style: each band ends on a byte boundary with an empty stored block, so the bands' outputs are simply
+// concatenated into one zlib stream, and the Adler-32 of the whole image is combined from the per-band sums. Bands do
+// not share an LZ77 window, which costs a little ratio at the band seams.
+//
+// Level 0 stores, levels 1-9 use greedy LZ77 over hash chains whose search depth grows with the level, coded with the
+// fixed Huffman tables (as stb_image_write does).
+
+static constexpr size_t PngBandTargetBytes = 512 * 1024;
+
+inline uint32_t Crc32Update(uint32_t crc, const uint8_t* pData, size_t size)
+{
+    static const struct CrcTable
+    {
+        uint32_t entries[256];
+
+        CrcTable()
+        {
+            for (uint32_t n = 0; n < 256; n++)
+            {
+                uint32_t c = n;
+                for (int k = 0; k < 8; k++)
+                {
+                    c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+                }
+                entries[n] = c;
+            }
+        }
+    } table;
+
+    crc = ~crc;
+    for (size_t i = 0; i < size; i++)
+    {
+        crc = table.entries[(crc ^ pData[i]) & 0xFF] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
+inline uint32_t Adler32(const uint8_t* pData, size_t size)
+{
+    static constexpr uint32_t Base = 65521;
+    uint32_t                  a    = 1;
+    uint32_t                  b    = 0;
+    while (size > 0)
+    {
+        // 5552 is the largest block for which b cannot overflow 32 bits before the modulo.
+        size_t block = (std::min)(size, size_t(5552));
+        for (size_t i = 0; i < block; i++)
+        {
+            a += pData[i];
+            b += a;
+        }
+        a %= Base;
+        b %= Base;
+        pData += block;
+        size -= block;
+    }
+    return (b << 16) | a;
+}
+
+// Adler-32 of the concatenation A + B, from adler(A), adler(B) and the length of B.
+inline uint32_t Adler32Combine(uint32_t adlerA, uint32_t adlerB, size_t lengthB)
+{
+    static constexpr uint32_t Base = 65521;
+    uint32_t                  rem  = static_cast<uint32_t>(lengthB % Base);
+    uint32_t                  a    = adlerA & 0xFFFF;
+    uint32_t                  b    = static_cast<uint32_t>((static_cast<uint64_t>(rem) * a) % Base);
+    a += (adlerB & 0xFFFF) + Base - 1;
+    b += (adlerA >> 16) + (adlerB >> 16) + Base - rem;
+    if (a >= Base)
+    {
+        a -= Base;
+    }
+    if (a >= Base)
+    {
+        a -= Base;
+    }
+    if (b >= 2 * Base)
+    {
+        b -= 2 * Base;
+    }
+    if (b >= Base)
+    {
+        b -= Base;
+    }
+    return (b << 16) | a;
+}
+
+class DeflateBitWriter
+{
+public:
+    explicit DeflateBitWriter(std::vector<uint8_t>& out)
+        : m_out(out)
+    {
+    }
+
+    void Put(uint32_t bits, uint32_t count)
+    {
+        m_buffer |= static_cast<uint64_t>(bits) << m_count;
+        m_count += count;
+        while (m_count >= 8)
+        {
+            m_out.push_back(static_cast<uint8_t>(m_buffer));
+            m_buffer >>= 8;
+            m_count -= 8;
+        }
+    }
+
+    // Huffman codes go out most significant bit first.
+    void PutCode(uint32_t code, uint32_t count)
+    {
+        uint32_t reversed = 0;
+        for (uint32_t i = 0; i < count; i++)
+        {
+            reversed = (reversed << 1) | ((code >> i) & 1);
+        }
+        Put(reversed, count);
+    }
+
+    void AlignToByte()
+    {
+        if (m_count > 0)
+        {
+            Put(0, 8 - m_count);
+        }
+    }
+
+private:
+    std::vector<uint8_t>& m_out;
+    uint64_t              m_buffer = 0;
+    uint32_t              m_count  = 0;
+};
+
+inline void PutFixedLiteral(DeflateBitWriter& writer, uint32_t symbol)
+{
+    // Fixed literal/length code, stored already bit-reversed together with its length.
+    static const struct FixedCodeTable
+    {
+        uint16_t code[288];
+        uint8_t  length[288];
+
+        FixedCodeTable()
+        {
+            for (uint32_t s = 0; s < 288; s++)
+            {
+                uint32_t c = 0;
+                uint32_t n = 0;
+                if (s < 144)
+                {
+                    c = 0x30 + s;
+                    n = 8;
+                }
+                else if (s < 256)
+                {
+                    c = 0x190 + s - 144;
+                    n = 9;
+                }
+                else if (s < 280)
+                {
+                    c = s - 256;
+                    n = 7;
+                }
+                else
+                {
+                    c = 0xC0 + s - 280;
+                    n = 8;
+                }
+                uint32_t reversed = 0;
+                for (uint32_t i = 0; i < n; i++)
+                {
+                    reversed = (reversed << 1) | ((c >> i) & 1);
+                }
+                code[s]   = static_cast<uint16_t>(reversed);
+                length[s] = static_cast<uint8_t>(n);
+            }
+        }
+    } table;
+
+    writer.Put(table.code[symbol], table.length[symbol]);
+}
+
+inline void PutFixedMatch(DeflateBitWriter& writer, uint32_t length, uint32_t distance)
+{
+    static const uint16_t LengthBase[29]  = {3,  4,  5,  6,  7,  8,  9,  10, 11,  13,  15,  17,  19,  23, 27,
+                                             31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258};
+    static const uint8_t  LengthExtra[29] = {0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2,
+                                             2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0};
+    static const uint16_t DistBase[30]    = {1,    2,    3,    4,    5,    7,    9,    13,    17,    25,
+                                             33,   49,   65,   97,   129,  193,  257,  385,   513,   769,
+                                             1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577};
+    static const uint8_t  DistExtra[30]   = {0, 0, 0, 0, 1, 1, 2, 2,  3,  3,  4,  4,  5,  5,  6,
+                                             6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
+
+    uint32_t lengthCode = 28;
+    while (LengthBase[lengthCode] > length)
+    {
+        lengthCode--;
+    }
+    PutFixedLiteral(writer, 257 + lengthCode);
+    writer.Put(length - LengthBase[lengthCode], LengthExtra[lengthCode]);
+
+    uint32_t distCode = 29;
+    while (DistBase[distCode] > distance)
+    {
+        distCode--;
+    }
+    writer.PutCode(distCode, 5);
+    writer.Put(distance - DistBase[distCode], DistExtra[distCode]);
+}
+
+// Appends raw deflate blocks for pData to out. A band that is not the last ends with an empty stored block so that it
+// finishes on a byte boundary and the next band can be appended directly.
+inline void DeflateBand(const uint8_t* pData, size_t size, int level, bool last, std::vector<uint8_t>& out)
+{
+    static constexpr uint32_t WindowSize = 32768;
+    static constexpr uint32_t HashBits   = 15;
+    static constexpr uint32_t MinMatch   = 3;
+    static constexpr uint32_t MaxMatch   = 258;
+    // Per level: how many chain entries to visit, and the match length that ends the search early.
+    static const uint32_t ChainDepth[10] = {0, 2, 4, 6, 8, 16, 32, 64, 256, 1024};
+    static const uint32_t NiceLength[10] = {0, 8, 16, 24, 32, 64, 128, 258, 258, 258};
+
+    DeflateBitWriter writer(out);
+    level = (std::min)((std::max)(level, 0), 9);
+
+    if (level == 0)
+    {
+        size_t offset = 0;
+        do
+        {
+            size_t block     = (std::min)(size - offset, size_t(65535));
+            bool   lastBlock = last && offset + block == size;
+            writer.Put(lastBlock ? 1 : 0, 1);
+            writer.Put(0, 2);
+            writer.AlignToByte();
+            writer.Put(static_cast<uint32_t>(block), 16);
+            writer.Put(static_cast<uint32_t>(block) ^ 0xFFFF, 16);
+            out.insert(out.end(), pData + offset, pData + offset + block);
+            offset += block;
+        } while (offset < size);
+        return;
+    }
+
+    writer.Put(last ? 1 : 0, 1);
+    writer.Put(1, 2);
+
+    std::vector<int32_t> head(size_t(1) << HashBits, -1);
+    std::vector<int32_t> prev(WindowSize, -1);
+    auto                 hash = [pData](size_t pos) {
+        uint32_t v = (uint32_t(pData[pos]) << 16) | (uint32_t(pData[pos + 1]) << 8) | pData[pos + 2];
+        return (v * 2654435761u) >> (32 - HashBits);
+    };
+    auto insert = [&](size_t pos) {
+        uint32_t h                = hash(pos);
+        prev[pos & (WindowSize - 1)] = head[h];
+        head[h]                   = static_cast<int32_t>(pos);
+    };
+
+    const uint32_t maxChain = ChainDepth[level];
+    const uint32_t nice     = NiceLength[level];
+    size_t         pos      = 0;
+    while (pos < size)
+    {
+        uint32_t bestLength   = 0;
+        uint32_t bestDistance = 0;
+        if (pos + MinMatch <= size)
+        {
+            const uint32_t maxLength = static_cast<uint32_t>((std::min)(size - pos, size_t(MaxMatch)));
+            int32_t        candidate = head[hash(pos)];
+            for (uint32_t chain = 0; candidate >= 0 && chain < maxChain; chain++)
+            {
+                size_t distance = pos - static_cast<size_t>(candidate);
+                if (distance > WindowSize - 1)
+                {
+                    break;
+                }
+                const uint8_t* a = pData + candidate;
+                const uint8_t* b = pData + pos;
+                if (a[bestLength] == b[bestLength])
+                {
+                    uint32_t length = 0;
+                    while (length < maxLength && a[length] == b[length])
+                    {
+                        length++;
+                    }
+                    if (length > bestLength)
+                    {
+                        bestLength   = length;
+                        bestDistance = static_cast<uint32_t>(distance);
+                        if (length >= nice || length == maxLength)
+                        {
+                            break;
+                        }
+                    }
+                }
+                int32_t next = prev[candidate & (WindowSize - 1)];
+                if (next >= candidate)
+                {
+                    break;
+                }
+                candidate = next;
+            }
+            insert(pos);
+        }
+
+        if (bestLength >= MinMatch)
+        {
+            PutFixedMatch(writer, bestLength, bestDistance);
+            for (size_t i = pos + 1; i < pos + bestLength && i + MinMatch <= size; i++)
+            {
+                insert(i);
+            }
+            pos += bestLength;
+        }
+        else
+        {
+            PutFixedLiteral(writer, pData[pos]);
+            pos++;
+        }
+    }
+    PutFixedLiteral(writer, 256);
+
+    if (!last)
+    {
+        writer.Put(0, 1);
+        writer.Put(0, 2);
+        writer.AlignToByte();
+        writer.Put(0x0000, 16);
+        writer.Put(0xFFFF, 16);
+    }
+    writer.AlignToByte();
+}
+
+// Writes the filtered scanlines for rows [y0, y1): per row, the filter with the smallest sum of absolute residuals.
+inline void FilterRows(const uint8_t* pPixels, uint32_t width, size_t stride, uint32_t y0, uint32_t y1,
+                       std::vector<uint8_t>& out)
+{
+    const size_t rowBytes = static_cast<size_t>(width) * 4;
+    const size_t bpp      = 4;
+    out.resize((y1 - y0) * (rowBytes + 1));
+
+    std::vector<uint8_t> candidate(rowBytes);
+    std::vector<uint8_t> zeroRow(rowBytes, 0);
+
+    for (uint32_t y = y0; y < y1; y++)
+    {
+        const uint8_t* pRow   = pPixels + y * stride;
+        const uint8_t* pPrior = y == 0 ? zeroRow.data() : pRow - stride;
+        uint8_t*       pOut   = out.data() + (y - y0) * (rowBytes + 1);
+        uint64_t       best   = UINT64_MAX;
+
+        auto tryFilter = [&](uint8_t filter, auto predict) {
+            uint64_t score = 0;
+            for (size_t i = 0; i < rowBytes; i++)
+            {
+                int     a        = i >= bpp ? pRow[i - bpp] : 0;
+                int     c        = i >= bpp ? pPrior[i - bpp] : 0;
+                uint8_t residual = static_cast<uint8_t>(pRow[i] - predict(a, pPrior[i], c));
+                candidate[i]     = residual;
+                score += static_cast<uint64_t>(abs(static_cast<int8_t>(residual)));
+            }
+            if (score < best)
+            {
+                best    = score;
+                pOut[0] = filter;
+                memcpy(pOut + 1, candidate.data(), rowBytes);
+            }
+        };
+
+        tryFilter(0, [](int, int, int) { return 0; });
+        tryFilter(1, [](int a, int, int) { return a; });
+        tryFilter(2, [](int, int b, int) { return b; });
+        tryFilter(3, [](int a, int b, int) { return (a + b) >> 1; });
+        tryFilter(4, [](int a, int b, int c) {
+            int p  = a + b - c;
+            int pa = abs(p - a);
+            int pb = abs(p - b);
+            int pc = abs(p - c);
+            return (pa <= pb && pa <= pc) ? a : (pb <= pc ? b : c);
+        });
+    }
+}
+
+inline void AppendBigEndian32(std::vector<uint8_t>& out, uint32_t value)
+{
+    out.push_back(static_cast<uint8_t>(value >> 24));
+    out.push_back(static_cast<uint8_t>(value >> 16));
+    out.push_back(static_cast<uint8_t>(value >> 8));
+    out.push_back(static_cast<uint8_t>(value));
+}
+
+inline void AppendPngChunk(std::vector<uint8_t>& out, const char* pType, const uint8_t* pData, size_t size)
+{
+    AppendBigEndian32(out, static_cast<uint32_t>(size));
+    size_t typeOffset = out.size();
+    out.insert(out.end(), pType, pType + 4);
+    if (size != 0)
+    {
+        out.insert(out.end(), pData, pData + size);
+    }
+    AppendBigEndian32(out, Crc32Update(0, out.data() + typeOffset, size + 4));
+}
+
+// Encodes an RGBA8 image. With a pool, bands are filtered and deflated in parallel; each band becomes one IDAT chunk.
+inline std::vector<uint8_t> EncodePngRgba(
+    const uint8_t* pPixels, uint32_t width, uint32_t height, size_t stride, int level, ThreadPool* pPool)
+{
+    const size_t   rowBytes    = static_cast<size_t>(width) * 4 + 1;
+    const uint32_t bandRows    = static_cast<uint32_t>((std::max)(size_t(1), PngBandTargetBytes / rowBytes));
+    const uint32_t bandCount   = (height + bandRows - 1) / bandRows;
+
+    struct Band
+    {
+        std::vector<uint8_t> deflated;
+        uint32_t             adler  = 1;
+        size_t               length = 0;
+    };
+    std::vector<Band> bands(bandCount);
+
+    auto encodeBand = [&](uint32_t index) {
+        uint32_t             y0 = index * bandRows;
+        uint32_t             y1 = (std::min)(height, y0 + bandRows);
+        std::vector<uint8_t> filtered;
+        FilterRows(pPixels, width, stride, y0, y1, filtered);
+        bands[index].adler  = Adler32(filtered.data(), filtered.size());
+        bands[index].length = filtered.size();
+        if (index == 0)
+        {
+            // zlib header: deflate, 32K window, no dictionary.
+            bands[index].deflated = {0x78, 0x01};
+        }
+        DeflateBand(filtered.data(), filtered.size(), level, index + 1 == bandCount, bands[index].deflated);
+    };
+
+    if (pPool != nullptr)
+    {
+        pPool->ParallelFor(bandCount, encodeBand);
+    }
+    else
+    {
+        for (uint32_t i = 0; i < bandCount; i++)
+        {
+            encodeBand(i);
+        }
+    }
+
+    uint32_t adler = 1;
+    for (const auto& band : bands)
+    {
+        adler = Adler32Combine(adler, band.adler, band.length);
+    }
+
+    std::vector<uint8_t> png = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+
+    uint8_t header[13] = {};
+    header[0]          = static_cast<uint8_t>(width >> 24);
+    header[1]          = static_cast<uint8_t>(width >> 16);
+    header[2]          = static_cast<uint8_t>(width >> 8);
+    header[3]          = static_cast<uint8_t>(width);
+    header[4]          = static_cast<uint8_t>(height >> 24);
+    header[5]          = static_cast<uint8_t>(height >> 16);
+    header[6]          = static_cast<uint8_t>(height >> 8);
+    header[7]          = static_cast<uint8_t>(height);
+    header[8]          = 8; // bit depth
+    header[9]          = 6; // RGBA
+    AppendPngChunk(png, "IHDR", header, sizeof(header));
+
+    for (auto& band : bands)
+    {
+        if (&band == &bands.back())
+        {
+            AppendBigEndian32(band.deflated, adler);
+        }
+        AppendPngChunk(png, "IDAT", band.deflated.data(), band.deflated.size());
+    }
+    AppendPngChunk(png, "IEND", nullptr, 0);
+    return png;
+}
@@ -0,0 +1,729 @@
+// Python bindings for the C interface in frame_generation.h. Inputs are taken through the buffer protocol and handed to
+// the generator where they lie; generated frames come back as framegen.Frame objects, which export their pixels as an
+// (height, width, 4) uint8 buffer, so numpy.asarray(frame) does not copy either. The GIL is released while a context
+// uploads, generates and reads back, so contexts driven from different Python threads run in parallel.
+
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+#include <structmember.h>
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <new>
+#include <vector>
+
+#include "../frame_generation.h"
+
+// Default formats of config.json: DXGI_FORMAT_R24_UNORM_X8_TYPELESS depth and DXGI_FORMAT_R16G16_FLOAT motion.
+static constexpr uint32_t DefaultDepthFormat  = 46;
+static constexpr uint32_t DefaultMotionFormat = 34;
+
+// ---------------------------------------------------------------------------------------------------------------------
+// Frame
+
+struct FrameObject
+{
+    PyObject_HEAD
+    FgOutputFrame info;
+    uint8_t*      pPixels;
+    Py_ssize_t    shape[3];
+    Py_ssize_t    strides[3];
+};
+
+static void Frame_dealloc(FrameObject* self)
+{
+    free(self->pPixels);
+    Py_TYPE(self)->tp_free(reinterpret_cast<PyObject*>(self));
+}
+
+static int Frame_getbuffer(FrameObject* self, Py_buffer* view, int flags)
+{
+    if ((flags & PyBUF_WRITABLE) == PyBUF_WRITABLE)
+    {
+        PyErr_SetString(PyExc_BufferError, "Frame pixels are read-only");
+        view->obj = nullptr;
+        return -1;
+    }
+    view->obj = reinterpret_cast<PyObject*>(self);
+    Py_INCREF(self);
+    view->buf        = self->pPixels;
+    view->len        = self->shape[0] * self->strides[0];
+    view->readonly   = 1;
+    view->itemsize   = 1;
+    view->format     = (flags & PyBUF_FORMAT) != 0 ? const_cast<char*>("B") : nullptr;
+    view->ndim       = 3;
+    view->shape      = (flags & PyBUF_ND) == PyBUF_ND ? self->shape : nullptr;
+    view->strides    = (flags & PyBUF_STRIDES) == PyBUF_STRIDES ? self->strides : nullptr;
+    view->suboffsets = nullptr;
+    view->internal   = nullptr;
+    return 0;
+}
+
+static PyObject* Frame_repr(FrameObject* self)
+{
+    return PyUnicode_FromFormat("<framegen.Frame %llu-%llu seq=%u %ux%u>",
+                                static_cast<unsigned long long>(self->info.prevFrameId),
+                                static_cast<unsigned long long>(self->info.currFrameId),
+                                self->info.seq,
+                                self->info.width,
+                                self->info.height);
+}
+
+static PyMemberDef FrameMembers[] = {
+    {"prev_frame_id", T_ULONGLONG, offsetof(FrameObject, info.prevFrameId), READONLY, "frame_id of the earlier input"},
+    {"curr_frame_id", T_ULONGLONG, offsetof(FrameObject, info.currFrameId), READONLY, "frame_id of the later input"},
+    {"timestamp_ns", T_ULONGLONG, offsetof(FrameObject, info.timestampNs), READONLY, "timestamp_ns of curr_frame_id"},
+    {"seq", T_UINT, offsetof(FrameObject, info.seq), READONLY, "0 .. interpolated_frames - 1, or CAPTURED_FRAME"},
+    {"width", T_UINT, offsetof(FrameObject, info.width), READONLY, nullptr},
+    {"height", T_UINT, offsetof(FrameObject, info.height), READONLY, nullptr},
+    {nullptr},
+};
+
+static PyBufferProcs FrameBufferProcs = {
+    reinterpret_cast<getbufferproc>(Frame_getbuffer),
+    nullptr,
+};
+
+static PyTypeObject FrameType = {PyVarObject_HEAD_INIT(nullptr, 0)};
+
+// Takes ownership of pPixels, which holds tightly packed RGBA8 rows.
+static PyObject* MakeFrame(const FgOutputFrame& info, uint8_t* pPixels)
+{
+    FrameObject* frame = PyObject_New(FrameObject, &FrameType);
+    if (frame == nullptr)
+    {
+        free(pPixels);
+        return nullptr;
+    }
+    frame->info          = info;
+    frame->info.rowPitch = info.width * 4;
+    frame->info.pPixels  = nullptr;
+    frame->pPixels       = pPixels;
+    frame->shape[0]      = info.height;
+    frame->shape[1]      = info.width;
+    frame->shape[2]      = 4;
+    frame->strides[0]    = static_cast<Py_ssize_t>(info.width) * 4;
+    frame->strides[1]    = 4;
+    frame->strides[2]    = 1;
+    return reinterpret_cast<PyObject*>(frame);
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+// WorkerPool
+
+struct WorkerPoolObject
+{
+    PyObject_HEAD
+    FgWorkerPool pool;
+};
+
+static void WorkerPool_dealloc(WorkerPoolObject* self)
+{
+    fgDestroyWorkerPool(self->pool);
+    Py_TYPE(self)->tp_free(reinterpret_cast<PyObject*>(self));
+}
+
+static int WorkerPool_init(WorkerPoolObject* self, PyObject* args, PyObject* kwargs)
+{
+    static const char* keywords[] = {"threads", nullptr};
+    unsigned int       threads    = 0;
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "|I", const_cast<char**>(keywords), &threads))
+    {
+        return -1;
+    }
+    // Contexts created with the pool hold its threads, so a live pool cannot be replaced.
+    if (self->pool != nullptr)
+    {
+        PyErr_SetString(PyExc_RuntimeError, "WorkerPool is already initialized");
+        return -1;
+    }
+    if (fgCreateWorkerPool(threads, &self->pool) != FG_SUCCESS)
+    {
+        PyErr_NoMemory();
+        return -1;
+    }
+    return 0;
+}
+
+static PyTypeObject WorkerPoolType = {PyVarObject_HEAD_INIT(nullptr, 0)};
+
+// ---------------------------------------------------------------------------------------------------------------------
+// Context
+
+struct ContextObject
+{
+    PyObject_HEAD
+    FgContext                   context;
+    PyObject*                   pPool; // keeps a shared WorkerPool alive for as long as the context
+    uint32_t                    width;
+    uint32_t                    height;
+    bool                        busy;
+    std::vector<FgOutputFrame>* pOutputs; // frames delivered while the GIL was released
+    std::vector<uint8_t*>*      pPixels;
+};
+
+// Runs on the thread that called into the context, without the GIL.
+static void OnOutputFrame(void* pUserData, const FgOutputFrame* pFrame)
+{
+    ContextObject* self   = static_cast<ContextObject*>(pUserData);
+    const size_t   stride = static_cast<size_t>(pFrame->width) * 4;
+    uint8_t*       pCopy  = static_cast<uint8_t*>(malloc(stride * pFrame->height));
+    if (pCopy != nullptr)
+    {
+        for (uint32_t y = 0; y < pFrame->height; y++)
+        {
+            memcpy(pCopy + y * stride, pFrame->pPixels + static_cast<size_t>(y) * pFrame->rowPitch, stride);
+        }
+    }
+    self->pOutputs->push_back(*pFrame);
+    self->pPixels->push_back(pCopy);
+}
+
+// Turns the frames collected by OnOutputFrame into a list of Frame objects.
+static PyObject* TakeOutputs(ContextObject* self)
+{
+    std::vector<FgOutputFrame> outputs;
+    std::vector<uint8_t*>      pixels;
+    outputs.swap(*self->pOutputs);
+    pixels.swap(*self->pPixels);
+
+    PyObject* list = PyList_New(0);
+    for (size_t i = 0; i < outputs.size(); i++)
+    {
+        PyObject* frame = nullptr;
+        if (list != nullptr && pixels[i] != nullptr)
+        {
+            frame = MakeFrame(outputs[i], pixels[i]);
+        }
+        else
+        {
+            free(pixels[i]);
+        }
+        if (list != nullptr && (frame == nullptr || PyList_Append(list, frame) != 0))
+        {
+            Py_CLEAR(list);
+        }
+        Py_XDECREF(frame);
+    }
+    return list != nullptr ? list : PyErr_Occurred() ? nullptr : PyErr_NoMemory();
+}
+
+static PyObject* RaiseResult(FgResult result)
+{
+    PyErr_SetString(result == FG_ERROR_INVALID_ARGUMENT ? PyExc_ValueError
+                    : result == FG_ERROR_OUT_OF_MEMORY  ? PyExc_MemoryError
+                                                        : PyExc_RuntimeError,
+                    fgResultString(result));
+    return nullptr;
+}
+
+// Only one call may be inside a context at a time; the flag is tested and set under the GIL.
+static bool EnterContext(ContextObject* self)
+{
+    if (self->context == nullptr)
+    {
+        PyErr_SetString(PyExc_RuntimeError, "the context has been closed");
+        return false;
+    }
+    if (self->busy)
+    {
+        PyErr_SetString(PyExc_RuntimeError, "the context is in use by another thread");
+        return false;
+    }
+    self->busy = true;
+    return true;
+}
+
+static void ContextDesc(ContextObject* self, FgContextDesc& desc)
+{
+    desc.workerPool     = self->pPool != nullptr ? reinterpret_cast<WorkerPoolObject*>(self->pPool)->pool : nullptr;
+    desc.outputCallback = OnOutputFrame;
+    desc.pUserData      = self;
+}
+
+// Parses the settings shared by Context() and Context.reset().
+static bool ParseSettings(
+    PyObject* args, PyObject* kwargs, FgContextDesc& desc, const char** pShaderDirectory, PyObject** pPool)
+{
+    static const char* keywords[] = {"width",
+                                     "height",
+                                     "depth_format",
+                                     "motion_format",
+                                     "interpolated_frames",
+                                     "readback_depth",
+                                     "synthesize_motion",
+                                     "emit_inputs",
+                                     "debug_layer",
+                                     "shader_directory",
+                                     "pool",
+                                     "warp",
+                                     "low_latency",
+                                     nullptr};
+    unsigned int width              = 0;
+    unsigned int height             = 0;
+    unsigned int depthFormat        = DefaultDepthFormat;
+    unsigned int motionFormat       = DefaultMotionFormat;
+    unsigned int interpolatedFrames = 1;
+    unsigned int readbackDepth      = 0;
+    int          synthesizeMotion   = 0;
+    int          emitInputs         = 0;
+    int          debugLayer         = 0;
+    const char*  shaderDirectory    = nullptr;
+    PyObject*    pool               = Py_None;
+    int          warp               = 0;
+    int          lowLatency         = 0;
+    if (!PyArg_ParseTupleAndKeywords(args,
+                                     kwargs,
+                                     "II|IIIIpppzOpp",
+                                     const_cast<char**>(keywords),
+                                     &width,
+                                     &height,
+                                     &depthFormat,
+                                     &motionFormat,
+                                     &interpolatedFrames,
+                                     &readbackDepth,
+                                     &synthesizeMotion,
+                                     &emitInputs,
+                                     &debugLayer,
+                                     &shaderDirectory,
+                                     &pool,
+                                     &warp,
+                                     &lowLatency))
+    {
+        return false;
+    }
+    if (pool != Py_None && !PyObject_TypeCheck(pool, &WorkerPoolType))
+    {
+        PyErr_SetString(PyExc_TypeError, "pool must be a framegen.WorkerPool");
+        return false;
+    }
+
+    desc                    = {};
+    desc.width              = width;
+    desc.height             = height;
+    desc.depthFormat        = depthFormat;
+    desc.motionFormat       = motionFormat;
+    desc.interpolatedFrames = interpolatedFrames;
+    desc.readbackDepth      = readbackDepth;
+    desc.shaderDirectory    = shaderDirectory;
+    desc.flags              = 0;
+    if (synthesizeMotion)
+    {
+        desc.flags |= FG_CONTEXT_SYNTHESIZE_MOTION;
+    }
+    if (emitInputs)
+    {
+        desc.flags |= FG_CONTEXT_EMIT_INPUTS;
+    }
+    if (debugLayer)
+    {
+        desc.flags |= FG_CONTEXT_DEBUG_LAYER;
+    }
+    if (warp)
+    {
+        desc.flags |= FG_CONTEXT_WARP;
+    }
+    if (lowLatency)
+    {
+        desc.flags |= FG_CONTEXT_LOW_LATENCY;
+    }
+    *pShaderDirectory = shaderDirectory;
+    *pPool            = pool != Py_None ? pool : nullptr;
+    return true;
+}
+
+static void Context_dealloc(ContextObject* self)
+{
+    // Outputs still in flight are delivered into the lists and dropped with them.
+    fgDestroyContext(self->context);
+    for (uint8_t* pPixels : *self->pPixels)
+    {
+        free(pPixels);
+    }
+    delete self->pOutputs;
+    delete self->pPixels;
+    Py_XDECREF(self->pPool);
+    Py_TYPE(self)->tp_free(reinterpret_cast<PyObject*>(self));
+}
+
+static PyObject* Context_new(PyTypeObject* type, PyObject* /*args*/, PyObject* /*kwargs*/)
+{
+    ContextObject* self = reinterpret_cast<ContextObject*>(type->tp_alloc(type, 0));
+    if (self != nullptr)
+    {
+        self->pOutputs = new (std::nothrow) std::vector<FgOutputFrame>();
+        self->pPixels  = new (std::nothrow) std::vector<uint8_t*>();
+        if (self->pOutputs == nullptr || self->pPixels == nullptr)
+        {
+            Py_DECREF(self);
+            return PyErr_NoMemory();
+        }
+    }
+    return reinterpret_cast<PyObject*>(self);
+}
+
+static int Context_init(ContextObject* self, PyObject* args, PyObject* kwargs)
+{
+    FgContextDesc desc            = {};
+    const char*   shaderDirectory = nullptr;
+    PyObject*     pool            = nullptr;
+    if (self->context != nullptr)
+    {
+        PyErr_SetString(PyExc_RuntimeError, "use Context.reset to change the settings");
+        return -1;
+    }
+    if (!ParseSettings(args, kwargs, desc, &shaderDirectory, &pool))
+    {
+        return -1;
+    }
+    Py_XINCREF(pool);
+    self->pPool = pool;
+    ContextDesc(self, desc);
+
+    // Device creation and shader loading take a while; other Python threads keep running.
+    FgResult result = FG_SUCCESS;
+    Py_BEGIN_ALLOW_THREADS
+    result = fgCreateContext(&desc, &self->context);
+    Py_END_ALLOW_THREADS
+    if (result != FG_SUCCESS)
+    {
+        RaiseResult(result);
+        return -1;
+    }
+    self->width  = desc.width;
+    self->height = desc.height;
+    return 0;
+}
+
+// Holds the Py_buffer views of one submission until the generator is done with them.
+struct InputViews
+{
+    Py_buffer views[4] = {};
+    int       count    = 0;
+
+    ~InputViews()
+    {
+        for (int i = 0; i < count; i++)
+        {
+            PyBuffer_Release(&views[i]);
+        }
+    }
+
+    // Fills plane from an object exporting the buffer protocol. Rows may be strided, but the texels of a row must be
+    // packed. With pRows, a 3-dimensional buffer is reported as pixel rows and anything else as an encoded image.
+    bool Plane(PyObject* object, const char* name, FgPlane& plane, bool* pRows = nullptr)
+    {
+        plane = {};
+        if (object == nullptr || object == Py_None)
+        {
+            return true;
+        }
+        Py_buffer& view = views[count];
+        if (PyObject_GetBuffer(object, &view, PyBUF_STRIDED_RO) != 0)
+        {
+            PyErr_Format(PyExc_TypeError, "%s must support the buffer protocol", name);
+            return false;
+        }
+        count++;
+
+        Py_ssize_t packed = view.itemsize;
+        for (int dim = view.ndim - 1; dim >= 1; dim--)
+        {
+            if (view.strides[dim] != packed)
+            {
+                PyErr_Format(PyExc_ValueError, "%s must have packed rows", name);
+                return false;
+            }
+            packed *= view.shape[dim];
+        }
+        if (view.ndim == 1 && view.strides[0] != view.itemsize)
+        {
+            PyErr_Format(PyExc_ValueError, "%s must be contiguous", name);
+            return false;
+        }
+
+        plane.pData = view.buf;
+        plane.size  = static_cast<size_t>(view.len);
+        if (view.ndim >= 2)
+        {
+            // Strided rows: the last row ends packed bytes after its start, wherever the earlier ones are.
+            plane.rowPitch = static_cast<uint32_t>(view.strides[0]);
+            plane.size     = static_cast<size_t>(view.strides[0]) * (view.shape[0] - 1) + static_cast<size_t>(packed);
+            if (view.strides[0] < packed)
+            {
+                PyErr_Format(PyExc_ValueError, "%s must have positive, non-overlapping rows", name);
+                return false;
+            }
+        }
+        if (pRows != nullptr)
+        {
+            *pRows = view.ndim == 3;
+        }
+        return true;
+    }
+};
+
+static PyObject* Context_submit(ContextObject* self, PyObject* args, PyObject* kwargs)
+{
+    static const char* keywords[] = {"color", "depth", "motion", "clip_info", "frame_id", "timestamp_ns", nullptr};
+    PyObject*          color      = nullptr;
+    PyObject*          depth      = Py_None;
+    PyObject*          motion     = Py_None;
+    PyObject*          clipInfo   = Py_None;
+    unsigned long long frameId    = 0;
+    unsigned long long timestamp  = 0;
+    if (!PyArg_ParseTupleAndKeywords(args,
+                                     kwargs,
+                                     "O|OOOKK",
+                                     const_cast<char**>(keywords),
+                                     &color,
+                                     &depth,
+                                     &motion,
+                                     &clipInfo,
+                                     &frameId,
+                                     &timestamp))
+    {
+        return nullptr;
+    }
+
+    InputViews  views;
+    FgFrameDesc desc = {};
+    bool        rows = false;
+    FgPlane     clip = {};
+    if (!views.Plane(color, "color", desc.color, &rows) || !views.Plane(depth, "depth", desc.depth) ||
+        !views.Plane(motion, "motion", desc.motion) || !views.Plane(clipInfo, "clip_info", clip))
+    {
+        return nullptr;
+    }
+    if (clip.pData != nullptr && (clip.size != 32 * sizeof(float) || views.views[views.count - 1].itemsize != 4))
+    {
+        PyErr_SetString(PyExc_ValueError, "clip_info must hold 32 float32 values");
+        return nullptr;
+    }
+    desc.frameId       = frameId;
+    desc.timestampNs   = timestamp;
+    desc.colorEncoding = rows ? FG_COLOR_RGBA8 : FG_COLOR_IMAGE;
+    desc.pClipInfo     = static_cast<const float*>(clip.pData);
+
+    if (!EnterContext(self))
+    {
+        return nullptr;
+    }
+    FgResult result = FG_SUCCESS;
+    Py_BEGIN_ALLOW_THREADS
+    result = fgSubmitFrame(self->context, &desc);
+    Py_END_ALLOW_THREADS
+    self->busy = false;
+
+    PyObject* frames = TakeOutputs(self);
+    if (frames == nullptr)
+    {
+        return nullptr;
+    }
+    if (result < 0)
+    {
+        Py_DECREF(frames);
+        return RaiseResult(result);
+    }
+    if (result == FG_INCOMPLETE_INPUT &&
+        PyErr_WarnFormat(PyExc_RuntimeWarning, 1, "frame %llu: %s", frameId, fgResultString(result)) != 0)
+    {
+        Py_DECREF(frames);
+        return nullptr;
+    }
+    return frames;
+}
+
+static PyObject* Context_flush(ContextObject* self, PyObject* /*unused*/)
+{
+    if (!EnterContext(self))
+    {
+        return nullptr;
+    }
+    FgResult result = FG_SUCCESS;
+    Py_BEGIN_ALLOW_THREADS
+    result = fgFlush(self->context);
+    Py_END_ALLOW_THREADS
+    self->busy = false;
+
+    PyObject* frames = TakeOutputs(self);
+    if (frames != nullptr && result != FG_SUCCESS)
+    {
+        Py_DECREF(frames);
+        return RaiseResult(result);
+    }
+    return frames;
+}
+
+static PyObject* Context_reset(ContextObject* self, PyObject* args, PyObject* kwargs)
+{
+    FgContextDesc desc            = {};
+    const char*   shaderDirectory = nullptr;
+    PyObject*     pool            = nullptr;
+    if (!ParseSettings(args, kwargs, desc, &shaderDirectory, &pool))
+    {
+        return nullptr;
+    }
+    if ((pool != nullptr && pool != self->pPool) || shaderDirectory != nullptr)
+    {
+        PyErr_SetString(PyExc_ValueError, "pool and shader_directory cannot change on reset");
+        return nullptr;
+    }
+    ContextDesc(self, desc);
+
+    if (!EnterContext(self))
+    {
+        return nullptr;
+    }
+    int      reused = 0;
+    FgResult result = FG_SUCCESS;
+    Py_BEGIN_ALLOW_THREADS
+    result = fgResetContext(self->context, &desc, &reused);
+    Py_END_ALLOW_THREADS
+    self->busy = false;
+
+    // Outputs of the previous settings are delivered by the reset and returned with it.
+    PyObject* frames = TakeOutputs(self);
+    if (frames != nullptr && result != FG_SUCCESS)
+    {
+        Py_DECREF(frames);
+        return RaiseResult(result);
+    }
+    self->width  = desc.width;
+    self->height = desc.height;
+    return frames != nullptr ? Py_BuildValue("(NO)", frames, reused ? Py_True : Py_False) : nullptr;
+}
+
+static PyObject* Context_close(ContextObject* self, PyObject* /*unused*/)
+{
+    if (self->busy)
+    {
+        PyErr_SetString(PyExc_RuntimeError, "the context is in use by another thread");
+        return nullptr;
+    }
+    FgContext context = self->context;
+    self->context     = nullptr;
+    Py_BEGIN_ALLOW_THREADS
+    fgDestroyContext(context);
+    Py_END_ALLOW_THREADS
+    PyObject* frames = TakeOutputs(self);
+    Py_XDECREF(frames);
+    if (frames == nullptr)
+    {
+        return nullptr;
+    }
+    Py_RETURN_NONE;
+}
+
+static PyObject* Context_enter(ContextObject* self, PyObject* /*unused*/)
+{
+    Py_INCREF(self);
+    return reinterpret_cast<PyObject*>(self);
+}
+
+static PyObject* Context_exit(ContextObject* self, PyObject* /*args*/)
+{
+    return Context_close(self, nullptr);
+}
+
+static PyMethodDef ContextMethods[] = {
+    {"submit",
+     reinterpret_cast<PyCFunction>(reinterpret_cast<void (*)(void)>(Context_submit)),
+     METH_VARARGS | METH_KEYWORDS,
+     "submit(color, depth=None, motion=None, clip_info=None, frame_id=0, timestamp_ns=0) -> list of Frame\n\n"
+     "Uploads a frame and, from the second frame on, generates the frames between it and the previous one. color is\n"
+     "an (height, width, 4) uint8 array, or the bytes of a PNG, QOI or raw RGBA file. depth and motion hold texels of\n"
+     "depth_format and motion_format; leave motion out to synthesize it. clip_info holds 32 float32 values.\n"
+     "Returns the frames whose readback has completed."},
+    {"flush",
+     reinterpret_cast<PyCFunction>(Context_flush),
+     METH_NOARGS,
+     "flush() -> list of Frame\n\nWaits for every outstanding frame."},
+    {"reset",
+     reinterpret_cast<PyCFunction>(reinterpret_cast<void (*)(void)>(Context_reset)),
+     METH_VARARGS | METH_KEYWORDS,
+     "reset(width, height, ...) -> (list of Frame, reused)\n\n"
+     "Starts a new sequence with new settings, keeping the device and shaders. reused tells whether the textures were\n"
+     "kept. Returns the outstanding frames of the previous sequence."},
+    {"close",
+     reinterpret_cast<PyCFunction>(Context_close),
+     METH_NOARGS,
+     "close()\n\nReleases the device; outstanding frames are dropped."},
+    {"__enter__", reinterpret_cast<PyCFunction>(Context_enter), METH_NOARGS, nullptr},
+    {"__exit__", reinterpret_cast<PyCFunction>(Context_exit), METH_VARARGS, nullptr},
+    {nullptr},
+};
+
+static PyMemberDef ContextMembers[] = {
+    {"width", T_UINT, offsetof(ContextObject, width), READONLY, nullptr},
+    {"height", T_UINT, offsetof(ContextObject, height), READONLY, nullptr},
+    {nullptr},
+};
+
+static PyTypeObject ContextType = {PyVarObject_HEAD_INIT(nullptr, 0)};
+
+// ---------------------------------------------------------------------------------------------------------------------
+// Module
+
+static PyModuleDef FramegenModule = {PyModuleDef_HEAD_INIT, "framegen", "Frame generation on D3D11.", -1};
+
+PyMODINIT_FUNC PyInit_framegen()
+{
+    FrameType.tp_name      = "framegen.Frame";
+    FrameType.tp_basicsize = sizeof(FrameObject);
+    FrameType.tp_dealloc   = reinterpret_cast<destructor>(Frame_dealloc);
+    FrameType.tp_repr      = reinterpret_cast<reprfunc>(Frame_repr);
+    FrameType.tp_as_buffer = &FrameBufferProcs;
+    FrameType.tp_flags     = Py_TPFLAGS_DEFAULT;
+    FrameType.tp_doc       = "A frame read back from a Context; numpy.asarray(frame) views its RGBA8 pixels.";
+    FrameType.tp_members   = FrameMembers;
+
+    WorkerPoolType.tp_name      = "framegen.WorkerPool";
+    WorkerPoolType.tp_basicsize = sizeof(WorkerPoolObject);
+    WorkerPoolType.tp_dealloc   = reinterpret_cast<destructor>(WorkerPool_dealloc);
+    WorkerPoolType.tp_flags     = Py_TPFLAGS_DEFAULT;
+    WorkerPoolType.tp_doc       = "WorkerPool(threads=0)\n\nCPU threads shared by the contexts created with it.";
+    WorkerPoolType.tp_init      = reinterpret_cast<initproc>(WorkerPool_init);
+    WorkerPoolType.tp_new       = PyType_GenericNew;
+
+    ContextType.tp_name      = "framegen.Context";
+    ContextType.tp_basicsize = sizeof(ContextObject);
+    ContextType.tp_dealloc   = reinterpret_cast<destructor>(Context_dealloc);
+    ContextType.tp_flags     = Py_TPFLAGS_DEFAULT;
+    ContextType.tp_doc       = "Context(width, height, depth_format=46, motion_format=34, interpolated_frames=1,\n"
+                               "        readback_depth=0, synthesize_motion=False, emit_inputs=False,\n"
+                               "        debug_layer=False, shader_directory=None, pool=None, warp=False,\n"
+                               "        low_latency=False)\n\n"
+                               "A D3D11 device, the shaders and the textures for one frame size. Use one context per\n"
+                               "thread; contexts on different threads run in parallel.";
+    ContextType.tp_methods   = ContextMethods;
+    ContextType.tp_members   = ContextMembers;
+    ContextType.tp_init      = reinterpret_cast<initproc>(Context_init);
+    ContextType.tp_new       = Context_new;
+
+    if (PyType_Ready(&FrameType) < 0 || PyType_Ready(&WorkerPoolType) < 0 || PyType_Ready(&ContextType) < 0)
+    {
+        return nullptr;
+    }
+
+    PyObject* module = PyModule_Create(&FramegenModule);
+    if (module == nullptr)
+    {
+        return nullptr;
+    }
+    Py_INCREF(&FrameType);
+    Py_INCREF(&WorkerPoolType);
+    Py_INCREF(&ContextType);
+    if (PyModule_AddObject(module, "Frame", reinterpret_cast<PyObject*>(&FrameType)) != 0 ||
+        PyModule_AddObject(module, "WorkerPool", reinterpret_cast<PyObject*>(&WorkerPoolType)) != 0 ||
+        PyModule_AddObject(module, "Context", reinterpret_cast<PyObject*>(&ContextType)) != 0 ||
+        PyModule_AddIntConstant(module, "API_VERSION", FG_API_VERSION) != 0 ||
+        PyModule_AddObject(module, "CAPTURED_FRAME", PyLong_FromUnsignedLong(FG_CAPTURED_FRAME)) != 0)
+    {
+        Py_DECREF(module);
+        return nullptr;
+    }
+    return module;
+}
@@ -0,0 +1,25 @@
+# Builds the framegen extension module together with the generator it wraps:
+#     python setup.py build_ext --inplace
+# The module loads the phsr_fg_*.dxbc shaders at run time; pass shader_directory to framegen.Context when they are not in
+# the working directory.
+import os
+
+from setuptools import Extension, setup
+
+root = os.path.dirname(os.path.abspath(__file__))
+repo = os.path.dirname(root)
+
+setup(
+    name="framegen",
+    version="1.0",
+    ext_modules=[
+        Extension(
+            "framegen",
+            sources=[os.path.join(root, "framegen.cpp"), os.path.join(repo, "frame_generation.cpp")],
+            include_dirs=[repo],
+            define_macros=[("FG_STANDALONE", "1")],
+            libraries=["d3d11"],
+            extra_compile_args=["/std:c++20", "/O2"] if os.name == "nt" else ["-std=c++20", "-O2"],
+        )
+    ],
+)
@@ -0,0 +1,114 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <map>
+#include <mutex>
+
+// Hands out GPU turns to concurrently running sessions. At most `slots` sessions submit work at once, and waiting
+// sessions are served in order of the work they have already been granted (start-time fair queueing), so a 4K stream
+// and a 720p stream get the same share of GPU time rather than the same number of pairs. A session charges the cost of
+// each turn, normally the pixels it generates, when the turn is granted.
+class SessionScheduler
+{
+public:
+    // slots == 0 lets every session run at once; the scheduler then only keeps the accounts.
+    explicit SessionScheduler(uint32_t slots) : m_slots(slots)
+    {
+    }
+
+    SessionScheduler(const SessionScheduler&)            = delete;
+    SessionScheduler& operator=(const SessionScheduler&) = delete;
+
+    // A session that joins late starts at the current virtual time instead of claiming the turns it was not there for.
+    uint32_t Join()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        uint32_t                    id = m_nextId++;
+        m_members[id].virtualTime      = m_virtualTime;
+        return id;
+    }
+
+    // Returns the seconds the session spent waiting for turns.
+    double Leave(uint32_t id)
+    {
+        double waitSeconds = 0.0;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            waitSeconds = m_members[id].waitSeconds;
+            m_members.erase(id);
+        }
+        m_turn.notify_all();
+        return waitSeconds;
+    }
+
+    // Blocks until the session may submit work costing `cost`. Every Acquire must be paired with a Release.
+    void Acquire(uint32_t id, uint64_t cost)
+    {
+        auto                         begin = std::chrono::steady_clock::now();
+        std::unique_lock<std::mutex> lock(m_mutex);
+        Member&                      member = m_members[id];
+
+        // Time spent idle (waiting for input) does not turn into credit.
+        member.virtualTime = (std::max)(member.virtualTime, m_virtualTime);
+        member.waiting     = true;
+        m_turn.wait(lock, [this, id]() { return (m_slots == 0 || m_active < m_slots) && IsNext(id); });
+
+        member.waiting = false;
+        m_virtualTime  = member.virtualTime;
+        member.virtualTime += cost;
+        member.waitSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+        m_active++;
+
+        // This session no longer blocks the others; the next in line may take a slot that is still free, instead of
+        // waiting for the next Release.
+        if (m_slots == 0 || m_active < m_slots)
+        {
+            m_turn.notify_all();
+        }
+    }
+
+    void Release(uint32_t /*id*/)
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_active--;
+        }
+        m_turn.notify_all();
+    }
+
+private:
+    struct Member
+    {
+        uint64_t virtualTime = 0;
+        double   waitSeconds = 0.0;
+        bool     waiting     = false;
+    };
+
+    // The waiting session with the least work granted goes first; ties go to the session that joined first.
+    bool IsNext(uint32_t id) const
+    {
+        const Member& candidate = m_members.at(id);
+        for (const auto& entry : m_members)
+        {
+            if (entry.first != id && entry.second.waiting &&
+                (entry.second.virtualTime < candidate.virtualTime ||
+                 (entry.second.virtualTime == candidate.virtualTime && entry.first < id)))
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    std::mutex                 m_mutex;
+    std::condition_variable    m_turn;
+    std::map<uint32_t, Member> m_members;
+    uint32_t                   m_slots;
+    uint32_t                   m_active      = 0;
+    uint32_t                   m_nextId      = 0;
+    uint64_t                   m_virtualTime = 0;
+};
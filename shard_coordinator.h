@@ -0,0 +1,178 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <algorithm>
+#include <condition_variable>
+#include <mutex>
+#include <vector>
+
+// Splitting one frame range over several worker processes. Pairs only share their inputs, so the range
+// [beginFrameId, endFrameId) of pairs is cut into shards of consecutive pairs; a shard of pairs [b, e) reads frames b to
+// e, so neighbouring shards overlap by the one frame e. Workers claim shards from the coordinator's ShardTable and
+// report them done; a shard whose worker is lost, fails or leaves outputs missing is issued again, up to maxAttempts
+// claims in all.
+
+enum class ShardState
+{
+    Pending,
+    Claimed,
+    Done,
+    Failed, // used up its attempts
+};
+
+struct Shard
+{
+    uint32_t   beginFrameId;
+    uint32_t   endFrameId; // one past the last pair, and the last frame read
+    ShardState state    = ShardState::Pending;
+    uint32_t   attempts = 0;
+    uint64_t   owner    = 0; // the claiming worker while Claimed
+};
+
+// Claim results that are not a shard index.
+static constexpr int32_t ShardWait     = -1; // nothing to hand out now, but a claimed shard may still come back
+static constexpr int32_t ShardFinished = -2; // the coordinator is done
+
+// Thread-safe table of the shards of one range, shared by the coordinator's connection threads.
+class ShardTable
+{
+public:
+    ShardTable(uint32_t beginFrameId, uint32_t endFrameId, uint32_t pairsPerShard, uint32_t maxAttempts)
+        : m_maxAttempts((std::max)(maxAttempts, 1u))
+    {
+        pairsPerShard = (std::max)(pairsPerShard, 1u);
+        for (uint32_t b = beginFrameId; b < endFrameId; b += (std::min)(pairsPerShard, endFrameId - b))
+        {
+            m_shards.push_back({b, b + (std::min)(pairsPerShard, endFrameId - b)});
+        }
+    }
+
+    ShardTable(const ShardTable&)            = delete;
+    ShardTable& operator=(const ShardTable&) = delete;
+
+    // Hands the first pending shard to owner. Returns its index, ShardWait or ShardFinished.
+    int32_t Claim(uint64_t owner)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_finished)
+        {
+            return ShardFinished;
+        }
+        for (size_t i = 0; i < m_shards.size(); i++)
+        {
+            Shard& shard = m_shards[i];
+            if (shard.state == ShardState::Pending)
+            {
+                shard.state = ShardState::Claimed;
+                shard.owner = owner;
+                shard.attempts++;
+                return static_cast<int32_t>(i);
+            }
+        }
+        return ShardWait;
+    }
+
+    Shard Get(int32_t index) const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_shards[index];
+    }
+
+    // Records owner's report for its shard. A failed shard is issued again while it has attempts left. Reports for a
+    // shard owner no longer holds are ignored.
+    void Complete(int32_t index, uint64_t owner, bool ok)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (index < 0 || static_cast<size_t>(index) >= m_shards.size() || m_shards[index].owner != owner ||
+            m_shards[index].state != ShardState::Claimed)
+        {
+            return;
+        }
+        if (ok)
+        {
+            m_shards[index].state = ShardState::Done;
+        }
+        else
+        {
+            Retry(m_shards[index]);
+        }
+        m_changed.notify_all();
+    }
+
+    // Issues the shards owner still holds again, after its connection was lost. Returns how many there were.
+    uint32_t ReleaseOwner(uint64_t owner)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        uint32_t                    released = 0;
+        for (Shard& shard : m_shards)
+        {
+            if (shard.state == ShardState::Claimed && shard.owner == owner)
+            {
+                Retry(shard);
+                released++;
+            }
+        }
+        m_changed.notify_all();
+        return released;
+    }
+
+    // Issues a shard reported done again, for outputs that turned out to be missing.
+    void Reissue(int32_t index)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_shards[index].state == ShardState::Done)
+        {
+            Retry(m_shards[index]);
+        }
+    }
+
+    // Blocks until every shard is done or failed, and returns a copy of the table.
+    std::vector<Shard> WaitSettled()
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_changed.wait(lock, [this]() {
+            return std::none_of(m_shards.begin(), m_shards.end(), [](const Shard& shard) {
+                return shard.state == ShardState::Pending || shard.state == ShardState::Claimed;
+            });
+        });
+        return m_shards;
+    }
+
+    // Makes every later Claim return ShardFinished.
+    void Finish()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_finished = true;
+    }
+
+    size_t Count() const
+    {
+        return m_shards.size();
+    }
+
+    // Claims made beyond the first of each shard.
+    uint32_t Reissues() const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        uint32_t                    reissues = 0;
+        for (const Shard& shard : m_shards)
+        {
+            reissues += shard.attempts > 1 ? shard.attempts - 1 : 0;
+        }
+        return reissues;
+    }
+
+private:
+    void Retry(Shard& shard)
+    {
+        shard.state = shard.attempts < m_maxAttempts ? ShardState::Pending : ShardState::Failed;
+        shard.owner = 0;
+    }
+
+    std::vector<Shard>      m_shards;
+    uint32_t                m_maxAttempts;
+    bool                    m_finished = false;
+    mutable std::mutex      m_mutex;
+    std::condition_variable m_changed;
+};
@@ -0,0 +1,702 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <string>
+
+#include "async_io.h"
+#include "image_formats.h"
+
+#ifndef _WIN32
+#include <linux/futex.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <time.h>
+#endif
+
+// Shared-memory frame exchange with a host process, so an engine test harness can feed the generator without files.
+// The host creates a named region holding two single-producer single-consumer rings:
+//
+//   ShmRingHeader                               at offset 0
+//   input slots [inputSlots]                    written by the host: clip info, motion, depth and colour of a frame
+//   output slots [outputSlots]                  written by the generator: one generated RGBA8 frame each
+//
+// Every slot and every field in it starts on a ShmRingAlignment boundary. Colour is a raw RGBA image
+// (image_formats.h) so it uploads through the .rgba path; the other fields have the layout of the .bin files.
+// Ring positions are free-running 32-bit counters, each on its own cache line: a producer fills slot head % slots and
+// then advances head, a consumer advances tail once it no longer needs the slot. Waits sleep on the counters
+// themselves, with a shared futex on Linux and a named auto-reset event per counter on Windows.
+// Slots carry steady-clock publish times, so per-slot latency can be measured from either side.
+
+static constexpr uint8_t  ShmRingMagic[8]  = {'F', 'G', 'S', 'H', 'M', 'R', 'N', 'G'};
+static constexpr uint32_t ShmRingVersion   = 1;
+static constexpr size_t   ShmRingAlignment = 4096;
+
+enum class ShmRingCounter : uint32_t {
+    InputHead,  // slots published by the host
+    InputTail,  // slots released by the generator
+    OutputHead, // slots published by the generator
+    OutputTail, // slots released by the host
+    Count
+};
+
+static constexpr size_t ShmRingCounterCount = static_cast<size_t>(ShmRingCounter::Count);
+
+struct alignas(64) ShmRingCounterLine
+{
+    std::atomic<uint32_t> value;
+    uint8_t               pad[60];
+};
+
+struct ShmRingHeader
+{
+    uint8_t  magic[8];
+    uint32_t version;
+    uint32_t width;
+    uint32_t height;
+    uint32_t depthFormat; // DXGI_FORMAT of the depth field
+    uint32_t mevcFormat;  // DXGI_FORMAT of the motion field
+    uint32_t inputSlots;
+    uint32_t outputSlots;
+    uint32_t fieldCapacity[FrameFileTypeCount]; // bytes reserved per input field, FrameFileType order
+    uint32_t reserved0;
+    uint64_t inputSlotSize;
+    uint64_t outputSlotSize;
+    uint64_t inputOffset;
+    uint64_t outputOffset;
+    uint64_t totalSize;
+
+    std::atomic<uint32_t> inputClosed;  // set by the host after its last input
+    std::atomic<uint32_t> outputClosed; // set by the generator after its last output
+    uint8_t               reserved1[40];
+
+    ShmRingCounterLine counters[ShmRingCounterCount];
+};
+
+// Starts each slot; the fields follow at ShmRingAlignment.
+struct ShmInputSlot
+{
+    uint32_t frameId;
+    uint32_t sizes[FrameFileTypeCount]; // valid bytes per field, 0 when the host has nothing for it
+    uint64_t publishNs;
+};
+
+struct ShmOutputSlot
+{
+    uint32_t frameId; // first frame of the pair
+    uint32_t seq;
+    uint32_t width;
+    uint32_t height;
+    uint64_t sourceNs;  // publish time of the pair's second input, the last one generation waited for
+    uint64_t publishNs;
+};
+
+static_assert(std::atomic<uint32_t>::is_always_lock_free, "ring counters must be lock-free to be shared");
+static_assert(offsetof(ShmRingHeader, counters) % 64 == 0, "ring counters must start on a cache line");
+
+inline uint64_t ShmRingNowNs()
+{
+    return static_cast<uint64_t>(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch())
+            .count());
+}
+
+class ShmRing
+{
+public:
+    // What the host fixes when it creates the region.
+    struct Layout
+    {
+        uint32_t width;
+        uint32_t height;
+        uint32_t depthFormat;
+        uint32_t mevcFormat;
+        uint32_t depthBytesPerPixel;
+        uint32_t motionBytesPerPixel;
+        uint32_t clipInfoBytes;
+        uint32_t inputSlots;
+        uint32_t outputSlots;
+    };
+
+    struct InputView
+    {
+        ShmInputSlot* pSlot;
+        uint8_t*      fields[FrameFileTypeCount]; // colour points at the pixels, after the raw image header
+    };
+
+    struct OutputView
+    {
+        ShmOutputSlot* pSlot;
+        uint8_t*       pPixels; // width * 4 bytes per row
+    };
+
+    // Host side: creates the region and its events. On Linux an existing region of the same name is replaced. Windows
+    // would hand back an existing mapping as it is, with the old counters and size, so there Create fails while a
+    // region of the name is still open anywhere.
+    static std::unique_ptr<ShmRing> Create(const std::string& name, const Layout& layout)
+    {
+        const size_t                             pixels   = static_cast<size_t>(layout.width) * layout.height;
+        std::array<uint32_t, FrameFileTypeCount> capacity = {};
+        capacity[static_cast<size_t>(FrameFileType::ClipInfo)] = layout.clipInfoBytes;
+        capacity[static_cast<size_t>(FrameFileType::MotionVector)] =
+            static_cast<uint32_t>(pixels * layout.motionBytesPerPixel);
+        capacity[static_cast<size_t>(FrameFileType::Depth)] = static_cast<uint32_t>(pixels * layout.depthBytesPerPixel);
+        capacity[static_cast<size_t>(FrameFileType::ColorInput)] =
+            static_cast<uint32_t>(sizeof(RawImageHeader) + pixels * 4);
+
+        const uint32_t inputSlots    = (std::max)(layout.inputSlots, 2u);
+        const uint32_t outputSlots   = (std::max)(layout.outputSlots, 1u);
+        uint64_t       inputSlotSize = ShmRingAlignment;
+        for (uint32_t bytes : capacity)
+        {
+            inputSlotSize += AlignUp(bytes, ShmRingAlignment);
+        }
+        const uint64_t outputSlotSize = ShmRingAlignment + AlignUp(pixels * 4, ShmRingAlignment);
+        const uint64_t inputOffset    = AlignUp(sizeof(ShmRingHeader), ShmRingAlignment);
+        const uint64_t outputOffset   = inputOffset + inputSlotSize * inputSlots;
+        const uint64_t totalSize      = outputOffset + outputSlotSize * outputSlots;
+
+        std::unique_ptr<ShmRing> pRing(new ShmRing());
+        if (!pRing->Map(name, totalSize, true))
+        {
+            return nullptr;
+        }
+
+        // A new region is zero-filled, which starts every counter and flag at 0. The magic goes in last, so a
+        // generator that opens the region early never sees a half-written header.
+        ShmRingHeader& header = *pRing->m_pHeader;
+        header.version        = ShmRingVersion;
+        header.width          = layout.width;
+        header.height         = layout.height;
+        header.depthFormat    = layout.depthFormat;
+        header.mevcFormat     = layout.mevcFormat;
+        header.inputSlots     = inputSlots;
+        header.outputSlots    = outputSlots;
+        header.inputSlotSize  = inputSlotSize;
+        header.outputSlotSize = outputSlotSize;
+        header.inputOffset    = inputOffset;
+        header.outputOffset   = outputOffset;
+        header.totalSize      = totalSize;
+        memcpy(header.fieldCapacity, capacity.data(), sizeof(header.fieldCapacity));
+        std::atomic_thread_fence(std::memory_order_release);
+        memcpy(header.magic, ShmRingMagic, sizeof(header.magic));
+        return pRing;
+    }
+
+    // Generator side: opens a region the host has created. Fails unless the header describes a layout that fits in
+    // the region.
+    static std::unique_ptr<ShmRing> Open(const std::string& name)
+    {
+        std::unique_ptr<ShmRing> pRing(new ShmRing());
+        if (!pRing->Map(name, 0, false) || pRing->m_size < sizeof(ShmRingHeader))
+        {
+            return nullptr;
+        }
+        const ShmRingHeader& header = *pRing->m_pHeader;
+        if (memcmp(header.magic, ShmRingMagic, sizeof(header.magic)) != 0)
+        {
+            return nullptr;
+        }
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (header.version != ShmRingVersion || !pRing->IsLayoutValid())
+        {
+            return nullptr;
+        }
+        return pRing;
+    }
+
+    ~ShmRing()
+    {
+        Unmap();
+    }
+
+    ShmRing(const ShmRing&)            = delete;
+    ShmRing& operator=(const ShmRing&) = delete;
+
+    const ShmRingHeader& Header() const
+    {
+        return *m_pHeader;
+    }
+
+    // Host: waits for a free input slot and returns its fields. Returns false on timeout.
+    bool BeginInput(InputView& view, uint32_t timeoutMs)
+    {
+        uint32_t head = Load(ShmRingCounter::InputHead);
+        if (!WaitWhile(ShmRingCounter::InputTail, [&](uint32_t tail) { return head - tail >= m_pHeader->inputSlots; },
+                       timeoutMs))
+        {
+            return false;
+        }
+        view = GetInput(head);
+        return true;
+    }
+
+    // Host: publishes the slot returned by BeginInput. sizes[type] says how much of each field was written; the raw
+    // image header of the colour field is filled in here.
+    void PublishInput(uint32_t frameId, const uint32_t sizes[FrameFileTypeCount])
+    {
+        uint32_t  head = Load(ShmRingCounter::InputHead);
+        InputView view = GetInput(head);
+
+        RawImageHeader image = MakeRawImageHeader(m_pHeader->width, m_pHeader->height);
+        memcpy(view.fields[static_cast<size_t>(FrameFileType::ColorInput)] - sizeof(image), &image, sizeof(image));
+
+        view.pSlot->frameId = frameId;
+        for (size_t type = 0; type < FrameFileTypeCount; type++)
+        {
+            uint32_t capacity = m_pHeader->fieldCapacity[type];
+            if (type == static_cast<size_t>(FrameFileType::ColorInput))
+            {
+                capacity -= sizeof(RawImageHeader);
+            }
+            view.pSlot->sizes[type] = (std::min)(sizes[type], capacity);
+        }
+        view.pSlot->publishNs = ShmRingNowNs();
+        Store(ShmRingCounter::InputHead, head + 1);
+    }
+
+    // Host: no more inputs will follow.
+    void CloseInput()
+    {
+        m_pHeader->inputClosed.store(1, std::memory_order_release);
+        Wake(ShmRingCounter::InputHead);
+    }
+
+    // Host: waits for the next generated frame. Returns false on timeout, or once the generator has closed its side
+    // and every output has been taken.
+    bool AcquireOutput(OutputView& view, uint32_t timeoutMs)
+    {
+        uint32_t tail = Load(ShmRingCounter::OutputTail);
+        bool     ready = WaitWhile(ShmRingCounter::OutputHead,
+                                   [&](uint32_t head) {
+                                       return head == tail && m_pHeader->outputClosed.load(std::memory_order_acquire) == 0;
+                                   },
+                                   timeoutMs);
+        if (!ready || Load(ShmRingCounter::OutputHead) == tail)
+        {
+            return false;
+        }
+        view = GetOutput(tail);
+        return true;
+    }
+
+    void ReleaseOutput()
+    {
+        Store(ShmRingCounter::OutputTail, Load(ShmRingCounter::OutputTail) + 1);
+    }
+
+    // Generator: waits until input position has been published. Returns false once the host has closed its side
+    // without publishing it.
+    bool WaitForInput(uint32_t position)
+    {
+        for (;;)
+        {
+            bool closed = m_pHeader->inputClosed.load(std::memory_order_acquire) != 0;
+            if (static_cast<int32_t>(Load(ShmRingCounter::InputHead) - position) > 0)
+            {
+                return true;
+            }
+            if (closed)
+            {
+                return false;
+            }
+            uint32_t head = Load(ShmRingCounter::InputHead);
+            WaitWhile(ShmRingCounter::InputHead,
+                      [&](uint32_t value) {
+                          return value == head && m_pHeader->inputClosed.load(std::memory_order_acquire) == 0;
+                      },
+                      ShmRingWaitSliceMs);
+        }
+    }
+
+    InputView GetInput(uint32_t position) const
+    {
+        InputView view = {};
+        uint8_t*  pSlot =
+            Base() + m_pHeader->inputOffset + (position % m_pHeader->inputSlots) * m_pHeader->inputSlotSize;
+        view.pSlot      = reinterpret_cast<ShmInputSlot*>(pSlot);
+        uint8_t* pField = pSlot + ShmRingAlignment;
+        for (size_t type = 0; type < FrameFileTypeCount; type++)
+        {
+            view.fields[type] = pField;
+            pField += AlignUp(m_pHeader->fieldCapacity[type], ShmRingAlignment);
+        }
+        view.fields[static_cast<size_t>(FrameFileType::ColorInput)] += sizeof(RawImageHeader);
+        return view;
+    }
+
+    // Generator: input slots below position may be reused.
+    void ReleaseInputs(uint32_t position)
+    {
+        if (static_cast<int32_t>(position - Load(ShmRingCounter::InputTail)) > 0)
+        {
+            Store(ShmRingCounter::InputTail, position);
+        }
+    }
+
+    // Generator: waits for a free output slot. Blocks for as long as the host does not take its outputs.
+    OutputView BeginOutput()
+    {
+        uint32_t head = Load(ShmRingCounter::OutputHead);
+        while (!WaitWhile(ShmRingCounter::OutputTail,
+                          [&](uint32_t tail) { return head - tail >= m_pHeader->outputSlots; },
+                          ShmRingWaitSliceMs))
+        {
+        }
+        return GetOutput(head);
+    }
+
+    // Generator: publishes the slot returned by BeginOutput and returns its latency from sourceNs.
+    uint64_t PublishOutput(uint32_t frameId, uint32_t seq, uint64_t sourceNs)
+    {
+        uint32_t   head = Load(ShmRingCounter::OutputHead);
+        OutputView view = GetOutput(head);
+        *view.pSlot     = {frameId, seq, m_pHeader->width, m_pHeader->height, sourceNs, ShmRingNowNs()};
+        Store(ShmRingCounter::OutputHead, head + 1);
+        return view.pSlot->publishNs - sourceNs;
+    }
+
+    void CloseOutput()
+    {
+        m_pHeader->outputClosed.store(1, std::memory_order_release);
+        Wake(ShmRingCounter::OutputHead);
+    }
+
+private:
+    static constexpr uint32_t ShmRingWaitSliceMs = 1000;
+
+    ShmRing() = default;
+
+    uint8_t* Base() const
+    {
+        return reinterpret_cast<uint8_t*>(m_pHeader);
+    }
+
+    // Everything the generator locates through the host's header: non-empty rings, fields and frames that fit in their
+    // slots, and slots that fit in the mapped region.
+    bool IsLayoutValid() const
+    {
+        const ShmRingHeader& header = *m_pHeader;
+        const uint64_t       pixels = static_cast<uint64_t>(header.width) * header.height;
+        uint64_t             fields = ShmRingAlignment;
+        for (uint32_t capacity : header.fieldCapacity)
+        {
+            fields += AlignUp(capacity, ShmRingAlignment);
+        }
+        auto fits = [](uint64_t offset, uint32_t slots, uint64_t slotSize, uint64_t end) {
+            return offset % ShmRingAlignment == 0 && slotSize % ShmRingAlignment == 0 && offset <= end &&
+                   slots <= (end - offset) / slotSize;
+        };
+        return pixels != 0 && header.inputSlots != 0 && header.outputSlots != 0 &&
+               header.fieldCapacity[static_cast<size_t>(FrameFileType::ColorInput)] >=
+                   sizeof(RawImageHeader) + pixels * 4 &&
+               header.inputSlotSize >= fields && header.outputSlotSize >= ShmRingAlignment + pixels * 4 &&
+               header.inputOffset >= sizeof(ShmRingHeader) && header.totalSize <= m_size &&
+               fits(header.inputOffset, header.inputSlots, header.inputSlotSize, header.outputOffset) &&
+               fits(header.outputOffset, header.outputSlots, header.outputSlotSize, header.totalSize);
+    }
+
+    OutputView GetOutput(uint32_t position) const
+    {
+        uint8_t* pSlot =
+            Base() + m_pHeader->outputOffset + (position % m_pHeader->outputSlots) * m_pHeader->outputSlotSize;
+        return {reinterpret_cast<ShmOutputSlot*>(pSlot), pSlot + ShmRingAlignment};
+    }
+
+    std::atomic<uint32_t>& Counter(ShmRingCounter counter) const
+    {
+        return m_pHeader->counters[static_cast<size_t>(counter)].value;
+    }
+
+    uint32_t Load(ShmRingCounter counter) const
+    {
+        return Counter(counter).load(std::memory_order_acquire);
+    }
+
+    void Store(ShmRingCounter counter, uint32_t value)
+    {
+        Counter(counter).store(value, std::memory_order_release);
+        Wake(counter);
+    }
+
+    // Sleeps on counter while blocked(value) holds. Returns false if it still holds after timeoutMs.
+    template <typename Pred>
+    bool WaitWhile(ShmRingCounter counter, Pred&& blocked, uint32_t timeoutMs)
+    {
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeoutMs);
+        for (uint32_t value = Load(counter); blocked(value); value = Load(counter))
+        {
+            auto now = std::chrono::steady_clock::now();
+            if (now >= deadline)
+            {
+                return false;
+            }
+            uint32_t remainingMs = static_cast<uint32_t>(
+                std::chrono::duration_cast<std::chrono::milliseconds>(deadline - now).count() + 1);
+#ifdef _WIN32
+            WaitForSingleObject(m_events[static_cast<size_t>(counter)], remainingMs);
+#else
+            timespec timeout = {static_cast<time_t>(remainingMs / 1000), static_cast<long>(remainingMs % 1000) * 1000000};
+            syscall(SYS_futex, reinterpret_cast<uint32_t*>(&Counter(counter)), FUTEX_WAIT, value, &timeout, nullptr, 0);
+#endif
+        }
+        return true;
+    }
+
+    void Wake(ShmRingCounter counter)
+    {
+#ifdef _WIN32
+        SetEvent(m_events[static_cast<size_t>(counter)]);
+#else
+        syscall(SYS_futex, reinterpret_cast<uint32_t*>(&Counter(counter)), FUTEX_WAKE, INT32_MAX, nullptr, nullptr, 0);
+#endif
+    }
+
+    // Creates the region at size, or opens an existing one at the size it has. m_size is the size mapped.
+    bool Map(const std::string& name, uint64_t size, bool create)
+    {
+#ifdef _WIN32
+        std::string objectName = "Local\\" + name;
+        m_mapping              = create ? CreateFileMappingA(INVALID_HANDLE_VALUE,
+                                                nullptr,
+                                                PAGE_READWRITE,
+                                                static_cast<DWORD>(size >> 32),
+                                                static_cast<DWORD>(size),
+                                                objectName.c_str())
+                                        : OpenFileMappingA(FILE_MAP_ALL_ACCESS, FALSE, objectName.c_str());
+        if (m_mapping == nullptr || (create && GetLastError() == ERROR_ALREADY_EXISTS))
+        {
+            return false;
+        }
+        m_pHeader = static_cast<ShmRingHeader*>(
+            MapViewOfFile(m_mapping, FILE_MAP_ALL_ACCESS, 0, 0, create ? static_cast<SIZE_T>(size) : 0));
+        if (m_pHeader != nullptr && !create)
+        {
+            MEMORY_BASIC_INFORMATION info = {};
+            if (VirtualQuery(m_pHeader, &info, sizeof(info)) == 0)
+            {
+                return false;
+            }
+            size = info.RegionSize;
+        }
+        for (size_t i = 0; i < ShmRingCounterCount && m_pHeader != nullptr; i++)
+        {
+            std::string eventName = objectName + ".counter" + std::to_string(i);
+            m_events[i]           = CreateEventA(nullptr, FALSE, FALSE, eventName.c_str());
+            if (m_events[i] == nullptr)
+            {
+                return false;
+            }
+        }
+#else
+        std::string objectName = "/" + name;
+        if (create)
+        {
+            shm_unlink(objectName.c_str());
+        }
+        int fd = shm_open(objectName.c_str(), create ? O_CREAT | O_EXCL | O_RDWR : O_RDWR, 0600);
+        if (fd < 0)
+        {
+            return false;
+        }
+        if (create && ftruncate(fd, static_cast<off_t>(size)) != 0)
+        {
+            close(fd);
+            return false;
+        }
+        if (!create)
+        {
+            // A host that has not sized the region yet leaves it empty.
+            struct stat st = {};
+            if (fstat(fd, &st) != 0 || st.st_size <= 0)
+            {
+                close(fd);
+                return false;
+            }
+            size = static_cast<uint64_t>(st.st_size);
+        }
+        void* p   = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        m_pHeader = p == MAP_FAILED ? nullptr : static_cast<ShmRingHeader*>(p);
+        close(fd);
+        if (create)
+        {
+            m_unlinkName = objectName;
+        }
+#endif
+        m_size = size;
+        return m_pHeader != nullptr;
+    }
+
+    void Unmap()
+    {
+#ifdef _WIN32
+        if (m_pHeader != nullptr)
+        {
+            UnmapViewOfFile(m_pHeader);
+        }
+        if (m_mapping != nullptr)
+        {
+            CloseHandle(m_mapping);
+        }
+        for (HANDLE& event : m_events)
+        {
+            if (event != nullptr)
+            {
+                CloseHandle(event);
+                event = nullptr;
+            }
+        }
+        m_mapping = nullptr;
+#else
+        if (m_pHeader != nullptr)
+        {
+            munmap(m_pHeader, m_size);
+        }
+        // The name goes away with the host; mappings that are still open stay valid.
+        if (!m_unlinkName.empty())
+        {
+            shm_unlink(m_unlinkName.c_str());
+            m_unlinkName.clear();
+        }
+#endif
+        m_pHeader = nullptr;
+    }
+
+    ShmRingHeader* m_pHeader = nullptr;
+    uint64_t       m_size    = 0;
+#ifdef _WIN32
+    HANDLE                                 m_mapping = nullptr;
+    std::array<HANDLE, ShmRingCounterCount> m_events  = {};
+#else
+    std::string m_unlinkName;
+#endif
+};
+
+// Generator-side frame source over the input ring, with the interface of FrameStreamReader. Frame ids count ring
+// positions from firstFrameId, and the files handed out point straight into the slots; a slot is only reused after
+// Release has moved past its frame.
+class ShmFrameSource
+{
+public:
+    struct Stats
+    {
+        uint64_t frames            = 0;
+        uint64_t outputs           = 0;
+        uint64_t totalLatencyNs    = 0;
+        uint64_t maxLatencyNs      = 0;
+        double   inputWaitSeconds  = 0.0;
+        double   outputWaitSeconds = 0.0;
+    };
+
+    ShmFrameSource(std::unique_ptr<ShmRing> pRing, uint32_t firstFrameId)
+        : m_pRing(std::move(pRing)),
+          m_firstFrameId(firstFrameId)
+    {
+    }
+
+    // Tells the host that no more outputs follow.
+    ~ShmFrameSource()
+    {
+        m_pRing->CloseOutput();
+    }
+
+    const ShmRingHeader& Header() const
+    {
+        return m_pRing->Header();
+    }
+
+    bool WaitForFrame(uint32_t frameId)
+    {
+        auto begin = std::chrono::steady_clock::now();
+        bool ready = m_pRing->WaitForInput(frameId - m_firstFrameId);
+        m_stats.inputWaitSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+        if (ready && frameId - m_firstFrameId >= m_stats.frames)
+        {
+            m_stats.frames = frameId - m_firstFrameId + 1;
+        }
+        return ready;
+    }
+
+    FrameFiles Acquire(uint32_t frameId)
+    {
+        FrameFiles files;
+        if (!WaitForFrame(frameId))
+        {
+            return files;
+        }
+
+        ShmRing::InputView view = m_pRing->GetInput(frameId - m_firstFrameId);
+        for (size_t type = 0; type < FrameFileTypeCount; type++)
+        {
+            if (view.pSlot->sizes[type] == 0)
+            {
+                continue;
+            }
+            // Colour keeps its raw image header in front of the pixels. A field never extends past its capacity,
+            // whatever size the host wrote.
+            uint8_t* pData = view.fields[type];
+            size_t   size  = view.pSlot->sizes[type];
+            if (type == static_cast<size_t>(FrameFileType::ColorInput))
+            {
+                pData -= sizeof(RawImageHeader);
+                size += sizeof(RawImageHeader);
+            }
+            size = (std::min)(size, static_cast<size_t>(Header().fieldCapacity[type]));
+            files[type].storage = std::shared_ptr<uint8_t>(std::shared_ptr<uint8_t>(), pData);
+            files[type].size    = size;
+        }
+        return files;
+    }
+
+    void Release(uint32_t frameId)
+    {
+        m_pRing->ReleaseInputs(frameId - m_firstFrameId);
+    }
+
+    // Host frame id and publish time of a frame still held by the generator.
+    uint32_t HostFrameId(uint32_t frameId) const
+    {
+        return m_pRing->GetInput(frameId - m_firstFrameId).pSlot->frameId;
+    }
+
+    uint64_t PublishNs(uint32_t frameId) const
+    {
+        return m_pRing->GetInput(frameId - m_firstFrameId).pSlot->publishNs;
+    }
+
+    // Copies a generated frame straight from mapped GPU memory into the next output slot.
+    void WriteOutput(uint32_t hostFrameId, uint32_t seq, uint64_t sourceNs, const uint8_t* pRows, size_t rowPitch)
+    {
+        auto               begin  = std::chrono::steady_clock::now();
+        ShmRing::OutputView view  = m_pRing->BeginOutput();
+        m_stats.outputWaitSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+
+        const size_t stride = static_cast<size_t>(Header().width) * 4;
+        for (uint32_t y = 0; y < Header().height; y++)
+        {
+            memcpy(view.pPixels + y * stride, pRows + y * rowPitch, stride);
+        }
+        uint64_t latency = m_pRing->PublishOutput(hostFrameId, seq, sourceNs);
+
+        m_stats.outputs++;
+        m_stats.totalLatencyNs += latency;
+        m_stats.maxLatencyNs = (std::max)(m_stats.maxLatencyNs, latency);
+    }
+
+    const Stats& GetStats() const
+    {
+        return m_stats;
+    }
+
+private:
+    std::unique_ptr<ShmRing> m_pRing;
+    uint32_t                 m_firstFrameId;
+    Stats                    m_stats;
+};
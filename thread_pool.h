@@ -0,0 +1,333 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+struct TileRect
+{
+    uint32_t x;
+    uint32_t y;
+    uint32_t width;
+    uint32_t height;
+};
+
+// Fixed-size pool of worker threads shared by the CPU-side stages (encoding, decoding, conversions).
+class ThreadPool
+{
+public:
+    // threadCount == 0 uses one thread per hardware thread. onThreadStart, when set, runs first on every pool thread
+    // with its index, e.g. to pin it to a processor.
+    explicit ThreadPool(uint32_t threadCount, std::function<void(uint32_t)> onThreadStart = nullptr)
+        : m_onThreadStart(std::move(onThreadStart))
+    {
+        if (threadCount == 0)
+        {
+            threadCount = (std::max)(std::thread::hardware_concurrency(), 1u);
+        }
+        m_counters.reset(new WorkerCounters[threadCount + 1]);
+        for (uint32_t i = 0; i < threadCount; i++)
+        {
+            m_threads.emplace_back([this, i]() { WorkerLoop(i); });
+        }
+    }
+
+    ~ThreadPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stop = true;
+        }
+        m_wake.notify_all();
+        for (auto& thread : m_threads)
+        {
+            thread.join();
+        }
+    }
+
+    ThreadPool(const ThreadPool&)            = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    uint32_t ThreadCount() const
+    {
+        return static_cast<uint32_t>(m_threads.size());
+    }
+
+    void Submit(std::function<void()> task)
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_tasks.push_back(std::move(task));
+        }
+        m_wake.notify_one();
+    }
+
+    // Runs task(i) for every i in [0, count) and returns when all of them have finished. The calling thread takes
+    // items too, so this is safe to call from inside a pool task. The items start out split evenly over the caller and
+    // the helpers; each takes from the front of its own range and, once that is empty, steals the back half of another
+    // participant's range, so a few slow items do not leave the other threads idle.
+    void ParallelFor(uint32_t count, const std::function<void(uint32_t)>& task)
+    {
+        if (count == 0)
+        {
+            return;
+        }
+
+        auto state          = std::make_shared<ParallelState>();
+        state->count        = count;
+        state->pTask        = &task;
+        state->participants = (std::min)(count, ThreadCount() + 1);
+        state->ranges.reset(new ItemRange[state->participants]);
+        for (uint32_t i = 0; i < state->participants; i++)
+        {
+            state->ranges[i].begin = static_cast<uint32_t>(uint64_t(count) * i / state->participants);
+            state->ranges[i].end   = static_cast<uint32_t>(uint64_t(count) * (i + 1) / state->participants);
+        }
+
+        for (uint32_t i = 1; i < state->participants; i++)
+        {
+            Submit([this, state]() { Participate(*state); });
+        }
+        Participate(*state);
+
+        std::unique_lock<std::mutex> lock(state->mutex);
+        state->finished.wait(lock, [&state]() { return state->done.load() == state->count; });
+    }
+
+    // Runs task once per tile of a width x height grid, row by row, through ParallelFor. tileSize 0 uses TileSize().
+    void ParallelForTiles(uint32_t                                    width,
+                          uint32_t                                    height,
+                          uint32_t                                    tileSize,
+                          const std::function<void(const TileRect&)>& task)
+    {
+        tileSize = tileSize != 0 ? tileSize : TileSize();
+        if (width == 0 || height == 0)
+        {
+            return;
+        }
+
+        uint32_t tilesX = (width + tileSize - 1) / tileSize;
+        uint32_t tilesY = (height + tileSize - 1) / tileSize;
+        ParallelFor(tilesX * tilesY, [&](uint32_t index) {
+            TileRect rect;
+            rect.x      = index % tilesX * tileSize;
+            rect.y      = index / tilesX * tileSize;
+            rect.width  = (std::min)(tileSize, width - rect.x);
+            rect.height = (std::min)(tileSize, height - rect.y);
+            task(rect);
+        });
+    }
+
+    // Edge of the square tiles ParallelForTiles uses by default.
+    uint32_t TileSize() const
+    {
+        return m_tileSize.load();
+    }
+
+    void SetTileSize(uint32_t tileSize)
+    {
+        m_tileSize = (std::max)(tileSize, 1u);
+    }
+
+    // What each thread did inside ParallelFor since the last reset: items run, ranges stolen from other threads,
+    // victims found empty, and seconds spent running items versus looking for them. Entry i is pool thread i; the last
+    // entry adds up the threads outside the pool that called ParallelFor.
+    struct WorkerStats
+    {
+        uint64_t items        = 0;
+        uint64_t steals       = 0;
+        uint64_t failedSteals = 0;
+        double   busySeconds  = 0.0;
+        double   idleSeconds  = 0.0;
+    };
+
+    std::vector<WorkerStats> GetWorkerStats() const
+    {
+        std::vector<WorkerStats> stats(m_threads.size() + 1);
+        for (size_t i = 0; i < stats.size(); i++)
+        {
+            stats[i].items        = m_counters[i].items.load();
+            stats[i].steals       = m_counters[i].steals.load();
+            stats[i].failedSteals = m_counters[i].failedSteals.load();
+            stats[i].busySeconds  = m_counters[i].busyNs.load() * 1e-9;
+            stats[i].idleSeconds  = m_counters[i].idleNs.load() * 1e-9;
+        }
+        return stats;
+    }
+
+    void ResetWorkerStats()
+    {
+        for (size_t i = 0; i <= m_threads.size(); i++)
+        {
+            m_counters[i].items        = 0;
+            m_counters[i].steals       = 0;
+            m_counters[i].failedSteals = 0;
+            m_counters[i].busyNs       = 0;
+            m_counters[i].idleNs       = 0;
+        }
+    }
+
+private:
+    struct ItemRange
+    {
+        std::mutex mutex;
+        uint32_t   begin = 0;
+        uint32_t   end   = 0;
+    };
+
+    struct ParallelState
+    {
+        std::unique_ptr<ItemRange[]>         ranges;
+        uint32_t                             participants = 0;
+        std::atomic<uint32_t>                nextSlot{0};
+        std::atomic<uint32_t>                done{0};
+        uint32_t                             count = 0;
+        const std::function<void(uint32_t)>* pTask = nullptr;
+        std::mutex                           mutex;
+        std::condition_variable              finished;
+    };
+
+    struct WorkerCounters
+    {
+        std::atomic<uint64_t> items{0};
+        std::atomic<uint64_t> steals{0};
+        std::atomic<uint64_t> failedSteals{0};
+        std::atomic<uint64_t> busyNs{0};
+        std::atomic<uint64_t> idleNs{0};
+    };
+
+    struct WorkerIdentity
+    {
+        const ThreadPool* pPool = nullptr;
+        uint32_t          index = 0;
+    };
+
+    static WorkerIdentity& CurrentWorker()
+    {
+        thread_local WorkerIdentity identity;
+        return identity;
+    }
+
+    // Threads outside this pool share the last counters.
+    WorkerCounters& CurrentCounters()
+    {
+        const WorkerIdentity& worker = CurrentWorker();
+        return m_counters[worker.pPool == this ? worker.index : static_cast<uint32_t>(m_threads.size())];
+    }
+
+    // Runs items until none is left in any range. Helpers that start after every range has been claimed return at once.
+    void Participate(ParallelState& state)
+    {
+        uint32_t slot = state.nextSlot.fetch_add(1);
+        if (slot >= state.participants)
+        {
+            return;
+        }
+
+        WorkerCounters& counters = CurrentCounters();
+        auto            begin    = std::chrono::steady_clock::now();
+        uint64_t        busyNs   = 0;
+        uint32_t        item     = 0;
+        while (TakeItem(state, slot, counters, item))
+        {
+            auto itemBegin = std::chrono::steady_clock::now();
+            (*state.pTask)(item);
+            busyNs += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - itemBegin)
+                          .count();
+            counters.items++;
+            if (state.done.fetch_add(1) + 1 == state.count)
+            {
+                std::lock_guard<std::mutex> lock(state.mutex);
+                state.finished.notify_all();
+            }
+        }
+
+        uint64_t totalNs =
+            std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - begin).count();
+        counters.busyNs += busyNs;
+        counters.idleNs += totalNs - (std::min)(busyNs, totalNs);
+    }
+
+    // Takes the next item of the participant's own range or, when that is empty, steals the back half of the first
+    // other range that still has items and continues from there. Returns false when every range is empty.
+    static bool TakeItem(ParallelState& state, uint32_t slot, WorkerCounters& counters, uint32_t& item)
+    {
+        ItemRange& own = state.ranges[slot];
+        {
+            std::lock_guard<std::mutex> lock(own.mutex);
+            if (own.begin < own.end)
+            {
+                item = own.begin++;
+                return true;
+            }
+        }
+
+        for (uint32_t i = 1; i < state.participants; i++)
+        {
+            ItemRange& victim = state.ranges[(slot + i) % state.participants];
+            uint32_t   begin  = 0;
+            uint32_t   end    = 0;
+            {
+                std::lock_guard<std::mutex> lock(victim.mutex);
+                if (victim.begin >= victim.end)
+                {
+                    counters.failedSteals++;
+                    continue;
+                }
+                begin      = victim.begin + (victim.end - victim.begin) / 2;
+                end        = victim.end;
+                victim.end = begin;
+            }
+
+            counters.steals++;
+            std::lock_guard<std::mutex> lock(own.mutex);
+            own.begin = begin + 1;
+            own.end   = end;
+            item      = begin;
+            return true;
+        }
+        return false;
+    }
+
+    void WorkerLoop(uint32_t index)
+    {
+        CurrentWorker() = {this, index};
+        if (m_onThreadStart)
+        {
+            m_onThreadStart(index);
+        }
+        for (;;)
+        {
+            std::function<void()> task;
+            {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                m_wake.wait(lock, [this]() { return m_stop || !m_tasks.empty(); });
+                if (m_tasks.empty())
+                {
+                    return;
+                }
+                task = std::move(m_tasks.front());
+                m_tasks.pop_front();
+            }
+            task();
+        }
+    }
+
+    std::function<void(uint32_t)>     m_onThreadStart;
+    std::vector<std::thread>          m_threads;
+    std::deque<std::function<void()>> m_tasks;
+    std::mutex                        m_mutex;
+    std::condition_variable           m_wake;
+    bool                              m_stop = false;
+    std::unique_ptr<WorkerCounters[]> m_counters;
+    std::atomic<uint32_t>             m_tileSize{64};
+};
@@ -0,0 +1,792 @@
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <vector>
+
+#include <dxgiformat.h>
+
+#include "thread_pool.h"
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+// Lossless coding of depth and motion frames. The frame is cut into square tiles that are coded independently, so
+// both directions parallelise over tiles. Each channel of a tile is predicted either from its spatial neighbours
+// (the LOCO-I median predictor), from the same pixel of the previous frame, or from the previous frame plus the
+// spatially predicted change, whichever codes smallest. Residuals are zigzag mapped and Rice coded in groups of
+// 16 samples with one parameter per group. Float channels are coded on an order-preserving integer remap of their
+// bits, so nearby values have nearby codes.
+//
+//   TiledFrameHeader
+//   uint32_t tileEnd[tileCount]       end of each tile's data, relative to the first tile
+//   tile data                         mode byte followed by the MSB-first bitstream of every channel
+
+static constexpr uint8_t  TiledFrameMagic[4]   = {'F', 'G', 'T', 'C'};
+static constexpr uint32_t TiledFrameTileSize   = 64;
+static constexpr uint32_t TiledFrameGroupSize  = 16;
+static constexpr uint32_t TiledFrameMaxChannel = 4;
+static constexpr uint32_t RiceEscapeQuotient   = 16;
+static constexpr uint32_t RiceZeroGroup        = 63; // parameter value marking a group of zero residuals
+static constexpr uint32_t RiceParamBits        = 6;
+
+enum TiledFrameFlags : uint16_t {
+    TiledFrameInter = 1, // some tiles reference the previous frame
+};
+
+enum class TilePredictor : uint8_t {
+    Spatial,
+    Temporal,
+    TemporalSpatial,
+    Count
+};
+
+struct TiledFrameHeader
+{
+    uint8_t  magic[4];
+    uint32_t width;
+    uint32_t height;
+    uint32_t format; // DXGI_FORMAT
+    uint16_t tileSize;
+    uint16_t flags;
+    uint32_t tileCount;
+};
+
+static_assert(sizeof(TiledFrameHeader) == 24, "tiled frame header layout is part of the file format");
+
+struct TileChannel
+{
+    uint32_t shift; // bit offset within the little-endian pixel
+    uint32_t bits;
+    bool     isFloat;
+};
+
+struct TileChannelLayout
+{
+    uint32_t    bytesPerPixel;
+    uint32_t    channelCount;
+    TileChannel channels[TiledFrameMaxChannel];
+};
+
+// Returns false for formats the codec does not handle; such frames are stored as they are.
+inline bool GetTileChannelLayout(uint32_t format, TileChannelLayout& layout)
+{
+    switch (static_cast<DXGI_FORMAT>(format))
+    {
+    case DXGI_FORMAT_R24_UNORM_X8_TYPELESS:
+    case DXGI_FORMAT_R24G8_TYPELESS:
+    case DXGI_FORMAT_D24_UNORM_S8_UINT:
+        layout = {4, 2, {{0, 24, false}, {24, 8, false}}};
+        return true;
+    case DXGI_FORMAT_R32_FLOAT:
+    case DXGI_FORMAT_D32_FLOAT:
+    case DXGI_FORMAT_R32_TYPELESS:
+        layout = {4, 1, {{0, 32, true}}};
+        return true;
+    case DXGI_FORMAT_R32_UINT:
+        layout = {4, 1, {{0, 32, false}}};
+        return true;
+    case DXGI_FORMAT_R16G16_FLOAT:
+        layout = {4, 2, {{0, 16, true}, {16, 16, true}}};
+        return true;
+    case DXGI_FORMAT_R16G16_TYPELESS:
+    case DXGI_FORMAT_R16G16_UNORM:
+    case DXGI_FORMAT_R16G16_SNORM:
+        layout = {4, 2, {{0, 16, false}, {16, 16, false}}};
+        return true;
+    case DXGI_FORMAT_R32G32_FLOAT:
+    case DXGI_FORMAT_R32G32_TYPELESS:
+        layout = {8, 2, {{0, 32, true}, {32, 32, true}}};
+        return true;
+    case DXGI_FORMAT_R16_FLOAT:
+        layout = {2, 1, {{0, 16, true}}};
+        return true;
+    case DXGI_FORMAT_R16_TYPELESS:
+    case DXGI_FORMAT_R16_UNORM:
+    case DXGI_FORMAT_D16_UNORM:
+        layout = {2, 1, {{0, 16, false}}};
+        return true;
+    default:
+        return false;
+    }
+}
+
+inline uint64_t ChannelMask(uint32_t bits)
+{
+    return bits >= 64 ? ~0ull : (1ull << bits) - 1;
+}
+
+// Maps float bits to integers that sort like the floats: negatives are inverted, positives get the sign bit set.
+inline uint64_t FloatBitsToOrdered(uint64_t value, uint32_t bits)
+{
+    uint64_t sign = 1ull << (bits - 1);
+    return (value & sign) != 0 ? ~value & ChannelMask(bits) : value | sign;
+}
+
+inline uint64_t OrderedToFloatBits(uint64_t value, uint32_t bits)
+{
+    uint64_t sign = 1ull << (bits - 1);
+    return (value & sign) != 0 ? value & ~sign : ~value & ChannelMask(bits);
+}
+
+// Pixels are little-endian words of up to 8 bytes.
+inline uint64_t LoadPixelBits(const uint8_t* p, uint32_t bytesPerPixel)
+{
+    uint64_t value = 0;
+    memcpy(&value, p, bytesPerPixel);
+    return value;
+}
+
+inline void StorePixelBits(uint8_t* p, uint32_t bytesPerPixel, uint64_t value)
+{
+    memcpy(p, &value, bytesPerPixel);
+}
+
+inline int64_t MedianPredictor(int64_t left, int64_t up, int64_t upLeft)
+{
+    if (upLeft >= (std::max)(left, up))
+    {
+        return (std::min)(left, up);
+    }
+    if (upLeft <= (std::min)(left, up))
+    {
+        return (std::max)(left, up);
+    }
+    return left + up - upLeft;
+}
+
+// Spatial prediction inside a tile: the first row uses the left neighbour, the first column the one above.
+inline int64_t PredictInTile(const int64_t* pPlane, uint32_t x, uint32_t y, uint32_t stride)
+{
+    if (y == 0)
+    {
+        return x == 0 ? 0 : pPlane[x - 1];
+    }
+    const int64_t* pRow = pPlane + static_cast<size_t>(y) * stride;
+    const int64_t* pUp  = pRow - stride;
+    if (x == 0)
+    {
+        return pUp[0];
+    }
+    return MedianPredictor(pRow[x - 1], pUp[x], pUp[x - 1]);
+}
+
+inline uint32_t CountLeadingZeros64(uint64_t value)
+{
+#if defined(_MSC_VER)
+    unsigned long index = 0;
+    return _BitScanReverse64(&index, value) ? 63 - index : 64;
+#else
+    return value == 0 ? 64 : static_cast<uint32_t>(__builtin_clzll(value));
+#endif
+}
+
+class TileBitWriter
+{
+public:
+    explicit TileBitWriter(std::vector<uint8_t>& out)
+        : m_out(out)
+    {
+    }
+
+    // count <= 32
+    void Put(uint64_t value, uint32_t count)
+    {
+        m_bits = (m_bits << count) | (value & ChannelMask(count));
+        m_count += count;
+        while (m_count >= 8)
+        {
+            m_count -= 8;
+            m_out.push_back(static_cast<uint8_t>(m_bits >> m_count));
+        }
+    }
+
+    void Finish()
+    {
+        if (m_count != 0)
+        {
+            m_out.push_back(static_cast<uint8_t>(m_bits << (8 - m_count)));
+            m_count = 0;
+        }
+    }
+
+private:
+    std::vector<uint8_t>& m_out;
+    uint64_t              m_bits  = 0;
+    uint32_t              m_count = 0;
+};
+
+inline uint64_t ByteSwap64(uint64_t value)
+{
+#if defined(_MSC_VER)
+    return _byteswap_uint64(value);
+#else
+    return __builtin_bswap64(value);
+#endif
+}
+
+// MSB-first reader. Refill makes at least 57 bits available, enough for one Rice code including an escape, so the
+// per-sample reads do not check for refills. Reads past the end return zero bits; the decoder checks for overrun
+// once the tile is done.
+class TileBitReader
+{
+public:
+    TileBitReader(const uint8_t* pData, size_t size)
+        : m_p(pData),
+          m_pEnd(pData + size)
+    {
+    }
+
+    void Refill()
+    {
+        if (m_count > 56)
+        {
+            return;
+        }
+        if (m_pEnd - m_p >= 8)
+        {
+            // Whole-word load; the bytes only partly taken are loaded again, to the same bit positions, next time.
+            uint64_t word;
+            memcpy(&word, m_p, sizeof(word));
+            m_bits |= ByteSwap64(word) >> m_count;
+            uint32_t bytes = (63 - m_count) >> 3;
+            m_p += bytes;
+            m_count += bytes * 8;
+            return;
+        }
+        while (m_count <= 56)
+        {
+            uint64_t byte = 0;
+            if (m_p < m_pEnd)
+            {
+                byte = *m_p++;
+            }
+            else
+            {
+                m_overrun += 8;
+            }
+            m_bits |= byte << (56 - m_count);
+            m_count += 8;
+        }
+    }
+
+    // count <= 32, after Refill
+    uint64_t Read(uint32_t count)
+    {
+        if (count == 0)
+        {
+            return 0;
+        }
+        uint64_t value = m_bits >> (64 - count);
+        Consume(count);
+        return value;
+    }
+
+    // Unary quotient capped at RiceEscapeQuotient, after Refill.
+    uint32_t ReadQuotient()
+    {
+        uint32_t zeros = (std::min)(CountLeadingZeros64(m_bits), RiceEscapeQuotient);
+        Consume(zeros < RiceEscapeQuotient ? zeros + 1 : zeros);
+        return zeros;
+    }
+
+    // True when every consumed bit came from the data; the refill look-ahead does not count.
+    bool WithinData() const
+    {
+        return m_overrun <= static_cast<int64_t>(m_count);
+    }
+
+private:
+    void Consume(uint32_t count)
+    {
+        m_bits <<= count;
+        m_count -= count;
+    }
+
+    const uint8_t* m_p;
+    const uint8_t* m_pEnd;
+    uint64_t       m_bits    = 0;
+    uint32_t       m_count   = 0;
+    int64_t        m_overrun = 0;
+};
+
+inline uint64_t ZigzagResidual(uint64_t residual, uint32_t bits)
+{
+    uint64_t mask  = ChannelMask(bits);
+    uint64_t sign  = (residual >> (bits - 1)) & 1;
+    uint64_t value = residual & mask;
+    return sign != 0 ? ((~value & mask) << 1 | 1) & mask : (value << 1) & mask;
+}
+
+inline uint64_t UnzigzagResidual(uint64_t code, uint32_t bits)
+{
+    uint64_t mask = ChannelMask(bits);
+    return (code & 1) != 0 ? ~(code >> 1) & mask : code >> 1;
+}
+
+inline void PutRiceGroup(TileBitWriter& writer, const uint64_t* pCodes, uint32_t count, uint32_t bits)
+{
+    uint64_t sum = 0;
+    for (uint32_t i = 0; i < count; i++)
+    {
+        sum += pCodes[i];
+    }
+    if (sum == 0)
+    {
+        writer.Put(RiceZeroGroup, RiceParamBits);
+        return;
+    }
+
+    uint32_t k = 0;
+    while (k < bits && (static_cast<uint64_t>(count) << k) < sum)
+    {
+        k++;
+    }
+    writer.Put(k, RiceParamBits);
+
+    for (uint32_t i = 0; i < count; i++)
+    {
+        uint64_t quotient = pCodes[i] >> k;
+        if (quotient < RiceEscapeQuotient)
+        {
+            writer.Put(1, static_cast<uint32_t>(quotient) + 1);
+            writer.Put(pCodes[i], k);
+        }
+        else
+        {
+            writer.Put(0, RiceEscapeQuotient);
+            writer.Put(pCodes[i], bits);
+        }
+    }
+}
+
+inline TileRect GetTileRect(uint32_t tileIndex, uint32_t frameWidth, uint32_t frameHeight)
+{
+    uint32_t tilesX = (frameWidth + TiledFrameTileSize - 1) / TiledFrameTileSize;
+    TileRect rect;
+    rect.x      = tileIndex % tilesX * TiledFrameTileSize;
+    rect.y      = tileIndex / tilesX * TiledFrameTileSize;
+    rect.width  = (std::min)(TiledFrameTileSize, frameWidth - rect.x);
+    rect.height = (std::min)(TiledFrameTileSize, frameHeight - rect.y);
+    return rect;
+}
+
+// Loads one channel of a tile as (ordered) integers.
+inline void LoadTilePlane(const uint8_t*           pPixels,
+                          uint32_t                 frameWidth,
+                          const TileRect&          rect,
+                          const TileChannelLayout& layout,
+                          const TileChannel&       channel,
+                          int64_t*                 pPlane)
+{
+    for (uint32_t y = 0; y < rect.height; y++)
+    {
+        const uint8_t* pRow =
+            pPixels + (static_cast<size_t>(rect.y + y) * frameWidth + rect.x) * layout.bytesPerPixel;
+        for (uint32_t x = 0; x < rect.width; x++)
+        {
+            uint64_t value = (LoadPixelBits(pRow + x * layout.bytesPerPixel, layout.bytesPerPixel) >> channel.shift) &
+                             ChannelMask(channel.bits);
+            if (channel.isFloat)
+            {
+                value = FloatBitsToOrdered(value, channel.bits);
+            }
+            pPlane[y * rect.width + x] = static_cast<int64_t>(value);
+        }
+    }
+}
+
+inline int64_t PredictSample(TilePredictor  predictor,
+                             const int64_t* pPlane,
+                             const int64_t* pPrevPlane,
+                             int64_t*       pDelta,
+                             uint32_t       x,
+                             uint32_t       y,
+                             uint32_t       stride)
+{
+    size_t i = static_cast<size_t>(y) * stride + x;
+    switch (predictor)
+    {
+    case TilePredictor::Temporal:
+        return pPrevPlane[i];
+    case TilePredictor::TemporalSpatial:
+        return pPrevPlane[i] + PredictInTile(pDelta, x, y, stride);
+    case TilePredictor::Spatial:
+    case TilePredictor::Count:
+    default:
+        return PredictInTile(pPlane, x, y, stride);
+    }
+}
+
+inline void EncodeTileWithPredictor(TilePredictor            predictor,
+                                    const int64_t            planes[][TiledFrameTileSize * TiledFrameTileSize],
+                                    const int64_t            prevPlanes[][TiledFrameTileSize * TiledFrameTileSize],
+                                    const TileRect&          rect,
+                                    const TileChannelLayout& layout,
+                                    std::vector<uint8_t>&    out)
+{
+    out.clear();
+    out.push_back(static_cast<uint8_t>(predictor));
+
+    TileBitWriter writer(out);
+    int64_t       delta[TiledFrameTileSize * TiledFrameTileSize];
+    uint64_t      codes[TiledFrameGroupSize];
+    uint32_t      samples = rect.width * rect.height;
+
+    for (uint32_t c = 0; c < layout.channelCount; c++)
+    {
+        const TileChannel& channel = layout.channels[c];
+        if (predictor == TilePredictor::TemporalSpatial)
+        {
+            for (uint32_t i = 0; i < samples; i++)
+            {
+                delta[i] = planes[c][i] - prevPlanes[c][i];
+            }
+        }
+
+        uint32_t grouped = 0;
+        for (uint32_t i = 0; i < samples; i++)
+        {
+            int64_t prediction =
+                PredictSample(predictor, planes[c], prevPlanes[c], delta, i % rect.width, i / rect.width, rect.width);
+            codes[grouped++] = ZigzagResidual(static_cast<uint64_t>(planes[c][i] - prediction), channel.bits);
+            if (grouped == TiledFrameGroupSize || i + 1 == samples)
+            {
+                PutRiceGroup(writer, codes, grouped, channel.bits);
+                grouped = 0;
+            }
+        }
+    }
+    writer.Finish();
+}
+
+template <TilePredictor Predictor>
+inline bool DecodeTilePlane(TileBitReader& reader,
+                            uint32_t       width,
+                            uint32_t       height,
+                            uint32_t       bits,
+                            const int64_t* pPrevPlane,
+                            int64_t*       pDelta,
+                            int64_t*       pPlane)
+{
+    const uint64_t mask    = ChannelMask(bits);
+    uint32_t       k       = 0;
+    uint32_t       inGroup = 0;
+
+    for (uint32_t y = 0; y < height; y++)
+    {
+        for (uint32_t x = 0; x < width; x++)
+        {
+            reader.Refill();
+            if (inGroup == 0)
+            {
+                k = static_cast<uint32_t>(reader.Read(RiceParamBits));
+                if (k != RiceZeroGroup && k > bits)
+                {
+                    return false;
+                }
+                inGroup = TiledFrameGroupSize;
+                reader.Refill();
+            }
+            inGroup--;
+
+            uint64_t code = 0;
+            if (k != RiceZeroGroup)
+            {
+                uint32_t quotient = reader.ReadQuotient();
+                code = quotient < RiceEscapeQuotient ? (static_cast<uint64_t>(quotient) << k) | reader.Read(k)
+                                                     : reader.Read(bits);
+            }
+
+            size_t  i = static_cast<size_t>(y) * width + x;
+            int64_t prediction;
+            if (Predictor == TilePredictor::Temporal)
+            {
+                prediction = pPrevPlane[i];
+            }
+            else if (Predictor == TilePredictor::TemporalSpatial)
+            {
+                prediction = pPrevPlane[i] + PredictInTile(pDelta, x, y, width);
+            }
+            else
+            {
+                prediction = PredictInTile(pPlane, x, y, width);
+            }
+
+            pPlane[i] = static_cast<int64_t>((static_cast<uint64_t>(prediction) + UnzigzagResidual(code, bits)) & mask);
+            if (Predictor == TilePredictor::TemporalSpatial)
+            {
+                pDelta[i] = pPlane[i] - pPrevPlane[i];
+            }
+        }
+    }
+    return true;
+}
+
+// Decodes every channel into per-thread scratch planes, then packs the channels into the tile's pixels.
+inline bool DecodeTile(const uint8_t*           pData,
+                       size_t                   size,
+                       const TileRect&          rect,
+                       const TileChannelLayout& layout,
+                       uint32_t                 frameWidth,
+                       const uint8_t*           pPrevPixels,
+                       uint8_t*                 pPixels)
+{
+    static constexpr size_t PlaneSize = TiledFrameTileSize * TiledFrameTileSize;
+
+    thread_local std::vector<int64_t> planes(PlaneSize * TiledFrameMaxChannel);
+    thread_local std::vector<int64_t> prevPlane(PlaneSize);
+    thread_local std::vector<int64_t> delta(PlaneSize);
+
+    if (size == 0 || pData[0] >= static_cast<uint8_t>(TilePredictor::Count))
+    {
+        return false;
+    }
+    TilePredictor predictor = static_cast<TilePredictor>(pData[0]);
+    if (predictor != TilePredictor::Spatial && pPrevPixels == nullptr)
+    {
+        return false;
+    }
+
+    TileBitReader reader(pData + 1, size - 1);
+    for (uint32_t c = 0; c < layout.channelCount; c++)
+    {
+        const TileChannel& channel = layout.channels[c];
+        int64_t*           pPlane  = planes.data() + c * PlaneSize;
+        if (predictor != TilePredictor::Spatial)
+        {
+            LoadTilePlane(pPrevPixels, frameWidth, rect, layout, channel, prevPlane.data());
+        }
+
+        bool ok = false;
+        switch (predictor)
+        {
+        case TilePredictor::Temporal:
+            ok = DecodeTilePlane<TilePredictor::Temporal>(
+                reader, rect.width, rect.height, channel.bits, prevPlane.data(), delta.data(), pPlane);
+            break;
+        case TilePredictor::TemporalSpatial:
+            ok = DecodeTilePlane<TilePredictor::TemporalSpatial>(
+                reader, rect.width, rect.height, channel.bits, prevPlane.data(), delta.data(), pPlane);
+            break;
+        case TilePredictor::Spatial:
+        case TilePredictor::Count:
+        default:
+            ok = DecodeTilePlane<TilePredictor::Spatial>(
+                reader, rect.width, rect.height, channel.bits, prevPlane.data(), delta.data(), pPlane);
+            break;
+        }
+        if (!ok)
+        {
+            return false;
+        }
+    }
+
+    for (uint32_t y = 0; y < rect.height; y++)
+    {
+        uint8_t* pRow = pPixels + (static_cast<size_t>(rect.y + y) * frameWidth + rect.x) * layout.bytesPerPixel;
+        for (uint32_t x = 0; x < rect.width; x++)
+        {
+            size_t   i     = static_cast<size_t>(y) * rect.width + x;
+            uint64_t pixel = 0;
+            for (uint32_t c = 0; c < layout.channelCount; c++)
+            {
+                const TileChannel& channel = layout.channels[c];
+                uint64_t           value   = static_cast<uint64_t>(planes[c * PlaneSize + i]);
+                pixel |= (channel.isFloat ? OrderedToFloatBits(value, channel.bits) : value) << channel.shift;
+            }
+            StorePixelBits(pRow + static_cast<size_t>(x) * layout.bytesPerPixel, layout.bytesPerPixel, pixel);
+        }
+    }
+    return reader.WithinData();
+}
+
+inline bool IsTiledFrame(const uint8_t* pData, size_t size)
+{
+    return pData != nullptr && size >= sizeof(TiledFrameHeader) && memcmp(pData, TiledFrameMagic, 4) == 0;
+}
+
+// Codes a tightly packed frame. pPrevPixels (same size and format, may be null) enables the temporal predictors.
+// Returns an empty vector when the format is not supported.
+inline std::vector<uint8_t> EncodeTiledFrame(const uint8_t* pPixels,
+                                             const uint8_t* pPrevPixels,
+                                             uint32_t       width,
+                                             uint32_t       height,
+                                             uint32_t       format,
+                                             ThreadPool*    pPool)
+{
+    TileChannelLayout layout;
+    if (!GetTileChannelLayout(format, layout) || width == 0 || height == 0)
+    {
+        return {};
+    }
+
+    uint32_t tilesX    = (width + TiledFrameTileSize - 1) / TiledFrameTileSize;
+    uint32_t tilesY    = (height + TiledFrameTileSize - 1) / TiledFrameTileSize;
+    uint32_t tileCount = tilesX * tilesY;
+
+    std::vector<std::vector<uint8_t>> tiles(tileCount);
+    auto encodeTile = [&](uint32_t tileIndex) {
+        using Plane = int64_t[TiledFrameTileSize * TiledFrameTileSize];
+        std::unique_ptr<Plane[]> planes(new Plane[TiledFrameMaxChannel]);
+        std::unique_ptr<Plane[]> prevPlanes(new Plane[TiledFrameMaxChannel]);
+
+        TileRect rect = GetTileRect(tileIndex, width, height);
+        for (uint32_t c = 0; c < layout.channelCount; c++)
+        {
+            LoadTilePlane(pPixels, width, rect, layout, layout.channels[c], planes[c]);
+            if (pPrevPixels != nullptr)
+            {
+                LoadTilePlane(pPrevPixels, width, rect, layout, layout.channels[c], prevPlanes[c]);
+            }
+        }
+
+        std::vector<uint8_t>& best = tiles[tileIndex];
+        std::vector<uint8_t>  candidate;
+        EncodeTileWithPredictor(TilePredictor::Spatial, planes.get(), prevPlanes.get(), rect, layout, best);
+        if (pPrevPixels != nullptr)
+        {
+            for (TilePredictor predictor : {TilePredictor::Temporal, TilePredictor::TemporalSpatial})
+            {
+                EncodeTileWithPredictor(predictor, planes.get(), prevPlanes.get(), rect, layout, candidate);
+                if (candidate.size() < best.size())
+                {
+                    best.swap(candidate);
+                }
+            }
+        }
+    };
+
+    if (pPool != nullptr)
+    {
+        pPool->ParallelFor(tileCount, encodeTile);
+    }
+    else
+    {
+        for (uint32_t i = 0; i < tileCount; i++)
+        {
+            encodeTile(i);
+        }
+    }
+
+    TiledFrameHeader header = {};
+    memcpy(header.magic, TiledFrameMagic, sizeof(header.magic));
+    header.width     = width;
+    header.height    = height;
+    header.format    = format;
+    header.tileSize  = static_cast<uint16_t>(TiledFrameTileSize);
+    header.tileCount = tileCount;
+
+    std::vector<uint32_t> tileEnd(tileCount);
+    uint64_t              total = 0;
+    for (uint32_t i = 0; i < tileCount; i++)
+    {
+        total += tiles[i].size();
+        tileEnd[i] = static_cast<uint32_t>(total);
+        if (tiles[i][0] != static_cast<uint8_t>(TilePredictor::Spatial))
+        {
+            header.flags |= TiledFrameInter;
+        }
+    }
+
+    std::vector<uint8_t> out(sizeof(header) + tileEnd.size() * sizeof(uint32_t));
+    out.reserve(out.size() + static_cast<size_t>(total));
+    memcpy(out.data(), &header, sizeof(header));
+    memcpy(out.data() + sizeof(header), tileEnd.data(), tileEnd.size() * sizeof(uint32_t));
+    for (const auto& tile : tiles)
+    {
+        out.insert(out.end(), tile.begin(), tile.end());
+    }
+    return out;
+}
+
+// Returns the size of the decoded frame in bytes, or 0 if the stream is not a valid tiled frame.
+inline size_t GetTiledFrameSize(const uint8_t* pData, size_t size)
+{
+    TiledFrameHeader  header;
+    TileChannelLayout layout;
+    if (!IsTiledFrame(pData, size))
+    {
+        return 0;
+    }
+    memcpy(&header, pData, sizeof(header));
+    if (!GetTileChannelLayout(header.format, layout) || header.tileSize != TiledFrameTileSize)
+    {
+        return 0;
+    }
+    return static_cast<size_t>(header.width) * header.height * layout.bytesPerPixel;
+}
+
+inline bool TiledFrameNeedsPrevious(const uint8_t* pData, size_t size)
+{
+    TiledFrameHeader header;
+    if (!IsTiledFrame(pData, size))
+    {
+        return false;
+    }
+    memcpy(&header, pData, sizeof(header));
+    return (header.flags & TiledFrameInter) != 0;
+}
+
+// Decodes into pPixels (GetTiledFrameSize bytes). pPrevPixels must be the previous decoded frame when
+// TiledFrameNeedsPrevious. Tiles are spread over the pool.
+inline bool DecodeTiledFrame(const uint8_t* pData,
+                             size_t         size,
+                             const uint8_t* pPrevPixels,
+                             uint8_t*       pPixels,
+                             ThreadPool*    pPool)
+{
+    if (GetTiledFrameSize(pData, size) == 0)
+    {
+        return false;
+    }
+
+    TiledFrameHeader  header;
+    TileChannelLayout layout;
+    memcpy(&header, pData, sizeof(header));
+    GetTileChannelLayout(header.format, layout);
+
+    uint32_t tilesX = (header.width + TiledFrameTileSize - 1) / TiledFrameTileSize;
+    uint32_t tilesY = (header.height + TiledFrameTileSize - 1) / TiledFrameTileSize;
+    size_t   tableBytes = static_cast<size_t>(header.tileCount) * sizeof(uint32_t);
+    if (header.tileCount != tilesX * tilesY || size - sizeof(header) < tableBytes)
+    {
+        return false;
+    }
+
+    std::vector<uint32_t> tileEnd(header.tileCount);
+    memcpy(tileEnd.data(), pData + sizeof(header), tableBytes);
+
+    const uint8_t*        pTiles     = pData + sizeof(header) + tableBytes;
+    const size_t          tilesBytes = size - sizeof(header) - tableBytes;
+    std::atomic<uint32_t> failed{0};
+
+    auto decodeTile = [&](uint32_t tileIndex) {
+        uint32_t begin = tileIndex == 0 ? 0 : tileEnd[tileIndex - 1];
+        uint32_t end   = tileEnd[tileIndex];
+        if (begin > end || end > tilesBytes ||
+            !DecodeTile(pTiles + begin, end - begin, GetTileRect(tileIndex, header.width, header.height), layout,
+                        header.width, pPrevPixels, pPixels))
+        {
+            failed++;
+        }
+    };
+
+    if (pPool != nullptr)
+    {
+        pPool->ParallelFor(header.tileCount, decodeTile);
+    }
+    else
+    {
+        for (uint32_t i = 0; i < header.tileCount; i++)
+        {
+            decodeTile(i);
+        }
+    }
+    return failed.load() == 0;
+}
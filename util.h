@@ -21,7 +21,6 @@ enum class ComputeShaderType : uint32_t {
 
 enum class StagResType : uint8_t {
   ColorInput,
-  ColorOutput,
   Mevc,
   Depth,
   Count
@@ -146,7 +145,7 @@ struct ShaderInfo {
   std::string dxbcFile;
 };
 
-std::vector<uint8_t> AcquireFileContent(const std::string& path) {
+inline std::vector<uint8_t> AcquireFileContent(const std::string& path) {
   std::vector<uint8_t> result;
   std::ifstream f(path, std::ios::binary);
   if (f.is_open()) {
@@ -159,7 +158,7 @@ std::vector<uint8_t> AcquireFileContent(const std::string& path) {
   return result;
 }
 
-DXGI_FORMAT GetInternalResFormat(InternalResType type) {
+inline DXGI_FORMAT GetInternalResFormat(InternalResType type) {
   switch (type) {
     case InternalResType::ReprojectedFullX:
     case InternalResType::ReprojectedFullY:
@@ -198,7 +197,7 @@ DXGI_FORMAT GetInternalResFormat(InternalResType type) {
   }
 }
 
-std::pair<uint32_t, uint32_t> GetInternalResResolution(InternalResType type,
+inline std::pair<uint32_t, uint32_t> GetInternalResResolution(InternalResType type,
                                                        uint32_t originWidth,
                                                        uint32_t originHeight) {
   switch (type) {
@@ -238,4 +237,41 @@ std::pair<uint32_t, uint32_t> GetInternalResResolution(InternalResType type,
     default:
       return {0, 0};
   }
-}
\ No newline at end of file
+}
+
+inline uint32_t GetFormatBytesPerPixel(DXGI_FORMAT format) {
+  switch (format) {
+    case DXGI_FORMAT_R32G32B32A32_FLOAT:
+      return 16;
+
+    case DXGI_FORMAT_R16G16B16A16_FLOAT:
+    case DXGI_FORMAT_R32G32_TYPELESS:
+    case DXGI_FORMAT_R32G32_FLOAT:
+      return 8;
+
+    case DXGI_FORMAT_R8G8B8A8_TYPELESS:
+    case DXGI_FORMAT_R8G8B8A8_UNORM:
+    case DXGI_FORMAT_R8G8B8A8_UNORM_SRGB:
+    case DXGI_FORMAT_R16G16_TYPELESS:
+    case DXGI_FORMAT_R16G16_FLOAT:
+    case DXGI_FORMAT_R16G16_UNORM:
+    case DXGI_FORMAT_R16G16_SNORM:
+    case DXGI_FORMAT_R32_TYPELESS:
+    case DXGI_FORMAT_D32_FLOAT:
+    case DXGI_FORMAT_R32_FLOAT:
+    case DXGI_FORMAT_R32_UINT:
+    case DXGI_FORMAT_R24G8_TYPELESS:
+    case DXGI_FORMAT_D24_UNORM_S8_UINT:
+    case DXGI_FORMAT_R24_UNORM_X8_TYPELESS:
+      return 4;
+
+    case DXGI_FORMAT_R16_TYPELESS:
+    case DXGI_FORMAT_R16_FLOAT:
+    case DXGI_FORMAT_D16_UNORM:
+    case DXGI_FORMAT_R16_UNORM:
+      return 2;
+
+    default:
+      return 0;
+  }
+}
@@ -0,0 +1,213 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define WORKER_TEAM_PAUSE() _mm_pause()
+#else
+#define WORKER_TEAM_PAUSE() std::this_thread::yield()
+#endif
+
+// A fixed team of threads for sequences of short phases, where handing every phase to a ThreadPool would cost more
+// than the phase itself. The members stay with the caller for the whole sequence and meet at a barrier after each
+// phase. A member that has to wait, at a barrier or for the next sequence, spins for spinMicroseconds before it parks,
+// so phases of tens of microseconds never wait for a wake-up. Run must only be called from one thread at a time.
+class WorkerTeam
+{
+public:
+    struct Phase
+    {
+        uint32_t                      count; // task(i) runs for every i in [0, count)
+        std::function<void(uint32_t)> task;
+    };
+
+    // Per barrier, i.e. per phase index: how often it was crossed, the seconds all members together waited at it and
+    // the longest single wait.
+    struct BarrierStats
+    {
+        uint64_t crossings      = 0;
+        double   waitSeconds    = 0.0;
+        double   maxWaitSeconds = 0.0;
+    };
+
+    // threadCount helpers; the thread that calls Run is the last member.
+    explicit WorkerTeam(uint32_t threadCount, uint32_t spinMicroseconds = 100) : m_spin(spinMicroseconds)
+    {
+        for (uint32_t i = 0; i < threadCount; i++)
+        {
+            m_threads.emplace_back([this]() { MemberLoop(); });
+        }
+    }
+
+    ~WorkerTeam()
+    {
+        m_stop = true;
+        m_generation++;
+        Wake();
+        for (auto& thread : m_threads)
+        {
+            thread.join();
+        }
+    }
+
+    WorkerTeam(const WorkerTeam&)            = delete;
+    WorkerTeam& operator=(const WorkerTeam&) = delete;
+
+    uint32_t Size() const
+    {
+        return static_cast<uint32_t>(m_threads.size()) + 1;
+    }
+
+    // Runs the phases in order with the whole team and returns once the last one has finished.
+    void Run(const std::vector<Phase>& phases)
+    {
+        if (phases.empty())
+        {
+            return;
+        }
+
+        while (m_next.size() < phases.size())
+        {
+            m_next.emplace_back();
+            m_barriers.emplace_back();
+        }
+        for (size_t i = 0; i < phases.size(); i++)
+        {
+            m_next[i] = 0;
+        }
+        m_pPhases = &phases;
+
+        m_generation++;
+        Wake();
+        Work();
+    }
+
+    // Not while Run is in progress.
+    std::vector<BarrierStats> GetBarrierStats() const
+    {
+        std::vector<BarrierStats> stats(m_barriers.size());
+        for (size_t i = 0; i < stats.size(); i++)
+        {
+            stats[i].crossings      = m_barriers[i].crossings.load();
+            stats[i].waitSeconds    = m_barriers[i].waitNs.load() * 1e-9;
+            stats[i].maxWaitSeconds = m_barriers[i].maxWaitNs.load() * 1e-9;
+        }
+        return stats;
+    }
+
+private:
+    struct BarrierCounters
+    {
+        std::atomic<uint64_t> crossings{0};
+        std::atomic<uint64_t> waitNs{0};
+        std::atomic<uint64_t> maxWaitNs{0};
+    };
+
+    void MemberLoop()
+    {
+        uint32_t seen = 0;
+        for (;;)
+        {
+            seen = WaitForChange(m_generation, seen);
+            if (m_stop)
+            {
+                return;
+            }
+            Work();
+        }
+    }
+
+    // Once the last barrier opens, Run may return and the caller set up the next run, so nothing of this run is
+    // touched after arriving there.
+    void Work()
+    {
+        const std::vector<Phase>& phases     = *m_pPhases;
+        const size_t              phaseCount = phases.size();
+        for (size_t p = 0; p < phaseCount; p++)
+        {
+            const Phase& phase = phases[p];
+            for (uint32_t i = m_next[p].fetch_add(1); i < phase.count; i = m_next[p].fetch_add(1))
+            {
+                phase.task(i);
+            }
+            Arrive(m_barriers[p]);
+        }
+    }
+
+    // Centralized barrier: the last member to arrive resets the count and opens the barrier by advancing the epoch.
+    void Arrive(BarrierCounters& counters)
+    {
+        uint32_t epoch = m_epoch.load();
+        if (m_arrived.fetch_add(1) + 1 == Size())
+        {
+            m_arrived = 0;
+            counters.crossings++;
+            m_epoch++;
+            Wake();
+            return;
+        }
+
+        auto begin = std::chrono::steady_clock::now();
+        WaitForChange(m_epoch, epoch);
+        uint64_t waitNs =
+            std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - begin).count();
+        counters.waitNs += waitNs;
+        uint64_t maxWaitNs = counters.maxWaitNs.load();
+        while (waitNs > maxWaitNs && !counters.maxWaitNs.compare_exchange_weak(maxWaitNs, waitNs))
+        {
+        }
+    }
+
+    // Spins until value differs from seen, then parks. Returns the new value.
+    uint32_t WaitForChange(const std::atomic<uint32_t>& value, uint32_t seen)
+    {
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::microseconds(m_spin);
+        for (uint32_t spins = 0; value.load() == seen; spins++)
+        {
+            if ((spins & 63) == 63 && std::chrono::steady_clock::now() >= deadline)
+            {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                m_parked++;
+                m_wake.wait(lock, [&value, seen]() { return value.load() != seen; });
+                m_parked--;
+                break;
+            }
+            WORKER_TEAM_PAUSE();
+        }
+        return value.load();
+    }
+
+    // A parked member counts itself under the mutex before it checks the value again, so a waker that changed the
+    // value and still sees no parked member cannot miss it.
+    void Wake()
+    {
+        if (m_parked.load() != 0)
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_wake.notify_all();
+        }
+    }
+
+    std::vector<std::thread>          m_threads;
+    uint32_t                          m_spin;
+    const std::vector<Phase>*         m_pPhases = nullptr;
+    std::deque<std::atomic<uint32_t>> m_next;
+    std::deque<BarrierCounters>       m_barriers;
+    std::atomic<uint32_t>             m_generation{0};
+    std::atomic<uint32_t>             m_epoch{0};
+    std::atomic<uint32_t>             m_arrived{0};
+    std::atomic<uint32_t>             m_parked{0};
+    std::atomic<bool>                 m_stop{false};
+    std::mutex                        m_mutex;
+    std::condition_variable           m_wake;
+};
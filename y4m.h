@@ -0,0 +1,406 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <sstream>
+#include <string>
+
+#include "thread_pool.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define Y4M_SSE2 1
+#else
+#define Y4M_SSE2 0
+#endif
+
+// YUV4MPEG2 streams as produced by ffmpeg -f yuv4mpegpipe and most playback tools: a single header line, then every
+// frame as a "FRAME" line followed by planar 8-bit Y, U and V. Samples are BT.709 limited range, the matrix ffmpeg
+// assumes for HD material when the stream carries no colour tags. Streams are written as 4:2:0 with JPEG siting.
+
+enum class Y4mChroma : uint32_t {
+    C420,
+    C422,
+    C444,
+    Mono
+};
+
+struct Y4mHeader
+{
+    uint32_t  width   = 0;
+    uint32_t  height  = 0;
+    uint32_t  rateNum = 30;
+    uint32_t  rateDen = 1;
+    Y4mChroma chroma  = Y4mChroma::C420;
+};
+
+static const char       Y4mMagic[]    = "YUV4MPEG2";
+static const char       Y4mFrameTag[] = "FRAME";
+static constexpr size_t Y4mMaxLine    = 1024;
+
+inline uint32_t GetY4mChromaWidth(const Y4mHeader& header)
+{
+    return header.chroma == Y4mChroma::C444 ? header.width : (header.width + 1) / 2;
+}
+
+inline uint32_t GetY4mChromaHeight(const Y4mHeader& header)
+{
+    return header.chroma == Y4mChroma::C420 ? (header.height + 1) / 2 : header.height;
+}
+
+// Bytes of one frame's planes, excluding its FRAME line.
+inline size_t GetY4mFrameSize(const Y4mHeader& header)
+{
+    size_t luma = static_cast<size_t>(header.width) * header.height;
+    if (header.chroma == Y4mChroma::Mono)
+    {
+        return luma;
+    }
+    return luma + 2 * static_cast<size_t>(GetY4mChromaWidth(header)) * GetY4mChromaHeight(header);
+}
+
+// Parses "num:den" or a plain integer rate.
+inline bool ParseY4mFrameRate(const std::string& text, uint32_t& rateNum, uint32_t& rateDen)
+{
+    char* pEnd = nullptr;
+    rateNum    = static_cast<uint32_t>(strtoul(text.c_str(), &pEnd, 10));
+    rateDen    = *pEnd == ':' ? static_cast<uint32_t>(strtoul(pEnd + 1, nullptr, 10)) : 1;
+    return rateNum != 0 && rateDen != 0;
+}
+
+// line is the header without its terminating newline. Only 8-bit streams are accepted; every 4:2:0 siting variant is
+// read the same way.
+inline bool ParseY4mHeader(const std::string& line, Y4mHeader& header)
+{
+    std::istringstream tokens(line);
+    std::string        token;
+    if (!(tokens >> token) || token != Y4mMagic)
+    {
+        return false;
+    }
+
+    header = {};
+    while (tokens >> token)
+    {
+        const char* pValue = token.c_str() + 1;
+        switch (token[0])
+        {
+        case 'W':
+            header.width = static_cast<uint32_t>(strtoul(pValue, nullptr, 10));
+            break;
+        case 'H':
+            header.height = static_cast<uint32_t>(strtoul(pValue, nullptr, 10));
+            break;
+        case 'F':
+            ParseY4mFrameRate(pValue, header.rateNum, header.rateDen);
+            break;
+        case 'C':
+        {
+            std::string chroma = pValue;
+            if (chroma == "420" || chroma == "420jpeg" || chroma == "420paldv" || chroma == "420mpeg2")
+            {
+                header.chroma = Y4mChroma::C420;
+            }
+            else if (chroma == "422")
+            {
+                header.chroma = Y4mChroma::C422;
+            }
+            else if (chroma == "444")
+            {
+                header.chroma = Y4mChroma::C444;
+            }
+            else if (chroma == "mono")
+            {
+                header.chroma = Y4mChroma::Mono;
+            }
+            else
+            {
+                return false;
+            }
+            break;
+        }
+        default:
+            // Interlacing, aspect ratio and X extensions do not change the frame layout.
+            break;
+        }
+    }
+    return header.width != 0 && header.height != 0 && header.rateNum != 0 && header.rateDen != 0;
+}
+
+inline uint8_t ClampToByte(int32_t value)
+{
+    return static_cast<uint8_t>(value < 0 ? 0 : value > 255 ? 255 : value);
+}
+
+// One row of limited-range BT.709 YUV to opaque RGBA8, in 16.16 fixed point. Chroma is replicated across the
+// horizontally subsampled pairs.
+inline void ConvertYuvRowToRgba(const uint8_t* pY,
+                                const uint8_t* pU,
+                                const uint8_t* pV,
+                                uint32_t       width,
+                                uint32_t       chromaShiftX,
+                                uint8_t*       pRgba)
+{
+    static constexpr int32_t CoefY  = 76309;
+    static constexpr int32_t CoefRV = 117489;
+    static constexpr int32_t CoefGU = 13975;
+    static constexpr int32_t CoefGV = 34925;
+    static constexpr int32_t CoefBU = 138438;
+    static constexpr int32_t Round  = 1 << 15;
+
+    for (uint32_t x = 0; x < width; x++)
+    {
+        int32_t y = (pY[x] - 16) * CoefY + Round;
+        int32_t u = pU != nullptr ? pU[x >> chromaShiftX] - 128 : 0;
+        int32_t v = pV != nullptr ? pV[x >> chromaShiftX] - 128 : 0;
+
+        pRgba[x * 4 + 0] = ClampToByte((y + CoefRV * v) >> 16);
+        pRgba[x * 4 + 1] = ClampToByte((y - CoefGU * u - CoefGV * v) >> 16);
+        pRgba[x * 4 + 2] = ClampToByte((y + CoefBU * u) >> 16);
+        pRgba[x * 4 + 3] = 255;
+    }
+}
+
+// Converts one frame's planes to RGBA8 rows stride bytes apart, spreading bands of rows over the pool.
+inline void ConvertY4mFrameToRgba(const uint8_t*   pFrame,
+                                  const Y4mHeader& header,
+                                  uint8_t*         pRgba,
+                                  size_t           stride,
+                                  ThreadPool*      pPool)
+{
+    static constexpr uint32_t BandRows = 32;
+
+    const uint32_t chromaWidth  = GetY4mChromaWidth(header);
+    const uint32_t chromaShiftX = header.chroma == Y4mChroma::C444 ? 0 : 1;
+    const uint32_t chromaShiftY = header.chroma == Y4mChroma::C420 ? 1 : 0;
+    const size_t   lumaSize     = static_cast<size_t>(header.width) * header.height;
+    const size_t   chromaSize   = static_cast<size_t>(chromaWidth) * GetY4mChromaHeight(header);
+    const bool     mono         = header.chroma == Y4mChroma::Mono;
+    const uint32_t bands        = (header.height + BandRows - 1) / BandRows;
+
+    auto convertBand = [&](uint32_t band) {
+        uint32_t end = (std::min)(header.height, (band + 1) * BandRows);
+        for (uint32_t y = band * BandRows; y < end; y++)
+        {
+            size_t chromaRow = static_cast<size_t>(y >> chromaShiftY) * chromaWidth;
+            ConvertYuvRowToRgba(pFrame + static_cast<size_t>(y) * header.width,
+                                mono ? nullptr : pFrame + lumaSize + chromaRow,
+                                mono ? nullptr : pFrame + lumaSize + chromaSize + chromaRow,
+                                header.width,
+                                chromaShiftX,
+                                pRgba + y * stride);
+        }
+    };
+
+    if (pPool != nullptr)
+    {
+        pPool->ParallelFor(bands, convertBand);
+    }
+    else
+    {
+        for (uint32_t band = 0; band < bands; band++)
+        {
+            convertBand(band);
+        }
+    }
+}
+
+// Header line, including its newline, of a progressive square-pixel stream.
+inline std::string FormatY4mHeader(const Y4mHeader& header)
+{
+    static const char* const ChromaTags[] = {"420jpeg", "422", "444", "mono"};
+
+    return std::string(Y4mMagic) + " W" + std::to_string(header.width) + " H" + std::to_string(header.height) + " F" +
+           std::to_string(header.rateNum) + ":" + std::to_string(header.rateDen) + " Ip A1:1 C" +
+           ChromaTags[static_cast<uint32_t>(header.chroma)] + "\n";
+}
+
+// Forward BT.709 limited-range matrix in 2.14 fixed point. Chroma takes the sum of a 2x2 block, so its shift is two
+// bits larger.
+static constexpr int32_t Y4mCoefYR   = 2991;
+static constexpr int32_t Y4mCoefYG   = 10064;
+static constexpr int32_t Y4mCoefYB   = 1016;
+static constexpr int32_t Y4mCoefUR   = -1649;
+static constexpr int32_t Y4mCoefUG   = -5547;
+static constexpr int32_t Y4mCoefUB   = 7196;
+static constexpr int32_t Y4mCoefVR   = 7196;
+static constexpr int32_t Y4mCoefVG   = -6536;
+static constexpr int32_t Y4mCoefVB   = -660;
+static constexpr int32_t Y4mOffsetY  = (16 << 14) + (1 << 13);
+static constexpr int32_t Y4mOffsetUV = (128 << 16) + (1 << 15);
+
+inline uint8_t RgbaToLuma(const uint8_t* pPixel)
+{
+    return static_cast<uint8_t>((Y4mCoefYR * pPixel[0] + Y4mCoefYG * pPixel[1] + Y4mCoefYB * pPixel[2] + Y4mOffsetY) >> 14);
+}
+
+// Converts the pixels [x, width) of two RGBA rows into luma for both rows and one 4:2:0 chroma row. Odd widths take
+// the last column twice; callers pass the same row twice for the last row of an odd height.
+inline void ConvertRgbaRowPairToYuv420Scalar(const uint8_t* pRow0,
+                                             const uint8_t* pRow1,
+                                             uint32_t       x,
+                                             uint32_t       width,
+                                             uint8_t*       pY0,
+                                             uint8_t*       pY1,
+                                             uint8_t*       pU,
+                                             uint8_t*       pV)
+{
+    for (; x < width; x += 2)
+    {
+        const uint32_t right = (std::min)(x + 1, width - 1);
+        const uint8_t* p[4]  = {pRow0 + x * 4, pRow0 + right * 4, pRow1 + x * 4, pRow1 + right * 4};
+
+        pY0[x] = RgbaToLuma(p[0]);
+        pY1[x] = RgbaToLuma(p[2]);
+        if (right != x)
+        {
+            pY0[right] = RgbaToLuma(p[1]);
+            pY1[right] = RgbaToLuma(p[3]);
+        }
+
+        int32_t r = p[0][0] + p[1][0] + p[2][0] + p[3][0];
+        int32_t g = p[0][1] + p[1][1] + p[2][1] + p[3][1];
+        int32_t b = p[0][2] + p[1][2] + p[2][2] + p[3][2];
+        pU[x / 2] = static_cast<uint8_t>((Y4mCoefUR * r + Y4mCoefUG * g + Y4mCoefUB * b + Y4mOffsetUV) >> 16);
+        pV[x / 2] = static_cast<uint8_t>((Y4mCoefVR * r + Y4mCoefVG * g + Y4mCoefVB * b + Y4mOffsetUV) >> 16);
+    }
+}
+
+#if Y4M_SSE2
+// Splits four RGBA pixels from each of two registers into 16-bit R, G and B lanes.
+inline void DeinterleaveRgba(__m128i a, __m128i b, __m128i& r, __m128i& g, __m128i& b16)
+{
+    const __m128i mask = _mm_set1_epi32(0xFF);
+    r   = _mm_packs_epi32(_mm_and_si128(a, mask), _mm_and_si128(b, mask));
+    g   = _mm_packs_epi32(_mm_and_si128(_mm_srli_epi32(a, 8), mask), _mm_and_si128(_mm_srli_epi32(b, 8), mask));
+    b16 = _mm_packs_epi32(_mm_and_si128(_mm_srli_epi32(a, 16), mask), _mm_and_si128(_mm_srli_epi32(b, 16), mask));
+}
+
+// Eight luma samples from 16-bit R, G and B lanes.
+inline __m128i RgbToLuma8(__m128i r, __m128i g, __m128i b)
+{
+    const __m128i coefRG = _mm_set1_epi32((Y4mCoefYG << 16) | Y4mCoefYR);
+    const __m128i coefB  = _mm_set1_epi32(Y4mCoefYB);
+    const __m128i offset = _mm_set1_epi32(Y4mOffsetY);
+    const __m128i zero   = _mm_setzero_si128();
+
+    __m128i lo = _mm_add_epi32(_mm_madd_epi16(_mm_unpacklo_epi16(r, g), coefRG),
+                               _mm_madd_epi16(_mm_unpacklo_epi16(b, zero), coefB));
+    __m128i hi = _mm_add_epi32(_mm_madd_epi16(_mm_unpackhi_epi16(r, g), coefRG),
+                               _mm_madd_epi16(_mm_unpackhi_epi16(b, zero), coefB));
+    lo         = _mm_srai_epi32(_mm_add_epi32(lo, offset), 14);
+    hi         = _mm_srai_epi32(_mm_add_epi32(hi, offset), 14);
+    __m128i y  = _mm_packs_epi32(lo, hi);
+    return _mm_packus_epi16(y, y);
+}
+
+// Four chroma samples from 16-bit sums of 2x2 blocks, held in the low four lanes.
+inline uint32_t BlockSumsToChroma4(__m128i r, __m128i g, __m128i b, int32_t coefR, int32_t coefG, int32_t coefB)
+{
+    const __m128i coefRG = _mm_set1_epi32(static_cast<int32_t>((static_cast<uint32_t>(coefG) << 16) |
+                                                               (static_cast<uint32_t>(coefR) & 0xFFFF)));
+    const __m128i coefBB = _mm_set1_epi32(coefB & 0xFFFF);
+    const __m128i offset = _mm_set1_epi32(Y4mOffsetUV);
+
+    __m128i sum = _mm_add_epi32(_mm_madd_epi16(_mm_unpacklo_epi16(r, g), coefRG),
+                                _mm_madd_epi16(_mm_unpacklo_epi16(b, _mm_setzero_si128()), coefBB));
+    sum         = _mm_srai_epi32(_mm_add_epi32(sum, offset), 16);
+    sum         = _mm_packs_epi32(sum, sum);
+    return static_cast<uint32_t>(_mm_cvtsi128_si32(_mm_packus_epi16(sum, sum)));
+}
+#endif
+
+// Eight pixels per step with SSE2; the integer arithmetic is the scalar path's, so both give identical bytes.
+inline void ConvertRgbaRowPairToYuv420(const uint8_t* pRow0,
+                                       const uint8_t* pRow1,
+                                       uint32_t       width,
+                                       uint8_t*       pY0,
+                                       uint8_t*       pY1,
+                                       uint8_t*       pU,
+                                       uint8_t*       pV)
+{
+    uint32_t x = 0;
+#if Y4M_SSE2
+    const __m128i ones = _mm_set1_epi16(1);
+    for (; x + 8 <= width; x += 8)
+    {
+        __m128i r0, g0, b0, r1, g1, b1;
+        DeinterleaveRgba(_mm_loadu_si128(reinterpret_cast<const __m128i*>(pRow0 + x * 4)),
+                         _mm_loadu_si128(reinterpret_cast<const __m128i*>(pRow0 + x * 4 + 16)),
+                         r0, g0, b0);
+        DeinterleaveRgba(_mm_loadu_si128(reinterpret_cast<const __m128i*>(pRow1 + x * 4)),
+                         _mm_loadu_si128(reinterpret_cast<const __m128i*>(pRow1 + x * 4 + 16)),
+                         r1, g1, b1);
+
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(pY0 + x), RgbToLuma8(r0, g0, b0));
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(pY1 + x), RgbToLuma8(r1, g1, b1));
+
+        // Vertical pairs are added in 16 bits, horizontal pairs by madd against ones.
+        __m128i r = _mm_madd_epi16(_mm_add_epi16(r0, r1), ones);
+        __m128i g = _mm_madd_epi16(_mm_add_epi16(g0, g1), ones);
+        __m128i b = _mm_madd_epi16(_mm_add_epi16(b0, b1), ones);
+        r         = _mm_packs_epi32(r, r);
+        g         = _mm_packs_epi32(g, g);
+        b         = _mm_packs_epi32(b, b);
+
+        uint32_t u = BlockSumsToChroma4(r, g, b, Y4mCoefUR, Y4mCoefUG, Y4mCoefUB);
+        uint32_t v = BlockSumsToChroma4(r, g, b, Y4mCoefVR, Y4mCoefVG, Y4mCoefVB);
+        memcpy(pU + x / 2, &u, sizeof(u));
+        memcpy(pV + x / 2, &v, sizeof(v));
+    }
+#endif
+    ConvertRgbaRowPairToYuv420Scalar(pRow0, pRow1, x, width, pY0, pY1, pU, pV);
+}
+
+// Converts RGBA8 rows stride bytes apart into the planes of one 4:2:0 frame, spreading bands of row pairs over the
+// pool. pFrame holds GetY4mFrameSize bytes.
+inline void ConvertRgbaToY4mFrame(const uint8_t* pRgba,
+                                  size_t         stride,
+                                  uint32_t       width,
+                                  uint32_t       height,
+                                  uint8_t*       pFrame,
+                                  ThreadPool*    pPool)
+{
+    static constexpr uint32_t BandPairs = 16;
+
+    Y4mHeader header     = {};
+    header.width         = width;
+    header.height        = height;
+    const uint32_t pairs = (height + 1) / 2;
+    const uint32_t bands = (pairs + BandPairs - 1) / BandPairs;
+    const size_t   cw    = GetY4mChromaWidth(header);
+    uint8_t*       pY    = pFrame;
+    uint8_t*       pU    = pY + static_cast<size_t>(width) * height;
+    uint8_t*       pV    = pU + cw * GetY4mChromaHeight(header);
+
+    auto convertBand = [&](uint32_t band) {
+        uint32_t end = (std::min)(pairs, (band + 1) * BandPairs);
+        for (uint32_t pair = band * BandPairs; pair < end; pair++)
+        {
+            uint32_t y0 = pair * 2;
+            uint32_t y1 = (std::min)(y0 + 1, height - 1);
+            ConvertRgbaRowPairToYuv420(pRgba + y0 * stride,
+                                       pRgba + y1 * stride,
+                                       width,
+                                       pY + static_cast<size_t>(y0) * width,
+                                       pY + static_cast<size_t>(y1) * width,
+                                       pU + pair * cw,
+                                       pV + pair * cw);
+        }
+    };
+
+    if (pPool != nullptr)
+    {
+        pPool->ParallelFor(bands, convertBand);
+    }
+    else
+    {
+        for (uint32_t band = 0; band < bands; band++)
+        {
+            convertBand(band);
+        }
+    }
+}